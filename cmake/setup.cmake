@@ -21,3 +21,7 @@ else(MSVC)
 endif(MSVC)
 
 option(BUILD_TESTS "Build Test Cases" OFF)
+option(ENGINE_TELEMETRY "Per-task engine telemetry (queue wait/run histograms, busy time)" ON)
+if(NOT ENGINE_TELEMETRY)
+  add_definitions(-DRTENGINE_NO_TELEMETRY)
+endif()
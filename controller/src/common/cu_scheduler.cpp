@@ -0,0 +1,124 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <utility>
+#include "vitis/ai/env_config.hpp"
+#include "cu_scheduler.hpp"
+
+DEF_ENV_PARAM(XLNX_DPU_SWITCH_AFTER, "16");
+
+std::shared_ptr<CuScheduler> CuScheduler::get(size_t device_index, size_t cu_index) {
+  static std::mutex mtx;
+  static std::map<std::pair<size_t, size_t>, std::weak_ptr<CuScheduler>> scheds;
+  std::lock_guard<std::mutex> lock(mtx);
+  auto &weak = scheds[{device_index, cu_index}];
+  auto sched = weak.lock();
+  if (!sched) {
+    sched = std::make_shared<CuScheduler>(unsigned(ENV_PARAM(XLNX_DPU_SWITCH_AFTER)));
+    weak = sched;
+  }
+  return sched;
+}
+
+CuScheduler::Lease::~Lease() {
+  if (sched_)
+    sched_->release(*this);
+}
+
+void CuScheduler::Lease::preloaded() {
+  if (preload_)
+    sched_->preloaded(*this);
+}
+
+CuScheduler::Lease CuScheduler::acquire(uint64_t state) {
+  std::unique_lock<std::mutex> lock(mtx_);
+  auto w = waiters_.insert(waiters_.end(), Waiter{state});
+  cv_.wait(lock, [&] { return can_run(w); });
+  waiters_.erase(w);
+  in_flight_++;
+  stats_.commands++;
+  const bool preload = !resident_valid_ || resident_ != state;
+  if (preload) {
+    // nothing is resident until the preload completed
+    resident_valid_ = false;
+    preloading_ = true;
+    streak_ = 0;
+    stats_.switches++;
+  } else {
+    streak_++;
+    // same-key waiters held back by the idle-CU pick can follow
+    cv_.notify_all();
+  }
+  return Lease(this, state, preload);
+}
+
+void CuScheduler::invalidate() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  resident_valid_ = false;
+  cv_.notify_all();
+}
+
+CuScheduler::Stats CuScheduler::get_stats() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return stats_;
+}
+
+bool CuScheduler::switch_due() const {
+  if (streak_ < switch_after_)
+    return false;
+  for (auto &w : waiters_)
+    if (w.state != resident_)
+      return true;
+  return false;
+}
+
+CuScheduler::WaiterIt CuScheduler::next() {
+  // the oldest command of the resident model, unless others waited long
+  // enough; then the oldest of any other
+  if (resident_valid_ && !switch_due())
+    for (auto it = waiters_.begin(); it != waiters_.end(); ++it)
+      if (it->state == resident_)
+        return it;
+  for (auto it = waiters_.begin(); it != waiters_.end(); ++it)
+    if (!resident_valid_ || it->state != resident_)
+      return it;
+  return waiters_.begin();
+}
+
+bool CuScheduler::can_run(WaiterIt w) {
+  if (preloading_)
+    return false;
+  if (in_flight_ == 0)
+    return w == next();
+  return resident_valid_ && w->state == resident_ && !switch_due();
+}
+
+void CuScheduler::release(Lease &lease) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  in_flight_--;
+  // a failed preload leaves nothing resident
+  if (lease.preload_)
+    preloading_ = false;
+  cv_.notify_all();
+}
+
+void CuScheduler::preloaded(Lease &lease) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  lease.preload_ = false;
+  preloading_ = false;
+  resident_ = lease.state_;
+  resident_valid_ = true;
+  cv_.notify_all();
+}
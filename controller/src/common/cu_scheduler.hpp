@@ -0,0 +1,97 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+
+/*
+ * Command admission for one CU shared by several models (runners pinned to
+ * the same __device_core_id__). Their code, weights and workspaces all stay
+ * in device memory; what a model changes on the CU is its preload state, so
+ * commands carry a key of it. Commands with the resident key run
+ * concurrently as before; another key waits until the CU drains and then
+ * has its preload re-run once. While the resident model keeps getting
+ * commands, waiting models are let in after switch_after of them.
+ */
+class CuScheduler {
+  public:
+    struct Stats {
+      uint64_t commands = 0;
+      uint64_t switches = 0;  // grants that had to re-run a preload
+    };
+
+    // permission to run one command; held until it completed
+    class Lease {
+      public:
+        Lease(Lease &&other) : sched_(other.sched_), state_(other.state_), preload_(other.preload_) {
+          other.sched_ = nullptr;
+        }
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease();
+        // this command has to run the preload first
+        bool needs_preload() const { return preload_; }
+        // preload done: same-key commands may run alongside again
+        void preloaded();
+
+      private:
+        friend class CuScheduler;
+        Lease(CuScheduler *sched, uint64_t state, bool preload)
+          : sched_(sched), state_(state), preload_(preload) {}
+        CuScheduler *sched_;
+        uint64_t state_;
+        bool preload_;
+    };
+
+    // shared by every controller on (device_index, cu_index);
+    // XLNX_DPU_SWITCH_AFTER (16) sets switch_after
+    static std::shared_ptr<CuScheduler> get(size_t device_index, size_t cu_index);
+
+    explicit CuScheduler(unsigned switch_after) : switch_after_(switch_after) {}
+    // blocks until a command of preload state `state` may be submitted
+    Lease acquire(uint64_t state);
+    // the CU lost its preload state (reset): the next command re-runs the
+    // preload, once the CU drained
+    void invalidate();
+    Stats get_stats() const;
+
+  private:
+    struct Waiter {
+      uint64_t state;
+    };
+    using WaiterIt = std::list<Waiter>::iterator;
+    bool can_run(WaiterIt w);
+    // next grant when the CU is idle
+    WaiterIt next();
+    bool switch_due() const;
+    void release(Lease &lease);
+    void preloaded(Lease &lease);
+
+    const unsigned switch_after_;
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::list<Waiter> waiters_;  // by arrival
+    bool resident_valid_ = false;
+    uint64_t resident_ = 0;
+    bool preloading_ = false;
+    unsigned in_flight_ = 0;
+    unsigned streak_ = 0;        // grants since the last switch
+    Stats stats_;
+};
@@ -0,0 +1,66 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "dpu_addr_table.hpp"
+
+constexpr uint64_t DpuAddrTable::UNSET;
+
+DpuAddrTable::DpuAddrTable(int num_regs, int batch)
+  : num_regs_(num_regs), batch_(batch), addrs_(size_t(num_regs) * batch, UNSET) {
+}
+
+void DpuAddrTable::set(int reg_id, int idx, uint64_t addr) {
+  if (unsigned(reg_id) >= unsigned(num_regs_) || unsigned(idx) >= unsigned(batch_))
+    throw std::runtime_error("Error: reg_id " + std::to_string(reg_id)
+      + " batch " + std::to_string(idx) + " outside the address table");
+  auto &slot = addrs_[reg_id * batch_ + idx];
+  if (slot != UNSET)
+  {
+    // rebinding keeps the programming order of the first binding
+    for (auto &e : entries_)
+      if (e.reg_id == reg_id && e.idx == idx)
+        e.addr = addr;
+  }
+  else
+    entries_.push_back({reg_id, idx, addr});
+  slot = addr;
+}
+
+void DpuAddrTable::unbound(int reg_id, int idx) {
+  // the old lookup's message: unbound io usually means split-io is off
+  throw std::runtime_error("need enable split-io (reg_id " + std::to_string(reg_id)
+    + ", batch " + std::to_string(idx) + " not bound)");
+}
+
+std::shared_ptr<const DpuAddrTable> DpuAddrCache::find(const Key &key) const {
+  auto cached = tables_.find(key);
+  return cached == tables_.end() ? nullptr : cached->second;
+}
+
+void DpuAddrCache::insert(Key key, std::shared_ptr<const DpuAddrTable> table) {
+  tables_.emplace(std::move(key), std::move(table));
+}
+
+void DpuAddrCache::evict(const void *buffer) {
+  for (auto cached = tables_.begin(); cached != tables_.end(); ) {
+    auto &bound = cached->first.second;
+    if (std::find(bound.begin(), bound.end(), buffer) != bound.end())
+      cached = tables_.erase(cached);
+    else
+      cached++;
+  }
+}
@@ -0,0 +1,86 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+ * Device address of every (reg_id, batch element) bound for a job, stored
+ * flat as [reg_id][batch] so the upload/download loops resolve an address
+ * with one index. entries() keeps the bound slots in the order they were set,
+ * which is the order their address registers are programmed.
+ */
+class DpuAddrTable {
+  public:
+    struct Entry {
+      int reg_id;
+      int idx;      // batch element
+      uint64_t addr;
+    };
+
+    DpuAddrTable() : num_regs_(0), batch_(0) {}
+    DpuAddrTable(int num_regs, int batch);
+
+    void set(int reg_id, int idx, uint64_t addr);
+    // throws if (reg_id, idx) is not bound
+    uint64_t get(int reg_id, int idx) const {
+      const auto addr = (unsigned(reg_id) < unsigned(num_regs_) && unsigned(idx) < unsigned(batch_))
+        ? addrs_[reg_id * batch_ + idx] : UNSET;
+      if (addr == UNSET)
+        unbound(reg_id, idx);
+      return addr;
+    }
+    bool is_set(int reg_id, int idx) const {
+      return unsigned(reg_id) < unsigned(num_regs_) && unsigned(idx) < unsigned(batch_)
+        && addrs_[reg_id * batch_ + idx] != UNSET;
+    }
+    const std::vector<Entry> &entries() const { return entries_; }
+    int num_regs() const { return num_regs_; }
+    int batch() const { return batch_; }
+
+  private:
+    static constexpr uint64_t UNSET = ~uint64_t(0); // 0 is a valid HBM address
+    [[noreturn]] static void unbound(int reg_id, int idx);
+
+    int num_regs_;
+    int batch_;
+    std::vector<uint64_t> addrs_;
+    std::vector<Entry> entries_;
+};
+
+/*
+ * Address tables of earlier bindings to the runner's own buffers, keyed by
+ * the buffers bound. A table goes once any of its buffers is freed: the next
+ * allocation may get the same address. Callers lock.
+ */
+class DpuAddrCache {
+  public:
+    // (create_tb_batch, bound buffers in binding order)
+    using Key = std::pair<bool, std::vector<const void*>>;
+
+    // nullptr if not cached
+    std::shared_ptr<const DpuAddrTable> find(const Key &key) const;
+    void insert(Key key, std::shared_ptr<const DpuAddrTable> table);
+    // drops every table buffer was bound in
+    void evict(const void *buffer);
+    size_t size() const { return tables_.size(); }
+
+  private:
+    std::map<Key, std::shared_ptr<const DpuAddrTable>> tables_;
+};
@@ -0,0 +1,250 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "dpu_profile.hpp"
+#include "vitis/ai/env_config.hpp"
+
+DEF_ENV_PARAM(XLNX_DPU_PROFILE, "0")
+DEF_ENV_PARAM(XLNX_DPU_PROFILE_INTERVAL_MS, "10000")
+
+namespace {
+  // CU control registers, relative to the CU base address
+  const uint64_t DPUREG_MISC_END = 0x84;
+  const uint64_t DPUREG_CONV_END = 0x88;
+  const uint64_t DPUREG_SAVE_END = 0x8c;
+  const uint64_t DPUREG_LOAD_END = 0x90;
+  const uint64_t DPUREG_CYCLE_COUNTER = 0xa8;
+
+  uint32_t readReg(xclDeviceHandle handle, uint64_t offset) {
+    uint32_t val = 0;
+    xclRead(handle, XCL_ADDR_KERNEL_CTRL, offset, &val, sizeof(val));
+    return val;
+  }
+
+  std::string getProfileFile() {
+    const char *value = getenv("XLNX_DPU_PROFILE_FILE");
+    return value ? value : "";
+  }
+
+  std::string escape(const std::string &s) {
+    std::string out;
+    for (char c : s)
+    {
+      if (c == '"' || c == '\\')
+        out += '\\';
+      if (static_cast<unsigned char>(c) >= 0x20)
+        out += c;
+    }
+    return out;
+  }
+
+  // mean/p50/p99/max of a histogram, scale converts its unit to us
+  void writeTimes(std::ostringstream &os, const std::string &name,
+    const LatencyHistogram::Snapshot &h, double scale) {
+    os << "\"" << name << "\": {\"count\": " << h.count
+       << ", \"mean_us\": " << h.mean_ns() * scale
+       << ", \"p50_us\": " << h.percentile_ns(50) * scale
+       << ", \"p99_us\": " << h.percentile_ns(99) * scale
+       << ", \"max_us\": " << h.max_ns * scale << "}";
+  }
+}
+
+/*
+ * Model Profile
+ */
+
+void DpuRunSample::add_counters(xclDeviceHandle handle, uint64_t cu_base_addr) {
+  cycles += readReg(handle, cu_base_addr + DPUREG_CYCLE_COUNTER);
+  load += readReg(handle, cu_base_addr + DPUREG_LOAD_END);
+  save += readReg(handle, cu_base_addr + DPUREG_SAVE_END);
+  conv += readReg(handle, cu_base_addr + DPUREG_CONV_END);
+  misc += readReg(handle, cu_base_addr + DPUREG_MISC_END);
+}
+
+void DpuModelProfile::record(const DpuRunSample &sample) {
+  if (sample.h2d_ns)
+    h2d_.record(sample.h2d_ns);
+  exec_.record(sample.exec_ns);
+  if (sample.d2h_ns)
+    d2h_.record(sample.d2h_ns);
+  cycles_.record(sample.cycles);
+  load_.fetch_add(sample.load, std::memory_order_relaxed);
+  save_.fetch_add(sample.save, std::memory_order_relaxed);
+  conv_.fetch_add(sample.conv, std::memory_order_relaxed);
+  misc_.fetch_add(sample.misc, std::memory_order_relaxed);
+  d2h_deferred_.fetch_add(sample.d2h_deferred_bytes, std::memory_order_relaxed);
+  batch_.fetch_add(sample.batch, std::memory_order_relaxed);
+  programmed_batch_.fetch_add(sample.programmed_batch, std::memory_order_relaxed);
+}
+
+void DpuModelProfile::record_fetched(uint64_t bytes) {
+  d2h_fetched_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+DpuModelProfile::Snapshot DpuModelProfile::snapshot() const {
+  Snapshot s;
+  s.clock_mhz = clock_mhz_;
+  s.h2d = h2d_.snapshot();
+  s.exec = exec_.snapshot();
+  s.d2h = d2h_.snapshot();
+  s.cycles = cycles_.snapshot();
+  s.load = load_.load(std::memory_order_relaxed);
+  s.save = save_.load(std::memory_order_relaxed);
+  s.conv = conv_.load(std::memory_order_relaxed);
+  s.misc = misc_.load(std::memory_order_relaxed);
+  s.d2h_deferred_bytes = d2h_deferred_.load(std::memory_order_relaxed);
+  s.d2h_fetched_bytes = d2h_fetched_.load(std::memory_order_relaxed);
+  s.batch = batch_.load(std::memory_order_relaxed);
+  s.programmed_batch = programmed_batch_.load(std::memory_order_relaxed);
+  return s;
+}
+
+double DpuModelProfile::Snapshot::effective_batch() const {
+  return exec.count ? double(batch) / exec.count : 0.0;
+}
+
+double DpuModelProfile::Snapshot::batch_fill() const {
+  return programmed_batch ? double(batch) / programmed_batch : 0.0;
+}
+
+uint64_t DpuModelProfile::Snapshot::d2h_avoided_bytes() const {
+  // a range read twice counts twice, never go below zero
+  return d2h_fetched_bytes < d2h_deferred_bytes ? d2h_deferred_bytes - d2h_fetched_bytes : 0;
+}
+
+double DpuModelProfile::Snapshot::dpu_mean_us() const {
+  return clock_mhz > 0 ? cycles.mean_ns() / clock_mhz : 0.0;
+}
+
+double DpuModelProfile::Snapshot::dpu_busy_fraction() const {
+  const double execUs = exec.mean_ns() * 1e-3;
+  return execUs > 0 ? dpu_mean_us() / execUs : 0.0;
+}
+
+double DpuModelProfile::Snapshot::transfer_fraction() const {
+  // h2d/d2h may have fewer samples than exec, compare totals
+  const double transfer = double(h2d.sum_ns) + double(d2h.sum_ns);
+  const double total = transfer + double(exec.sum_ns);
+  return total > 0 ? transfer / total : 0.0;
+}
+
+double DpuModelProfile::Snapshot::memory_instr_fraction() const {
+  const double total = double(load) + save + conv + misc;
+  return total > 0 ? (double(load) + save) / total : 0.0;
+}
+
+/*
+ * Profile Registry
+ */
+
+bool DpuProfile::enabled() {
+  return ENV_PARAM(XLNX_DPU_PROFILE) != 0;
+}
+
+DpuProfile &DpuProfile::get_instance() {
+  static DpuProfile profile;
+  return profile;
+}
+
+DpuProfile::DpuProfile() : dump_stop_(false) {
+  if (enabled() && !getProfileFile().empty())
+    dump_thread_ = std::thread([this]{ dump(); });
+}
+
+DpuProfile::~DpuProfile() {
+  if (dump_thread_.joinable())
+  {
+    {
+      std::unique_lock<std::mutex> lock(dump_mtx_);
+      dump_stop_ = true;
+    }
+    dump_cvar_.notify_all();
+    dump_thread_.join();
+  }
+}
+
+DpuModelProfile *DpuProfile::get_model(const std::string &model, double clock_mhz) {
+  std::unique_lock<std::mutex> lock(mtx_);
+  auto &entry = models_[model];
+  if (!entry)
+    entry.reset(new DpuModelProfile(clock_mhz));
+  return entry.get();
+}
+
+std::map<std::string, DpuModelProfile::Snapshot> DpuProfile::get_stats() const {
+  std::unique_lock<std::mutex> lock(mtx_);
+  std::map<std::string, DpuModelProfile::Snapshot> stats;
+  for (auto &m : models_)
+    stats[m.first] = m.second->snapshot();
+  return stats;
+}
+
+std::string DpuProfile::to_json() const {
+  std::ostringstream os;
+  os << "{\"models\": [";
+  bool first = true;
+  for (auto &m : get_stats())
+  {
+    auto &s = m.second;
+    os << (first ? "" : ",") << "\n  {\"name\": \"" << escape(m.first) << "\""
+       << ", \"clock_mhz\": " << s.clock_mhz << ",\n   ";
+    first = false;
+    writeTimes(os, "h2d", s.h2d, 1e-3);
+    os << ",\n   ";
+    writeTimes(os, "exec", s.exec, 1e-3);
+    os << ",\n   ";
+    writeTimes(os, "d2h", s.d2h, 1e-3);
+    os << ",\n   ";
+    writeTimes(os, "dpu", s.cycles, s.clock_mhz > 0 ? 1.0 / s.clock_mhz : 0.0);
+    os << ",\n   \"dpu_cycles_mean\": " << s.cycles.mean_ns()
+       << ", \"instructions\": {\"load\": " << s.load << ", \"save\": " << s.save
+       << ", \"conv\": " << s.conv << ", \"misc\": " << s.misc << "}"
+       << ",\n   \"lazy_d2h\": {\"deferred_bytes\": " << s.d2h_deferred_bytes
+       << ", \"fetched_bytes\": " << s.d2h_fetched_bytes
+       << ", \"avoided_bytes\": " << s.d2h_avoided_bytes() << "}"
+       << ",\n   \"batch\": {\"effective\": " << s.effective_batch()
+       << ", \"programmed\": " << (s.exec.count ? double(s.programmed_batch) / s.exec.count : 0.0)
+       << ", \"fill\": " << s.batch_fill() << "}"
+       << ",\n   \"dpu_busy_fraction\": " << s.dpu_busy_fraction()
+       << ", \"transfer_fraction\": " << s.transfer_fraction()
+       << ", \"memory_instr_fraction\": " << s.memory_instr_fraction() << "}";
+  }
+  os << "\n]}\n";
+  return os.str();
+}
+
+void DpuProfile::dump() {
+  // write to a temp file and rename so readers never see a partial report
+  const std::string path = getProfileFile();
+  const std::string tmpPath = path + ".tmp";
+  const auto interval = std::chrono::milliseconds(ENV_PARAM(XLNX_DPU_PROFILE_INTERVAL_MS));
+
+  std::unique_lock<std::mutex> lock(dump_mtx_);
+  while (true)
+  {
+    const bool stop = dump_cvar_.wait_for(lock, interval, [this]{ return dump_stop_; });
+    {
+      std::ofstream ofs(tmpPath, std::ios::trunc);
+      ofs << to_json();
+    }
+    std::rename(tmpPath.c_str(), path.c_str());
+    if (stop)
+      break;
+  }
+}
@@ -0,0 +1,126 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <xrt.h>
+#include "engine_stats.hpp"
+
+/*
+ * Opt-in per-model profile of DPU runs, XLNX_DPU_PROFILE=1.
+ * After every command the controller reads the CU's cycle counter and its
+ * load/save/conv/misc instruction counters; host H2D, exec and D2H wall times
+ * are taken around the same run. Cycles become time with the CU clock from
+ * the xclbin (XLNX_DPU_CLOCK_MHZ overrides it).
+ * XLNX_DPU_PROFILE_FILE=path writes to_json() every
+ * XLNX_DPU_PROFILE_INTERVAL_MS (10000).
+ */
+
+// one inference; counters summed over the commands it issued
+struct DpuRunSample {
+  uint64_t h2d_ns = 0;   // 0 if inputs were already on the device
+  uint64_t exec_ns = 0;  // submit to completion, all commands
+  uint64_t d2h_ns = 0;   // 0 if outputs stay on the device
+  uint64_t d2h_deferred_bytes = 0;  // outputs left for a lazy download
+  uint32_t batch = 0;             // batch elements moved (effective batch)
+  uint32_t programmed_batch = 0;  // engines programmed and run
+  uint64_t cycles = 0;   // DPUREG_CYCLE_COUNTER
+  uint64_t load = 0;     // instructions finished per engine
+  uint64_t save = 0;
+  uint64_t conv = 0;
+  uint64_t misc = 0;
+
+  // add the counters the CU at cu_base_addr kept for its last command
+  void add_counters(xclDeviceHandle handle, uint64_t cu_base_addr);
+};
+
+// lock-free, shared by all controllers running the same model
+class DpuModelProfile {
+  public:
+    explicit DpuModelProfile(double clock_mhz) : clock_mhz_(clock_mhz),
+      load_(0), save_(0), conv_(0), misc_(0), d2h_deferred_(0), d2h_fetched_(0),
+      batch_(0), programmed_batch_(0) {}
+    void record(const DpuRunSample &sample);
+    // bytes of lazily downloaded outputs pulled when the app read them
+    void record_fetched(uint64_t bytes);
+
+    struct Snapshot {
+      double clock_mhz = 0;  // 0 if unknown, dpu times are then 0 too
+      LatencyHistogram::Snapshot h2d, exec, d2h;
+      LatencyHistogram::Snapshot cycles;  // per inference, in cycles not ns
+      uint64_t load = 0;
+      uint64_t save = 0;
+      uint64_t conv = 0;
+      uint64_t misc = 0;
+      uint64_t d2h_deferred_bytes = 0;
+      uint64_t d2h_fetched_bytes = 0;
+      uint64_t batch = 0;             // summed over exec.count runs
+      uint64_t programmed_batch = 0;
+
+      // lazy output bytes never read back
+      uint64_t d2h_avoided_bytes() const;
+      // mean batch elements per run, and their share of the engines run;
+      // low fill on a big-batch xclbin means engines idle on partial batches
+      double effective_batch() const;
+      double batch_fill() const;
+      double dpu_mean_us() const;
+      // share of the exec wall time the DPU was running; low values mean
+      // submission/completion overhead dominates
+      double dpu_busy_fraction() const;
+      // share of the host-visible run spent moving data over PCIe
+      double transfer_fraction() const;
+      // load+save over all instructions, the on-card memory-bound hint
+      double memory_instr_fraction() const;
+    };
+    Snapshot snapshot() const;
+
+  private:
+    const double clock_mhz_;
+    LatencyHistogram h2d_, exec_, d2h_, cycles_;
+    std::atomic<uint64_t> load_, save_, conv_, misc_;
+    std::atomic<uint64_t> d2h_deferred_, d2h_fetched_;
+    std::atomic<uint64_t> batch_, programmed_batch_;
+};
+
+class DpuProfile {
+  public:
+    static bool enabled();
+    static DpuProfile &get_instance();
+    ~DpuProfile();
+
+    // stable for the life of the process; the first caller sets the clock
+    DpuModelProfile *get_model(const std::string &model, double clock_mhz);
+    std::map<std::string, DpuModelProfile::Snapshot> get_stats() const;
+    std::string to_json() const;
+
+  private:
+    DpuProfile();
+    void dump(); // periodic report, see XLNX_DPU_PROFILE_FILE
+
+    mutable std::mutex mtx_;
+    std::map<std::string, std::unique_ptr<DpuModelProfile>> models_;
+
+    std::mutex dump_mtx_;
+    std::condition_variable dump_cvar_;
+    bool dump_stop_;
+    std::thread dump_thread_;
+};
@@ -25,6 +25,9 @@
 #include <regex>
 #include <sstream>
 #include <iomanip>
+#include <functional>
+#include <future>
+#include <map>
 #include <math.h>
 #include "engine.hpp"
 #include "dpucloud_controller.hpp"
@@ -38,6 +41,8 @@
 #include "vitis/ai/env_config.hpp"
 #include "vitis/ai/profiling.hpp"
 #include "device_handle.hpp"
+#include "xrt_bin_stream.hpp"
+#include "layout_transpose.hpp"
 #ifndef _WIN32
 #include "trace.hpp"
 #endif
@@ -72,8 +77,15 @@ using namespace chrono;
 //#define batch_size_ 8
 DEF_ENV_PARAM(DEBUG_DPU_CONTROLLER, "0")
 DEF_ENV_PARAM(XLNX_SHOW_DPU_COUNTER, "0");
+DEF_ENV_PARAM(XLNX_DPU_SHARE_WEIGHTS, "1");
 DEF_ENV_PARAM(XLNX_BUFFER_POOL, "0");
 DEF_ENV_PARAM(XLNX_ENABLE_FINGERPRINT_CHECK, "1");
+// per command; lower it for low-latency models so a hung CU is noticed quickly
+DEF_ENV_PARAM(XLNX_DPU_TIMEOUT_MS, "15000");
+// reset a timed out CU and retry the job once instead of failing it
+DEF_ENV_PARAM(XLNX_DPU_HANG_RETRY, "1");
+// CU clock for the XLNX_DPU_PROFILE cycle counters, 0 = from the xclbin
+DEF_ENV_PARAM(XLNX_DPU_CLOCK_MHZ, "0");
 /*
  * a contiguous memory block is allocated for each requests' I/O
  * layout:
@@ -97,6 +109,7 @@ struct bo_share{
   int reg_id;
   vector<int> cnt;
   xclDeviceHandle handle;
+  std::shared_ptr<void> handle_ref;  // keeps handle open for the last sharer
   std::vector<xclBufferHandle> bo_handles;
 };
 struct bounding {
@@ -108,22 +121,32 @@ struct bounding {
 static std::mutex bo_mtx_;
 static std::vector<std::pair<bounding, bo_share>> xdpu_workspace_bo;
 
+/*
+ * Device-scoped cache of read-only weight and instruction BOs.
+ * Controllers on one card that load the same blob (by md5) into the same bank
+ * list share a single BO and physical address. The BOs are allocated on a
+ * handle owned by the cache so they outlive the controller that uploaded
+ * them; the handle is closed when the last entry on the device is released.
+ */
+struct weight_bo {
+  int cnt = 0;
+  xclBufferHandle bo_handle = NULLBO;
+  std::shared_future<uint64_t> paddr;  // ready once the upload is done
+  std::shared_ptr<DpuXmodel> owner;    // keeps the user-ptr host pages alive
+};
+struct weight_device {
+  xclDeviceHandle handle = nullptr;
+  std::map<DpuCloudController::SharedBoKey, weight_bo> bos;
+};
+static std::mutex weight_mtx_;
+static std::unordered_map<size_t, weight_device> xdpu_weight_bo;
+
 static uint32_t read32_dpu_reg(xclDeviceHandle dpu_handle, uint64_t offset) {
-  uint32_t val;
-  //xclRead(dpu_handle, XCL_ADDR_KERNEL_CTRL, offset, (void *)(&val), 4);
-  val = 0;
+  uint32_t val = 0;
+  xclRead(dpu_handle, XCL_ADDR_KERNEL_CTRL, offset, (void *)(&val), 4);
   return val;
 }
-static bool check_exist(int regid, std::vector<int> regids) {
-  bool rtn = false;
-  for (unsigned i=0; i< regids.size(); i++) {
-     if (regids[i] == regid)
-       rtn = true;
-  }
-  return rtn;
-
-}
-static int check_io_split(std::vector<int> regids1, std::vector<int> regids2) {
+static int check_io_split(const std::vector<int> &regids1, const std::vector<int> &regids2) {
   int rtn = 1;
   for (unsigned i=0; i< regids1.size(); i++) {
     for (unsigned j=0; j< regids2.size(); j++) {
@@ -136,24 +159,26 @@ static int check_io_split(std::vector<int> regids1, std::vector<int> regids2) {
 }
 
 DpuCloudController::DpuCloudController(std::string meta, xir::Attrs* attrs) 
-  : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(meta, attrs),dump_mode_(false),debug_mode_(false) {
-  // assign many contexts -- one for each worker thread
-  // threads cannot share contexts (or xclExecWait may miss the 'done' signal)
-  Engine& engine = Engine::get_instance();
-  for (unsigned i=0; i < engine.get_num_workers(); i++) {
-    contexts_.emplace_back(new XrtContext(*handle_));
+  : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(meta, attrs),
+    // one context for each worker thread, opened when the worker first runs us
+    // threads cannot share contexts (or xclExecWait may miss the 'done' signal)
+    contexts_(*handle_, engine_.get_num_workers()),
+    dump_mode_(false),debug_mode_(false) {
+  {
+    StartupProfile::Scope model(startup_, "model");
+    model_ =std::make_shared<DpuXmodel>(meta);
   }
-
-  model_ =std::make_shared<DpuXmodel>(meta);
   split_io = check_io_split(model_->get_input_regid(), model_->get_output_regid()); 
 }
 
 DpuCloudController::DpuCloudController(const xir::Subgraph *subgraph, xir::Attrs* attrs) 
-  : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(subgraph, attrs),dump_mode_(false),debug_mode_(false) {
-  Engine& engine = Engine::get_instance();
-  for (unsigned i=0; i < engine.get_num_workers(); i++)
-    contexts_.emplace_back(new XrtContext(*handle_));
-  model_ =std::make_shared<DpuXmodel>(subgraph);
+  : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(subgraph, attrs),
+    contexts_(*handle_, engine_.get_num_workers()),
+    dump_mode_(false),debug_mode_(false) {
+  {
+    StartupProfile::Scope model(startup_, "model");
+    model_ =std::make_shared<DpuXmodel>(subgraph);
+  }
   split_io = check_io_split(model_->get_input_regid(), model_->get_output_regid()); 
 }
 
@@ -175,7 +200,24 @@ void DpuCloudController::init_profiler() {
 #endif
 }
 
+void DpuCloudController::init_dpu_profile() {
+  if (!DpuProfile::enabled())
+    return;
+  double clock_mhz = ENV_PARAM(XLNX_DPU_CLOCK_MHZ);
+  if (clock_mhz <= 0)
+    clock_mhz = xir::XrtBinStream(handle_->get_device_info().xclbin_path).get_data_clock_mhz();
+  if (clock_mhz <= 0)
+    LOG(WARNING) << "No CU clock in the xclbin, set XLNX_DPU_CLOCK_MHZ to convert DPU cycles to time";
+  dpu_profile_ = DpuProfile::get_instance().get_model(model_->get_subgraph_info().name, clock_mhz);
+}
+
 DpuCloudController::~DpuCloudController() {
+  release_shared_bos();
+  for (auto &r : user_mem_.regions())
+    xclFreeBO(user_mem_handle_, r.second.bo);
+  if (user_mem_handle_ != nullptr)
+    xclClose(user_mem_handle_);
+
   /*auto iter = xdpu_workspace_dpu.begin();
   if (iter != xdpu_workspace_dpu.end()) {
    for (unsigned i=0;i<iter->second.size(); i++) {
@@ -224,6 +266,17 @@ std::vector<unsigned> DpuCloudController::get_hbmio() {
   hbm.emplace_back(handle_->get_device_info().ddr_bank);
   return hbm;
 }
+std::vector<unsigned> DpuCloudController::get_hbmws() {
+  return get_hbmio();
+}
+
+HbmPlan DpuCloudController::plan_hbm(unsigned num_weight_banks) {
+  xir::XrtBinStream binstream(handle_->get_device_info().xclbin_path);
+  auto plan = plan_hbm_banks(HbmTopology::from_xclbin(binstream),
+    handle_->get_device_info().cu_index, num_weight_banks);
+  LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER)) << plan.to_string();
+  return plan;
+}
 
 std::vector<vart::TensorBuffer*> DpuCloudController::init_tensor_buffer(std::vector<const xir::Tensor*> tensors, int batchSupport, unsigned runEngine) {
  std::vector<vart::TensorBuffer*>  tbufs;
@@ -276,7 +329,7 @@ std::vector<const xir::Tensor*> DpuCloudController::init_tensor(std::vector<cons
 
 }
 xclBufferHandle  DpuCloudController::get_xrt_bo(void* data, int size, vector<unsigned> hbm) {
-  auto handle = contexts_[0]->get_dev_handle();
+  auto handle = mem_handle_.get();
   xclBufferHandle reg0Mem;
   if (hbm.size() == 0)
     throw std::runtime_error("Error: hbm not initialized");
@@ -297,15 +350,158 @@ xclBufferHandle  DpuCloudController::get_xrt_bo(void* data, int size, vector<uns
 }
 
 xclBufferHandle  DpuCloudController::get_xrt_bo(void* data, int size, unsigned hbm) {
-  auto handle = contexts_[0]->get_dev_handle();
+  auto handle = mem_handle_.get();
   xclBufferHandle reg0Mem;
   reg0Mem = xclAllocUserPtrBO(handle, data, size, hbm);
   return reg0Mem;
 
 }
+uint64_t DpuCloudController::get_shared_bo(const std::string &md5, void* data, int size, vector<unsigned> hbm) {
+  const size_t device_id = handle_->get_device_info().device_index;
+  SharedBoKey key(device_id, md5, hbm);
+  std::promise<uint64_t> uploaded;
+  std::shared_future<uint64_t> paddr;
+  std::map<SharedBoKey, weight_bo>::iterator entry;
+  xclDeviceHandle handle;
+  bool owner = false;
+  {
+    std::unique_lock<std::mutex> lock(weight_mtx_);
+    auto &dev = xdpu_weight_bo[device_id];
+    if (dev.handle == nullptr) {
+      dev.handle = xclOpen(device_id, NULL, XCL_INFO);
+      if (dev.handle == nullptr) {
+        xdpu_weight_bo.erase(device_id);
+        throw std::runtime_error("Error: xclOpen failed for weight cache");
+      }
+    }
+    handle = dev.handle;
+    entry = dev.bos.find(key);
+    if (entry == dev.bos.end()) {
+      entry = dev.bos.emplace(key, weight_bo()).first;
+      entry->second.paddr = uploaded.get_future().share();
+      entry->second.owner = model_;
+      owner = true;
+    }
+    entry->second.cnt++;
+    paddr = entry->second.paddr;
+    shared_bos_.emplace_back(key);
+  }
+
+  if (!owner) {
+    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+      << "share weight bo " << md5 << " size: " << size
+      << ", device_id: " << device_id;
+    try {
+      return paddr.get();
+    } catch (...) {
+      // the uploader dropped the entry, there is nothing to release
+      std::unique_lock<std::mutex> lock(weight_mtx_);
+      forget_shared_bo(key);
+      throw;
+    }
+  }
+
+  try {
+    xclBufferHandle bo = NULLBO;
+    for (auto bank : hbm) {
+      bo = xclAllocUserPtrBO(handle, data, size, bank);
+      if (bo != NULLBO)
+        break;
+    }
+    if (bo == NULLBO)
+      throw std::bad_alloc();
+    {
+      std::unique_lock<std::mutex> lock(weight_mtx_);
+      entry->second.bo_handle = bo;
+    }
+    xclSyncBO(handle, bo, XCL_BO_SYNC_BO_TO_DEVICE, size, 0);
+    xclBOProperties boProp;
+    xclGetBOProperties(handle, bo, &boProp);
+    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+      << "upload weight bo " << md5 << " size: " << size
+      << ", device_id: " << device_id << " phy_addr: " << boProp.paddr;
+    uploaded.set_value(boProp.paddr);
+  } catch (...) {
+    {
+      // drop the entry so the next load retries, sharers waiting on it
+      // get the error
+      std::unique_lock<std::mutex> lock(weight_mtx_);
+      auto dev = xdpu_weight_bo.find(device_id);
+      if (entry->second.bo_handle != NULLBO)
+        xclFreeBO(handle, entry->second.bo_handle);
+      dev->second.bos.erase(entry);
+      forget_shared_bo(key);
+      if (dev->second.bos.empty()) {
+        xclClose(dev->second.handle);
+        xdpu_weight_bo.erase(dev);
+      }
+    }
+    uploaded.set_exception(std::current_exception());
+    throw;
+  }
+  return paddr.get();
+}
+
+void DpuCloudController::forget_shared_bo(const SharedBoKey &key) {
+  auto it = std::find(shared_bos_.begin(), shared_bos_.end(), key);
+  if (it != shared_bos_.end())
+    shared_bos_.erase(it);
+}
+
+std::shared_ptr<void> DpuCloudController::open_mem_handle(size_t device_index) {
+  auto handle = xclOpen(device_index, NULL, XCL_INFO);
+  if (handle == nullptr)
+    throw std::runtime_error("Error: xclOpen failed");
+  return std::shared_ptr<void>(handle, [](void *h) { xclClose(h); });
+}
+
+void DpuCloudController::run_bank_uploads(std::map<unsigned, std::vector<std::function<void()>>> &bank_uploads) {
+  if (bank_uploads.size() <= 1) {
+    for (auto &b : bank_uploads)
+      for (auto &job : b.second)
+        job();
+    return;
+  }
+  std::vector<std::future<void>> pending;
+  for (auto &b : bank_uploads)
+    pending.emplace_back(std::async(std::launch::async, [&b] {
+      for (auto &job : b.second)
+        job();
+    }));
+  // all banks must finish before an error is rethrown, jobs hold pointers into our locals
+  for (auto &f : pending)
+    f.wait();
+  for (auto &f : pending)
+    f.get();
+}
+
+void DpuCloudController::release_shared_bos() {
+  std::unique_lock<std::mutex> lock(weight_mtx_);
+  for (auto &key : shared_bos_) {
+    auto dev = xdpu_weight_bo.find(std::get<0>(key));
+    if (dev == xdpu_weight_bo.end())
+      continue;
+    auto entry = dev->second.bos.find(key);
+    if (entry == dev->second.bos.end() || --entry->second.cnt > 0)
+      continue;
+    if (entry->second.bo_handle != NULLBO)
+      xclFreeBO(dev->second.handle, entry->second.bo_handle);
+    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+      << "free weight bo " << std::get<1>(key)
+      << ", device_id: " << std::get<0>(key);
+    dev->second.bos.erase(entry);
+    if (dev->second.bos.empty()) {
+      xclClose(dev->second.handle);
+      xdpu_weight_bo.erase(dev);
+    }
+  }
+  shared_bos_.clear();
+}
+
 void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc, xir::Attrs* attrs ) {
 
-  auto handle = contexts_[0]->get_dev_handle();
+  mem_handle_ = open_mem_handle(handle_->get_device_info().device_index);
+  auto handle = mem_handle_.get();
 //  auto cu_base_addr = handle_->get_device_info().cu_base_addr;
 //  uint64_t fingerprint = model_->get_fingerprint();
 
@@ -336,6 +532,7 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
   }
 
   init_profiler();
+  init_dpu_profile();
 
   xclBOProperties boProp;
   dump_mode_ = model_->get_dump_mode();
@@ -358,20 +555,45 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
   }
 
   //for (auto p : model_->get_parameter()) {
-  auto weights = model_->get_parameter();
-  auto segment = model_->get_xdpu_regid_to_hw_segment();
+  const auto upload_start = std::chrono::steady_clock::now();
+  const auto &weights = model_->get_parameter();
+  const auto &weights_md5 = model_->get_parameter_md5();
+  const auto &segment = model_->get_xdpu_regid_to_hw_segment();
+  const bool share_weights = ENV_PARAM(XLNX_DPU_SHARE_WEIGHTS)
+    && weights_md5.size() == weights.size();
+  // shared uploads are queued by primary bank; banks upload concurrently,
+  // blobs on the same bank one after another
+  std::map<unsigned, std::vector<std::function<void()>>> bank_uploads;
+  std::vector<uint64_t> shared_addrs(weights.size(), 0);
   for (unsigned param_idx=0; param_idx < weights.size(); param_idx++) {
     auto p = weights[param_idx];
     if (std::get<1>(p)) {
       xclBufferHandle reg0Mem  = NULLBO;
+      int seg_id = -1;
       if ((handle_->get_device_info().full_name).find("DPUCAHX8H") != std::string::npos) { //V3E
         if (segment.find(std::get<2>(p)) != segment.end()) {
           auto seg = segment.find(std::get<2>(p));
           auto seg_str = seg->second;
-          int seg_id = seg_str[seg_str.length()-1]- '0';  //W0, W1
-          reg0Mem = get_xrt_bo(get<0>(p), get<1>(p), hbmw[seg_id]);
+          seg_id = seg_str[seg_str.length()-1]- '0';  //W0, W1
         }
       }
+      if (share_weights) {
+        // segment bank first, then the rest of hbmw as fallback
+        vector<unsigned> banks;
+        if (seg_id >= 0)
+          banks.emplace_back(hbmw[seg_id]);
+        for (auto b : hbmw)
+          if (std::find(banks.begin(), banks.end(), b) == banks.end())
+            banks.emplace_back(b);
+        auto md5 = weights_md5[param_idx];
+        auto *addr = &shared_addrs[param_idx];
+        bank_uploads[banks[0]].emplace_back([this, md5, p, banks, addr] {
+          *addr = get_shared_bo(md5, get<0>(p), get<1>(p), banks);
+        });
+        continue;
+      }
+      if (seg_id >= 0)
+        reg0Mem = get_xrt_bo(get<0>(p), get<1>(p), hbmw[seg_id]);
       if (reg0Mem == NULLBO)
         reg0Mem = get_xrt_bo(get<0>(p), get<1>(p), hbmw);
       xclSyncBO(handle, reg0Mem, XCL_BO_SYNC_BO_TO_DEVICE, std::get<1>(p), 0);
@@ -389,17 +611,29 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
   // Load mc_code
   if(!debug_mode_) { 
     for (auto c : model_->get_code()) {
-      auto codeMem = get_xrt_bo(c.first, c.second.first, hbmc);
-      xclSyncBO(handle, codeMem, XCL_BO_SYNC_BO_TO_DEVICE, c.second.first, 0);
-      xclGetBOProperties(handle, codeMem, &boProp);
+      uint64_t paddr;
+      auto code_md5 = model_->get_code_md5(c.second.second);
+      if (ENV_PARAM(XLNX_DPU_SHARE_WEIGHTS) && !code_md5.empty()
+        && (c.second.second == 0 || c.second.second == 1)) {
+        auto *addr = c.second.second == 0 ? &code_addr_ : &preload_code_addr_;
+        bank_uploads[hbmc[0]].emplace_back([this, code_md5, c, hbmc, addr] {
+          *addr = get_shared_bo(code_md5, c.first, c.second.first, hbmc);
+        });
+        continue;
+      } else {
+        auto codeMem = get_xrt_bo(c.first, c.second.first, hbmc);
+        xclSyncBO(handle, codeMem, XCL_BO_SYNC_BO_TO_DEVICE, c.second.first, 0);
+        xclGetBOProperties(handle, codeMem, &boProp);
+        paddr = boProp.paddr;
+      }
       if (c.second.second == 0) {
-        code_addr_ = boProp.paddr;
+        code_addr_ = paddr;
       } else  if(c.second.second == 1) {
-        preload_code_addr_ = boProp.paddr;
+        preload_code_addr_ = paddr;
       }
     }
   } else {
-    auto dbg_layers = model_->get_dbg_layers();
+    const auto &dbg_layers = model_->get_dbg_layers();
     for(auto iter = dbg_layers.begin() + 1;iter != dbg_layers.end();iter++) { 
       if (get<1>(iter->code_addr) > 0) {
         auto codeBO = get_xrt_bo(get<0>(iter->code_addr), get<1>(iter->code_addr), hbmc);
@@ -414,6 +648,19 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
       }
     }
   }
+  try {
+    run_bank_uploads(bank_uploads);
+  } catch (...) {
+    // we are still in the derived constructor: give back the blobs other
+    // banks shared before the error leaves them counted
+    release_shared_bos();
+    throw;
+  }
+  for (unsigned param_idx=0; param_idx < weights.size(); param_idx++)
+    if (share_weights && std::get<1>(weights[param_idx]))
+      xdpu_total_dpureg_map.emplace(std::make_pair(std::get<2>(weights[param_idx]), shared_addrs[param_idx]));
+  startup_.add("upload", std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - upload_start).count());
   auto iter = xdpu_total_reg_map.begin();
   while(iter !=xdpu_total_reg_map.end()) {
 
@@ -424,6 +671,7 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
     iter++;
 
   }
+  const auto workspace_start = std::chrono::steady_clock::now();
   if (model_->get_xdpu_workspace_reg_map().size()>0) {
     int share_check=1;
     for(auto workspace : model_->get_xdpu_workspace_reg_map()) {
@@ -482,7 +730,7 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
            << "generate new featuremap bo " << "cu_index: "<< bd.cu_id 
            << ", device_id: " << bd.device_id
            ;
-         auto hbm = get_hbmio();
+         auto hbm = get_hbmws();
          for (int i=0;i<batch_size_;i++) {
            void *ioPtr = NULL;
            
@@ -517,7 +765,8 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
            free(ioPtr);
         }
         bo_s.bo_handles = handles;
-        bo_s.handle=contexts_[0]->get_dev_handle();
+        bo_s.handle=mem_handle_.get();
+        bo_s.handle_ref=mem_handle_;
         bo_s.reg_id=workspace.first;
         workspace_addr.emplace_back(workspace.first, addrs);
         {
@@ -527,9 +776,13 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
       }
     }
   }
+  startup_.add("workspace", std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - workspace_start).count());
   model_->init_vitis_tensors(batch_size_, handle_->get_device_info().device_index);
   cu_index_=handle_->get_device_info().cu_index;
   device_index_=handle_->get_device_info().device_index;
+  init_reg_vals();
+  cu_sched_ = CuScheduler::get(device_index_, cu_index_);
 
   program_once_complete = 0;
   //tensorbufferPool& pool = tensorbufferPool::Instance();
@@ -545,6 +798,84 @@ void DpuCloudController::init_graph(vector<unsigned> hbmw, vector<unsigned> hbmc
 
 }
 
+void DpuCloudController::init_reg_vals() {
+  // params and workspaces are fixed once the graph is loaded, so their
+  // address register writes are built here instead of on every trigger
+  num_reg_ids_ = 0;
+  for (auto &reg : xdpu_total_reg_map)
+    num_reg_ids_ = std::max(num_reg_ids_, reg.first + 1);
+  for (auto reg : model_->get_input_regid())
+    num_reg_ids_ = std::max(num_reg_ids_, reg + 1);
+  for (auto reg : model_->get_output_regid())
+    num_reg_ids_ = std::max(num_reg_ids_, reg + 1);
+
+  param_reg_vals_.clear();
+  for (auto &reg : xdpu_total_dpureg_map) {
+    param_reg_vals_.push_back({ (XDPU_CONTROL_ADDR_0_L + 8*reg.first) / 4, reg.second & 0xFFFFFFFF });
+    param_reg_vals_.push_back({ (XDPU_CONTROL_ADDR_0_H + 8*reg.first) / 4, (reg.second >> 32) & 0xFFFFFFFF });
+    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+        << "parameter: "  //
+        << reg.first << " : " << std::hex
+        << reg.second      //
+        ;
+  }
+  workspace_reg_vals_.clear();
+  for (auto &workspace : workspace_addr) {
+    for (int bz=0;bz<batch_size_;bz++) {
+      workspace_reg_vals_.push_back({ (XDPU_CONTROL_ADDR_0_L + 8*workspace.first + bz*0x100) / 4, workspace.second[bz] & 0xFFFFFFFF });
+      workspace_reg_vals_.push_back({ (XDPU_CONTROL_ADDR_0_H + 8*workspace.first + bz*0x100) / 4, (workspace.second[bz] >> 32) & 0xFFFFFFFF });
+      LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+        << "featuremap addr : "   //
+        << workspace.second[bz]      //
+        ;
+    }
+  }
+  // what a run leaves on the CU besides its io and workspaces. Runners of
+  // one model load the same code and weights, so they get one key and never
+  // switch, also when each has its own copy (XLNX_DPU_SHARE_WEIGHTS=0)
+  uint64_t key = 14695981039346656037ull;
+  auto mix = [&key](uint64_t v) { key = (key ^ v) * 1099511628211ull; };
+  auto mix_md5 = [&mix](const std::string &md5) {
+    for (unsigned char c : md5)
+      mix(c);
+    mix(0);
+  };
+  const auto code_md5 = model_->get_code_md5(0);
+  const auto &params = model_->get_parameter();
+  const auto &params_md5 = model_->get_parameter_md5();
+  if (code_md5.empty() || params_md5.size() != params.size()) {
+    // nothing to tell blobs apart by, only their addresses
+    mix(code_addr_);
+    mix(preload_code_addr_);
+    for (auto &reg : param_reg_vals_) {
+      mix(uint64_t(reg.first));
+      mix(uint32_t(reg.second));
+    }
+  } else {
+    mix_md5(code_md5);
+    mix_md5(model_->get_code_md5(1));
+    for (unsigned i=0; i < params.size(); i++) {
+      mix(uint64_t(std::get<2>(params[i])));
+      mix_md5(params_md5[i]);
+    }
+  }
+  preload_state_ = key;
+}
+
+void DpuCloudController::append_io_reg_vals(std::vector<std::pair<int, int>> &regVals, const DpuAddrTable &io_addrs) {
+  for (auto &io : io_addrs.entries()) {
+    regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*io.reg_id + io.idx*0x100) / 4, io.addr & 0xFFFFFFFF });
+    regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*io.reg_id + io.idx*0x100) / 4, (io.addr >> 32) & 0xFFFFFFFF });
+    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+        << "io: " 
+        << io.idx
+        << " regid: " << std::hex //
+        << io.reg_id << " "
+        << io.addr      //
+        ;
+  }
+}
+
 vector<float> DpuCloudController::get_input_scale() {
 
   return model_->get_input_scales();
@@ -578,6 +909,21 @@ DpuCloudController::get_merged_io_tensors(int reg_id) const {
 
 }
 
+void DpuCloudController::fault_in_buffers() {
+  XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>::fault_in_buffers();
+  // host-only buffers handed out when io-split is disabled
+  std::unique_lock<std::mutex> lock(hwbufio_mtx_);
+  for (auto &tb : bufs_) {
+    auto data = tb->data();
+    std::memset(reinterpret_cast<void*>(data.first), 0, data.second);
+  }
+}
+
+void DpuCloudController::init_worker(unsigned worker_id) {
+  // opens the worker's XRT context and exec BO
+  contexts_[worker_id];
+}
+
 std::vector<vart::TensorBuffer*> DpuCloudController::get_inputs(int batchsz) {
   // TODO if batchsz =! 8 or 1 , create_tensor_buffers for user-requested batchsz
   // E.g., batchsz=1 for MLperf Server Scenario
@@ -684,7 +1030,7 @@ std::vector<vart::TensorBuffer*> DpuCloudController::create_tensorbuffer_for_bat
     //  } 
     //} else {
       
-      if ((!check_exist(iter->first, model_->get_input_regid()))&& (!check_exist(iter->first , model_->get_output_regid()))) { 
+      if ((!model_->is_input_regid(iter->first))&& (!model_->is_output_regid(iter->first))) { 
         //for xmodel 1.3 with io-split 
         //can be removed in the future
         auto buf = create_tensor_buffers_hbm(get_merged_io_tensors(iter->first),false, get_hbmio(),1);
@@ -695,12 +1041,12 @@ std::vector<vart::TensorBuffer*> DpuCloudController::create_tensorbuffer_for_bat
       } else { // input/output
         if (split_io) {
           if (isInputs) {
-            if (!check_exist(iter->first, model_->get_input_regid())) {
+            if (!model_->is_input_regid(iter->first)) {
               iter++;
               continue;
             }
           } else {
-            if (!check_exist( iter->first, model_->get_output_regid())) {
+            if (!model_->is_output_regid(iter->first)) {
               iter++;
               continue;
             }
@@ -813,6 +1159,9 @@ void DpuCloudController::data_float2fix(int8_t* dataDst, float* dataSrc, int siz
 void DpuCloudController::free_buffers(std::vector<vart::TensorBuffer*> &tbufs) {
   std::unique_lock<std::mutex> lock(hwbufio_mtx_);
   for (auto tb : tbufs) {
+    // address tables of bindings that used this buffer; its address may
+    // come back with the next allocation
+    io_addr_cache_.evict(tb);
     // free buffer if io-split disable
     if (tb->get_location() == vart::TensorBuffer::location_t::HOST_VIRT) {
 
@@ -850,8 +1199,6 @@ void DpuCloudController::free_buffers(std::vector<vart::TensorBuffer*> &tbufs) {
       } 
       auto it = tbuf2hwbufsio_.find(tb);
       if (it != tbuf2hwbufsio_.end()) {
-        auto hwbufs = it->second;
-        hwbufs.clear();
         tbuf2hwbufsio_.erase(tb);
       }
  
@@ -898,121 +1245,166 @@ bool DpuCloudController::check_tensorbuffer_outside(const std::vector<vart::Tens
   return create_tb_outside;
 }
 uint32_t DpuCloudController::tensorbuffer_trans(std::vector<vart::TensorBuffer*> &input_tensor_buffers, std::vector<vart::TensorBuffer*> &output_tensor_buffers, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs, bool is_input, uint32_t buf_id) {
-  int ibs = inputs[0]->get_tensor()->get_shape()[0]*batch_size_/model_->get_input_tensors()[0]->get_shape()[0];
-  int obs = outputs[0]->get_tensor()->get_shape()[0]*batch_size_/model_->get_output_tensors()[0]->get_shape()[0];
-  // check if tensorbuffer store batch inputs/outputs
-  int inputBs = batch_size_;
   uint32_t id=0;
-  if ((inputs.size()/model_->get_input_tensors().size())>1)
-    inputBs = inputs.size()/model_->get_input_tensors().size();
+  if (is_input) {
+    id = acquire_staging(input_tensor_buffers, output_tensor_buffers);
+    apply_tensorbuffer_trans(plan_tensorbuffer_trans(inputs, outputs, true), input_tensor_buffers, true);
+  } else {
+    apply_tensorbuffer_trans(plan_tensorbuffer_trans(inputs, outputs, false), output_tensor_buffers, false);
+    release_staging(input_tensor_buffers, output_tensor_buffers, buf_id);
+  }
+  return id;
+
+}
+std::vector<DpuCloudController::TransCopy> DpuCloudController::plan_tensorbuffer_trans(const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs, bool is_input) {
+  return plan_tensorbuffer_trans(inputs, outputs, is_input, model_->get_input_io(), model_->get_output_io(),
+    is_input ? model_->get_input_scales() : model_->get_output_scales(), batch_size_);
+}
+std::vector<DpuCloudController::TransCopy> DpuCloudController::plan_tensorbuffer_trans(const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs, bool is_input,
+    const std::vector<DpuXmodel::io_tensor> &input_io, const std::vector<DpuXmodel::io_tensor> &output_io, const std::vector<float> &scales, int batch_size) {
+  int ibs = inputs[0]->get_tensor()->get_shape()[0]*batch_size/input_io[0].tensor->get_shape()[0];
+  int obs = outputs[0]->get_tensor()->get_shape()[0]*batch_size/output_io[0].tensor->get_shape()[0];
+  // check if tensorbuffer store batch inputs/outputs
+  int inputBs = batch_size;
+  if ((inputs.size()/input_io.size())>1)
+    inputBs = inputs.size()/input_io.size();
   else
     inputBs = ibs;
-  auto tensors = get_input_tensors();
-  int tsize = ibs;
-  std::vector<vart::TensorBuffer*> buffers_from, buffers_to, buffers;
-  //tensorbufferPool& pool = tensorbufferPool::Instance();
-  if (is_input) {
-    if(pool.get_pool_size() > 0) {
-      id = pool.get();
-      auto bufs = pool.get_buffer(id);
-      input_tensor_buffers = bufs.first;
-      output_tensor_buffers = bufs.second;
-    } else {
-      input_tensor_buffers = get_inputs(1);
-      output_tensor_buffers = get_outputs(1);
+  const auto &tensors = is_input ? input_io : output_io;
+  const auto &buffers = is_input ? inputs : outputs;
+  int tsize = is_input ? ibs : obs;
+  std::vector<const xir::Tensor*> model_tensors;
+  for (auto &io : tensors)
+    model_tensors.push_back(io.tensor);
+  auto matches = match_tensor_names(model_tensors, buffers);
+  if (matches.empty())
+      throw std::runtime_error("Error: invilad tensorbuffer input");
+  std::vector<TransCopy> copies;
+  unsigned tensor_idx=0;
+  for (unsigned m=0; m < matches.size(); m++) {
+    const unsigned i = matches[m].first;
+    auto *buffer = buffers[matches[m].second];
+    if (m == 0 || matches[m-1].first != i)
+      tensor_idx = 0;
+    auto dims_idx = std::vector<int>(tensors[i].tensor->get_shape().size(),0);
+    const bool is_float = buffer->get_tensor()->get_data_type().type == xir::DataType::FLOAT;
+    const unsigned channels = is_nchw_of(buffer->get_tensor(), tensors[i].tensor)
+      ? unsigned(tensors[i].tensor->get_shape()[3]) : 0;
+    if (ibs == inputBs) { //one tensrobuffer store batch
+      for (int b=0; b < tsize; b++) {
+        dims_idx[0] = b;
+        copies.push_back({unsigned(b*tensors.size()+i), (char*)buffer->data(dims_idx).first,
+          is_float, scales[i], tensors[i].size, channels});
+      }
+    }
+    else {
+      copies.push_back({unsigned(tensor_idx*tensors.size()+i), (char*)buffer->data(dims_idx).first,
+        is_float, scales[i], tensors[i].size, channels});
+      tensor_idx++;
     }
-    buffers = inputs;
-  } else {
-    tensors = get_output_tensors();
-    buffers = outputs;
-    tsize = obs;
   }
-  bool tensor_find = false;
+  return copies;
+}
+std::vector<std::pair<unsigned, unsigned>> DpuCloudController::match_tensor_names(const std::vector<const xir::Tensor*> &tensors, const std::vector<vart::TensorBuffer*> &buffers) {
+  std::vector<std::pair<unsigned, unsigned>> matches;
   for (unsigned i=0; i < tensors.size(); i++ ) {
-    int tensor_size = tensors[i]->get_element_num()/batch_size_;
-    unsigned tensor_idx=0;
-    vector<int> shape;
-    if (!is_input)
-      shape = output_tensor_buffers[i]->get_tensor()->get_shape();
-    else
-      shape = input_tensor_buffers[i]->get_tensor()->get_shape();
-    auto dims = std::vector<int>(shape.size(),0);
-    auto dims_idx = std::vector<int>(shape.size(),0);
+    const auto &name = tensors[i]->get_name();
     for (unsigned j=0; j < buffers.size(); j++) {
-      if (tensors[i]->get_name().find(buffers[j]->get_tensor()->get_name()) != std::string::npos) {
-        if (ibs == inputBs) { //one tensrobuffer store batch
-          for (int b=0; b < tsize; b++) {
-            int idx = b*tensors.size()+i;
-            dims_idx[0] = b;
-            if (buffers[j]->get_tensor()->get_data_type().type == xir::DataType::FLOAT) {
-              if (is_input)
-                data_float2fix((int8_t*)input_tensor_buffers[idx]->data(dims).first,(float*)inputs[j]->data(dims_idx).first,tensor_size,  model_->get_input_scales()[i]);
-              else
-                data_fix2float((float*)outputs[j]->data(dims_idx).first, (int8_t*)output_tensor_buffers[idx]->data(dims).first,tensor_size,model_->get_output_scales()[i]);
-            } else {
-              if (is_input)
-                memcpy((int8_t*)input_tensor_buffers[idx]->data(dims).first,(int8_t*)inputs[j]->data(dims_idx).first,tensor_size);
-              else
-                memcpy((char*)outputs[j]->data(dims_idx).first, (void*)output_tensor_buffers[idx]->data(dims).first,tensor_size);
-            }
-            tensor_idx++;
-          }
-        }
-        else {
-          int idx = tensor_idx*tensors.size()+i;
-          if (buffers[j]->get_tensor()->get_data_type().type == xir::DataType::FLOAT) {    
-            if (is_input)
-    	      data_float2fix((int8_t*)input_tensor_buffers[idx]->data(dims).first,(float*)inputs[j]->data(dims).first,tensor_size, model_->get_input_scales()[i]);
-            else
-              data_fix2float((float*)outputs[j]->data(dims).first,(int8_t*)output_tensor_buffers[idx]->data(dims).first,tensor_size,model_->get_output_scales()[i]);
-          } else {
-            if (is_input)
-    	      memcpy((int8_t*)input_tensor_buffers[idx]->data(dims).first,(int8_t*)inputs[j]->data(dims).first,tensor_size);
-            else
-              memcpy((int8_t*)outputs[j]->data(dims).first,(int8_t*)output_tensor_buffers[idx]->data(dims).first,tensor_size);
-          }
-          tensor_idx++;
-        }
-      } 
+      if (name.find(buffers[j]->get_tensor()->get_name()) != std::string::npos)
+        matches.emplace_back(i, j);
     }
-    if (tensor_idx > 0)
-      tensor_find = true;
   }
-  if (!tensor_find)
-      throw std::runtime_error("Error: invilad tensorbuffer input");
-  if (!is_input) {
-    if(pool.get_pool_size() == 0) {
-      free_buffers(input_tensor_buffers);
-      free_buffers(output_tensor_buffers);
+  return matches;
+}
+bool DpuCloudController::is_nchw_of(const xir::Tensor *user, const xir::Tensor *model) {
+  const auto u = user->get_shape();
+  const auto m = model->get_shape();
+  if (u.size() != 4 || m.size() != 4)
+    return false;
+  if (u[1] == m[1] && u[2] == m[2] && u[3] == m[3])
+    return false;
+  return u[1] == m[3] && u[2] == m[1] && u[3] == m[2];
+}
+void DpuCloudController::apply_tensorbuffer_trans(const std::vector<TransCopy> &copies, const std::vector<vart::TensorBuffer*> &staging, bool is_input) {
+  for (auto &c : copies) {
+    auto shape = staging[c.staging]->get_tensor()->get_shape();
+    auto dims = std::vector<int>(shape.size(),0);
+    auto data = (int8_t*)staging[c.staging]->data(dims).first;
+    if (c.channels) {
+      const size_t hw = c.size / c.channels;
+      if (c.is_float && is_input)
+        layout::nchw_to_nhwc((float*)c.user, c.channels, hw, c.scale, data);
+      else if (c.is_float)
+        layout::nhwc_to_nchw(data, c.channels, hw, c.scale, (float*)c.user);
+      else if (is_input)
+        layout::nchw_to_nhwc((int8_t*)c.user, c.channels, hw, data);
+      else
+        layout::nhwc_to_nchw(data, c.channels, hw, (int8_t*)c.user);
+    } else if (c.is_float) {
+      if (is_input)
+        data_float2fix(data, (float*)c.user, c.size, c.scale);
+      else
+        data_fix2float((float*)c.user, data, c.size, c.scale);
     } else {
-      pool.free_id(buf_id);
+      if (is_input)
+        memcpy(data, c.user, c.size);
+      else
+        memcpy(c.user, data, c.size);
     }
   }
+}
+uint32_t DpuCloudController::acquire_staging(std::vector<vart::TensorBuffer*> &input_tensor_buffers, std::vector<vart::TensorBuffer*> &output_tensor_buffers) {
+  uint32_t id=0;
+  //tensorbufferPool& pool = tensorbufferPool::Instance();
+  if(pool.get_pool_size() > 0) {
+    id = pool.get();
+    auto bufs = pool.get_buffer(id);
+    input_tensor_buffers = bufs.first;
+    output_tensor_buffers = bufs.second;
+  } else {
+    input_tensor_buffers = get_inputs(1);
+    output_tensor_buffers = get_outputs(1);
+  }
   return id;
-
 }
-vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_inside(bool create_tb_batch, std::vector<vart::TensorBuffer*> &output_tensor_buffers, std::vector<vart::TensorBuffer*> &input_tensor_buffers  ) {
-  vector<std::tuple<int, int,uint64_t>> xdpu_total_dpureg_map2;
-  std::vector<XrtDeviceBuffer*> io_bufs(batch_size_);
+void DpuCloudController::release_staging(std::vector<vart::TensorBuffer*> &input_tensor_buffers, std::vector<vart::TensorBuffer*> &output_tensor_buffers, uint32_t buf_id) {
+  if(pool.get_pool_size() == 0) {
+    free_buffers(input_tensor_buffers);
+    free_buffers(output_tensor_buffers);
+  } else {
+    pool.free_id(buf_id);
+  }
+}
+std::shared_ptr<const DpuAddrTable> DpuCloudController::get_dpu_reg_inside(bool create_tb_batch, std::vector<vart::TensorBuffer*> &output_tensor_buffers, std::vector<vart::TensorBuffer*> &input_tensor_buffers  ) {
   int tensors_sz =batch_size_;  
   int tensor_inBatch=1;
   if (create_tb_batch) {
     tensor_inBatch= batch_size_;
     tensors_sz = 1;
   }
+  // the table only depends on which of our buffers are bound, reuse it
+  DpuAddrCache::Key key;
+  key.first = create_tb_batch;
+  key.second.assign(output_tensor_buffers.begin(), output_tensor_buffers.begin() + tensors_sz);
+  if (split_io)
+    key.second.insert(key.second.end(), input_tensor_buffers.begin(), input_tensor_buffers.begin() + tensors_sz);
+  std::unique_lock<std::mutex> lock(hwbufio_mtx_);
+  if (auto cached = io_addr_cache_.find(key))
+    return cached;
+
+  auto xdpu_total_dpureg_map2 = std::make_shared<DpuAddrTable>(num_reg_ids_, batch_size_);
   for (int idx=0; idx<tensors_sz; idx++) {
     {
-      std::unique_lock<std::mutex> lock(hwbufio_mtx_);
       auto it = tbuf2hwbufsio_.find(output_tensor_buffers[idx]);
       if ((it == tbuf2hwbufsio_.end()))
         throw std::runtime_error("TensorBuffer not found");
-      auto  hwbufs = it->second;
+      auto &hwbufs = it->second;
       auto iter = xdpu_total_reg_map.begin();
       while(iter != xdpu_total_reg_map.end()) {
-        if ((!check_exist(iter->first ,model_->get_input_regid())) || (!split_io)) {
+        if ((!model_->is_input_regid(iter->first)) || (!split_io)) {
           auto reg_map = hwbufs.find(iter->first);
           if ((reg_map == hwbufs.end())) {
-            if (check_exist(iter->first, model_->get_output_regid()))
+            if (model_->is_output_regid(iter->first))
               throw std::runtime_error("TensorBuffer not found");
             else {
               iter++;
@@ -1020,9 +1412,9 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_inside(bo
             }
           }
             //throw std::runtime_error("Output TensorBuffer not found");
-          auto buf = reg_map->second;
+          auto &buf = reg_map->second;
           for (int i=0; i < tensor_inBatch; i++) {  // i or idx is 0
-            xdpu_total_dpureg_map2.push_back(std::make_tuple(iter->first, idx+i, buf[i]->data_phy(std::vector<int>{0,0}).first));
+            xdpu_total_dpureg_map2->set(iter->first, idx+i, buf[i]->data_phy(std::vector<int>{0,0}).first);
             LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
               <<"Engine : " << i<<  " workspace reg_id: " 
               << iter->first
@@ -1035,14 +1427,13 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_inside(bo
       }
     }
     if (split_io){
-      std::unique_lock<std::mutex> lock(hwbufio_mtx_);
       auto it = tbuf2hwbufsio_.find(input_tensor_buffers[idx]);
       if ((it == tbuf2hwbufsio_.end()))
         throw std::runtime_error("TensorBuffer not found");
-      auto  hwbufs = it->second;
+      auto &hwbufs = it->second;
       auto iter = xdpu_total_reg_map.begin();
       while(iter != xdpu_total_reg_map.end()) {
-        if (check_exist(iter->first, model_->get_input_regid())) {
+        if (model_->is_input_regid(iter->first)) {
           auto reg_map = hwbufs.find(iter->first);
           if ((reg_map == hwbufs.end())) {
             //if ((iter->first == model_->get_input_regid())|| (iter->first == model_->get_output_regid()))
@@ -1053,9 +1444,9 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_inside(bo
             //}
           }
             //throw std::runtime_error("Input TensorBuffer not found");
-          auto buf = reg_map->second;
+          auto &buf = reg_map->second;
           for (int i=0; i < tensor_inBatch; i++) { // i or idx is 0
-            xdpu_total_dpureg_map2.push_back(std::make_tuple(iter->first, i+idx, buf[i]->data_phy(std::vector<int>{0,0}).first));
+            xdpu_total_dpureg_map2->set(iter->first, i+idx, buf[i]->data_phy(std::vector<int>{0,0}).first);
             LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
               <<"Engine : " << i<<  " workspace reg_id: " 
               << iter->first
@@ -1067,31 +1458,16 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_inside(bo
       }
     }
   }
+  io_addr_cache_.insert(std::move(key), xdpu_total_dpureg_map2);
   return xdpu_total_dpureg_map2;
 }
-uint64_t DpuCloudController::get_addr(int32_t regid, int idx,vector<std::tuple<int, int,uint64_t>>& xdpu_total_dpureg_map2) {
-  uint64_t addr;
-
-  for (auto iter2 : xdpu_total_dpureg_map2) {
-    if (regid == std::get<0>(iter2))
-    {
-      if (idx == std::get<1>(iter2)) {
-        addr =  std::get<2>(iter2);
-        return addr;
-      }
-
-    }
-  }
-  throw std::runtime_error("need enable split-io");
-  return addr;   
-
-}
-vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_outside(bool create_tb_batch,  const std::vector<vart::TensorBuffer*> &outputs, const std::vector<vart::TensorBuffer*> &inputs) {
+std::shared_ptr<const DpuAddrTable> DpuCloudController::get_dpu_reg_outside(bool create_tb_batch,  const std::vector<vart::TensorBuffer*> &outputs, const std::vector<vart::TensorBuffer*> &inputs) {
   return get_dpu_reg_outside_hbm(create_tb_batch, outputs, inputs);
 }
-vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_outside_hbm(bool create_tb_batch, const std::vector<vart::TensorBuffer*> &outputs, const std::vector<vart::TensorBuffer*> &inputs) {
-  // for the condition that alloc memory without API
-  vector<std::tuple<int, int,uint64_t>> xdpu_total_dpureg_map2;
+std::shared_ptr<const DpuAddrTable> DpuCloudController::get_dpu_reg_outside_hbm(bool create_tb_batch, const std::vector<vart::TensorBuffer*> &outputs, const std::vector<vart::TensorBuffer*> &inputs) {
+  // for the condition that alloc memory without API; user buffers may move
+  // between runs, so this table is rebuilt every time
+  auto xdpu_total_dpureg_map2 = std::make_shared<DpuAddrTable>(num_reg_ids_, batch_size_);
   if (split_io) {
     auto dims_size = (inputs[0]->get_tensor()->get_shape()).size();
     auto dims_out_size = (outputs[0]->get_tensor()->get_shape()).size();
@@ -1103,8 +1479,8 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_outside_h
     }
     std::unordered_map<int32_t,int> in_regs;
     std::unordered_map<int32_t,int> out_regs;
-    auto input_reg = model_->get_input_regid();
-    auto output_reg = model_->get_output_regid();
+    const auto &input_reg = model_->get_input_regid();
+    const auto &output_reg = model_->get_output_regid();
     for (unsigned r=0; r< input_reg.size(); r++) {
       in_regs.emplace(input_reg[r], 0);
     }
@@ -1117,13 +1493,13 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_outside_h
       for (int ts=0; ts < tensor_batch; ts++) {
         for (int i=0; i < batch_size_/tensor_batch; i++) {
           dims[0] = i;
-          auto intensors = model_->get_input_tensors();
+          const auto &intensors = model_->get_input_io();
           int input_idx = ts*intensors.size();
           auto tensor = inputs[input_idx]->get_tensor();
           for (unsigned t=0; t<intensors.size(); t++) {
             if (tensor->get_attr<int32_t>("reg_id") == iter.first) {
-              uint64_t in_addr = inputs[input_idx+t]->data_phy(dims).first-model_->get_input_offset()[t];
-              xdpu_total_dpureg_map2.push_back(std::make_tuple(iter.first,i+ts,in_addr));
+              uint64_t in_addr = inputs[input_idx+t]->data_phy(dims).first-intensors[t].offset;
+              xdpu_total_dpureg_map2->set(iter.first, i+ts, in_addr);
 
               LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
               <<"Engine : " << i+ts<<  " workspace reg_id: " 
@@ -1140,13 +1516,13 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_outside_h
       for (int ts=0; ts < tensor_batch; ts++) {
         for (int i=0; i < batch_size_/tensor_batch; i++) {
           dims_out[0] = i;
-          auto outtensors = model_->get_output_tensors();
+          const auto &outtensors = model_->get_output_io();
           int output_idx = ts*outtensors.size();
           auto tensor = outputs[output_idx]->get_tensor();
           for (unsigned t=0; t<outtensors.size(); t++) {
             if (tensor->get_attr<int32_t>("reg_id") == iter.first) {
-              uint64_t out_addr = outputs[output_idx+t]->data_phy(dims_out).first-model_->get_output_offset()[t];
-              xdpu_total_dpureg_map2.push_back(std::make_tuple(iter.first,i+ts,out_addr));
+              uint64_t out_addr = outputs[output_idx+t]->data_phy(dims_out).first-outtensors[t].offset;
+              xdpu_total_dpureg_map2->set(iter.first, i+ts, out_addr);
               LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
               <<"Engine : " << i+ts<<  " workspace reg_id: " 
               << iter.first
@@ -1181,18 +1557,115 @@ vector<std::tuple<int, int,uint64_t>>  DpuCloudController::get_dpu_reg_outside_h
   return xdpu_total_dpureg_map2;
 }
 
-void DpuCloudController::dpu_trigger_run(ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle, vector<std::tuple<int, int,uint64_t>> xdpu_total_dpureg_map_io) {
+static void log_cu_regs(xclDeviceHandle xcl_handle, uint64_t cu_base_addr) {
+  LOG(WARNING) << "LOAD START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_LOAD_START)
+    << " LOAD END:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_LOAD_END)
+    << " SAVE START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_SAVE_START)
+    << " SAVE END:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_SAVE_END)
+    << " CONV START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_CONV_START)
+    << " CONV END:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_CONV_END)
+    << " MISC START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_MISC_START)
+    << " MISC END:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_MISC_END);
+}
+
+bool DpuCloudController::exec_and_wait(ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle) {
+  if (xclExecBuf(xcl_handle, bo_handle))
+    throw std::runtime_error("Error: xclExecBuf failed");
+
+  // wait in slices of at most 1 s so short timeouts are honoured
+  const auto deadline = std::chrono::steady_clock::now()
+    + std::chrono::milliseconds(ENV_PARAM(XLNX_DPU_TIMEOUT_MS));
+  while (ecmd->state != ERT_CMD_STATE_COMPLETED) {
+    if (ecmd->state == ERT_CMD_STATE_ERROR || ecmd->state == ERT_CMD_STATE_ABORT)
+      return false;
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now()).count();
+    if (left <= 0)
+      return false;
+    xclExecWait(xcl_handle, int(std::min<int64_t>(left, 1000)));
+  }
+  return true;
+}
+
+void DpuCloudController::reset_cu(ert_start_kernel_cmd*& ecmd, xclDeviceHandle& xcl_handle, xclBufferHandle& bo_handle) {
+  // keep the packet header; the command BO goes away with the old context
+  const auto header = ecmd->header;
+  const auto cu_mask = ecmd->cu_mask;
+  {
+    std::lock_guard<std::mutex> lock(reset_mtx_);
+    auto &context = contexts_.reset(engine_.get_my_worker_id());
+    xcl_handle = context.get_dev_handle();
+    bo_handle = context.get_bo_handle();
+    ecmd = reinterpret_cast<ert_start_kernel_cmd*>(context.get_bo_addr());
+    program_once_complete = 0;
+  }
+  // other models' runners on this CU must redo their preload too
+  cu_sched_->invalidate();
+  ecmd->header = header;
+  ecmd->cu_mask = cu_mask;
+  ecmd->state = ERT_CMD_STATE_NEW;
+}
+
+bool DpuCloudController::is_healthy() const {
+  return CuHealth::get_instance().is_healthy(device_index_, cu_index_);
+}
+
+void DpuCloudController::retry_on_hang(ert_start_kernel_cmd*& ecmd, xclDeviceHandle& xcl_handle, xclBufferHandle& bo_handle, const std::function<bool()> &trigger) {
+  retry_on_hang(device_index_, cu_index_, ENV_PARAM(XLNX_DPU_HANG_RETRY),
+    [&] { reset_cu(ecmd, xcl_handle, bo_handle); }, trigger);
+}
+
+void DpuCloudController::retry_on_hang(size_t device_index, size_t cu_index, bool retry,
+    const std::function<void()> &reset, const std::function<bool()> &trigger) {
+  auto &health = CuHealth::get_instance();
+  if (trigger()) {
+    // a CU given up on earlier is back once a command completes on it
+    if (!health.is_healthy(device_index, cu_index))
+      health.report_recovery(device_index, cu_index);
+    return;
+  }
+  const auto cu = std::to_string(cu_index);
+  health.report_hang(device_index, cu_index);
+  if (!retry)
+    throw std::runtime_error("Error: CU timeout " + cu);
+
+  LOG(WARNING) << "CU " << cu << " timed out, resetting and retrying";
+  reset();
+  if (!trigger()) {
+    health.report_failure(device_index, cu_index);
+    throw std::runtime_error("Error: CU timeout " + cu + " after reset");
+  }
+  health.report_recovery(device_index, cu_index);
+  LOG(WARNING) << "CU " << cu << " recovered";
+}
+
+void DpuCloudController::dpu_trigger_run(ert_start_kernel_cmd*& ecmd, xclDeviceHandle& xcl_handle, xclBufferHandle& bo_handle, const DpuProgram &program, const DpuAddrTable &xdpu_total_dpureg_map_io, DpuRunSample *sample) {
+  retry_on_hang(ecmd, xcl_handle, bo_handle, [&] {
+    return dpu_trigger_once(ecmd, xcl_handle, bo_handle, program, xdpu_total_dpureg_map_io, sample);
+  });
+}
+
+bool DpuCloudController::dpu_trigger_once(ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle, const DpuProgram &program, const DpuAddrTable &xdpu_total_dpureg_map_io, DpuRunSample *sample) {
+  return trigger_once(*cu_sched_, preload_state_, program_once_complete, debug_mode_, handle_->get_device_info(),
+    ecmd, xcl_handle, bo_handle, program, xdpu_total_dpureg_map_io, sample);
+}
+
+bool DpuCloudController::trigger_once(CuScheduler &sched, uint64_t state, std::atomic<int> &program_once_complete, bool debug_mode,
+    const DeviceInfo &cu, ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle,
+    const DpuProgram &program, const DpuAddrTable &xdpu_total_dpureg_map_io, DpuRunSample *sample) {
   int p;
-  int exec_buf_result;
-  auto dev_info = handle_->get_device_info();
-  auto cu_base_addr = dev_info.cu_base_addr;
-  auto core_idx = dev_info.cu_index;
+  auto cu_base_addr = cu.cu_base_addr;
+  auto core_idx = cu.cu_index;
+  const auto preload_code_addr = program.preload_code_addr;
+  const auto code_addr = program.code_addr;
 
   std::vector<std::pair<int, int> > regVals;
-  if (0 == program_once_complete) {
+  // held until our command completed; another model's commands wait
+  auto lease = sched.acquire(state);
+  if (lease.needs_preload() || 0 == program_once_complete) {
 
     // in debug mode, need to run preload instruction layer by layer
-    if(!debug_mode_){
+    if(!debug_mode){
       program_once_complete = 1;
     }
     regVals.push_back({ XDPU_CONTROL_AP, XDPU_CONTROL_AP_START });
@@ -1201,16 +1674,11 @@ void DpuCloudController::dpu_trigger_run(ert_start_kernel_cmd* ecmd, xclDeviceHa
     regVals.push_back(  { XDPU_CONTROL_START / 4, 0x0 });
     regVals.push_back(  { XDPU_CONTROL_RESET / 4, 0x1 });
     regVals.push_back(  { XDPU_CONTROL_HP / 4, 0x204040 });
-    if (preload_code_addr_){
+    if (preload_code_addr){
       // do preload
-      regVals.push_back( { XDPU_CONTROL_INSTR_L / 4, preload_code_addr_ & 0xFFFFFFFF });
-      regVals.push_back( { XDPU_CONTROL_INSTR_H / 4, (preload_code_addr_ >> 32) & 0xFFFFFFFF });
-      auto iter = xdpu_total_dpureg_map.begin();
-      while(iter !=xdpu_total_dpureg_map.end()) {
-        regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*iter->first) / 4, iter->second & 0xFFFFFFFF });
-        regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*iter->first) / 4, (iter->second >> 32) & 0xFFFFFFFF });
-        iter++;
-      }
+      regVals.push_back( { XDPU_CONTROL_INSTR_L / 4, preload_code_addr & 0xFFFFFFFF });
+      regVals.push_back( { XDPU_CONTROL_INSTR_H / 4, (preload_code_addr >> 32) & 0xFFFFFFFF });
+      regVals.insert(regVals.end(), program.param_reg_vals.begin(), program.param_reg_vals.end());
       p = 6;
       for (unsigned i=0; i < regVals.size(); i++) {
         ecmd->data[p++] = (regVals[i].first) * 4;
@@ -1218,68 +1686,21 @@ void DpuCloudController::dpu_trigger_run(ert_start_kernel_cmd* ecmd, xclDeviceHa
       }
       ecmd->count = 1 + p;
 
-      exec_buf_result = xclExecBuf(xcl_handle, bo_handle);
-      if (exec_buf_result)
-        throw std::runtime_error("Error: xclExecBuf failed");
-
-      // wait for kernel
-      for (int wait_count=0; wait_count < 15 && xclExecWait(xcl_handle, 1000) == 0
-              && ecmd->state != ERT_CMD_STATE_COMPLETED; wait_count++);
-
-      if (ecmd->state != ERT_CMD_STATE_COMPLETED) {
-        std::cout << "LOAD START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_LOAD_START) << std::endl;
-        std::cout << "LOAD END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_LOAD_END) << std::endl;
-        std::cout << "SAVE START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_SAVE_START) << std::endl;
-        std::cout << "SAVE END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_SAVE_END) << std::endl;
-        std::cout << "CONV START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_CONV_START) << std::endl;
-        std::cout << "CONV END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_CONV_END) << std::endl;
-        std::cout << "MISC START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_MISC_START) << std::endl;
-        std::cout << "MISC END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_MISC_END) << std::endl;
-        std::cout << "Error: CU timeout when do preload " << std::endl;
-        throw std::runtime_error("Error: CU timeout when do preload "
-          + std::to_string(handle_->get_device_info().cu_index));
+      if (!exec_and_wait(ecmd, xcl_handle, bo_handle)) {
+        log_cu_regs(xcl_handle, cu_base_addr);
+        LOG(WARNING) << "Error: CU timeout when do preload " << core_idx;
+        return false;
       }
+      lease.preloaded();
       regVals.clear();
     }
   }
-  regVals.push_back(  { XDPU_CONTROL_INSTR_L / 4, code_addr_ & 0xFFFFFFFF });
-  regVals.push_back(  { XDPU_CONTROL_INSTR_H / 4, (code_addr_ >> 32) & 0xFFFFFFFF });
-  auto iter = xdpu_total_dpureg_map.begin();
-  while(iter !=xdpu_total_dpureg_map.end()) {
-    regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*iter->first) / 4, iter->second & 0xFFFFFFFF });
-    regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*iter->first) / 4, (iter->second >> 32) & 0xFFFFFFFF });
-    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-        << "parameter: "  //
-        << iter->first << " : " << std::hex
-        << iter->second      //
-        ;
-    iter++;
-  }
-  auto iter3 = workspace_addr.begin();
-  while(iter3 != workspace_addr.end() ) {
-    for (int bz=0;bz<batch_size_;bz++) {
-      regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*iter3->first + bz*0x100) / 4, (iter3->second)[bz] & 0xFFFFFFFF });
-      regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*iter3->first + bz*0x100) / 4, (iter3->second[bz] >> 32) & 0xFFFFFFFF });
-      LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-        << "featuremap addr : "   //
-        << iter3->second[bz]      //
-        ;
-    }
-    iter3++;
-  }
-
+  regVals.push_back(  { XDPU_CONTROL_INSTR_L / 4, code_addr & 0xFFFFFFFF });
+  regVals.push_back(  { XDPU_CONTROL_INSTR_H / 4, (code_addr >> 32) & 0xFFFFFFFF });
+  regVals.insert(regVals.end(), program.param_reg_vals.begin(), program.param_reg_vals.end());
+  regVals.insert(regVals.end(), program.workspace_reg_vals.begin(), program.workspace_reg_vals.end());
   // program DPU input/output addrs
-  for (auto iter2 : xdpu_total_dpureg_map_io) {
-    regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*std::get<0>(iter2) + std::get<1>(iter2)*0x100) / 4, std::get<2>(iter2) & 0xFFFFFFFF });
-    regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*std::get<0>(iter2) + std::get<1>(iter2)*0x100) / 4, (std::get<2>(iter2) >> 32) & 0xFFFFFFFF });
-    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-        << "io: " 
-        <<std::get<1>(iter2) 
-        << " regid: " << std::hex //
-        << std::get<0>(iter2) << " "
-        << std::get<2>(iter2)      //
-        ;
-  }
+  append_io_reg_vals(regVals, xdpu_total_dpureg_map_io);
 
   p = 6;
   for (unsigned i=0; i < regVals.size(); i++) {
@@ -1291,46 +1712,44 @@ void DpuCloudController::dpu_trigger_run(ert_start_kernel_cmd* ecmd, xclDeviceHa
 #ifndef _WIN32
   vitis::ai::trace::add_trace("dpu-controller", vitis::ai::trace::func_start, core_idx);
 #endif
-  // exec kernel
-  exec_buf_result = xclExecBuf(xcl_handle, bo_handle);
-  if (exec_buf_result)
-    throw std::runtime_error("Error: xclExecBuf failed");
-
-  // wait for kernel
-  for (int wait_count=0; wait_count < 15 && xclExecWait(xcl_handle, 1000) == 0
-          && ecmd->state != ERT_CMD_STATE_COMPLETED; wait_count++);
-
+  // exec kernel and wait
+  const bool completed = exec_and_wait(ecmd, xcl_handle, bo_handle);
 #ifndef _WIN32
 vitis::ai::trace::add_trace("dpu-controller", vitis::ai::trace::func_end, core_idx);
 #endif
-  if (ecmd->state != ERT_CMD_STATE_COMPLETED) {
-    std::cout << "Error: CU timeout " << std::endl;
-
-    std::cout << "LOAD START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_LOAD_START) << std::endl;
-    std::cout << "LOAD END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_LOAD_END) << std::endl;
-    std::cout << "SAVE START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_SAVE_START) << std::endl;
-    std::cout << "SAVE END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_SAVE_END) << std::endl;
-    std::cout << "CONV START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_CONV_START) << std::endl;
-    std::cout << "CONV END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_CONV_END) << std::endl;
-    std::cout << "MISC START:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_MISC_START) << std::endl;
-    std::cout << "MISC END  :" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_MISC_END) << std::endl;
-    throw std::runtime_error("Error: CU timeout " + std::to_string(handle_->get_device_info().cu_index));
+  if (!completed) {
+    log_cu_regs(xcl_handle, cu_base_addr);
+    LOG(WARNING) << "Error: CU timeout " << core_idx;
+    return false;
   }
+  // no preload program: the reset went out with this command
+  lease.preloaded();
   if(ENV_PARAM(XLNX_SHOW_DPU_COUNTER))
     std::cout << "IP COUNTER:" << read32_dpu_reg(xcl_handle, cu_base_addr + DPUREG_CYCLE_COUNTER) <<std::endl;
-
-
+  // the counters restart with each command; another worker may already have
+  // started the next one on this cu, so they are best effort
+  if (sample)
+    sample->add_counters(xcl_handle, cu_base_addr);
+  return true;
 }
 
 void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs, 
     const std::vector<vart::TensorBuffer*> &outputs) {
-  std::vector<vart::TensorBuffer*> input_tensor_buffers;
-  std::vector<vart::TensorBuffer*> output_tensor_buffers;
+  run_bound(*bind(inputs, outputs));
+}
+
+std::shared_ptr<const DpuIoBinding> DpuCloudController::bind(const std::vector<vart::TensorBuffer*> &inputs,
+    const std::vector<vart::TensorBuffer*> &outputs) {
+  auto binding = std::make_shared<IoBinding>();
+  binding->owner = this;
+  binding->inputs = inputs;
+  binding->outputs = outputs;
   int inputBs = batch_size_;
-  auto input_tensors_size = model_->get_input_tensors().size();
+  const auto &input_io = model_->get_input_io();
+  auto input_tensors_size = input_io.size();
   if(inputs.size()%input_tensors_size)
     throw std::runtime_error("Error: input tensorbuffers error");
-  int ibs = inputs[0]->get_tensor()->get_shape()[0]*batch_size_/model_->get_input_tensors()[0]->get_shape()[0];
+  int ibs = inputs[0]->get_tensor()->get_shape()[0]*batch_size_/input_io[0].tensor->get_shape()[0];
   //int obs = outputs[0]->get_tensor()->get_shape()[0]*batch_size_/model_->get_output_tensors()[0]->get_shape()[0];
   // check if tensorbuffer store batch inputs/outputs
   if ((inputs.size()/input_tensors_size)>1)
@@ -1352,70 +1771,432 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
       create_tb_batch = true;
     }
   //}
-  uint32_t buf_id = 0;
   if(create_tb_outside) {
     LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
       << "create tensorbuffer by user side";
     if (!tensorbuffer_phy) {
-      buf_id = tensorbuffer_trans(input_tensor_buffers, output_tensor_buffers,inputs,outputs, true, 0);
-      create_tb_batch = false; // we call get_inputs(1), tensorbuffer.data not in batch
+      if (!bind_registered(*binding, create_tb_batch, inputBs)) {
+        // staged through our buffers (get_inputs(1)), not in batch; their
+        // addresses are resolved per run
+        binding->in_copies = plan_tensorbuffer_trans(inputs, outputs, true);
+        binding->out_copies = plan_tensorbuffer_trans(inputs, outputs, false);
+        create_tb_batch = false;
+      }
     } else {
-      input_tensor_buffers = inputs;
-      output_tensor_buffers = outputs;
-
+      binding->io_addrs = get_dpu_reg_outside(create_tb_batch, binding->outputs, binding->inputs);
     } 
   }
   else {
-    input_tensor_buffers = inputs;
-    output_tensor_buffers = outputs;
+    binding->io_addrs = get_dpu_reg_inside(create_tb_batch, binding->outputs, binding->inputs);
   }
-  Engine& engine = Engine::get_instance();
-  const unsigned worker_id = engine.get_my_worker_id();
-  if (worker_id >= contexts_.size())
-  throw std::runtime_error("Error: worker_id too large; update controller code");
-
-  auto &context = *(contexts_[worker_id]);
-  auto xcl_handle = context.get_dev_handle();
-  auto bo_handle = context.get_bo_handle();
-  auto bo_addr = context.get_bo_addr();
+  binding->tensorbuffer_phy = tensorbuffer_phy;
+  binding->create_tb_batch = create_tb_batch;
+  binding->inputBs = inputBs;
+  if (!create_tb_outside || binding->registered)
+    binding->io_banks = get_hbmio();
+  if (!tensorbuffer_phy && binding->io_addrs && !binding->registered) {
+    binding->in_ptrs = host_batch_ptrs(inputs, create_tb_batch, inputBs, input_io);
+    binding->out_ptrs = host_batch_ptrs(outputs, create_tb_batch, inputBs, model_->get_output_io());
+  }
+  return binding;
+}
 
-  // get device buffers for input TensorBuffers
-  vector<std::tuple<int, int,uint64_t>> xdpu_total_dpureg_map_io;
+std::vector<uint64_t> DpuCloudController::host_batch_ptrs(const std::vector<vart::TensorBuffer*> &bufs,
+    bool create_tb_batch, int inputBs, const std::vector<DpuXmodel::io_tensor> &tensors) {
+  std::vector<uint64_t> ptrs(inputBs * tensors.size());
+  for (int i=0; i < inputBs; i++) {
+    for (unsigned j=0; j < tensors.size(); j++) {
+      // one buffer holds the batch, or one buffer per batch element
+      auto *tb = create_tb_batch ? bufs[j] : bufs[i*tensors.size()+j];
+      const int32_t b = create_tb_batch ? i : 0;
+      if (auto *host = dynamic_cast<vart::HostBatchAccess*>(tb)) {
+        ptrs[i*tensors.size()+j] = host->batch_ptr(b);
+      } else {
+        auto dims_size = create_tb_batch ? tensors[j].tensor->get_shape().size() : tb->get_tensor()->get_shape().size();
+        auto idx = std::vector<int32_t>(dims_size, 0);
+        idx[0] = b;
+        ptrs[i*tensors.size()+j] = tb->data(idx).first;
+      }
+    }
+  }
+  return ptrs;
+}
 
-  //std::vector<uint64_t> in_addrs(batch_size_);
-  //std::vector<uint64_t> out_addrs(batch_size_);
-  if (create_tb_outside && tensorbuffer_phy) {
-    xdpu_total_dpureg_map_io = get_dpu_reg_outside(create_tb_batch, output_tensor_buffers, input_tensor_buffers);
-  } else {
-    xdpu_total_dpureg_map_io = get_dpu_reg_inside(create_tb_batch, output_tensor_buffers, input_tensor_buffers);
+std::vector<vart::TensorBuffer*> DpuCloudController::order_by_tensor(const std::vector<vart::TensorBuffer*> &bufs,
+    const std::vector<DpuXmodel::io_tensor> &tensors, bool create_tb_batch, int inputBs) {
+  std::vector<const xir::Tensor*> model_tensors;
+  for (auto &io : tensors)
+    model_tensors.push_back(io.tensor);
+  const unsigned per_tensor = create_tb_batch ? 1 : inputBs;
+  std::vector<vart::TensorBuffer*> ordered(per_tensor * tensors.size());
+  std::vector<unsigned> count(tensors.size(), 0);
+  // the k-th buffer matching a tensor holds batch element k
+  for (auto &m : match_tensor_names(model_tensors, bufs)) {
+    if (count[m.first] == per_tensor)
+      return {};
+    ordered[count[m.first]++ * tensors.size() + m.first] = bufs[m.second];
   }
-  if (!tensorbuffer_phy) {
-  __TIC__(INPUT_H2D)
-    for (int i=0; i < inputBs; i++)
-    {
-      for (unsigned j=0; j < model_->get_input_offset().size(); j++) {
-        uint8_t* dataPtr;
-        auto tensor = get_input_tensors()[j];
-        auto reg_id = tensor->get_attr<int32_t>("reg_id"); 
-        const auto inSize = tensor->get_element_num()/batch_size_;
-        if (create_tb_batch) {
-          auto dims_size = (tensor->get_shape()).size();
-          auto dims = std::vector<int32_t>(dims_size, 0);
-          dims[0] = i;
-          dataPtr = ((uint8_t*)input_tensor_buffers[j]->data(dims).first);
+  for (auto c : count)
+    if (c != per_tensor)
+      return {};
+  return ordered;
+}
+
+bool DpuCloudController::bind_registered(IoBinding &binding, bool create_tb_batch, int inputBs) {
+  // address registers of engines left out would keep pointing at whatever
+  // the previous job used, which may be another request's registered memory
+  if (!split_io || inputBs != batch_size_)
+    return false;
+  std::unique_lock<std::mutex> lock(user_mem_mtx_);
+  return bind_registered(binding, user_mem_, model_->get_input_io(), model_->get_output_io(),
+    num_reg_ids_, create_tb_batch, inputBs);
+}
+
+bool DpuCloudController::bind_registered(IoBinding &binding, const UserMemRegistry &user_mem,
+    const std::vector<DpuXmodel::io_tensor> &input_io, const std::vector<DpuXmodel::io_tensor> &output_io,
+    int num_reg_ids, bool create_tb_batch, int inputBs) {
+  if (user_mem.regions().empty())
+    return false;
+  auto io_addrs = std::make_shared<DpuAddrTable>(num_reg_ids, inputBs);
+  std::vector<uint64_t> ptrs[2];
+  std::vector<std::pair<xclBufferHandle, size_t>> bos[2];
+  for (int dir=0; dir < 2; dir++) {
+    const auto &tensors = dir == 0 ? input_io : output_io;
+    auto ordered = order_by_tensor(dir == 0 ? binding.inputs : binding.outputs, tensors, create_tb_batch, inputBs);
+    if (ordered.empty())
+      return false;
+    for (unsigned k=0; k < ordered.size(); k++) {
+      const auto &io = tensors[k % tensors.size()];
+      auto *user = ordered[k]->get_tensor();
+      const auto user_type = user->get_data_type();
+      const auto model_type = io.tensor->get_data_type();
+      if (user_type.type != model_type.type || user_type.bit_width != model_type.bit_width
+          || user->get_element_num() / user->get_shape()[0] != int64_t(io.size)
+          || is_nchw_of(user, io.tensor)
+          || (create_tb_batch && user->get_shape()[0] < inputBs))
+        return false;
+    }
+    ptrs[dir] = host_batch_ptrs(ordered, create_tb_batch, inputBs, tensors);
+    for (int i=0; i < inputBs; i++) {
+      for (unsigned j=0; j < tensors.size(); j++) {
+        const auto &io = tensors[j];
+        const uint64_t ptr = ptrs[dir][i*tensors.size()+j];
+        auto *region = user_mem.find(reinterpret_cast<const void*>(ptr), io.size);
+        if (region == nullptr)
+          return false;
+        const size_t offset = ptr - region->start;
+        const uint64_t addr = region->paddr + offset - io.offset;
+        // tensors sharing a reg_id must keep the model's offsets between them
+        if (io_addrs->is_set(io.reg_id, i)) {
+          if (io_addrs->get(io.reg_id, i) != addr)
+            return false;
         } else {
-          auto dims = input_tensor_buffers[i*model_->get_input_offset().size()+j]->get_tensor()->get_shape();
-          auto idx = std::vector<int32_t>(dims.size(), 0);
-          dataPtr =(uint8_t*)input_tensor_buffers[i*model_->get_input_offset().size()+j]->data(idx).first;
+          io_addrs->set(io.reg_id, i, addr);
         }
-        if (xclUnmgdPwrite(xcl_handle, 0, (void *)dataPtr, inSize,
-          get_addr(reg_id, i, xdpu_total_dpureg_map_io) + model_->get_input_offset()[j]))
-          throw std::runtime_error("Error: upload failed");
+        bos[dir].emplace_back(region->bo, offset);
       }
+    }
+  }
+  LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+    << "user buffers bound through registered memory";
+  binding.registered = true;
+  binding.io_addrs = io_addrs;
+  binding.in_ptrs = std::move(ptrs[0]);
+  binding.out_ptrs = std::move(ptrs[1]);
+  binding.in_bos = std::move(bos[0]);
+  binding.out_bos = std::move(bos[1]);
+  return true;
+}
+
+std::pair<std::shared_ptr<const DpuIoBinding>, std::shared_ptr<const DpuIoBinding>> DpuCloudController::chain(
+    const DpuIoBinding &upstream, const DpuIoBinding &downstream, bool download_chained) {
+  if (downstream.owner != this)
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  auto *down = dynamic_cast<const IoBinding*>(&downstream);
+  // bound by DpuController::bind() (V3ME): io is resolved per run
+  if (!down)
+    return DpuController::chain(upstream, downstream, download_chained);
+  auto *up = dynamic_cast<const IoBinding*>(&upstream);
+  if (!up)
+    throw std::runtime_error("Error: upstream binding cannot be chained");
+  auto *up_ctrl = static_cast<const DpuCloudController*>(up->owner);
+  if (up_ctrl->device_index_ != device_index_)
+    throw std::runtime_error("Error: chained runners must be on the same device");
+  auto chained = chain_of(*up, up_ctrl->model_->get_output_io(), up_ctrl->split_io,
+    *down, model_->get_input_io(), model_->get_output_io(), split_io, get_hbmio(), download_chained);
+  return {chained.first, chained.second};
+}
 
+std::pair<std::shared_ptr<DpuCloudController::IoBinding>, std::shared_ptr<DpuCloudController::IoBinding>> DpuCloudController::chain_of(
+    const IoBinding &up, const std::vector<DpuXmodel::io_tensor> &up_io, bool up_split_io,
+    const IoBinding &down, const std::vector<DpuXmodel::io_tensor> &down_io,
+    const std::vector<DpuXmodel::io_tensor> &down_outputs, bool down_split_io,
+    const std::vector<unsigned> &banks, bool download_chained) {
+  // without split io a reg_id's buffer holds inputs and outputs together
+  if (!up_split_io || !down_split_io)
+    throw std::runtime_error("Error: chained subgraphs need split io");
+  // staged bindings get new device addresses on every run
+  if (!up.io_addrs || !down.io_addrs)
+    throw std::runtime_error("Error: chained bindings need runner-allocated, phy or registered buffers");
+  if (up.inputBs != down.inputBs)
+    throw std::runtime_error("Error: chained bindings differ in batch");
+  for (auto bank : up.io_banks)
+    if (std::find(banks.begin(), banks.end(), bank) == banks.end())
+      throw std::runtime_error("Error: upstream io bank " + std::to_string(bank) + " is not connected to this CU");
+
+  auto chained_up = std::make_shared<IoBinding>(up);
+  auto chained_down = std::make_shared<IoBinding>(down);
+  auto io_addrs = std::make_shared<DpuAddrTable>(*down.io_addrs);
+  if (chained_up->out_on_device.empty())
+    chained_up->out_on_device.assign(up.inputBs * up_io.size(), false);
+  chained_down->in_on_device.assign(down.inputBs * down_io.size(), false);
+  // where each chained input is, per (batch element, tensor)
+  std::vector<uint64_t> src_addrs(down.inputBs * down_io.size());
+  for (unsigned j=0; j < down_io.size(); j++) {
+    const auto &name = down_io[j].tensor->get_name();
+    auto src = std::find_if(up_io.begin(), up_io.end(),
+      [&name](const DpuXmodel::io_tensor &io) { return io.tensor->get_name() == name; });
+    if (src == up_io.end())
+      continue;
+    if (src->size != down_io[j].size)
+      throw std::runtime_error("Error: chained tensor " + name + " differs in size");
+    // downstream would write that output over upstream's
+    for (auto &out : down_outputs)
+      if (out.reg_id == down_io[j].reg_id)
+        throw std::runtime_error("Error: chained input " + name + " shares reg_id "
+          + std::to_string(out.reg_id) + " with an output");
+    const unsigned k = src - up_io.begin();
+    for (int i=0; i < down.inputBs; i++) {
+      const uint64_t addr = up.io_addrs->get(src->reg_id, i) + src->offset;
+      src_addrs[i*down_io.size()+j] = addr;
+      io_addrs->set(down_io[j].reg_id, i, addr - down_io[j].offset);
+      chained_down->in_on_device[i*down_io.size()+j] = true;
+      if (!download_chained) {
+        if (up.topk && up.topk->output == k)
+          throw std::runtime_error("Error: chained output " + name + " is post-processed upstream, chain with download_chained");
+        chained_up->out_on_device[i*up_io.size()+k] = true;
+      }
+      LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+        << "chained input " << name << " engine " << i << " phy_addr: " << std::hex << addr;
+    }
+  }
+  if (std::find(chained_down->in_on_device.begin(), chained_down->in_on_device.end(), true)
+      == chained_down->in_on_device.end())
+    throw std::runtime_error("Error: no input of the downstream subgraph is an upstream output");
+  // one base address per reg_id and engine: every tensor in a chained reg
+  // must be chained, at the offsets the upstream DPU wrote them
+  for (int i=0; i < down.inputBs; i++) {
+    for (unsigned j=0; j < down_io.size(); j++) {
+      const auto &io = down_io[j];
+      const bool on_device = chained_down->in_on_device[i*down_io.size()+j];
+      for (unsigned m=0; m < down_io.size(); m++)
+        if (down_io[m].reg_id == io.reg_id && chained_down->in_on_device[i*down_io.size()+m] != on_device)
+          throw std::runtime_error("Error: chained and uploaded inputs share reg_id " + std::to_string(io.reg_id));
+      if (on_device && io_addrs->get(io.reg_id, i) + io.offset != src_addrs[i*down_io.size()+j])
+        throw std::runtime_error("Error: chained inputs sharing reg_id " + std::to_string(io.reg_id)
+          + " are laid out differently upstream");
     }
+  }
+  chained_down->io_addrs = io_addrs;
+  return {chained_up, chained_down};
+}
+
+std::shared_ptr<const DpuIoBinding> DpuCloudController::with_topk(const DpuIoBinding &bound, const DpuTopK &topk) {
+  if (bound.owner != this)
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  auto *binding = dynamic_cast<const IoBinding*>(&bound);
+  // bound by DpuController::bind() (V3ME): io is resolved per run
+  if (!binding)
+    return DpuController::with_topk(bound, topk);
+  const auto &output_io = model_->get_output_io();
+  if (topk.output >= output_io.size())
+    throw std::runtime_error("Error: topk output " + std::to_string(topk.output) + " out of range");
+  if (topk.k == 0 || topk.results == nullptr)
+    throw std::runtime_error("Error: topk needs k > 0 and a result array");
+  if (binding->tensorbuffer_phy)
+    throw std::runtime_error("Error: topk needs outputs downloaded to host");
+  for (size_t i=topk.output; i < binding->out_on_device.size(); i += output_io.size())
+    if (binding->out_on_device[i])
+      throw std::runtime_error("Error: topk output is left on the device by chain()");
+  auto with = std::make_shared<IoBinding>(*binding);
+  with->topk = std::make_shared<const DpuTopK>(topk);
+  // post-processing reads the output right after the run
+  for (size_t i=topk.output; i < with->lazy_outs.size(); i += output_io.size())
+    with->lazy_outs[i] = {nullptr, 0};
+  // the results replace the output's copy into user buffers
+  with->out_copies.erase(std::remove_if(with->out_copies.begin(), with->out_copies.end(),
+    [&](const TransCopy &c) { return c.staging % output_io.size() == topk.output; }),
+    with->out_copies.end());
+  return with;
+}
+
+std::shared_ptr<const DpuIoBinding> DpuCloudController::with_batch(const DpuIoBinding &bound, unsigned batch) {
+  if (bound.owner != this)
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  auto *binding = dynamic_cast<const IoBinding*>(&bound);
+  // bound by DpuController::bind() (V3ME): io is resolved per run
+  if (!binding)
+    return DpuController::with_batch(bound, batch);
+  return with_batch_of(*binding, batch, model_->get_input_io().size(), model_->get_output_io().size());
+}
+
+std::shared_ptr<DpuCloudController::IoBinding> DpuCloudController::with_batch_of(const IoBinding &binding, unsigned batch,
+    size_t num_inputs, size_t num_outputs) {
+  if (batch == 0 || batch > unsigned(binding.inputBs))
+    throw std::runtime_error("Error: batch " + std::to_string(batch) + " out of range, binding holds "
+      + std::to_string(binding.inputBs));
+  auto with = std::make_shared<IoBinding>(binding);
+  with->liveBs = batch;
+  // staged copies are numbered [batch element][tensor]
+  auto idle = [&](size_t num_tensors) {
+    return [=](const TransCopy &c) { return c.staging / num_tensors >= batch; };
+  };
+  with->in_copies.erase(std::remove_if(with->in_copies.begin(), with->in_copies.end(),
+    idle(num_inputs)), with->in_copies.end());
+  with->out_copies.erase(std::remove_if(with->out_copies.begin(), with->out_copies.end(),
+    idle(num_outputs)), with->out_copies.end());
+  return with;
+}
+
+std::shared_ptr<const DpuIoBinding> DpuCloudController::with_lazy_outputs(const DpuIoBinding &bound) {
+  if (bound.owner != this)
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  auto *binding = dynamic_cast<const IoBinding*>(&bound);
+  // bound by DpuController::bind() (V3ME): io is resolved per run
+  if (!binding)
+    return DpuController::with_lazy_outputs(bound);
+  return with_lazy_outputs_of(*binding, model_->get_output_io());
+}
+
+std::shared_ptr<DpuCloudController::IoBinding> DpuCloudController::with_lazy_outputs_of(const IoBinding &binding,
+    const std::vector<DpuXmodel::io_tensor> &output_io) {
+  auto with = std::make_shared<IoBinding>(binding);
+  if (binding.tensorbuffer_phy)
+    return with;
+  if (!binding.io_addrs || binding.registered)
+    throw std::runtime_error("Error: lazy outputs need runner-allocated output buffers");
+  const int inputBs = binding.inputBs;
+  auto ordered = order_by_tensor(binding.outputs, output_io, binding.create_tb_batch, inputBs);
+  if (ordered.empty())
+    throw std::runtime_error("Error: invilad tensorbuffer output");
+  with->lazy_outs.assign(inputBs * output_io.size(), {nullptr, 0});
+  for (int i=0; i < inputBs; i++) {
+    for (unsigned j=0; j < output_io.size(); j++) {
+      if (binding.topk && binding.topk->output == j)
+        continue;
+      auto *tb = binding.create_tb_batch ? ordered[j] : ordered[i*output_io.size()+j];
+      auto *host = dynamic_cast<vart::TensorBufferExtImpHost*>(tb);
+      if (!host)
+        throw std::runtime_error("Error: lazy outputs need runner-allocated output buffers");
+      with->lazy_outs[i*output_io.size()+j] = {host, binding.create_tb_batch ? i : 0};
+    }
+  }
+  return with;
+}
+
+bool DpuCloudController::register_memory(void *ptr, size_t size) {
+  if (!binds_io_)
+    return DpuController::register_memory(ptr, size);
+  if (reinterpret_cast<uintptr_t>(ptr) % rte::getpagesize())
+    throw std::runtime_error("Error: registered memory must be page aligned");
+  std::unique_lock<std::mutex> lock(user_mem_mtx_);
+  if (user_mem_.find(ptr, size))
+    return true;
+  if (user_mem_handle_ == nullptr) {
+    user_mem_handle_ = xclOpen(device_index_, NULL, XCL_INFO);
+    if (user_mem_handle_ == nullptr)
+      throw std::runtime_error("Error: xclOpen failed for registered memory");
+  }
+  xclBufferHandle bo = NULLBO;
+  for (auto bank : get_hbmio()) {
+    bo = xclAllocUserPtrBO(user_mem_handle_, ptr, size, bank);
+    if (bo != NULLBO)
+      break;
+  }
+  if (bo == NULLBO) {
+    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+      << "cannot pin " << size << " bytes of user memory, runs will stage it";
+    return false;
+  }
+  xclBOProperties p;
+  xclGetBOProperties(user_mem_handle_, bo, &p);
+  try {
+    user_mem_.add({reinterpret_cast<uintptr_t>(ptr), size, bo, p.paddr});
+  } catch (...) {
+    xclFreeBO(user_mem_handle_, bo);
+    throw;
+  }
+  LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+    << "registered user memory size: " << size << " phy_addr: " << std::hex << p.paddr;
+  return true;
+}
+
+void DpuCloudController::unregister_memory(void *ptr) {
+  if (!binds_io_)
+    return DpuController::unregister_memory(ptr);
+  std::unique_lock<std::mutex> lock(user_mem_mtx_);
+  UserMemRegistry::Region region;
+  if (!user_mem_.remove(ptr, region))
+    throw std::runtime_error("Error: memory was not registered");
+  xclFreeBO(user_mem_handle_, region.bo);
+}
+
+void DpuCloudController::run_bound(const DpuIoBinding &bound) {
+  if (bound.owner != this)
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  const auto &binding = static_cast<const IoBinding&>(bound);
+  // batch elements moved and dumped; every engine still runs
+  const int inputBs = binding.live_batch();
+  const bool create_tb_batch = binding.create_tb_batch;
+  const bool tensorbuffer_phy = binding.tensorbuffer_phy;
+  const bool staged = !binding.io_addrs;
+  const auto &input_io = model_->get_input_io();
+  const auto &output_io = model_->get_output_io();
+  std::vector<vart::TensorBuffer*> staged_inputs;
+  std::vector<vart::TensorBuffer*> staged_outputs;
+  uint32_t buf_id = 0;
+  auto io_addrs = binding.io_addrs;
+  if (staged) {
+    buf_id = acquire_staging(staged_inputs, staged_outputs);
+    apply_tensorbuffer_trans(binding.in_copies, staged_inputs, true);
+    io_addrs = get_dpu_reg_inside(create_tb_batch, staged_outputs, staged_inputs);
+  }
+  // host address of each (batch element, tensor), resolved at bind() unless staged
+  std::vector<uint64_t> staged_in_ptrs;
+  std::vector<uint64_t> staged_out_ptrs;
+  if (staged) {
+    staged_in_ptrs = host_batch_ptrs(staged_inputs, create_tb_batch, inputBs, input_io);
+    staged_out_ptrs = host_batch_ptrs(staged_outputs, create_tb_batch, inputBs, output_io);
+  }
+  const auto &in_ptrs = staged ? staged_in_ptrs : binding.in_ptrs;
+  const auto &out_ptrs = staged ? staged_out_ptrs : binding.out_ptrs;
+  const unsigned worker_id = engine_.get_my_worker_id();
+  auto &context = contexts_[worker_id];
+  auto xcl_handle = context.get_dev_handle();
+  auto bo_handle = context.get_bo_handle();
+  auto bo_addr = context.get_bo_addr();
+
+  const DpuAddrTable &xdpu_total_dpureg_map_io = *io_addrs;
+  DpuRunSample sample;
+  sample.batch = inputBs;
+  sample.programmed_batch = batch_size_;
+  DpuRunSample *profiled = dpu_profile_ ? &sample : nullptr;
+  auto phase_start = std::chrono::steady_clock::now();
+  auto phase_ns = [&phase_start]() {
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - phase_start).count();
+    phase_start = now;
+    return ns;
+  };
+  if (!tensorbuffer_phy) {
+  __TIC__(INPUT_H2D)
+    upload_inputs(binding, input_io, xdpu_total_dpureg_map_io, in_ptrs, xcl_handle, user_mem_handle_);
   __TOC__(INPUT_H2D)
+    if (profiled)
+      sample.h2d_ns = phase_ns();
   }
+  if (profiled)
+    phase_ns();
   auto ecmd = reinterpret_cast<ert_start_kernel_cmd*>(bo_addr);
   ecmd->cu_mask =  handle_->get_device_info().cu_mask;
   ecmd->extra_cu_masks = 0;
@@ -1426,7 +2207,7 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
 
   // program DPU request
   //
-  auto dbg_layers = model_->get_dbg_layers();
+  const auto &dbg_layers = model_->get_dbg_layers();
   if(!debug_mode_) { //=== run release instructions
     if(dump_mode_ ) { // dump input
       int tensor_idx = 0;
@@ -1435,8 +2216,8 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
         auto size = std::get<1>(out);
         auto data = std::make_unique<char[]>(size);
         auto reg_id = std::get<3>(out);
-        for (int i=0; i < batch_size_; i++) {
-          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, get_addr(reg_id,i,xdpu_total_dpureg_map_io) + offset))
+        for (int i=0; i < inputBs; i++) {
+          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, xdpu_total_dpureg_map_io.get(reg_id, i) + offset))
             throw std::runtime_error("Error: dump failed!");
           std::stringstream ss;
           ss << dump_folder_ << "/E" << i << "/" << std::get<2>(out);
@@ -1448,11 +2229,13 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
       }
     }
 
-    auto info = model_->get_subgraph_info();
+    const auto &info = model_->get_subgraph_info();
 #ifndef _WIN32
     vitis::ai::trace::add_trace("dpu-runner", info.name, batch_size_, info.workload, info.depth);
 #endif
-    dpu_trigger_run(ecmd,xcl_handle, bo_handle, xdpu_total_dpureg_map_io);
+    dpu_trigger_run(ecmd,xcl_handle, bo_handle, get_program(), xdpu_total_dpureg_map_io, profiled);
+    if (profiled)
+      sample.exec_ns = phase_ns();
 
     if(dump_mode_ ) {  // dump final output
       int tensor_idx = 0;
@@ -1461,8 +2244,8 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
         auto size = std::get<1>(out);
         auto data = std::make_unique<char[]>(size);
         auto reg_id = std::get<3>(out);
-        for (int i=0; i < batch_size_; i++) {
-          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, get_addr(reg_id, i,xdpu_total_dpureg_map_io) + offset))
+        for (int i=0; i < inputBs; i++) {
+          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, xdpu_total_dpureg_map_io.get(reg_id, i) + offset))
             throw std::runtime_error("Error: dump failed!");
           std::stringstream ss;
           ss << dump_folder_ << "/E" << i << "/" << std::get<2>(out);
@@ -1483,8 +2266,8 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
         auto size = std::get<1>(input);
         auto data = std::make_unique<char[]>(size);
         auto reg_id = std::get<3>(input);
-        for (int i=0; i < batch_size_; i++) {
-          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, get_addr(reg_id, i, xdpu_total_dpureg_map_io) + offset))
+        for (int i=0; i < inputBs; i++) {
+          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, xdpu_total_dpureg_map_io.get(reg_id, i) + offset))
             throw std::runtime_error("Error: dump failed!");
           std::stringstream ss;
           ss << dump_folder_ << "/E" << i << "/" << std::get<2>(input);
@@ -1497,16 +2280,18 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
     }
 
     int layer_idx = 0;
+    // each layer's code in turn; workers may run this concurrently
+    auto program = get_program();
     for(auto iter = dbg_layers.begin() + 1;iter != dbg_layers.end();iter++) {
-      auto layer = *iter;
+      const auto &layer = *iter;
       auto code_info = layer_debug_mode.find(layer.name);
       if (code_info != layer_debug_mode.end()) {
         if((code_info->second).second>0) {
-          code_addr_ = (code_info->second).first;
+          program.code_addr = (code_info->second).first;
           auto code_info_pre = layer_debug_mode_preload.find(layer.name);
           if (code_info_pre != layer_debug_mode_preload.end()) {
             if((code_info_pre->second).second>0) {
-              preload_code_addr_ = (code_info_pre->second).first;
+              program.preload_code_addr = (code_info_pre->second).first;
             }
           }
         }
@@ -1514,7 +2299,11 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
 #ifndef _WIN32
         vitis::ai::trace::add_trace("dpu-runner", layer.name, batch_size_, layer.workload, layer.depth);
 #endif
-        dpu_trigger_run(ecmd,xcl_handle, bo_handle, xdpu_total_dpureg_map_io);
+        if (profiled)
+          phase_ns();
+        dpu_trigger_run(ecmd,xcl_handle, bo_handle, program, xdpu_total_dpureg_map_io, profiled);
+        if (profiled)
+          sample.exec_ns += phase_ns();
       }
 
       // Save the outputs to file
@@ -1525,14 +2314,14 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
           auto size = std::get<1>(out);
           auto reg_id = std::get<3>(out);
           auto data = std::make_unique<char[]>(size);
-          if(check_exist(reg_id, model_->get_output_regid())) {
-            for (auto it :  xdpu_total_dpureg_map_io ) {
-              auto regid = std::get<0>(it);
-              if (regid == reg_id) {
-                if (xclUnmgdPread(xcl_handle, 0, data.get(), size, std::get<2>(it) + offset))
+          if(model_->is_output_regid(reg_id)) {
+            for (auto &it :  xdpu_total_dpureg_map_io.entries() ) {
+              auto regid = it.reg_id;
+              if (regid == reg_id && it.idx < inputBs) {
+                if (xclUnmgdPread(xcl_handle, 0, data.get(), size, it.addr + offset))
                   throw std::runtime_error("Error: dump failed!");
                 std::stringstream ss;
-                ss << dump_folder_ << "/E" << std::get<1>(it) << "/" << std::get<2>(out);
+                ss << dump_folder_ << "/E" << it.idx << "/" << std::get<2>(out);
                 std::ofstream ofs(ss.str(), std::ofstream::binary);
                 ofs.write(data.get(), size);
                 ofs.close();
@@ -1542,7 +2331,7 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
             auto iter3 = workspace_addr.begin();
             while(iter3 != workspace_addr.end() ) {
               if(iter3->first == reg_id) {
-                for (int bz=0;bz<batch_size_;bz++) {
+                for (int bz=0;bz<inputBs;bz++) {
                   if (xclUnmgdPread(xcl_handle, 0, data.get(), size, iter3->second[bz] + offset))
                     throw std::runtime_error("Error: dump failed!");
                   std::stringstream ss;
@@ -1564,40 +2353,96 @@ void DpuCloudController::run(const std::vector<vart::TensorBuffer*> &inputs,
     }
   }
 
+  if (profiled)
+    phase_ns();
   if (!tensorbuffer_phy) {
   __TIC__(OUTPUT_D2H)
-    for (int i=0; i < inputBs; i++)
-    {
-      auto output_size = model_->get_output_offset().size();
-      for (unsigned j=0; j< output_size; j++) {
-        auto tensor = get_output_tensors()[j];
-        const auto outSize = tensor->get_element_num()/batch_size_;
-        int8_t* dataPtr;
-        auto reg_id = tensor->get_attr<int32_t>("reg_id");
-        if (create_tb_batch) {
-          auto dims_size = (tensor->get_shape()).size();
-          auto dims = std::vector<int32_t>(dims_size, 0u);
-          dims[0] = i;
-          dataPtr = ((int8_t *)output_tensor_buffers[j]->data(dims).first);
-        } else {
-          auto dims = output_tensor_buffers[i*output_size+j]->get_tensor()->get_shape();
-          auto idx = std::vector<int32_t>(dims.size(), 0u);
+    download_outputs(binding, output_io, xdpu_total_dpureg_map_io, out_ptrs, xcl_handle, user_mem_handle_,
+      mem_handle_, dpu_profile_, sample);
+  __TOC__(OUTPUT_D2H)
+    if (profiled)
+      sample.d2h_ns = phase_ns();
+  }
+  run_topk(binding, output_io, model_->get_output_scales(), out_ptrs);
+  if (profiled)
+    dpu_profile_->record(sample);
+  if (staged) {
+    apply_tensorbuffer_trans(binding.out_copies, staged_outputs, false);
+    release_staging(staged_inputs, staged_outputs, buf_id);
+  }
 
-          dataPtr = (int8_t *)output_tensor_buffers[i*model_->get_output_offset().size()+j]->data(idx).first;
-        }
-        //__TIC_PROFILING__(OUTPUT)
-        if (xclUnmgdPread(xcl_handle, 0, (void*)dataPtr,
-          outSize,
-          get_addr(reg_id,i, xdpu_total_dpureg_map_io)+ model_->get_output_offset()[j]))
-          throw std::runtime_error("Error: download failed");
-        //__TOC_PROFILING__(OUTPUT)
+}
+
+void DpuCloudController::upload_inputs(const IoBinding &binding, const std::vector<DpuXmodel::io_tensor> &input_io,
+    const DpuAddrTable &io_addrs, const std::vector<uint64_t> &in_ptrs, xclDeviceHandle xcl_handle, xclDeviceHandle user_mem_handle) {
+  for (int i=0; i < binding.live_batch(); i++)
+  {
+    for (unsigned j=0; j < input_io.size(); j++) {
+      const auto &io = input_io[j];
+      // written in place by the upstream DPU
+      if (!binding.in_on_device.empty() && binding.in_on_device[i*input_io.size()+j])
+        continue;
+      if (binding.registered) {
+        // DMA from the pinned user pages into the BO's device copy
+        const auto &bo = binding.in_bos[i*input_io.size()+j];
+        if (xclSyncBO(user_mem_handle, bo.first, XCL_BO_SYNC_BO_TO_DEVICE, io.size, bo.second))
+          throw std::runtime_error("Error: upload failed");
+        continue;
       }
+      uint8_t* dataPtr = (uint8_t*)in_ptrs[i*input_io.size()+j];
+      if (xclUnmgdPwrite(xcl_handle, 0, (void *)dataPtr, io.size,
+        io_addrs.get(io.reg_id, i) + io.offset))
+        throw std::runtime_error("Error: upload failed");
     }
-  __TOC__(OUTPUT_D2H)
-  }
-  if((!tensorbuffer_phy) &&create_tb_outside) {
-    tensorbuffer_trans(input_tensor_buffers, output_tensor_buffers,inputs,outputs, false, buf_id);
   }
+}
 
+void DpuCloudController::download_outputs(const IoBinding &binding, const std::vector<DpuXmodel::io_tensor> &output_io,
+    const DpuAddrTable &io_addrs, const std::vector<uint64_t> &out_ptrs, xclDeviceHandle xcl_handle, xclDeviceHandle user_mem_handle,
+    const std::shared_ptr<void> &mem_handle, DpuModelProfile *profile, DpuRunSample &sample) {
+  const auto output_size = output_io.size();
+  for (int i=0; i < binding.live_batch(); i++)
+  {
+    for (unsigned j=0; j< output_size; j++) {
+      const auto &io = output_io[j];
+      // read in place by the downstream DPU
+      if (!binding.out_on_device.empty() && binding.out_on_device[i*output_size+j])
+        continue;
+      // fetched from the device when the app reads it, if ever
+      if (!binding.lazy_outs.empty() && binding.lazy_outs[i*output_size+j].first) {
+        const auto &lazy = binding.lazy_outs[i*output_size+j];
+        const uint64_t addr = io_addrs.get(io.reg_id, i) + io.offset;
+        auto mem = mem_handle;
+        lazy.first->set_pending(lazy.second, [mem, addr, profile](void *dst, size_t offset, size_t size) {
+          if (xclUnmgdPread(mem.get(), 0, dst, size, addr + offset))
+            throw std::runtime_error("Error: download failed");
+          if (profile)
+            profile->record_fetched(size);
+        });
+        sample.d2h_deferred_bytes += io.size;
+        continue;
+      }
+      if (binding.registered) {
+        const auto &bo = binding.out_bos[i*output_size+j];
+        if (xclSyncBO(user_mem_handle, bo.first, XCL_BO_SYNC_BO_FROM_DEVICE, io.size, bo.second))
+          throw std::runtime_error("Error: download failed");
+        continue;
+      }
+      int8_t* dataPtr = (int8_t *)out_ptrs[i*output_size+j];
+      if (xclUnmgdPread(xcl_handle, 0, (void*)dataPtr,
+        io.size,
+        io_addrs.get(io.reg_id, i)+ io.offset))
+        throw std::runtime_error("Error: download failed");
+    }
+  }
 }
 
+void DpuCloudController::run_topk(const IoBinding &binding, const std::vector<DpuXmodel::io_tensor> &output_io,
+    const std::vector<float> &output_scales, const std::vector<uint64_t> &out_ptrs) {
+  if (!binding.topk)
+    return;
+  const auto &topk = *binding.topk;
+  for (int i=0; i < binding.live_batch(); i++)
+    softmax_topk(reinterpret_cast<const int8_t*>(out_ptrs[i*output_io.size()+topk.output]),
+      output_io[topk.output].size, output_scales[topk.output], topk.k, topk.results + i*topk.k);
+}
@@ -13,11 +13,19 @@
 // limitations under the License.
 
 #pragma once
+#include "cu_scheduler.hpp"
+#include "dpu_addr_table.hpp"
 #include "dpu_controller.hpp"
+#include "dpu_profile.hpp"
 #include "graph.hpp"
+#include "hbm_placement.hpp"
 #include "tensor_buffer_imp_host.hpp"
 #include "tensor_buffer_imp_view.hpp"
 #include "tensor_buffer_imp_host_phy.hpp"
+#include "user_mem_registry.hpp"
+#include <atomic>
+#include <functional>
+#include <map>
 #include <queue>
 #include "blockingconcurrentqueue.hpp"
 //
@@ -91,6 +99,38 @@ class DpuCloudController
   virtual void run(
     const std::vector<vart::TensorBuffer*> &inputs,
     const std::vector<vart::TensorBuffer*> &outputs) override;
+  // batch layout, tensor name matching, scales and device addresses are
+  // resolved here; run_bound() only moves data and triggers the DPU
+  virtual std::shared_ptr<const DpuIoBinding> bind(
+    const std::vector<vart::TensorBuffer*> &inputs,
+    const std::vector<vart::TensorBuffer*> &outputs) override;
+  virtual void run_bound(const DpuIoBinding &binding) override;
+  // pin a page-aligned user region as a BO in one of our io banks; bind()
+  // then DMAs HOST_VIRT buffers inside it directly instead of staging them
+  virtual bool register_memory(void *ptr, size_t size) override;
+  virtual void unregister_memory(void *ptr) override;
+  // the output's int8 data is post-processed where it was downloaded to
+  // (before any dequantizing copy into user buffers, which is dropped)
+  virtual std::shared_ptr<const DpuIoBinding> with_topk(
+    const DpuIoBinding &binding, const DpuTopK &topk) override;
+  // only the first batch elements are uploaded, downloaded and dumped. The
+  // idle engines' address registers are still programmed: they run anyway,
+  // and a slot left out would keep the previous command's addresses, i.e.
+  // write into another request's buffers
+  virtual std::shared_ptr<const DpuIoBinding> with_batch(
+    const DpuIoBinding &binding, unsigned batch) override;
+  // our host output buffers are armed with a fetch of their device copy
+  // instead of being downloaded; phy ones are only read by sync_for_read()
+  // already and come back unchanged
+  virtual std::shared_ptr<const DpuIoBinding> with_lazy_outputs(
+    const DpuIoBinding &binding) override;
+  // inputs of downstream whose model tensor is one of upstream's outputs
+  // (same name) get their registers pointed at where upstream's DPU writes
+  // it and are no longer uploaded; upstream no longer downloads them unless
+  // download_chained. Both bindings must resolve addresses at bind(), both
+  // subgraphs have split io, and no chained reg_id holds an output
+  virtual std::pair<std::shared_ptr<const DpuIoBinding>, std::shared_ptr<const DpuIoBinding>> chain(
+    const DpuIoBinding &upstream, const DpuIoBinding &downstream, bool download_chained) override;
   virtual std::vector<const xir::Tensor*> get_input_tensors() const override;
   virtual std::vector<const xir::Tensor*> get_output_tensors() const override;
   virtual std::vector<vart::TensorBuffer*> get_inputs(int batchsz=-1) override;
@@ -98,26 +138,122 @@ class DpuCloudController
   virtual std::vector<vart::TensorBuffer*> get_outputs_inner(std::vector<unsigned> hbm,bool isInputs, int batchsz=-1) ;
   std::vector<float> get_input_scale() override;
   std::vector<float> get_output_scale() override;
+  virtual void fault_in_buffers() override;
+  virtual void init_worker(unsigned worker_id) override;
   //float get_input_scale(xir::Tensor* tensor);
   float get_output_scale(xir::Tensor* tensor);
   virtual std::vector<unsigned> get_hbmw();
   virtual std::vector<unsigned> get_hbmc();
   virtual std::vector<unsigned> get_hbmio();
+  virtual std::vector<unsigned> get_hbmws(); // workspace banks, default get_hbmio()
   virtual std::vector<vart::TensorBuffer*> create_tensor_buffers_hbm(
     const std::vector<const xir::Tensor*> &tensors, bool isInput, std::vector<unsigned> ddrBank,int batch_size);
 
   //virtual void init(const std::string &meta);
   //virtual void init(const xir::Subgraph* subgraph);
   virtual void init_graph(std::vector<unsigned> hbmw, std::vector<unsigned> hbmc, xir::Attrs* attrs);
+  // bank plan for this CU from the xclbin's MEM_TOPOLOGY/CONNECTIVITY
+  HbmPlan plan_hbm(unsigned num_weight_banks);
   virtual std::vector<const xir::Tensor*> get_merged_io_tensors(int size) const;
   virtual std::vector<vart::TensorBuffer*> init_tensor_buffer(std::vector<const xir::Tensor*> tensors, int batchSupport, unsigned runEngine=1);
   virtual std::vector<const xir::Tensor*> init_tensor(std::vector<const xir::Tensor*> tensors, int batchSupport, unsigned runEngine=1);
   virtual bool check_tensorbuffer_outside(const std::vector<vart::TensorBuffer*> &outputs);
   virtual void free_buffers(std::vector<vart::TensorBuffer*> &tbufs);
   virtual uint32_t tensorbuffer_trans(std::vector<vart::TensorBuffer*> &input_tensor_buffers, std::vector<vart::TensorBuffer*> &output_tensor_buffers, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs, bool is_input, uint32_t buf_id);
-  virtual std::vector<std::tuple<int, int,uint64_t>>  get_dpu_reg_inside(bool create_tb_batch, std::vector<vart::TensorBuffer*> &output_tensor_buffers, std::vector<vart::TensorBuffer*> &input_tensor_buffers );
-  std::vector<std::tuple<int, int,uint64_t>> get_dpu_reg_outside(bool create_tb_batch, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs);
-  std::vector<std::tuple<int, int,uint64_t>> get_dpu_reg_outside_hbm(bool create_tb_batch, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs);
+  // one copy between a user host buffer and our staging buffers
+  struct TransCopy {
+    unsigned staging;   // index into the staging buffers
+    char *user;         // user data, already offset to its batch element
+    bool is_float;      // user side is float, (de)quantize with scale
+    float scale;
+    size_t size;        // elements
+    unsigned channels;  // user side is NCHW with this many channels, 0 if NHWC
+  };
+  // user is the NCHW form of model's NHWC tensor (batch aside); a shape
+  // that reads the same both ways counts as NHWC
+  static bool is_nchw_of(const xir::Tensor *user, const xir::Tensor *model);
+  // (tensor, buffer) index pairs whose names match, in tensor order
+  static std::vector<std::pair<unsigned, unsigned>> match_tensor_names(const std::vector<const xir::Tensor*> &tensors, const std::vector<vart::TensorBuffer*> &buffers);
+  // match user host buffers to model tensors by name, in one direction;
+  // copies are numbered [batch element][tensor] of the staging buffers
+  std::vector<TransCopy> plan_tensorbuffer_trans(const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs, bool is_input);
+  static std::vector<TransCopy> plan_tensorbuffer_trans(const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs, bool is_input,
+    const std::vector<DpuXmodel::io_tensor> &input_io, const std::vector<DpuXmodel::io_tensor> &output_io, const std::vector<float> &scales, int batch_size);
+  static void apply_tensorbuffer_trans(const std::vector<TransCopy> &copies, const std::vector<vart::TensorBuffer*> &staging, bool is_input);
+  // staging buffers for user host buffers, from the pool or created per run
+  uint32_t acquire_staging(std::vector<vart::TensorBuffer*> &input_tensor_buffers, std::vector<vart::TensorBuffer*> &output_tensor_buffers);
+  void release_staging(std::vector<vart::TensorBuffer*> &input_tensor_buffers, std::vector<vart::TensorBuffer*> &output_tensor_buffers, uint32_t buf_id);
+  struct IoBinding : DpuIoBinding {
+    bool tensorbuffer_phy;
+    bool create_tb_batch;
+    int inputBs;
+    int liveBs = 0;  // set by with_batch(): elements moved per run, else inputBs
+    int live_batch() const { return liveBs ? liveBs : inputBs; }
+    // null for user host buffers: their staging buffers change per run
+    std::shared_ptr<const DpuAddrTable> io_addrs;
+    std::vector<TransCopy> in_copies;
+    std::vector<TransCopy> out_copies;
+    // host address per (batch element, tensor) for the upload/download loops
+    std::vector<uint64_t> in_ptrs;
+    std::vector<uint64_t> out_ptrs;
+    // user host buffers inside registered memory: synced through its BO,
+    // per (batch element, tensor), instead of unmanaged reads/writes
+    bool registered = false;
+    std::vector<std::pair<xclBufferHandle, size_t>> in_bos;  // BO, offset
+    std::vector<std::pair<xclBufferHandle, size_t>> out_bos;
+    // banks its io may be placed in, empty if unknown (user phy buffers)
+    std::vector<unsigned> io_banks;
+    // set by chain(), per (batch element, tensor): inputs the upstream DPU
+    // writes in place, outputs a downstream DPU reads in place
+    std::vector<bool> in_on_device;
+    std::vector<bool> out_on_device;
+    // set by with_lazy_outputs(), per (batch element, tensor): our host
+    // buffer and its batch index, null where the output is downloaded
+    std::vector<std::pair<vart::TensorBufferExtImpHost*, int32_t>> lazy_outs;
+  };
+  // with_batch() of one of our bindings, for a model with that many input
+  // and output tensors
+  static std::shared_ptr<IoBinding> with_batch_of(const IoBinding &binding, unsigned batch, size_t num_inputs, size_t num_outputs);
+  // chain() of two of our bindings, given each subgraph's io and split_io
+  // and the banks downstream's CU reaches
+  static std::pair<std::shared_ptr<IoBinding>, std::shared_ptr<IoBinding>> chain_of(
+    const IoBinding &up, const std::vector<DpuXmodel::io_tensor> &up_outputs, bool up_split_io,
+    const IoBinding &down, const std::vector<DpuXmodel::io_tensor> &down_inputs,
+    const std::vector<DpuXmodel::io_tensor> &down_outputs, bool down_split_io,
+    const std::vector<unsigned> &banks, bool download_chained);
+  // with_lazy_outputs() of one of our bindings to outputs output_io; each
+  // output but the topk one is armed by download_outputs()
+  static std::shared_ptr<IoBinding> with_lazy_outputs_of(const IoBinding &binding, const std::vector<DpuXmodel::io_tensor> &output_io);
+  // run_bound()'s transfers of the live batch elements, at the binding's
+  // host pointers (in_ptrs/out_ptrs unless staged). Registered buffers sync
+  // through their BOs on user_mem_handle; lazy outputs are armed with a
+  // fetch through mem_handle, which they keep open
+  static void upload_inputs(const IoBinding &binding, const std::vector<DpuXmodel::io_tensor> &input_io, const DpuAddrTable &io_addrs,
+    const std::vector<uint64_t> &in_ptrs, xclDeviceHandle xcl_handle, xclDeviceHandle user_mem_handle);
+  static void download_outputs(const IoBinding &binding, const std::vector<DpuXmodel::io_tensor> &output_io, const DpuAddrTable &io_addrs,
+    const std::vector<uint64_t> &out_ptrs, xclDeviceHandle xcl_handle, xclDeviceHandle user_mem_handle,
+    const std::shared_ptr<void> &mem_handle, DpuModelProfile *profile, DpuRunSample &sample);
+  // the binding's topk, if any, on its downloaded output
+  static void run_topk(const IoBinding &binding, const std::vector<DpuXmodel::io_tensor> &output_io, const std::vector<float> &output_scales,
+    const std::vector<uint64_t> &out_ptrs);
+  // user buffers in tensor order ([batch element][tensor] unless one buffer
+  // holds the batch); empty if a tensor has no or too many matches
+  static std::vector<vart::TensorBuffer*> order_by_tensor(const std::vector<vart::TensorBuffer*> &bufs, const std::vector<DpuXmodel::io_tensor> &tensors, bool create_tb_batch, int inputBs);
+  // resolve a binding of user host buffers through registered memory; false
+  // (binding untouched) unless every buffer lies in a registered region and
+  // matches its model tensor's type and size
+  bool bind_registered(IoBinding &binding, bool create_tb_batch, int inputBs);
+  // the same against user_mem for a full batch of inputBs engines, reg_ids
+  // below num_reg_ids; the caller holds user_mem's lock
+  static bool bind_registered(IoBinding &binding, const UserMemRegistry &user_mem,
+    const std::vector<DpuXmodel::io_tensor> &input_io, const std::vector<DpuXmodel::io_tensor> &output_io,
+    int num_reg_ids, bool create_tb_batch, int inputBs);
+  static std::vector<uint64_t> host_batch_ptrs(const std::vector<vart::TensorBuffer*> &bufs, bool create_tb_batch, int inputBs, const std::vector<DpuXmodel::io_tensor> &tensors);
+  // io addresses for our own buffers, cached per binding until one is freed
+  virtual std::shared_ptr<const DpuAddrTable> get_dpu_reg_inside(bool create_tb_batch, std::vector<vart::TensorBuffer*> &output_tensor_buffers, std::vector<vart::TensorBuffer*> &input_tensor_buffers );
+  // io addresses for user phy buffers, built per run
+  std::shared_ptr<const DpuAddrTable> get_dpu_reg_outside(bool create_tb_batch, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs);
+  std::shared_ptr<const DpuAddrTable> get_dpu_reg_outside_hbm(bool create_tb_batch, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs);
 //=======
 //  virtual void tensorbuffer_trans(std::vector<vart::TensorBuffer*> &input_tensor_buffers, std::vector<vart::TensorBuffer*> &output_tensor_buffers, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs, bool is_input);
 //  virtual std::vector<std::tuple<int, int,uint64_t>>  get_dpu_reg_inside(bool create_tb_batch, std::vector<vart::TensorBuffer*> &output_tensor_buffers, std::vector<vart::TensorBuffer*> &input_tensor_buffers );
@@ -125,25 +261,89 @@ class DpuCloudController
 //  std::vector<std::tuple<int, int,uint64_t>> get_dpu_reg_outside_hbm(bool create_tb_batch, const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs);
 //>>>>>>> origin/master
   std::vector<vart::TensorBuffer*> create_tensorbuffer_for_batch(std::vector<unsigned> hbm, bool isInputs, std::vector<const xir::Tensor*> tensors, std::vector<int> tensor_offset, int output_bz, bool isTensorsBatch);
-  void dpu_trigger_run(ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle, std::vector<std::tuple<int, int,uint64_t>> xdpu_total_dpureg_map2);
+  // what a command programs besides its io addresses; in debug mode the
+  // code addresses are those of one layer
+  struct DpuProgram {
+    uint64_t code_addr;
+    uint64_t preload_code_addr;
+    const std::vector<std::pair<int, int>> &param_reg_vals;  // also used by the preload
+    const std::vector<std::pair<int, int>> &workspace_reg_vals;
+  };
+  DpuProgram get_program() const {
+    return {code_addr_, preload_code_addr_, param_reg_vals_, workspace_reg_vals_};
+  }
+  // run the programmed job; on a CU timeout reset the worker's context and
+  // retry once, so the packet and handles may be replaced. With a sample the
+  // CU counters of the completed job are added to it
+  void dpu_trigger_run(ert_start_kernel_cmd*& ecmd, xclDeviceHandle& xcl_handle, xclBufferHandle& bo_handle, const DpuProgram &program, const DpuAddrTable &io_addrs, DpuRunSample *sample = nullptr);
+  bool dpu_trigger_once(ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle, const DpuProgram &program, const DpuAddrTable &io_addrs, DpuRunSample *sample);
+  // dpu_trigger_once() for the CU cu: the command is admitted by sched under
+  // preload key state and runs the preload program first when the lease asks
+  // for it or program_once_complete is clear (set here unless debug_mode)
+  static bool trigger_once(CuScheduler &sched, uint64_t state, std::atomic<int> &program_once_complete, bool debug_mode,
+    const DeviceInfo &cu, ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle,
+    const DpuProgram &program, const DpuAddrTable &io_addrs, DpuRunSample *sample);
+  // address register writes of the io bindings, in table order
+  static void append_io_reg_vals(std::vector<std::pair<int, int>> &regVals, const DpuAddrTable &io_addrs);
+  // submit ecmd and wait up to XLNX_DPU_TIMEOUT_MS; false on timeout or error
+  static bool exec_and_wait(ert_start_kernel_cmd* ecmd, xclDeviceHandle xcl_handle, xclBufferHandle bo_handle);
+  // after a timeout: reopen this worker's context and make the next command
+  // take the CU alone to redo the preload program (which resets the DPU)
+  void reset_cu(ert_start_kernel_cmd*& ecmd, xclDeviceHandle& xcl_handle, xclBufferHandle& bo_handle);
+  // run trigger(); if it times out, reset_cu() and run it once more. trigger
+  // must read the packet and handles through the references given here
+  void retry_on_hang(ert_start_kernel_cmd*& ecmd, xclDeviceHandle& xcl_handle, xclBufferHandle& bo_handle, const std::function<bool()> &trigger);
+  // the same for CU cu_index of device_index, reporting to CuHealth: hung on
+  // a timeout (retried after reset() if retry), healthy again once a command
+  // completes
+  static void retry_on_hang(size_t device_index, size_t cu_index, bool retry,
+    const std::function<void()> &reset, const std::function<bool()> &trigger);
+  virtual bool is_healthy() const override;
+  // device handle for long-lived BOs, closed by its last holder
+  static std::shared_ptr<void> open_mem_handle(size_t device_index);
   xclBufferHandle get_xrt_bo(void* data, int size, std::vector<unsigned> hbm);
   xclBufferHandle get_xrt_bo(void* data, int size, unsigned hbm);
+  // device index, blob md5, bank list (in allocation order)
+  using SharedBoKey = std::tuple<size_t, std::string, std::vector<unsigned>>;
+  // upload a read-only blob once per device/bank list, return its phy addr
+  uint64_t get_shared_bo(const std::string &md5, void* data, int size, std::vector<unsigned> hbm);
+  void release_shared_bos();
+  // drop one reference to key from shared_bos_, under weight_mtx_
+  void forget_shared_bo(const SharedBoKey &key);
+  // each bank's jobs in order, the banks concurrently; rethrows the first
+  // error once every bank is done
+  static void run_bank_uploads(std::map<unsigned, std::vector<std::function<void()>>> &bank_uploads);
+  std::vector<SharedBoKey> shared_bos_;
   std::unordered_map<vart::TensorBuffer*, std::unordered_map<int, std::vector<vart::TensorBuffer*>>> tbuf2hwbufsio_;
+  // create_tb_batch + bound output (then input) buffers, under hwbufio_mtx_
+  DpuAddrCache io_addr_cache_;
   std::mutex hwbufio_mtx_;
   std::list<std::unique_ptr<vart::TensorBuffer>> bufs_;
   std::unordered_map<vart::TensorBuffer*, vart::TensorBuffer*> bufsView2Phy_;
   std::list<std::unique_ptr<vart::TensorBufferExtImpView>> bufsView_;
-  std::vector<std::unique_ptr<XrtContext>> contexts_;
+  XrtWorkerContexts contexts_;
+  // owns code, params and workspace BOs from get_xrt_bo(); unlike the worker
+  // contexts it is never reset, so a CU reset leaves device memory alone
+  std::shared_ptr<void> mem_handle_;
   uint64_t code_addr_;
   uint64_t preload_code_addr_;
   uint64_t reg0_addr_;
-  int program_once_complete;
+  std::atomic<int> program_once_complete;
+  // admission on our CU, shared with other models pinned to it: a command
+  // re-runs the preload when another model's ran last
+  std::shared_ptr<CuScheduler> cu_sched_;
+  uint64_t preload_state_ = 0;  // key of the code, preload and param blobs
+  std::mutex reset_mtx_;
   //bool in_split;
   //bool out_split;
   std::vector<const xir::Tensor*> input_tensors_;
   std::vector<const xir::Tensor*> output_tensors_;
   int32_t xdpu_total_reg_size[3];
   std::unordered_map<int,uint64_t> xdpu_total_dpureg_map;
+  // register writes for params (also used by the preload) and workspaces
+  std::vector<std::pair<int, int>> param_reg_vals_;
+  std::vector<std::pair<int, int>> workspace_reg_vals_;
+  int num_reg_ids_ = 0;
   std::unordered_map<int32_t, int32_t> xdpu_total_reg_map;
   int32_t xdpu_total_out_size;
   int32_t xdpu_total_in_size;
@@ -155,8 +355,8 @@ class DpuCloudController
   std::vector<int32_t> getInputOffsets();
   size_t getOutputBufferSize();
   std::vector<int32_t> getOutputOffsets();
-  void data_float2fix(int8_t* dataDst, float* dataSrc, int size, float scale);
-  void data_fix2float(float* dataDst, int8_t* dataSrc, int size, float scale);
+  static void data_float2fix(int8_t* dataDst, float* dataSrc, int size, float scale);
+  static void data_fix2float(float* dataDst, int8_t* dataSrc, int size, float scale);
   bool dump_mode_;
   std::string dump_folder_;
   bool debug_mode_;
@@ -169,11 +369,21 @@ class DpuCloudController
   std::shared_ptr<DpuXmodel> model_;
   size_t cu_index_;
   size_t device_index_;
+  DpuModelProfile *dpu_profile_ = nullptr; // set with XLNX_DPU_PROFILE=1
+  // register_memory() regions; their BOs belong to user_mem_handle_, which
+  // a CU reset does not close
+  UserMemRegistry user_mem_;
+  xclDeviceHandle user_mem_handle_ = nullptr;
+  std::mutex user_mem_mtx_;
+  // false where bind() only records the buffers (V3ME): no run would read
+  // registered memory, so none is pinned
+  bool binds_io_ = true;
 
-  uint64_t get_addr(int32_t regid, int idx, std::vector<std::tuple<int, int,uint64_t>>& xdpu_total_dpureg_map_io);
  private:
   int flag;
   void init_profiler();
+  void init_dpu_profile();
+  void init_reg_vals();
   bool share;
   std::unordered_map<int, xir::Tensor*> tensors_map_;
   //std::unordered_map<string, xir::Tensor*> tensor_no_batch_map_;
@@ -89,6 +89,8 @@ DpuXmodel::DpuXmodel(const std::string meta): dump_mode_(false),debug_mode_(fals
 }
 
 DpuXmodel::~DpuXmodel() {
+  if (image_)
+    return; // blobs point into the cache mapping, released with image_
   auto iter = xdpu_code_map.begin();
   if (iter != xdpu_code_map.end()) {
     rte::aligned_ptr_deleter pDel;
@@ -229,6 +231,19 @@ void DpuXmodel::init_vitis_tensors(int batch_size, size_t device_index) {
       vitis_tensor->set_attrs(std::move(attrs));
       outtensors_.emplace_back(std::move(vitis_tensor));
   }
+  // resolve reg_id/size once, run() walks these per batch element
+  input_io_.clear();
+  for (unsigned int i=0; i< intensors_.size(); i++) {
+    auto tensor = intensors_[i].get();
+    input_io_.push_back({tensor, tensor->get_attr<int32_t>("reg_id"), xdpu_io_input_offset[i],
+      size_t(tensor->get_element_num()/batch_size)});
+  }
+  output_io_.clear();
+  for (unsigned int i=0; i< outtensors_.size(); i++) {
+    auto tensor = outtensors_[i].get();
+    output_io_.push_back({tensor, tensor->get_attr<int32_t>("reg_id"), xdpu_io_output_offset[i],
+      size_t(tensor->get_element_num()/batch_size)});
+  }
 }
 void DpuXmodel::init_graph(const xir::Subgraph* subgraph) {
   //auto handle = contexts_[0]->get_dev_handle();
@@ -245,118 +260,19 @@ void DpuXmodel::init_graph(const xir::Subgraph* subgraph) {
   subgraph_ = subgraph; // check subgraph_->get_name()
   vitis::ai::trace::add_subgraph(subgraph_);
 
-  // Get Reg ID size
-  size_t total_io_size = 0;
-  split_io = 0;
-  if (subgraph_->has_attr("reg_id_to_hw_segment")) {
-    auto reg_id_to_hw_segment =
-      subgraph_->template get_attr<std::map<std::string, std::string>>(
-          "reg_id_to_hw_segment");
-    for(auto &r : reg_id_to_hw_segment) {
-      auto reg_id_str = r.first;
-      int reg_id = reg_id_str[reg_id_str.length()-1]- '0';
-      xdpu_regid_to_hw_segment.emplace(std::make_pair(reg_id,r.second));
-    }
+  // with XLNX_MODEL_CACHE_DIR set, code/params, their md5s and the reg maps
+  // come from the on-disk cache instead of walking and hashing the attributes
+  const auto cache_dir = debug_mode_ ? std::string() : ModelImage::cache_dir();
+  uint64_t cache_key = 0;
+  if (!cache_dir.empty()) {
+    cache_key = get_cache_key();
+    image_ = ModelImage::load(cache_dir, cache_key);
   }
-  if (subgraph_->has_attr("reg_id_to_context_type_v2")) {
-
-    auto reg_id_to_context_type_v2 =
-      subgraph_->get_attr<std::map<std::string, std::string>>("reg_id_to_context_type_v2");
-    auto reg_id_to_size =
-      subgraph_->get_attr<std::map<std::string, int32_t>>("reg_id_to_size");
-    int io_cnt = 0;
-    for(auto &r : reg_id_to_context_type_v2) {
-      if ((r.second == "INTERFACE") || (r.second == "WORKSPACE")) {
-          total_io_size += reg_id_to_size.at(r.first);
-      }
-      if ((r.second != "CONST")) {
-        auto reg_id_str = r.first;
-        int reg_id = reg_id_str[reg_id_str.length()-1]- '0';
-        xdpu_total_reg_map.emplace(std::make_pair(reg_id,  reg_id_to_size.at(r.first)));
-        if (r.second == "WORKSPACE") {
-          xdpu_workspace_reg_map.emplace_back(std::make_pair(reg_id,  reg_id_to_size.at(r.first)));
-        }
-        io_cnt ++;
-        LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-          << "io reg_id: "  //
-          << reg_id 
-          << "  size: " 
-          << reg_id_to_size.at(r.first)      //
-          ;
-      }
-    }
-    if (io_cnt > 1) split_io =1;
-  } 
-  else { //for vai1.3 xmodel
-    auto reg_id_to_context_type =
-      subgraph_->get_attr<std::map<std::string, std::string>>("reg_id_to_context_type");
-    auto reg_id_to_size =
-      subgraph_->get_attr<std::map<std::string, int32_t>>("reg_id_to_size");
-    int count = 0;
-    for(auto &r : reg_id_to_context_type) {
-      if (r.second == "DATA") {
-          total_io_size += reg_id_to_size.at(r.first);
-        
-        auto reg_id_str = r.first;
-        int reg_id = reg_id_str[reg_id_str.length()-1]- '0';
-        xdpu_total_reg_map.emplace(std::make_pair(reg_id,  reg_id_to_size.at(r.first)));
-        LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-          << "version <=1.3 io reg_id: "  //
-          << reg_id 
-          << "  size: " 
-          <<reg_id_to_size.at(r.first)      //
-          ;
-        
-        count++;
-      }
-    }
-    if (count > 1) split_io=1;
-  }
-  auto iter = xdpu_total_reg_map.begin();
-  while(iter !=xdpu_total_reg_map.end()) {
-
-    xdpu_total_reg_map_out.emplace_back(std::make_pair(iter->first, iter->second));
-    iter++;
-  } 
-  // Load parameter
-  size_t parameter_size = 0;
-  const char * parameter_value = NULL;
-  std::map<std::string, std::vector<char>> reg_id_to_parameter_value;
-  if (subgraph_->has_attr("reg_id_to_parameter_value")) {
-    reg_id_to_parameter_value =
-      subgraph_->get_attr<std::map<std::string, std::vector<char>>>("reg_id_to_parameter_value");
-    for (const auto& c : reg_id_to_parameter_value) {
-      if (!c.second.empty()) {
-        parameter_size = c.second.size();
-        auto reg_id_str = c.first;
-        int reg_id = reg_id_str[reg_id_str.length()-1]-'0';
-        parameter_value = (const char *)&c.second[0];
-        //// reg0
-        LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER)) << "parameter size is : " 
-          << parameter_size << " for "
-          << subgraph_->get_name() << c.first;
-        if (parameter_size) {
-          md5value.emplace_back(md5sum(parameter_value, parameter_size));
-          void *reg0Ptr = NULL; 
-          if (rte::posix_memalign(&reg0Ptr, rte::getpagesize(), parameter_size))
-            throw std::bad_alloc();
-          for (unsigned i=0; i < parameter_size; i++) ((char*)reg0Ptr)[i] = parameter_value[i];
-          xdpu_parameter_map.emplace_back(std::make_tuple((char*)reg0Ptr, parameter_size,reg_id));
-        } else {
-          std::string value = subgraph_->get_name() + c.first;
-          md5value.emplace_back(md5sum(value.data(), value.length()));
-
-        }
-      }
-    }
-  } else {
-    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER)) << "no parameter in thie subgraph: " 
-      << subgraph_->get_name();
-    std::string value = subgraph_->get_name();
-    md5value.emplace_back(md5sum(value.data(), value.length()));
+  if (image_)
+    init_from_image();
+  else
+    init_regs_and_parameters();
 
-  }
-  
   layer_info layer(subgraph_->get_name());
   subgraph_info.workload = subgraph_->get_attr<uint64_t>("workload");
   subgraph_info.depth = subgraph_->get_depth();
@@ -423,24 +339,8 @@ void DpuXmodel::init_graph(const xir::Subgraph* subgraph) {
   dbg_layers_.emplace_back(std::move(layer));
   // Load mc_code
   if(!debug_mode_) { 
-    auto& mc_code = subgraph_->get_attr<std::vector<char>>("mc_code");
-    unsigned size = mc_code.size();
-    void *codePtr = NULL;
-    if (rte::posix_memalign(&codePtr, rte::getpagesize(), size))
-      throw std::bad_alloc();
-    for (unsigned i=0; i < size; i++) ((char*)codePtr)[i] = mc_code[i];
-    xdpu_code_map.emplace(std::make_pair((char*)codePtr, std::make_pair(size,0)));
-    if (subgraph_->has_attr("mc_code_preload")) {
-      auto& mc_code_preload = subgraph_->get_attr<std::vector<char>>("mc_code_preload");
-      if (mc_code_preload.size() > 0) {
-        unsigned size_pre = mc_code_preload.size();
-        void *codePtr_pre = NULL;
-        if (rte::posix_memalign(&codePtr_pre, rte::getpagesize(), size_pre))
-          throw std::bad_alloc();
-        for (unsigned i=0; i < size_pre; i++) ((char*)codePtr_pre)[i] = mc_code_preload[i];
-        xdpu_code_map.emplace(std::make_pair((char*)codePtr_pre, std::make_pair(size_pre,1)));
-      }
-    }
+    if (!image_)
+      init_code();
   } else {
     auto children = subgraph_->get_children(); 
     auto child_order = subgraph_->get_attr<std::vector<std::string>>("children_topological_sort");
@@ -498,6 +398,213 @@ void DpuXmodel::init_graph(const xir::Subgraph* subgraph) {
 
   }
 
+  if (!cache_dir.empty() && !image_)
+    store_image(cache_dir, cache_key);
   //program_once_complete = 0;
 }
 
+uint64_t DpuXmodel::get_cache_key() {
+  // everything init_regs_and_parameters() and init_code() read
+  auto h = ModelImage::hash(subgraph_->get_name().data(), subgraph_->get_name().size(), 1);
+  auto hash_str_map = [&h](const std::map<std::string, std::string> &m) {
+    for (auto &kv : m) {
+      h = ModelImage::hash(kv.first.data(), kv.first.size(), h);
+      h = ModelImage::hash(kv.second.data(), kv.second.size(), h);
+    }
+  };
+  for (auto name : {"reg_id_to_hw_segment", "reg_id_to_context_type_v2", "reg_id_to_context_type"})
+    if (subgraph_->has_attr(name))
+      hash_str_map(subgraph_->get_attr<std::map<std::string, std::string>>(name));
+  if (subgraph_->has_attr("reg_id_to_size"))
+    for (auto &kv : subgraph_->get_attr<std::map<std::string, int32_t>>("reg_id_to_size")) {
+      h = ModelImage::hash(kv.first.data(), kv.first.size(), h);
+      h = ModelImage::hash(&kv.second, sizeof(kv.second), h);
+    }
+  if (subgraph_->has_attr("reg_id_to_parameter_value"))
+    for (auto &kv : subgraph_->get_attr<std::map<std::string, std::vector<char>>>("reg_id_to_parameter_value")) {
+      h = ModelImage::hash(kv.first.data(), kv.first.size(), h);
+      h = ModelImage::hash(kv.second.data(), kv.second.size(), h);
+    }
+  for (auto name : {"mc_code", "mc_code_preload"})
+    if (subgraph_->has_attr(name)) {
+      auto& code = subgraph_->get_attr<std::vector<char>>(name);
+      h = ModelImage::hash(code.data(), code.size(), h);
+    }
+  return h;
+}
+
+void DpuXmodel::init_from_image() {
+  split_io = image_->split_io;
+  md5value = image_->md5value;
+  for (auto &r : image_->regid_to_hw_segment)
+    xdpu_regid_to_hw_segment.emplace(r);
+  for (auto &r : image_->total_reg_map) {
+    xdpu_total_reg_map.emplace(r);
+    xdpu_total_reg_map_out.emplace_back(r);
+  }
+  xdpu_workspace_reg_map = image_->workspace_reg_map;
+  for (auto &p : image_->params) {
+    xdpu_parameter_map.emplace_back(std::make_tuple(p.data, p.size, p.id));
+    xdpu_parameter_md5.emplace_back(p.md5);
+  }
+  for (auto &c : image_->code) {
+    xdpu_code_map.emplace(std::make_pair(c.data, std::make_pair(c.size, c.id)));
+    xdpu_code_md5.emplace(c.id, c.md5);
+  }
+}
+
+void DpuXmodel::store_image(const std::string &dir, uint64_t key) {
+  ModelImage image;
+  image.key = key;
+  image.split_io = split_io;
+  image.md5value = md5value;
+  image.regid_to_hw_segment.assign(xdpu_regid_to_hw_segment.begin(), xdpu_regid_to_hw_segment.end());
+  image.total_reg_map = xdpu_total_reg_map_out;
+  image.workspace_reg_map = xdpu_workspace_reg_map;
+  for (unsigned i=0; i < xdpu_parameter_map.size(); i++) {
+    auto &p = xdpu_parameter_map[i];
+    image.params.push_back({std::get<2>(p), std::get<1>(p), xdpu_parameter_md5[i], std::get<0>(p)});
+  }
+  for (auto &c : xdpu_code_map)
+    image.code.push_back({c.second.second, c.second.first, get_code_md5(c.second.second), c.first});
+  image.store(dir);
+}
+
+void DpuXmodel::init_regs_and_parameters() {
+  // Get Reg ID size
+  size_t total_io_size = 0;
+  split_io = 0;
+  if (subgraph_->has_attr("reg_id_to_hw_segment")) {
+    auto reg_id_to_hw_segment =
+      subgraph_->template get_attr<std::map<std::string, std::string>>(
+          "reg_id_to_hw_segment");
+    for(auto &r : reg_id_to_hw_segment) {
+      auto reg_id_str = r.first;
+      int reg_id = reg_id_str[reg_id_str.length()-1]- '0';
+      xdpu_regid_to_hw_segment.emplace(std::make_pair(reg_id,r.second));
+    }
+  }
+  if (subgraph_->has_attr("reg_id_to_context_type_v2")) {
+
+    auto reg_id_to_context_type_v2 =
+      subgraph_->get_attr<std::map<std::string, std::string>>("reg_id_to_context_type_v2");
+    auto reg_id_to_size =
+      subgraph_->get_attr<std::map<std::string, int32_t>>("reg_id_to_size");
+    int io_cnt = 0;
+    for(auto &r : reg_id_to_context_type_v2) {
+      if ((r.second == "INTERFACE") || (r.second == "WORKSPACE")) {
+          total_io_size += reg_id_to_size.at(r.first);
+      }
+      if ((r.second != "CONST")) {
+        auto reg_id_str = r.first;
+        int reg_id = reg_id_str[reg_id_str.length()-1]- '0';
+        xdpu_total_reg_map.emplace(std::make_pair(reg_id,  reg_id_to_size.at(r.first)));
+        if (r.second == "WORKSPACE") {
+          xdpu_workspace_reg_map.emplace_back(std::make_pair(reg_id,  reg_id_to_size.at(r.first)));
+        }
+        io_cnt ++;
+        LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+          << "io reg_id: "  //
+          << reg_id 
+          << "  size: " 
+          << reg_id_to_size.at(r.first)      //
+          ;
+      }
+    }
+    if (io_cnt > 1) split_io =1;
+  } 
+  else { //for vai1.3 xmodel
+    auto reg_id_to_context_type =
+      subgraph_->get_attr<std::map<std::string, std::string>>("reg_id_to_context_type");
+    auto reg_id_to_size =
+      subgraph_->get_attr<std::map<std::string, int32_t>>("reg_id_to_size");
+    int count = 0;
+    for(auto &r : reg_id_to_context_type) {
+      if (r.second == "DATA") {
+          total_io_size += reg_id_to_size.at(r.first);
+        
+        auto reg_id_str = r.first;
+        int reg_id = reg_id_str[reg_id_str.length()-1]- '0';
+        xdpu_total_reg_map.emplace(std::make_pair(reg_id,  reg_id_to_size.at(r.first)));
+        LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+          << "version <=1.3 io reg_id: "  //
+          << reg_id 
+          << "  size: " 
+          <<reg_id_to_size.at(r.first)      //
+          ;
+        
+        count++;
+      }
+    }
+    if (count > 1) split_io=1;
+  }
+  auto iter = xdpu_total_reg_map.begin();
+  while(iter !=xdpu_total_reg_map.end()) {
+
+    xdpu_total_reg_map_out.emplace_back(std::make_pair(iter->first, iter->second));
+    iter++;
+  } 
+  // Load parameter
+  size_t parameter_size = 0;
+  const char * parameter_value = NULL;
+  std::map<std::string, std::vector<char>> reg_id_to_parameter_value;
+  if (subgraph_->has_attr("reg_id_to_parameter_value")) {
+    reg_id_to_parameter_value =
+      subgraph_->get_attr<std::map<std::string, std::vector<char>>>("reg_id_to_parameter_value");
+    for (const auto& c : reg_id_to_parameter_value) {
+      if (!c.second.empty()) {
+        parameter_size = c.second.size();
+        auto reg_id_str = c.first;
+        int reg_id = reg_id_str[reg_id_str.length()-1]-'0';
+        parameter_value = (const char *)&c.second[0];
+        //// reg0
+        LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER)) << "parameter size is : " 
+          << parameter_size << " for "
+          << subgraph_->get_name() << c.first;
+        if (parameter_size) {
+          md5value.emplace_back(md5sum(parameter_value, parameter_size));
+          xdpu_parameter_md5.emplace_back(md5value.back());
+          void *reg0Ptr = NULL; 
+          if (rte::posix_memalign(&reg0Ptr, rte::getpagesize(), parameter_size))
+            throw std::bad_alloc();
+          for (unsigned i=0; i < parameter_size; i++) ((char*)reg0Ptr)[i] = parameter_value[i];
+          xdpu_parameter_map.emplace_back(std::make_tuple((char*)reg0Ptr, parameter_size,reg_id));
+        } else {
+          std::string value = subgraph_->get_name() + c.first;
+          md5value.emplace_back(md5sum(value.data(), value.length()));
+
+        }
+      }
+    }
+  } else {
+    LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER)) << "no parameter in thie subgraph: " 
+      << subgraph_->get_name();
+    std::string value = subgraph_->get_name();
+    md5value.emplace_back(md5sum(value.data(), value.length()));
+
+  }
+}
+
+void DpuXmodel::init_code() {
+  auto& mc_code = subgraph_->get_attr<std::vector<char>>("mc_code");
+  unsigned size = mc_code.size();
+  void *codePtr = NULL;
+  if (rte::posix_memalign(&codePtr, rte::getpagesize(), size))
+    throw std::bad_alloc();
+  for (unsigned i=0; i < size; i++) ((char*)codePtr)[i] = mc_code[i];
+  xdpu_code_map.emplace(std::make_pair((char*)codePtr, std::make_pair(size,0)));
+  xdpu_code_md5.emplace(0, md5sum((const char*)codePtr, size));
+  if (subgraph_->has_attr("mc_code_preload")) {
+    auto& mc_code_preload = subgraph_->get_attr<std::vector<char>>("mc_code_preload");
+    if (mc_code_preload.size() > 0) {
+      unsigned size_pre = mc_code_preload.size();
+      void *codePtr_pre = NULL;
+      if (rte::posix_memalign(&codePtr_pre, rte::getpagesize(), size_pre))
+        throw std::bad_alloc();
+      for (unsigned i=0; i < size_pre; i++) ((char*)codePtr_pre)[i] = mc_code_preload[i];
+      xdpu_code_map.emplace(std::make_pair((char*)codePtr_pre, std::make_pair(size_pre,1)));
+      xdpu_code_md5.emplace(1, md5sum((const char*)codePtr_pre, size_pre));
+    }
+  }
+}
+
@@ -12,26 +12,55 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <regex>
 #include "dpu_controller.hpp"
+#include "model_cache.hpp"
 
 class DpuXmodel  {
  public:
   DpuXmodel(const std::string meta);
   DpuXmodel(const xir::Subgraph *subgraph);
   virtual ~DpuXmodel();
-  std::vector<std::tuple<char*, int32_t,int>> get_parameter() {
+  // the model is frozen once constructed, getters hand out references
+  const std::vector<std::tuple<char*, int32_t,int>> &get_parameter() const {
     return xdpu_parameter_map;
   }
-  std::unordered_map<char*, std::pair<int32_t,int>> get_code() {
+  const std::unordered_map<char*, std::pair<int32_t,int>> &get_code() const {
     return xdpu_code_map;
   }
-  std::vector<std::int32_t> get_input_offset() {
+  const std::vector<std::int32_t> &get_input_offset() const {
     return xdpu_io_input_offset;
   }
-  std::vector<std::int32_t> get_output_offset() {
+  const std::vector<std::int32_t> &get_output_offset() const {
     return xdpu_io_output_offset;
   }
   void init_vitis_tensors(int batch_size, size_t device_index);
+  /**
+   * io tensor descriptor, built by init_vitis_tensors
+   * @param tensor: runner-side tensor (batch_size * xir batch)
+   * @param reg_id: register holding the tensor
+   * @param offset: offset of the tensor in its register
+   * @param size: bytes per batch element
+   */
+  struct io_tensor {
+    const xir::Tensor* tensor;
+    int32_t reg_id;
+    int32_t offset;
+    size_t size;
+  };
+  const std::vector<io_tensor> &get_input_io() const {
+    return input_io_;
+  }
+  const std::vector<io_tensor> &get_output_io() const {
+    return output_io_;
+  }
+  bool is_input_regid(int32_t reg_id) const {
+    return std::find(input_regid.begin(), input_regid.end(), reg_id) != input_regid.end();
+  }
+  bool is_output_regid(int32_t reg_id) const {
+    return std::find(output_regid.begin(), output_regid.end(), reg_id) != output_regid.end();
+  }
   /**
    * layer information
    * @param code_addr: address for instruction
@@ -71,16 +100,16 @@ class DpuXmodel  {
       return tmp + ".bin";
     }
   }; 
-  subg_info get_subgraph_info() {
+  const subg_info &get_subgraph_info() const {
     return subgraph_info;
   }
-  std::vector<layer_info> get_dbg_layers() {
+  const std::vector<layer_info> &get_dbg_layers() const {
     return dbg_layers_;
   }
   bool get_dump_mode() {
     return dump_mode_;
   }
-  std::string get_dump_folder() {
+  const std::string &get_dump_folder() const {
     return dump_folder_;
   }
   bool get_debug_mode() {
@@ -95,25 +124,25 @@ class DpuXmodel  {
   //std::vector<int32_t> get_total_insize() {
   //  return xdpu_total_in_size;
   //}
-  std::vector<int32_t> get_input_regid() {
+  const std::vector<int32_t> &get_input_regid() const {
     return input_regid;
   }
-  std::vector<int32_t> get_output_regid() {
+  const std::vector<int32_t> &get_output_regid() const {
     return output_regid;
   }
-  std::vector<float> get_input_scales() {
+  const std::vector<float> &get_input_scales() const {
     return input_scales_;
   } 
-  std::vector<float> get_output_scales() {
+  const std::vector<float> &get_output_scales() const {
     return output_scales_;
   } 
-  std::vector<std::pair<int32_t, int32_t>> get_xdpu_total_reg_map() {
+  const std::vector<std::pair<int32_t, int32_t>> &get_xdpu_total_reg_map() const {
     return xdpu_total_reg_map_out;
   }
-  std::vector<std::pair<int32_t, int32_t>> get_xdpu_workspace_reg_map() {
+  const std::vector<std::pair<int32_t, int32_t>> &get_xdpu_workspace_reg_map() const {
     return xdpu_workspace_reg_map;
   }
-  std::unordered_map<int32_t, std::string> get_xdpu_regid_to_hw_segment() {
+  const std::unordered_map<int32_t, std::string> &get_xdpu_regid_to_hw_segment() const {
     return xdpu_regid_to_hw_segment;
   }
   const xir::Subgraph* get_subgraph() {
@@ -143,14 +172,30 @@ class DpuXmodel  {
   uint64_t get_fingerprint() {
     return fingerprint;
   }
-  std::vector<std::string> get_md5() {
+  const std::vector<std::string> &get_md5() const {
     return md5value;
   }
+  // md5 of each get_parameter() blob, same order
+  const std::vector<std::string> &get_parameter_md5() const {
+    return xdpu_parameter_md5;
+  }
+  // md5 of the release-mode code blobs, keyed by kind (0: mc_code, 1: preload)
+  std::string get_code_md5(int kind) {
+    auto it = xdpu_code_md5.find(kind);
+    return it == xdpu_code_md5.end() ? std::string() : it->second;
+  }
 
  private:
   void init(const std::string &meta);
   void init(const xir::Subgraph* subgraph);
   void init_graph(const xir::Subgraph* subgraph);
+  void init_regs_and_parameters();
+  void init_code();
+  // on-disk model cache, see model_cache.hpp
+  uint64_t get_cache_key();
+  void init_from_image();
+  void store_image(const std::string &dir, uint64_t key);
+  std::shared_ptr<ModelImage> image_;
   std::vector<std::string> md5value;
   std::vector<std::vector<std::int32_t>> input_dims;
   std::vector<std::vector<std::int32_t>> output_dims;
@@ -164,12 +209,16 @@ class DpuXmodel  {
   std::vector<std::unique_ptr<xir::Tensor>> graph_outtensors_;
   std::vector<std::int32_t> xdpu_io_input_offset;
   std::vector<std::int32_t> xdpu_io_output_offset;
+  std::vector<io_tensor> input_io_;
+  std::vector<io_tensor> output_io_;
   std::vector<std::pair<int32_t, int32_t>> xdpu_workspace_reg_map;
   std::unordered_map<int32_t, int32_t> xdpu_total_reg_map;
   std::vector<std::pair<int32_t, int32_t>> xdpu_total_reg_map_out;
   std::vector<std::tuple<char*, int32_t,int>> xdpu_parameter_map;
   std::unordered_map<int32_t,std::string> xdpu_regid_to_hw_segment;
   std::unordered_map<char*, std::pair<int32_t,int>> xdpu_code_map;
+  std::vector<std::string> xdpu_parameter_md5;
+  std::unordered_map<int, std::string> xdpu_code_md5;
   subg_info subgraph_info;
   const xir::Subgraph *subgraph_;
   std::list<std::unique_ptr<xir::Tensor>> tensors_;
@@ -0,0 +1,68 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <xir/tensor/tensor.hpp>
+
+namespace vart {
+
+/*
+ * Row-major strides of a tensor, computed once when a host tensor buffer is
+ * created instead of on every data() call.
+ */
+class HostTensorLayout {
+ public:
+  explicit HostTensorLayout(const xir::Tensor* tensor)
+    : dims_(tensor->get_shape()), strides_(dims_.size(), 1),
+      elem_size_(tensor->get_data_type().bit_width / 8) {
+    for (int k = int(dims_.size()) - 2; k >= 0; k--)
+      strides_[k] = strides_[k + 1] * dims_[k + 1];
+    elem_num_ = dims_.empty() ? 1 : strides_[0] * dims_[0];
+  }
+  // element offset of idx[0..n); missing trailing indices count as 0
+  int64_t offset(const std::int32_t* idx, size_t n) const {
+    int64_t offset = 0;
+    for (size_t k = 0; k < n && k < strides_.size(); k++)
+      offset += idx[k] * strides_[k];
+    return offset;
+  }
+  const std::vector<std::int32_t>& dims() const { return dims_; }
+  size_t rank() const { return dims_.size(); }
+  // elements per batch element (dims[0])
+  int64_t batch_len() const { return strides_.empty() ? 1 : strides_[0]; }
+  int64_t elem_num() const { return elem_num_; }
+  // bytes per element
+  uint32_t elem_size() const { return elem_size_; }
+
+ private:
+  std::vector<std::int32_t> dims_;
+  std::vector<int64_t> strides_;
+  int64_t elem_num_;
+  uint32_t elem_size_;
+};
+
+// Host address of one batch element without building an index vector,
+// implemented by the runner's host tensor buffers
+class HostBatchAccess {
+ public:
+  virtual ~HostBatchAccess() {}
+  virtual uint64_t batch_ptr(std::int32_t b) = 0;
+  // flush size bytes written at batch_ptr(b) to the device; run() does not
+  // upload HOST_PHY buffers itself
+  virtual void sync_batch_for_write(std::int32_t b, size_t size) {}
+};
+
+}  // namespace vart
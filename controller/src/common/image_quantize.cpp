@@ -0,0 +1,65 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vart/tensor_buffer.hpp>
+#include <xir/tensor/tensor.hpp>
+#include "image_quantize.hpp"
+#include "host_tensor_layout.hpp"
+
+ImageQuantizer::ImageQuantizer(const std::vector<float> &mean, const std::vector<float> &scale, float input_scale)
+  : channels_(unsigned(mean.size())), lut_(mean.size() * 256) {
+  if (mean.empty() || mean.size() != scale.size())
+    throw std::runtime_error("Error: image mean and scale need one value per channel");
+  for (unsigned c=0; c < channels_; c++)
+    for (int p=0; p < 256; p++) {
+      const float v = std::round((p - mean[c]) * scale[c] * input_scale);
+      lut_[c * 256 + p] = int8_t(std::min(127.f, std::max(-128.f, v)));
+    }
+}
+
+void ImageQuantizer::operator()(const uint8_t *pixels, size_t num_pixels, int8_t *dst) const {
+  if (channels_ == 3) {
+    // the usual RGB/BGR case, unrolled
+    const int8_t *c0 = lut_.data(), *c1 = c0 + 256, *c2 = c1 + 256;
+    for (size_t i=0; i < num_pixels; i++, pixels += 3, dst += 3) {
+      dst[0] = c0[pixels[0]];
+      dst[1] = c1[pixels[1]];
+      dst[2] = c2[pixels[2]];
+    }
+    return;
+  }
+  for (size_t i=0; i < num_pixels; i++)
+    for (unsigned c=0; c < channels_; c++, pixels++, dst++)
+      *dst = lut_[c * 256 + *pixels];
+}
+
+void ImageQuantizer::write(vart::TensorBuffer *input, const uint8_t *images, unsigned num_images) const {
+  const auto dims = input->get_tensor()->get_shape();
+  const size_t pixels = size_t(dims[1]) * dims[2];
+  const size_t bytes = pixels * channels_;
+  auto *batch = dynamic_cast<vart::HostBatchAccess*>(input);
+  const bool host = input->get_location() == vart::TensorBuffer::location_t::HOST_VIRT;
+  for (unsigned b=0; b < num_images; b++) {
+    const uint64_t dst = batch ? batch->batch_ptr(b)
+      : input->data({int32_t(b), 0, 0, 0}).first;
+    (*this)(images + b * bytes, pixels, reinterpret_cast<int8_t*>(dst));
+    if (batch)
+      batch->sync_batch_for_write(b, bytes);
+    else if (!host)
+      input->sync_for_write(b * bytes, bytes);
+  }
+}
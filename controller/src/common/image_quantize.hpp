@@ -0,0 +1,46 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vart {
+class TensorBuffer;
+}
+
+/*
+ * uint8 HWC pixels to a DPU input's int8 values in one pass:
+ *   round((pixel - mean[c]) * scale[c] * input_scale), saturated
+ * with input_scale = 2^fix_point of the input tensor. A uint8 channel has
+ * only 256 values, so each channel's results are tabled once and the pass
+ * is a byte lookup, without the 4x larger float image in between.
+ */
+class ImageQuantizer {
+  public:
+    ImageQuantizer(const std::vector<float> &mean, const std::vector<float> &scale, float input_scale);
+
+    unsigned channels() const { return channels_; }
+    // num_pixels pixels of channels() bytes each, packed HWC into dst
+    void operator()(const uint8_t *pixels, size_t num_pixels, int8_t *dst) const;
+    // num_images HWC images into batch elements 0.. of an int8 NHWC input,
+    // flushing each written element unless the input is HOST_VIRT
+    void write(vart::TensorBuffer *input, const uint8_t *images, unsigned num_images) const;
+
+  private:
+    unsigned channels_;
+    std::vector<int8_t> lut_; // [channel][pixel value]
+};
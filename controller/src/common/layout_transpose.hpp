@@ -0,0 +1,67 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * NCHW <-> NHWC of one batch element, fused with the element conversion
+ * (quantize/dequantize or plain copy) so the data is touched once. Both
+ * are a rows x cols -> cols x rows transpose: NCHW to NHWC has C rows of
+ * H*W, the inverse H*W rows of C. Square tiles keep the strided side in
+ * cache; the contiguous inner loop is left to the compiler to vectorize.
+ */
+namespace layout {
+
+constexpr size_t transpose_tile = 32;
+
+// dst[j*rows + i] = conv(src[i*cols + j])
+template <typename Src, typename Dst, typename Conv>
+void transpose(const Src *src, size_t rows, size_t cols, Dst *dst, Conv conv) {
+  if (rows < transpose_tile) {
+    // few source rows (image channels) stream side by side without tiling
+    for (size_t j=0; j < cols; j++, dst += rows)
+      for (size_t i=0; i < rows; i++)
+        dst[i] = conv(src[i*cols + j]);
+    return;
+  }
+  for (size_t i0=0; i0 < rows; i0 += transpose_tile) {
+    const size_t i1 = std::min(rows, i0 + transpose_tile);
+    for (size_t j0=0; j0 < cols; j0 += transpose_tile) {
+      const size_t j1 = std::min(cols, j0 + transpose_tile);
+      for (size_t j=j0; j < j1; j++)
+        for (size_t i=i0; i < i1; i++)
+          dst[j*rows + i] = conv(src[i*cols + j]);
+    }
+  }
+}
+
+// same conversions as DpuCloudController::data_float2fix/data_fix2float
+inline void nchw_to_nhwc(const float *src, size_t channels, size_t hw, float scale, int8_t *dst) {
+  transpose(src, channels, hw, dst, [scale](float v) { return (int8_t)(v*scale); });
+}
+inline void nchw_to_nhwc(const int8_t *src, size_t channels, size_t hw, int8_t *dst) {
+  transpose(src, channels, hw, dst, [](int8_t v) { return v; });
+}
+inline void nhwc_to_nchw(const int8_t *src, size_t channels, size_t hw, float scale, float *dst) {
+  transpose(src, hw, channels, dst, [scale](int8_t v) { return (float)(v*scale); });
+}
+inline void nhwc_to_nchw(const int8_t *src, size_t channels, size_t hw, int8_t *dst) {
+  transpose(src, hw, channels, dst, [](int8_t v) { return v; });
+}
+
+} // namespace layout
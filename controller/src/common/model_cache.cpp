@@ -0,0 +1,366 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+
+#include "model_cache.hpp"
+#include "vitis/ai/env_config.hpp"
+
+DEF_ENV_PARAM(DEBUG_MODEL_CACHE, "0")
+
+/*
+ * File layout (host endian, the cache is not meant to be portable):
+ *   magic[8] key:u64 meta_size:u64 checksum:u64
+ *   meta: split_io, md5value, params, code, reg maps
+ *   blobs, each at a page aligned file offset
+ * checksum chains hash() over meta and the blobs in order, seeded with key.
+ */
+
+namespace {
+  const char MAGIC[8] = {'R','T','M','O','D','E','L','2'};
+  const size_t HEADER_SIZE = sizeof(MAGIC) + 3 * sizeof(uint64_t);
+
+  std::atomic<uint64_t> cacheHits(0);
+  std::atomic<uint64_t> cacheMisses(0);
+  std::atomic<uint64_t> cacheStores(0);
+
+  std::string pathOf(const std::string &dir, uint64_t key) {
+    std::ostringstream os;
+    os << dir << "/" << std::hex << key << ".rtm";
+    return os.str();
+  }
+
+  class Writer {
+    public:
+      template <typename T> void put(T v) {
+        buf_.append(reinterpret_cast<const char*>(&v), sizeof(v));
+      }
+      void put(const std::string &s) {
+        put<uint32_t>(s.size());
+        buf_.append(s);
+      }
+      const std::string &str() const { return buf_; }
+    private:
+      std::string buf_;
+  };
+
+  class Reader {
+    public:
+      Reader(const char *data, size_t size) : data_(data), size_(size), pos_(0) {}
+      template <typename T> T get() {
+        T v;
+        take(&v, sizeof(v));
+        return v;
+      }
+      std::string get_string() {
+        std::string s(get<uint32_t>(), '\0');
+        take(&s[0], s.size());
+        return s;
+      }
+    private:
+      void take(void *dst, size_t n) {
+        if (n > size_ - pos_)
+          throw std::runtime_error("truncated");
+        memcpy(dst, data_ + pos_, n);
+        pos_ += n;
+      }
+      const char *data_;
+      size_t size_;
+      size_t pos_;
+  };
+
+  void putBlobs(Writer &w, const std::vector<ModelImage::Blob> &blobs,
+    std::vector<uint64_t>::const_iterator &offset) {
+    w.put<uint32_t>(blobs.size());
+    for (auto &b : blobs)
+    {
+      w.put<int32_t>(b.id);
+      w.put<int32_t>(b.size);
+      w.put(b.md5);
+      w.put<uint64_t>(*offset++);
+    }
+  }
+
+  void getBlobs(Reader &r, std::vector<ModelImage::Blob> &blobs,
+    char *base, size_t size) {
+    const auto n = r.get<uint32_t>();
+    for (unsigned i=0; i < n; i++)
+    {
+      ModelImage::Blob b;
+      b.id = r.get<int32_t>();
+      b.size = r.get<int32_t>();
+      b.md5 = r.get_string();
+      const auto offset = r.get<uint64_t>();
+      if (b.size < 0 || offset > size || uint64_t(b.size) > size - offset)
+        throw std::runtime_error("blob out of range");
+      b.data = base + offset;
+      blobs.emplace_back(std::move(b));
+    }
+  }
+
+  void putPairs(Writer &w, const std::vector<std::pair<int32_t, int32_t>> &pairs) {
+    w.put<uint32_t>(pairs.size());
+    for (auto &p : pairs)
+    {
+      w.put<int32_t>(p.first);
+      w.put<int32_t>(p.second);
+    }
+  }
+
+  void getPairs(Reader &r, std::vector<std::pair<int32_t, int32_t>> &pairs) {
+    const auto n = r.get<uint32_t>();
+    for (unsigned i=0; i < n; i++)
+    {
+      const auto first = r.get<int32_t>();
+      pairs.emplace_back(first, r.get<int32_t>());
+    }
+  }
+
+  bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0)
+    {
+      auto n = write(fd, data, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  uint64_t payloadChecksum(uint64_t key, const char *meta, size_t metaSize,
+    const std::vector<ModelImage::Blob> &params, const std::vector<ModelImage::Blob> &code) {
+    auto h = ModelImage::hash(meta, metaSize, key);
+    for (auto *blobs : {&params, &code})
+      for (auto &b : *blobs)
+        h = ModelImage::hash(b.data, b.size, h);
+    return h;
+  }
+
+  bool syncDir(const std::string &dir) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    const bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+  }
+}
+
+ModelImage::~ModelImage() {
+  if (map_)
+    munmap(map_, map_size_);
+}
+
+std::string ModelImage::cache_dir() {
+  const char *value = getenv("XLNX_MODEL_CACHE_DIR");
+  return value ? value : "";
+}
+
+// MurmurHash64A, 8 bytes per step
+uint64_t ModelImage::hash(const void *data, size_t size, uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ull;
+  const int r = 47;
+  uint64_t h = seed ^ (size * m);
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  const unsigned char *end = p + (size & ~size_t(7));
+  for (; p != end; p += 8)
+  {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  switch (size & 7)
+  {
+    case 7: h ^= uint64_t(p[6]) << 48; // fallthrough
+    case 6: h ^= uint64_t(p[5]) << 40; // fallthrough
+    case 5: h ^= uint64_t(p[4]) << 32; // fallthrough
+    case 4: h ^= uint64_t(p[3]) << 24; // fallthrough
+    case 3: h ^= uint64_t(p[2]) << 16; // fallthrough
+    case 2: h ^= uint64_t(p[1]) << 8;  // fallthrough
+    case 1: h ^= uint64_t(p[0]);
+            h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+std::shared_ptr<ModelImage> ModelImage::load(const std::string &dir, uint64_t key) {
+  const auto path = pathOf(dir, key);
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    cacheMisses++;
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE)
+  {
+    close(fd);
+    cacheMisses++;
+    return nullptr;
+  }
+
+  // writable private mapping: XRT pins user-ptr BO pages for write
+  const size_t size = st.st_size;
+  void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    cacheMisses++;
+    return nullptr;
+  }
+
+  auto image = std::make_shared<ModelImage>();
+  image->map_ = map;
+  image->map_size_ = size;
+  char *base = static_cast<char*>(map);
+  try {
+    Reader header(base, HEADER_SIZE);
+    char magic[sizeof(MAGIC)];
+    for (auto &c : magic)
+      c = header.get<char>();
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || header.get<uint64_t>() != key)
+      throw std::runtime_error("bad header");
+    const auto metaSize = header.get<uint64_t>();
+    const auto checksum = header.get<uint64_t>();
+    if (metaSize > size - HEADER_SIZE)
+      throw std::runtime_error("truncated");
+
+    Reader r(base + HEADER_SIZE, metaSize);
+    image->key = key;
+    image->split_io = r.get<int32_t>();
+    const auto numMd5 = r.get<uint32_t>();
+    for (unsigned i=0; i < numMd5; i++)
+      image->md5value.emplace_back(r.get_string());
+    getBlobs(r, image->params, base, size);
+    getBlobs(r, image->code, base, size);
+    getPairs(r, image->total_reg_map);
+    getPairs(r, image->workspace_reg_map);
+    const auto numSeg = r.get<uint32_t>();
+    for (unsigned i=0; i < numSeg; i++)
+    {
+      const auto regid = r.get<int32_t>();
+      image->regid_to_hw_segment.emplace_back(regid, r.get_string());
+    }
+    // a torn or bit-rotted file; the caller rebuilds and overwrites it
+    if (payloadChecksum(key, base + HEADER_SIZE, metaSize, image->params, image->code) != checksum)
+      throw std::runtime_error("checksum mismatch");
+  } catch (const std::exception &e) {
+    LOG(WARNING) << "Ignoring invalid model cache file " << path << ": " << e.what();
+    cacheMisses++;
+    return nullptr;
+  }
+  LOG_IF(INFO, ENV_PARAM(DEBUG_MODEL_CACHE)) << "model cache hit " << path;
+  cacheHits++;
+  return image;
+}
+
+void ModelImage::store(const std::string &dir) const {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  auto align = [page](uint64_t v) { return (v + page - 1) / page * page; };
+
+  // blob offsets depend on the meta size, which does not depend on them
+  std::vector<uint64_t> offsets(params.size() + code.size(), 0);
+  auto serialize = [&]() {
+    Writer w;
+    w.put<int32_t>(split_io);
+    w.put<uint32_t>(md5value.size());
+    for (auto &s : md5value)
+      w.put(s);
+    std::vector<uint64_t>::const_iterator offset = offsets.begin();
+    putBlobs(w, params, offset);
+    putBlobs(w, code, offset);
+    putPairs(w, total_reg_map);
+    putPairs(w, workspace_reg_map);
+    w.put<uint32_t>(regid_to_hw_segment.size());
+    for (auto &s : regid_to_hw_segment)
+    {
+      w.put<int32_t>(s.first);
+      w.put(s.second);
+    }
+    return w.str();
+  };
+  uint64_t end = HEADER_SIZE + serialize().size();
+  unsigned i = 0;
+  for (auto *blobs : {&params, &code})
+    for (auto &b : *blobs)
+    {
+      offsets[i++] = align(end);
+      end = offsets[i-1] + b.size;
+    }
+  const auto meta = serialize();
+
+  Writer header;
+  for (auto c : MAGIC)
+    header.put<char>(c);
+  header.put<uint64_t>(key);
+  header.put<uint64_t>(meta.size());
+  header.put<uint64_t>(payloadChecksum(key, meta.data(), meta.size(), params, code));
+
+  mkdir(dir.c_str(), 0755);
+  const auto path = pathOf(dir, key);
+  // runners of one process may store the same key concurrently
+  static std::atomic<unsigned> tmpSeq(0);
+  const auto tmp = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(tmpSeq++);
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0
+    && writeAll(fd, header.str().data(), header.str().size())
+    && writeAll(fd, meta.data(), meta.size());
+  uint64_t pos = HEADER_SIZE + meta.size();
+  i = 0;
+  for (auto *blobs : {&params, &code})
+    for (auto &b : *blobs)
+    {
+      // zero padding up to the aligned offset
+      const std::string pad(offsets[i] - pos, '\0');
+      ok = ok && writeAll(fd, pad.data(), pad.size()) && writeAll(fd, b.data, b.size);
+      pos = offsets[i++] + b.size;
+    }
+  // the data must be durable before the rename publishes it, and the
+  // rename before we count the store
+  ok = ok && fsync(fd) == 0;
+  if (fd >= 0)
+    ok = (close(fd) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0 || !syncDir(dir))
+  {
+    LOG(WARNING) << "Failed to write model cache file " << path << ": " << strerror(errno);
+    unlink(tmp.c_str());
+    return;
+  }
+  LOG_IF(INFO, ENV_PARAM(DEBUG_MODEL_CACHE)) << "model cache stored " << path;
+  cacheStores++;
+}
+
+ModelImage::CacheStats ModelImage::get_cache_stats() {
+  return {cacheHits.load(), cacheMisses.load(), cacheStores.load()};
+}
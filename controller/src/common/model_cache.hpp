@@ -0,0 +1,72 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Processed DPU subgraph as stored in the on-disk model cache:
+ * code and parameter blobs with their md5s plus the register maps.
+ * Files live in $XLNX_MODEL_CACHE_DIR/<key>.rtm, keyed by a content hash of
+ * the subgraph's code and parameters. A loaded image is mmap'ed; blobs are
+ * page aligned so they can back user-ptr BOs directly.
+ */
+class ModelImage {
+ public:
+  struct Blob {
+    int32_t id;   // reg_id for parameters, kind (0 code, 1 preload) for code
+    int32_t size;
+    std::string md5;
+    char *data;   // into the mapping once loaded
+  };
+
+  ModelImage() = default;
+  ~ModelImage();
+  ModelImage(const ModelImage &) = delete;
+  ModelImage &operator=(const ModelImage &) = delete;
+
+  uint64_t key = 0;
+  int32_t split_io = 0;
+  std::vector<std::string> md5value;
+  std::vector<Blob> params;
+  std::vector<Blob> code;
+  std::vector<std::pair<int32_t, int32_t>> total_reg_map;     // reg_id, size
+  std::vector<std::pair<int32_t, int32_t>> workspace_reg_map; // reg_id, size
+  std::vector<std::pair<int32_t, std::string>> regid_to_hw_segment;
+
+  // "" when XLNX_MODEL_CACHE_DIR is unset (cache disabled)
+  static std::string cache_dir();
+  // 64-bit content hash, chain calls through seed
+  static uint64_t hash(const void *data, size_t size, uint64_t seed);
+  // nullptr if there is no valid image for key
+  static std::shared_ptr<ModelImage> load(const std::string &dir, uint64_t key);
+  // write atomically (tmp + rename); failures are logged, not thrown
+  void store(const std::string &dir) const;
+
+  struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+  };
+  static CacheStats get_cache_stats();
+
+ private:
+  void *map_ = nullptr;
+  size_t map_size_ = 0;
+};
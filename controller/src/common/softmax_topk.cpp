@@ -0,0 +1,67 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "softmax_topk.hpp"
+
+void softmax_topk(const int8_t *data, size_t n, float scale, unsigned k, TopKEntry *out) {
+  if (!(scale > 0))
+    throw std::runtime_error("Error: softmax_topk needs a positive output scale");
+  // level l holds value l - 128, so larger levels are larger values
+  uint32_t hist[256] = {0};
+  for (size_t i=0; i < n; i++)
+    hist[uint8_t(data[i]) ^ 0x80]++;
+  int top = 255;
+  while (top > 0 && hist[top] == 0)
+    top--;
+
+  // softmax is shift invariant: exp relative to the max stays in (0, 1]
+  float level_exp[256];
+  double sum = 0;
+  for (int l=0; l <= top; l++) {
+    if (hist[l] == 0)
+      continue;
+    level_exp[l] = std::exp((l - top) * scale);
+    sum += hist[l] * double(level_exp[l]);
+  }
+
+  // lowest level still needed: everything above it plus some of it make k
+  const unsigned kept = unsigned(std::min<size_t>(k, n));
+  unsigned above = 0;
+  int threshold = top;
+  while (threshold > 0 && above + hist[threshold] < kept) {
+    above += hist[threshold];
+    threshold--;
+  }
+  unsigned at_threshold = kept - above;
+  unsigned count = 0;
+  for (size_t i=0; i < n && count < kept; i++) {
+    const int l = uint8_t(data[i]) ^ 0x80;
+    if (l < threshold || (l == threshold && at_threshold == 0))
+      continue;
+    if (l == threshold)
+      at_threshold--;
+    out[count++] = {int32_t(i), float(l)};  // level for now, prob below
+  }
+  std::sort(out, out + count, [](const TopKEntry &a, const TopKEntry &b) {
+    return a.prob != b.prob ? a.prob > b.prob : a.index < b.index;
+  });
+  const float inv_sum = float(1.0 / sum);
+  for (unsigned c=0; c < count; c++)
+    out[c].prob = level_exp[int(out[c].prob)] * inv_sum;
+  for (unsigned c=count; c < k; c++)
+    out[c] = {-1, 0.f};
+}
@@ -0,0 +1,33 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Classification post-processing of one int8 DPU output: dequantize,
+ * softmax and top-k in one step. int8 has only 256 levels, so exp is taken
+ * once per level present and the k best come from a histogram threshold:
+ * two passes over the data, no allocation and no full sort.
+ */
+struct TopKEntry {
+  int32_t index;  // class, -1 past the end of a short output
+  float prob;
+};
+
+// softmax(scale * data[0..n)) at its k largest entries, best first (ties
+// by lower index), into out[0..k)
+void softmax_topk(const int8_t *data, size_t n, float scale, unsigned k, TopKEntry *out);
@@ -14,6 +14,7 @@
 
 #include "./tensor_buffer_imp_host.hpp"
 
+#include <algorithm>
 #include <sstream>
 #include <xir/tensor/tensor.hpp>
 
@@ -21,7 +22,7 @@
 namespace vart {
 TensorBufferExtImpHost::TensorBufferExtImpHost(void* data, const xir::Tensor* tensor)
     //: TensorBuffer(tensor), buffer_((size_t)tensor->get_data_size()) {}
-    : TensorBuffer(tensor), data_(data) {}
+    : TensorBuffer(tensor), data_(data), layout_(tensor) {}
 
 vart::TensorBuffer::location_t TensorBufferExtImpHost::get_location() const {
   return location_t::HOST_VIRT;
@@ -35,30 +36,62 @@ std::pair<uint64_t, size_t> TensorBufferExtImpHost::data_phy(
 
 std::pair<std::uint64_t, std::size_t> TensorBufferExtImpHost::data(
     const std::vector<std::int32_t> idx) {
-    uint32_t size = tensor_->get_data_type().bit_width / 8;
-    if (idx.size() == 0) {
-      auto ret = reinterpret_cast<uint64_t>(data_);
-      return {ret,
-              tensor_->get_element_num() * size};
-    }
-    auto dims = tensor_->get_shape();
-    CHECK_EQ(dims.size(), idx.size());
-    auto offset = 0;
-    for (std::size_t k = 0; k < tensor_->get_shape().size(); k++) {
-      auto stride = 1;
-      for (std::size_t m = k + 1; m < tensor_->get_shape().size(); m++) {
-        stride *= dims[m];
+    if (idx.size())
+      CHECK_EQ(layout_.rank(), idx.size());
+    return data(idx.data(), idx.size());
+}
+std::pair<std::uint64_t, std::size_t> TensorBufferExtImpHost::data(
+    const std::int32_t* idx, size_t n) {
+    const auto offset = layout_.offset(idx, n);
+    std::lock_guard<std::mutex> lock(pending_mtx_);
+    if (!pending_.empty()) {
+      // the rest of the addressed batch element, or everything
+      if (n == 0) {
+        for (std::int32_t b=0; b < std::int32_t(pending_.size()); b++)
+          fetch(b, 0, batch_bytes());
+      } else {
+        fetch(idx[0], (offset - idx[0] * layout_.batch_len()) * layout_.elem_size(), batch_bytes());
       }
-      offset += idx[k] * stride;
     }
-    auto elem_num = tensor_->get_element_num();
-    auto ret = reinterpret_cast<uint64_t>(data_) + offset * size;
+    auto ret = reinterpret_cast<uint64_t>(data_) + offset * layout_.elem_size();
     return {ret,
-            (elem_num - offset) * size};
+            (layout_.elem_num() - offset) * layout_.elem_size()};
 
 }
 void TensorBufferExtImpHost::sync_for_read(uint64_t offset, size_t size) {
-  // noop;
+  // noop unless outputs were left on the device
+  const size_t bytes = batch_bytes();
+  std::lock_guard<std::mutex> lock(pending_mtx_);
+  for (size_t b = offset / bytes; b < pending_.size() && b * bytes < offset + size; b++) {
+    const size_t begin = std::max<uint64_t>(offset, b * bytes) - b * bytes;
+    const size_t end = std::min<uint64_t>(offset + size, (b + 1) * bytes) - b * bytes;
+    fetch(std::int32_t(b), begin, end);
+  }
+}
+
+void TensorBufferExtImpHost::set_pending(std::int32_t b, Fetch fetch) {
+  std::lock_guard<std::mutex> lock(pending_mtx_);
+  if (pending_.empty())
+    pending_.resize(layout_.dims().empty() ? 1 : layout_.dims()[0]);
+  CHECK_LT(size_t(b), pending_.size());
+  pending_[b] = {std::move(fetch), batch_bytes()};
+}
+
+void TensorBufferExtImpHost::fetch(std::int32_t b, size_t begin, size_t end) {
+  if (b < 0 || size_t(b) >= pending_.size())
+    return;
+  auto &p = pending_[b];
+  if (!p.fetch || begin >= p.from || begin >= end)
+    return;
+  const size_t stop = std::min(end, p.from);
+  p.fetch(static_cast<char*>(data_) + b * batch_bytes() + begin, begin, stop - begin);
+  // a range reaching what is already here extends it; others may be
+  // fetched again by a later, wider access
+  if (end >= p.from) {
+    p.from = begin;
+    if (begin == 0)
+      p.fetch = nullptr;
+  }
 }
 
 void TensorBufferExtImpHost::sync_for_write(uint64_t offset, size_t size) {
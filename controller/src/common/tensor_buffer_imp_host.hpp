@@ -13,12 +13,15 @@
 // limitations under the License.
 
 #pragma once
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vart/tensor_buffer.hpp>
+#include "host_tensor_layout.hpp"
 
 namespace vart {
-class TensorBufferExtImpHost : public vart::TensorBuffer {
+class TensorBufferExtImpHost : public vart::TensorBuffer, public HostBatchAccess {
  public:
  public:
   explicit TensorBufferExtImpHost(void* data, const xir::Tensor* tensor);
@@ -29,6 +32,18 @@ class TensorBufferExtImpHost : public vart::TensorBuffer {
 
   virtual ~TensorBufferExtImpHost() = default;
 
+  // data() with the index as an array, no vector copies
+  std::pair<std::uint64_t, std::size_t> data(const std::int32_t* idx, size_t n);
+  virtual uint64_t batch_ptr(std::int32_t b) override {
+    return reinterpret_cast<uint64_t>(data_) + b * layout_.batch_len() * layout_.elem_size();
+  }
+
+  // Lazy download: batch element b is still on the device. data() and
+  // sync_for_read() pull the bytes they cover through fetch(dst, offset,
+  // size), offsets within the batch element; batch_ptr() never fetches.
+  using Fetch = std::function<void(void* dst, size_t offset, size_t size)>;
+  void set_pending(std::int32_t b, Fetch fetch);
+
  private:
   virtual location_t get_location() const override;
   virtual std::pair<uint64_t, size_t> data_phy(
@@ -42,7 +57,21 @@ class TensorBufferExtImpHost : public vart::TensorBuffer {
   //                             size_t offset) override;
   // virtual void copy_to_host(void* buf, size_t size, size_t offset) override;
 
+  // pull bytes [begin, end) of batch element b if still on the device;
+  // called with pending_mtx_ held
+  void fetch(std::int32_t b, size_t begin, size_t end);
+  size_t batch_bytes() const { return layout_.batch_len() * layout_.elem_size(); }
+
   //std::vector<char> buffer_;
   void* data_;
+  const HostTensorLayout layout_;
+  struct Pending {
+    Fetch fetch;  // null once all of it is on the host
+    size_t from;  // bytes [from, batch_bytes()) are on the host
+  };
+  // runner threads may read one output concurrently, and the next
+  // run_bound may arm it again
+  std::mutex pending_mtx_;
+  std::vector<Pending> pending_;  // per batch element, empty if never lazy
 };
 }  // namespace vart
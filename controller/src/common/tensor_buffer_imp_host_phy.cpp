@@ -24,7 +24,8 @@ namespace vart {
 namespace rt_engine {
 
 TensorBufferExtImpHostPhy::TensorBufferExtImpHostPhy(void* data, const xir::Tensor* tensor)
-    : TensorBuffer{tensor}, data_{data}, location_{location_t::HOST_PHY}, tensor_{tensor} {
+    : TensorBuffer{tensor}, data_{data}, location_{location_t::HOST_PHY}, tensor_{tensor},
+      layout_{tensor} {
   elem_num_ = tensor_->get_element_num();
   LOG_IF(INFO, ENV_PARAM(DEBUG_TENSOR_BUFFER_ALLOCATOR))
       << "TensorBufferExtImpHostPhy "
@@ -49,66 +50,40 @@ std::pair<uint64_t, size_t> TensorBufferExtImpHostPhy::data_x(
 
 std::pair<uint64_t, size_t> TensorBufferExtImpHostPhy::data(
       const std::vector<std::int32_t> idx = {}) {
-    uint32_t size = tensor_->get_data_type().bit_width / 8;
-    if (idx.size() == 0) {
-      return {reinterpret_cast<uint64_t>(data_),
-              elem_num_ * size};
-    }
-    auto dims = tensor_->get_shape();
-    auto offset = 0;
-    for (std::size_t k = 0; k < dims.size(); k++) {
-      auto stride = 1;
-      for (std::size_t m = k + 1; m < dims.size(); m++) {
-        stride *= dims[m];
-      }
-      offset += idx[k] * stride;
-    }
-    //auto elem_num = tensor_->get_element_num();
+    return data(idx.data(), idx.size());
+}
+
+std::pair<uint64_t, size_t> TensorBufferExtImpHostPhy::data(
+      const std::int32_t* idx, size_t n) {
+    uint32_t size = layout_.elem_size();
+    const auto offset = layout_.offset(idx, n);
     return {reinterpret_cast<uint64_t>(data_) + offset * size,
             (elem_num_ - offset) * size};
 }
 
 std::pair<uint64_t, size_t> TensorBufferExtImpHostPhy::data_phy(
   const std::vector<std::int32_t> idx) {
-  uint32_t size = tensor_->get_data_type().bit_width / 8;
-  auto dims = tensor_->get_shape();
+  return data_phy(idx.data(), idx.size());
+}
+
+std::pair<uint64_t, size_t> TensorBufferExtImpHostPhy::data_phy(
+  const std::int32_t* idx, size_t n) {
+  uint32_t size = layout_.elem_size();
 
   // single device buffer
   if (dbufs_.size() == 1) {
-    if (idx.size() == 0) {
-      return {dbufs_[0]->get_phys_addr(), elem_num_ * size};
-    }
-
-    auto offset = 0;
-    for (std::size_t k = 0; k < dims.size(); k++) {
-      auto stride = 1;
-      for (std::size_t m = k + 1; m < dims.size(); m++) {
-        stride *= dims[m];
-      }
-      offset += idx[k] * stride;
-    }
-    //auto elem_num = tensor_->get_element_num();
+    const auto offset = layout_.offset(idx, n);
     return {dbufs_[0]->get_phys_addr() + offset * size,
           (elem_num_ - offset) * size};
   }
 
-  // multi device buffers
-  auto batch_len = 1;
-  for (std::size_t m = 1; m < dims.size(); m++) {
-    batch_len *= dims[m];
-  }
-  if (idx.size() == 0) {
-    return {dbufs_[idx[0]]->get_phys_addr(), batch_len * size};
+  // multi device buffers, one per batch element
+  const auto batch_len = layout_.batch_len();
+  if (n == 0) {
+    return {dbufs_[0]->get_phys_addr(), batch_len * size};
   }
 
-  auto offset = 0;
-  for (std::size_t k = 1; k < dims.size(); k++) {
-    auto stride = 1;
-    for (std::size_t m = k + 1; m < dims.size(); m++) {
-      stride *= dims[m];
-    }
-    offset += idx[k] * stride;
-  }
+  const auto offset = layout_.offset(idx, n) - idx[0] * batch_len;
   return {dbufs_[idx[0]]->get_phys_addr() + offset * size,
           (batch_len - offset) * size};
 }
@@ -151,6 +126,14 @@ void TensorBufferExtImpHostPhy::sync_for_write(uint64_t offset, size_t size) {
   }
 }
 
+void TensorBufferExtImpHostPhy::sync_batch_for_write(std::int32_t b, size_t size) {
+  CHECK_NE(dbufs_.size(), 0);
+  if (dbufs_.size() == 1)
+    dbufs_[0]->sync_for_write(b * layout_.batch_len() * layout_.elem_size(), size);
+  else
+    dbufs_[b]->sync_for_write(0, size);
+}
+
 void TensorBufferExtImpHostPhy::copy_from_host(size_t batch_idx,
                                                const void* buf, size_t size,
                                                size_t offset) {
@@ -17,10 +17,11 @@
 #include <vart/tensor_buffer.hpp>
 #include <xir/tensor/tensor.hpp>
 #include "device_memory.hpp"
+#include "host_tensor_layout.hpp"
 
 namespace vart {
 namespace rt_engine {
-class TensorBufferExtImpHostPhy : public vart::TensorBuffer {
+class TensorBufferExtImpHostPhy : public vart::TensorBuffer, public HostBatchAccess {
  public:
   explicit TensorBufferExtImpHostPhy(void* data, const xir::Tensor* tensor);
   virtual ~TensorBufferExtImpHostPhy();
@@ -41,6 +42,13 @@ class TensorBufferExtImpHostPhy : public vart::TensorBuffer {
                             size_t offset) override;
   std::pair<uint64_t, size_t> data_x(const std::vector<std::int32_t> idx,
                                      int phy);
+  // data()/data_phy() with the index as an array, no vector copies
+  std::pair<std::uint64_t, std::size_t> data(const std::int32_t* idx, size_t n);
+  std::pair<uint64_t, size_t> data_phy(const std::int32_t* idx, size_t n);
+  virtual uint64_t batch_ptr(std::int32_t b) override {
+    return reinterpret_cast<uint64_t>(data_) + b * layout_.batch_len() * layout_.elem_size();
+  }
+  virtual void sync_batch_for_write(std::int32_t b, size_t size) override;
   void set_device_buffer(std::unique_ptr<DeviceBuffer> buf);
 
  private:
@@ -49,6 +57,7 @@ class TensorBufferExtImpHostPhy : public vart::TensorBuffer {
   const xir::Tensor* tensor_;
   std::vector<std::unique_ptr<DeviceBuffer>> dbufs_;
   int elem_num_;
+  const HostTensorLayout layout_;
  private:
   std::vector<std::tuple<int, uint64_t, int>> host_to_dev_range(
                                 size_t batch_idx, size_t offset, size_t size);
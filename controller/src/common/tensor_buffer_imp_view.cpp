@@ -27,14 +27,17 @@ TensorBufferExtImpView::TensorBufferExtImpView(
     : TensorBuffer(xir::Tensor::clone(tensor).release()),
       tensor_{
           std::unique_ptr<xir::Tensor>(const_cast<xir::Tensor*>(get_tensor()))},
-      offset_{offset} {
-  for (unsigned i =0; i< backstore.size();i++)
+      offset_{offset},
+      layout_{tensor} {
+  for (unsigned i =0; i< backstore.size();i++) {
     backstore_.emplace_back(backstore[i]);
-  if (backstore.size() != 1)
-    backstore_batch = true;
+    backstore_phy_.emplace_back(dynamic_cast<rt_engine::TensorBufferExtImpHostPhy*>(backstore[i]));
+  }
+  backstore_batch = backstore.size() != 1;
   // when dims[0] from xir is bigger than 1, need to handle data in tensor_batch in etch tensorbuffer
   tensor_batch = tensor->get_shape()[0]/backstore_.size();
   CHECK_EQ(tensor->get_shape()[0], tensor_batch*backstore_.size());
+  size_in_single_batch_ = tensor->get_data_size() / tensor->get_shape()[0];
   LOG_IF(INFO, ENV_PARAM(DEBUG_TENSOR_BUFFER_ALLOCATOR) >= 3)
       << " TensorBufferExtImpView created: " << to_string();
   ;
@@ -53,74 +56,58 @@ TensorBuffer::location_t TensorBufferExtImpView::get_location() const {
 
 std::pair<uint64_t, size_t> TensorBufferExtImpView::data_x(
     const std::vector<std::int32_t> idx_orig, int phy) {
-  std::vector<int32_t> idx;//= std::vector<int32_t>(idx_orig);
-  //auto dims_orig = get_tensor()->get_shape();
-  //if (idx_orig.size() == 0) {
-  //  for (size_t i = 0; i < dims_orig.size(); i++)
-  //    dims_orig[i] = 0;
-  //  idx = std::vector<int32_t>(dims_orig);
-  //} else {
-  //  idx = std::vector<int32_t>(idx_orig);
-  //}
-  //auto tensor = get_tensor();
-  auto dims = tensor_->get_shape();
-  auto offset = 0;
-
-  if (idx_orig.size()) {
-    CHECK_EQ(dims.size(), idx_orig.size());
-    idx = std::vector<int32_t>(idx_orig);
-  } else {
-    idx = std::vector<int32_t>(dims.size(), 0);
+  if (idx_orig.size())
+    CHECK_EQ(layout_.rank(), idx_orig.size());
+  return data_x(idx_orig.data(), idx_orig.size(), phy);
+}
+
+std::pair<uint64_t, size_t> TensorBufferExtImpView::data_x(
+    const std::int32_t* idx, size_t n, int phy) {
+  // offset inside the batch element, the batch index picks the backstore
+  std::int32_t batch_idx = 0;
+  int64_t offset_in_single_batch = 0;
+  if (n) {
+    batch_idx = idx[0];
+    offset_in_single_batch = layout_.offset(idx, n) - idx[0] * layout_.batch_len();
   }
-  auto batch_idx = idx[0];
-  const auto batch = dims[0];
-  idx[0] = 0;
-  dims[0] = 1;
-  //auto calc1 = vitis::ai::DimCalc(dims);
-  //auto offset_in_single_batch = (int)calc1.offset(idx);
-    for (std::size_t k = 0; k < dims.size(); k++) {
-      auto stride = 1;
-      for (std::size_t m = k + 1; m < dims.size(); m++) {
-        stride *= dims[m];
-      }
-      offset += idx[k] * stride;
-    }
-  auto offset_in_single_batch = offset;
-  auto size_in_single_batch = tensor_->get_data_size() / batch;
-  CHECK_LE(offset_in_single_batch, size_in_single_batch);
+  CHECK_LE(offset_in_single_batch, size_in_single_batch_);
   auto size_left_in_single_batch =
-      size_in_single_batch - offset_in_single_batch;
-  CHECK_GE(size_in_single_batch, 0);
+      size_in_single_batch_ - offset_in_single_batch;
 
-  uint64_t data_back;
-  size_t size_back;
-  int buf_idx = floor(batch_idx/tensor_batch);
-  if (backstore_batch) {
-    if (phy) {
-      std::tie(data_back, size_back) =
-          backstore_[buf_idx]->data_phy({0, offset_in_single_batch});
-    } else {
-      std::tie(data_back, size_back) =
-          backstore_[buf_idx]->data({0, offset_in_single_batch});
-    }
-
-  } else {
-    if (phy) {
-      std::tie(data_back, size_back) =
-          backstore_[0]->data_phy({buf_idx, offset_in_single_batch});
-    } else {
-      std::tie(data_back, size_back) =
-          backstore_[0]->data({buf_idx, offset_in_single_batch});
-    }
-  }
-  //LOG_IF(INFO, ENV_PARAM(DEBUG_TENSOR_BUFFER_ALLOCATOR) >= 3)
-  //    << " TensorBufferExtImpView data: " << data_back
-  //    << " size " << size_back
-  //    <<" offset_ " << offset_
-  //    <<" offset " << offset
-  //    << " size left " << size_left_in_single_batch;
+  int buf_idx = batch_idx / tensor_batch;
+  uint64_t data_back = backstore_batch
+    ? back_data(buf_idx, 0, offset_in_single_batch, phy).first
+    : back_data(0, buf_idx, offset_in_single_batch, phy).first;
   return std::make_pair(data_back + offset_, (size_t)size_left_in_single_batch);
 }
+
+std::pair<uint64_t, size_t> TensorBufferExtImpView::back_data(
+    size_t buf, std::int32_t batch, std::int32_t offset, int phy) {
+  const std::int32_t idx[2] = {batch, offset};
+  if (auto *back = backstore_phy_[buf])
+    return phy ? back->data_phy(idx, 2) : back->data(idx, 2);
+  if (phy)
+    return backstore_[buf]->data_phy({batch, offset});
+  return backstore_[buf]->data({batch, offset});
+}
+
+uint64_t TensorBufferExtImpView::batch_ptr(std::int32_t b) {
+  int buf_idx = b / tensor_batch;
+  uint64_t data_back = backstore_batch
+    ? back_data(buf_idx, 0, 0, 0).first
+    : back_data(0, buf_idx, 0, 0).first;
+  return data_back + offset_;
+}
+
+void TensorBufferExtImpView::sync_batch_for_write(std::int32_t b, size_t size) {
+  // the backstore range batch_ptr(b) points into
+  int buf_idx = b / tensor_batch;
+  if (backstore_batch)
+    backstore_[buf_idx]->sync_for_write(offset_, size);
+  else
+    backstore_[0]->sync_for_write(batch_ptr(b) - back_data(0, 0, 0, 0).first, size);
+}
+
 std::pair<uint64_t, size_t> TensorBufferExtImpView::data_phy(
     const std::vector<std::int32_t> idx) {
   return data_x(idx, 1);
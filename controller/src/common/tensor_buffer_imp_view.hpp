@@ -18,7 +18,7 @@
 #include <vart/tensor_buffer.hpp>
 #include "tensor_buffer_imp_host_phy.hpp"
 namespace vart {
-class TensorBufferExtImpView : public vart::TensorBuffer {
+class TensorBufferExtImpView : public vart::TensorBuffer, public HostBatchAccess {
  public:
  public:
   explicit TensorBufferExtImpView(
@@ -31,6 +31,9 @@ class TensorBufferExtImpView : public vart::TensorBuffer {
 
   virtual ~TensorBufferExtImpView();
 
+  virtual uint64_t batch_ptr(std::int32_t b) override;
+  virtual void sync_batch_for_write(std::int32_t b, size_t size) override;
+
  private:
   virtual location_t get_location() const override;
   virtual std::pair<uint64_t, size_t> data_phy(
@@ -45,12 +48,21 @@ class TensorBufferExtImpView : public vart::TensorBuffer {
                             size_t offset) override;
   std::pair<uint64_t, size_t> data_x(const std::vector<std::int32_t> idx,
                                      int phy);
+  std::pair<uint64_t, size_t> data_x(const std::int32_t* idx, size_t n,
+                                     int phy);
+  // backstore data()/data_phy() at {batch, offset}
+  std::pair<uint64_t, size_t> back_data(size_t buf, std::int32_t batch,
+                                        std::int32_t offset, int phy);
 
  private:
   std::unique_ptr<xir::Tensor> tensor_;
   const size_t offset_;
   std::vector<vart::TensorBuffer*> backstore_;
+  // backstore_ entries that are our host phy buffers, else nullptr
+  std::vector<rt_engine::TensorBufferExtImpHostPhy*> backstore_phy_;
   bool backstore_batch;
   size_t tensor_batch;
+  const HostTensorLayout layout_;
+  int64_t size_in_single_batch_;
 };
 }  // namespace vart
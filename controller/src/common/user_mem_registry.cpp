@@ -0,0 +1,51 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iterator>
+#include <stdexcept>
+#include "user_mem_registry.hpp"
+
+void UserMemRegistry::add(const Region &region) {
+  if (region.size == 0)
+    throw std::runtime_error("Error: cannot register an empty memory region");
+  auto next = regions_.lower_bound(region.start);
+  if (next != regions_.end() && next->first < region.start + region.size)
+    throw std::runtime_error("Error: memory region overlaps a registered one");
+  if (next != regions_.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second.size > region.start)
+      throw std::runtime_error("Error: memory region overlaps a registered one");
+  }
+  regions_.emplace_hint(next, region.start, region);
+}
+
+bool UserMemRegistry::remove(const void *ptr, Region &removed) {
+  auto it = regions_.find(reinterpret_cast<uintptr_t>(ptr));
+  if (it == regions_.end())
+    return false;
+  removed = it->second;
+  regions_.erase(it);
+  return true;
+}
+
+const UserMemRegistry::Region *UserMemRegistry::find(const void *ptr, size_t size) const {
+  const auto start = reinterpret_cast<uintptr_t>(ptr);
+  auto it = regions_.upper_bound(start);
+  if (it == regions_.begin())
+    return nullptr;
+  const Region &region = std::prev(it)->second;
+  if (start + size > region.start + region.size)
+    return nullptr;
+  return &region;
+}
@@ -0,0 +1,46 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <xrt.h>
+
+/*
+ * Host memory regions the user registered for direct DMA, each pinned once
+ * as a user-pointer BO. Lookups find the region holding a whole buffer, so
+ * bind() can program device addresses inside the BO instead of staging.
+ */
+class UserMemRegistry {
+  public:
+    struct Region {
+      uintptr_t start;
+      size_t size;
+      xclBufferHandle bo;
+      uint64_t paddr;   // device address of start
+    };
+
+    // throws if the region overlaps one already registered
+    void add(const Region &region);
+    // drop the region starting at ptr; false if there is none
+    bool remove(const void *ptr, Region &removed);
+    // the region holding all of [ptr, ptr + size), or nullptr
+    const Region *find(const void *ptr, size_t size) const;
+    const std::map<uintptr_t, Region> &regions() const { return regions_; }
+
+  private:
+    std::map<uintptr_t, Region> regions_; // by start
+};
@@ -17,6 +17,7 @@
 #include <sstream>
 #include <unordered_map>
 #include <cstdlib>
+#include <cstring>
 #include "xir/tensor/tensor.hpp"
 #include <xir/graph/graph.hpp>
 #include <xir/graph/subgraph.hpp>
@@ -31,6 +32,38 @@
 
 DEF_ENV_PARAM(DEBUG_DPU_CONTROLLER, "0")
 
+Engine &DpuController::get_engine(const xir::Attrs* attrs) {
+  if (attrs == nullptr || !attrs->has_attr("engine"))
+    return Engine::get_instance();
+
+  const auto name = attrs->get_attr<std::string>("engine");
+  auto config = EngineConfig::from_env();
+  if (attrs->has_attr("engine_num_workers"))
+    config.num_workers = attrs->get_attr<int>("engine_num_workers");
+  if (attrs->has_attr("engine_min_workers"))
+    config.min_workers = attrs->get_attr<int>("engine_min_workers");
+  if (attrs->has_attr("engine_worker_idle_ms"))
+    config.worker_idle_ms = attrs->get_attr<int>("engine_worker_idle_ms");
+  if (attrs->has_attr("engine_cpu_affinity"))
+    config.cpu_affinity = attrs->get_attr<std::vector<int>>("engine_cpu_affinity");
+  if (attrs->has_attr("engine_sched_policy"))
+  {
+    const auto policy = attrs->get_attr<std::string>("engine_sched_policy");
+    if (policy == "fifo")
+      config.sched_policy = EngineConfig::FIFO;
+    else if (policy == "rr")
+      config.sched_policy = EngineConfig::RR;
+    else if (policy != "default")
+      throw std::runtime_error("Error: unknown engine_sched_policy: " + policy);
+  }
+  if (attrs->has_attr("engine_sched_priority"))
+    config.sched_priority = attrs->get_attr<int>("engine_sched_priority");
+
+  LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
+    << "using engine '" << name << "'";
+  return Engine::get_instance(name, config);
+}
+
 template <class Dhandle, class DbufIn, class DbufOut>
 XclDpuController<Dhandle, DbufIn, DbufOut>::XclDpuController(std::string meta, xir::Attrs* attrs) 
 : DpuController(meta, attrs),  default_attrs_{xir::Attrs::create()}  {
@@ -61,7 +94,10 @@ XclDpuController<Dhandle, DbufIn, DbufOut>::XclDpuController(std::string meta, x
     ;
 
   //handle_.reset(new Dhandle(kernelName, xclbinPath));
-  handle_.reset(new Dhandle(kernelName, xclbinPath, attrs));
+  {
+    StartupProfile::Scope acquire(startup_, "acquire");
+    handle_.reset(new Dhandle(kernelName, xclbinPath, attrs));
+  }
   if (!attrs->has_attr("__device_core_id__")) {
     attrs->set_attr<size_t>("__device_core_id__", handle_->get_device_info().cu_index);
   }
@@ -103,7 +139,10 @@ XclDpuController<Dhandle, DbufIn, DbufOut>::XclDpuController(const xir::Subgraph
     << "loading xclbin: "  //
     << xclbinPath      //
     ;
-  handle_.reset(new Dhandle(kernelName, xclbinPath, attrs));
+  {
+    StartupProfile::Scope acquire(startup_, "acquire");
+    handle_.reset(new Dhandle(kernelName, xclbinPath, attrs));
+  }
   if (!attrs->has_attr("__device_core_id__")) {
     attrs->set_attr<size_t>("__device_core_id__", handle_->get_device_info().cu_index);
   }
@@ -150,6 +189,15 @@ std::vector<DeviceBuffer *>XclDpuController<Dhandle, DbufIn, DbufOut>::get_devic
   return it->second;
 }
 
+template <class Dhandle, class DbufIn, class DbufOut>
+void XclDpuController<Dhandle, DbufIn, DbufOut>::fault_in_buffers() {
+  std::unique_lock<std::mutex> lock(tbuf_mtx_);
+  for (auto &tb : tbufs_) {
+    auto data = tb->data();
+    std::memset(reinterpret_cast<void*>(data.first), 0, data.second);
+  }
+}
+
 template <class Dhandle, class DbufIn, class DbufOut>
 std::vector<float> 
 XclDpuController<Dhandle, DbufIn, DbufOut>::get_input_scale() {
@@ -17,30 +17,121 @@
 #include <unordered_map>
 #include <mutex>
 #include <list>
+#include <memory>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 #include "xir/graph/subgraph.hpp"
 #include "device_handle.hpp"
 #include "device_memory.hpp"
 #include "ert.h"
+#include "engine.hpp"
 #include "common/alignment.hpp"
+#include "common/softmax_topk.hpp"
+#include "startup_profile.hpp"
+class DpuController;
+
+/*
+ * IO binding
+ */
+
+// classification post-processing the engine worker runs right after the
+// download: softmax of one int8 output and its k best classes per batch
+// element, see softmax_topk()
+struct DpuTopK {
+  unsigned output = 0;           // output tensor index
+  unsigned k = 5;
+  TopKEntry *results = nullptr;  // [batch element][k], rewritten by every run
+};
+
+// the buffers of a job, resolved once by DpuController::bind() and reused by
+// run_bound(); controllers derive from it to keep what they resolved. A
+// binding is valid as long as its buffers are
+struct DpuIoBinding {
+  virtual ~DpuIoBinding() {}
+  const DpuController *owner = nullptr;
+  std::vector<vart::TensorBuffer*> inputs;
+  std::vector<vart::TensorBuffer*> outputs;
+  std::shared_ptr<const DpuTopK> topk;  // set by DpuController::with_topk()
+};
+
 /*
  * DPU-specific hostcode
  */
 
 class DpuController {
  public:
-  DpuController(std::string meta, xir::Attrs* attrs) {}
-  DpuController(const xir::Subgraph *subgraph, xir::Attrs* attrs) {}
+  DpuController(std::string meta, xir::Attrs* attrs) : engine_(get_engine(attrs)) {}
+  DpuController(const xir::Subgraph *subgraph, xir::Attrs* attrs) : engine_(get_engine(attrs)) {}
   virtual ~DpuController() {}
+  // engine that runs this controller's jobs; worker ids come from it
+  Engine &get_engine() const { return engine_; }
+  // engine named by attrs "engine" (created from "engine_*" attrs on first
+  // use), or the default engine
+  static Engine &get_engine(const xir::Attrs* attrs);
   virtual void run(
     const std::vector<vart::TensorBuffer*> &inputs, 
     const std::vector<vart::TensorBuffer*> &outputs) = 0;
+  // resolve the buffers once for repeated runs; by default only records them
+  virtual std::shared_ptr<const DpuIoBinding> bind(
+    const std::vector<vart::TensorBuffer*> &inputs,
+    const std::vector<vart::TensorBuffer*> &outputs) {
+    auto binding = std::make_shared<DpuIoBinding>();
+    binding->owner = this;
+    binding->inputs = inputs;
+    binding->outputs = outputs;
+    return binding;
+  }
+  virtual void run_bound(const DpuIoBinding &binding) {
+    run(binding.inputs, binding.outputs);
+  }
+  // pin a user host region once so runs can DMA buffers inside it without
+  // staging; false if this controller has no such path (runs copy as before)
+  virtual bool register_memory(void* /*ptr*/, size_t /*size*/) { return false; }
+  virtual void unregister_memory(void* /*ptr*/) {}
+  // binding that also runs topk after each download
+  virtual std::shared_ptr<const DpuIoBinding> with_topk(
+    const DpuIoBinding& /*binding*/, const DpuTopK& /*topk*/) {
+    throw std::runtime_error("Error: post-processing not supported by this controller");
+  }
+  // binding that moves only its first batch elements, see
+  // DpuRunner::with_batch()
+  virtual std::shared_ptr<const DpuIoBinding> with_batch(
+    const DpuIoBinding& /*binding*/, unsigned /*batch*/) {
+    throw std::runtime_error("Error: partial batches not supported by this controller");
+  }
+  // binding whose outputs stay on the device after each run until read,
+  // see DpuRunner::with_lazy_outputs()
+  virtual std::shared_ptr<const DpuIoBinding> with_lazy_outputs(
+    const DpuIoBinding& /*binding*/) {
+    throw std::runtime_error("Error: lazy outputs not supported by this controller");
+  }
+  // re-bind downstream (one of our bindings) to read those of its inputs
+  // that are upstream's outputs where upstream's DPU wrote them; returns
+  // {upstream, downstream} re-bound, see DpuRunner::chain()
+  virtual std::pair<std::shared_ptr<const DpuIoBinding>, std::shared_ptr<const DpuIoBinding>> chain(
+    const DpuIoBinding& /*upstream*/, const DpuIoBinding& /*downstream*/, bool /*download_chained*/) {
+    throw std::runtime_error("Error: chained execution not supported by this controller");
+  }
   virtual std::vector<const xir::Tensor*> get_input_tensors() const = 0; 
   virtual std::vector<const xir::Tensor*> get_output_tensors() const = 0; 
   virtual std::vector<vart::TensorBuffer*> get_inputs(int batchsz=-1) = 0;
   virtual std::vector<vart::TensorBuffer*> get_outputs(int batchsz=-1) = 0;
   virtual std::vector<float> get_input_scale() = 0;
   virtual std::vector<float> get_output_scale() = 0;
+  // warm-up hooks, see DpuRunner::warmup()
+  // touch every host page of the buffers handed out so far
+  virtual void fault_in_buffers() {}
+  // create resources owned by worker_id; called from that worker's thread
+  virtual void init_worker(unsigned /*worker_id*/) {}
+  // wall time of each construction phase (acquire, model, upload, ...)
+  const StartupProfile &get_startup_profile() const { return startup_; }
+  // false while this controller's CU is hung and not yet recovered
+  virtual bool is_healthy() const { return true; }
+
+ protected:
+  Engine &engine_;
+  StartupProfile startup_;
 
  private:
   DpuController() = delete;
@@ -61,6 +152,7 @@ class XclDpuController : public DpuController {
   virtual std::vector<vart::TensorBuffer*> get_outputs(int batchsz=-1) override;
   virtual std::vector<float> get_input_scale() override;
   virtual std::vector<float> get_output_scale() override;
+  virtual void fault_in_buffers() override;
 
  protected:
   virtual std::vector<vart::TensorBuffer*> create_tensor_buffers(
@@ -34,7 +34,6 @@
 #include "dpu_runner.hpp"
 #include "xir/tensor/tensor.hpp"
 #include "vart/tensor_buffer.hpp"
-#include "vitis/ai/target_factory.hpp"
 //#include "common/graph.hpp"
 
 #include "vitis/ai/env_config.hpp"
@@ -119,158 +118,19 @@ DpuV3eController::DpuV3eController(const xir::Subgraph *subgraph, xir::Attrs* at
   hbmc.clear();
 
   if(!ENV_PARAM(XLNX_DPU_HBM_GLOBAL_ADDRESSING)) {
-    std::string kernelName;
-    bool enable_dwc=false;
-    if (subgraph->has_attr("dpu_fingerprint")) {
-      const uint64_t fingerprint = subgraph->get_attr<std::uint64_t>("dpu_fingerprint");
-      kernelName = vitis::ai::target_factory()->create(fingerprint).name();
-    } else {
-      kernelName = subgraph->get_attr<std::string>("kernel");
+    // weights are split into segments W0/W1, each wants its own bank
+    plan_ = plan_hbm(/*num_weight_banks*/2);
+    use_plan_ = true;
+    hbmw = plan_.ordered(plan_.weights, 2);
+    hbmc = plan_.ordered(plan_.code);
+  } else {
+    for (int i=0; i< 32; i++) {
+      hbmio.push_back(i);
+      hbmc.push_back(i);
+      hbmw.push_back(i);
     }
-    if(kernelName.find("DWC") != std::string::npos) {
-      enable_dwc = true; 
-    }
-    auto handle = contexts_[0]->get_dev_handle();
-    auto cu_index = handle_->get_device_info().cu_index;
-
-    xclDeviceInfo2 deviceInfo;
-    if (xclGetDeviceInfo2(handle, &deviceInfo)) {
-      throw std::runtime_error("Unable to obtain device information");
-    }
-    string dsa = deviceInfo.mName;
-
-    if (dsa.find("u50lv") != std::string::npos) {
-      if(!enable_dwc) {
-        if (cu_index == 0) {
-          hbmio.push_back(0);
-          hbmio.push_back(1);
-          hbmio.push_back(16);
-          hbmio.push_back(17);
-          hbmio.push_back(2);
-          hbmc.push_back(6);
-          hbmw.push_back(20);
-          hbmw.push_back(21);
-        }
-        else {
-          hbmio.push_back(3);
-          hbmio.push_back(4);
-          hbmio.push_back(18);
-          hbmio.push_back(19);
-          hbmio.push_back(5);
-          hbmc.push_back(7);
-          hbmw.push_back(22);
-          hbmw.push_back(23);
-        }
-      } else {
-        if (cu_index == 0) {
-          hbmio.push_back(0);
-          hbmio.push_back(16);
-          hbmio.push_back(17);
-          hbmio.push_back(1);
-          hbmc.push_back(22);
-          hbmw.push_back(20);
-          hbmw.push_back(21);
-        }
-        else {
-          hbmio.push_back(2);
-          hbmio.push_back(18);
-          hbmio.push_back(19);
-          hbmio.push_back(3);
-          hbmc.push_back(6);
-          hbmw.push_back(4);
-          hbmw.push_back(5);
-        }
-
-      }
-    }
-    else if (dsa.find("u50") != std::string::npos) {
-      if (cu_index == 0) {
-        hbmio.push_back(0);
-        hbmio.push_back(10);
-        hbmio.push_back(11);
-        hbmc.push_back(8);
-        hbmw.push_back(4);
-        hbmw.push_back(5);
-      }
-      else {
-        hbmio.push_back(1);
-        hbmio.push_back(12);
-        hbmio.push_back(13);
-        hbmc.push_back(9);
-        hbmw.push_back(6);
-        hbmw.push_back(7);
-      }
-    }
-    else if ((dsa.find("u280") != std::string::npos) || (dsa.find("u55c") != std::string::npos)) {
-      if(!enable_dwc) {
-        if (cu_index == 0) {
-          hbmio.push_back(0);
-          hbmio.push_back(19);
-          hbmio.push_back(20);
-          hbmio.push_back(1);
-          hbmc.push_back(16);
-          hbmw.push_back(10);
-          hbmw.push_back(11);
-        }
-        else if (cu_index == 1) {
-          hbmio.push_back(2);
-          hbmio.push_back(3);
-          hbmio.push_back(21);
-          hbmio.push_back(22);
-          hbmio.push_back(4);
-          hbmc.push_back(17);
-          hbmw.push_back(12);
-          hbmw.push_back(13);
-        }
-        else {
-          hbmio.push_back(5);
-          hbmio.push_back(6);
-          hbmio.push_back(23);
-          hbmio.push_back(24);
-          hbmio.push_back(7);
-          hbmc.push_back(18);
-          hbmw.push_back(14);
-          hbmw.push_back(15);
-        }
-      } else {
-        if (cu_index == 1) {
-          hbmio.push_back(0);
-          hbmio.push_back(16);
-          hbmio.push_back(17);
-          hbmc.push_back(24);
-          hbmw.push_back(8);
-          hbmw.push_back(9);
-        }
-        else if (cu_index == 0) {
-          hbmio.push_back(1);
-          hbmio.push_back(18);
-          hbmio.push_back(19);
-          hbmio.push_back(2);
-          hbmc.push_back(25);
-          hbmw.push_back(22);
-          hbmw.push_back(23);
-        }
-        else {
-          hbmio.push_back(3);
-          hbmio.push_back(20);
-          hbmio.push_back(21);
-          hbmio.push_back(4);
-          hbmc.push_back(26);
-          hbmw.push_back(10);
-          hbmw.push_back(11);
-        }
-
-      }
-       
-    }
-  }
-  for (int i=0; i< 32; i++) {
-    hbmio.push_back(i);
-    hbmc.push_back(i);
-    hbmw.push_back(i);
   }
 
-
   init_graph(hbmw,hbmc,attrs);
 }
 
@@ -284,5 +144,13 @@ std::vector<unsigned> DpuV3eController::get_hbmc() {
   return hbmc;
 }
 std::vector<unsigned> DpuV3eController::get_hbmio() {
+  // one slot per batch engine, see create_tensor_buffers_hbm()
+  if (use_plan_)
+    return plan_.ordered(plan_.io, batch_size_);
+  return hbmio;
+}
+std::vector<unsigned> DpuV3eController::get_hbmws() {
+  if (use_plan_)
+    return plan_.ordered(plan_.workspace, batch_size_);
   return hbmio;
 }
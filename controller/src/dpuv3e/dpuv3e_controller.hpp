@@ -24,6 +24,7 @@ class DpuV3eController
   virtual std::vector<unsigned> get_hbmw() override;
   virtual std::vector<unsigned> get_hbmc() override;
   virtual std::vector<unsigned> get_hbmio() override;
+  virtual std::vector<unsigned> get_hbmws() override;
   //virtual void run(
   //  const std::vector<vart::TensorBuffer*> &inputs, 
   //  const std::vector<vart::TensorBuffer*> &outputs) override;
@@ -33,5 +34,7 @@ class DpuV3eController
   std::vector<unsigned> hbmw;
   std::vector<unsigned> hbmc;
   std::vector<unsigned> hbmio;
+  HbmPlan plan_;
+  bool use_plan_ = false;
 };
 
@@ -23,13 +23,11 @@
 using namespace std;
 std::mutex globalMutex;
 
-Dpuv3Int8Controller::Dpuv3Int8Controller(std::string meta, xir::Attrs* attrs) : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(meta, attrs) {
+Dpuv3Int8Controller::Dpuv3Int8Controller(std::string meta, xir::Attrs* attrs) : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(meta, attrs),
+  contexts_(*handle_, engine_.get_num_workers()) {
 
-  Engine& engine = Engine::get_instance();
-  for (unsigned i=0; i < engine.get_num_workers(); i++)
-    contexts_.emplace_back(new XrtContext(*handle_));
-  inputsTBfs_.resize(engine.get_num_workers());
-  outputsTBfs_.resize(engine.get_num_workers());
+  inputsTBfs_.resize(engine_.get_num_workers());
+  outputsTBfs_.resize(engine_.get_num_workers());
   xmodel_.reset(new Xmodel(meta, false));
 
   initializeTensors(); 
@@ -37,14 +35,12 @@ Dpuv3Int8Controller::Dpuv3Int8Controller(std::string meta, xir::Attrs* attrs) :
   initCreateBuffers();
 }
 
-Dpuv3Int8Controller::Dpuv3Int8Controller(const xir::Subgraph *subgraph, xir::Attrs* attrs) : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(subgraph, attrs)
+Dpuv3Int8Controller::Dpuv3Int8Controller(const xir::Subgraph *subgraph, xir::Attrs* attrs) : XclDpuController<XrtDeviceHandle, XrtDeviceBuffer, XrtDeviceBuffer>(subgraph, attrs),
+  contexts_(*handle_, engine_.get_num_workers())
 {
 
-  Engine& engine = Engine::get_instance();
-  for (unsigned i=0; i < engine.get_num_workers(); i++)
-    contexts_.emplace_back(new XrtContext(*handle_));
-  inputsTBfs_.resize(engine.get_num_workers());
-  outputsTBfs_.resize(engine.get_num_workers());
+  inputsTBfs_.resize(engine_.get_num_workers());
+  outputsTBfs_.resize(engine_.get_num_workers());
   xmodel_ = std::make_unique<Xmodel>(subgraph, attrs, false);
  
   initializeTensors();
@@ -715,15 +711,27 @@ void Dpuv3Int8Controller::data_float2fix(int8_t* dataDst, float* dataSrc, int si
     dataDst[i] = (int8_t)(dataSrc[i]*scale);
 }
 
+void Dpuv3Int8Controller::init_worker(unsigned worker_id) {
+  if (worker_id >= contexts_.size())
+    throw std::runtime_error("Error: worker_id too large; update controller code");
+
+  contexts_[worker_id];
+  // staging buffers for user-provided tensor buffers, see run()
+  if (inputsTBfs_[worker_id].size() == 0)
+  {
+    inputsTBfs_[worker_id] = get_inputs();
+    outputsTBfs_[worker_id] = get_outputs();
+  }
+}
+
 void Dpuv3Int8Controller::run(const std::vector<vart::TensorBuffer*> &inputs,
                         const std::vector<vart::TensorBuffer*> &outputs) {
 
-  Engine& engine = Engine::get_instance();
-  const unsigned worker_id = engine.get_my_worker_id();
+  const unsigned worker_id = engine_.get_my_worker_id();
   if (worker_id >= contexts_.size())
     throw std::runtime_error("Error: worker_id too large; update controller code");
 
-  auto &context = *(contexts_[worker_id]);
+  auto &context = contexts_[worker_id];
   auto xcl_handle = context.get_dev_handle();
   auto bo_handle = context.get_bo_handle();
   auto bo_addr = context.get_bo_addr();
@@ -43,6 +43,7 @@ class Dpuv3Int8Controller : public XclDpuController<XrtDeviceHandle, XrtDeviceBu
   virtual std::vector<const xir::Tensor*> get_output_tensors() const override; 
   virtual std::vector<vart::TensorBuffer*> get_inputs(int batchsz=-1) override;
   virtual std::vector<vart::TensorBuffer*> get_outputs(int batchsz=-1) override;
+  virtual void init_worker(unsigned worker_id) override;
 
 
  protected:    
@@ -83,7 +84,7 @@ class Dpuv3Int8Controller : public XclDpuController<XrtDeviceHandle, XrtDeviceBu
   std::unique_ptr<xir::Tensor> druDst_tensor_;
 
   std::vector<int,rte::AlignedAllocator<int>> instr_;
-  std::vector<std::unique_ptr<XrtContext>> contexts_;
+  XrtWorkerContexts contexts_;
   std::vector<std::vector<vart::TensorBuffer*>> inputsTBfs_;
   std::vector<std::vector<vart::TensorBuffer*>> outputsTBfs_;
 
@@ -114,6 +114,8 @@ static uint32_t read32_dpu_reg(xclDeviceHandle dpu_handle, uint64_t offset) {
 
 DpuV3meController::DpuV3meController(std::string meta, xir::Attrs* attrs)
   : DpuCloudController(meta, attrs) {
+  // run() always stages user host buffers
+  binds_io_ = false;
 
   dpu_hbm_start = ENV_PARAM(DPU_HBM_START)? ENV_PARAM(DPU_HBM_START) : 16;
   for (int i=dpu_hbm_start; i<32;i++)
@@ -123,11 +125,20 @@ DpuV3meController::DpuV3meController(std::string meta, xir::Attrs* attrs)
 
 DpuV3meController::DpuV3meController(const xir::Subgraph *subgraph, xir::Attrs* attrs) 
   : DpuCloudController(subgraph, attrs) {
+  // run() always stages user host buffers
+  binds_io_ = false;
 
+  // DPU_HBM_START pins the old fixed range, otherwise follow the xclbin
   dpu_hbm_start = ENV_PARAM(DPU_HBM_START)? ENV_PARAM(DPU_HBM_START) : 16;
-  for (int i=dpu_hbm_start; i<32;i++)
-    hbm.emplace_back(i);
-  init_graph(hbm,hbm,attrs);
+  if (ENV_PARAM(DPU_HBM_START)) {
+    for (int i=dpu_hbm_start; i<32;i++)
+      hbm.emplace_back(i);
+    init_graph(hbm,hbm,attrs);
+  } else {
+    plan_ = plan_hbm(/*num_weight_banks*/1);
+    use_plan_ = true;
+    init_graph(get_hbmw(),get_hbmc(),attrs);
+  }
 }
 DpuV3meController::~DpuV3meController() {
 }
@@ -141,10 +152,11 @@ std::tuple<uint64_t,int32_t,std::string> DpuV3meController::alloc_and_fill_devic
   for (unsigned i=0; i < size; i++){
     ((char*)codePtr)[i] = code[i];
   }
-  for (int idx=dpu_hbm_start; idx<32; idx++) {
-    auto codeMem = xclAllocUserPtrBO(handle, codePtr, size, idx);
+  auto banks = get_hbmc();
+  for (unsigned i=0; i<banks.size(); i++) {
+    auto codeMem = xclAllocUserPtrBO(handle, codePtr, size, banks[i]);
     if (codeMem == NULLBO) {
-      if (idx == 31) {
+      if (i == banks.size()-1) {
         throw std::bad_alloc();
       }else {
         continue;
@@ -164,12 +176,23 @@ std::tuple<uint64_t,int32_t,std::string> DpuV3meController::alloc_and_fill_devic
 //    return get_outputs_inner(hbm, batchsz);
 //}
 std::vector<unsigned> DpuV3meController::get_hbmw() {
+  if (use_plan_)
+    return plan_.ordered(plan_.weights);
   return hbm;
 }
 std::vector<unsigned> DpuV3meController::get_hbmc() {
+  if (use_plan_)
+    return plan_.ordered(plan_.code);
   return hbm;
 }
 std::vector<unsigned> DpuV3meController::get_hbmio() {
+  if (use_plan_)
+    return plan_.ordered(plan_.io, batch_size_);
+  return hbm;
+}
+std::vector<unsigned> DpuV3meController::get_hbmws() {
+  if (use_plan_)
+    return plan_.ordered(plan_.workspace, batch_size_);
   return hbm;
 }
 static void _show_regs(xclDeviceHandle xcl_handle, uint64_t cuba){
@@ -242,14 +265,16 @@ void DpuV3meController::run(const std::vector<vart::TensorBuffer*> &inputs,
     const std::vector<vart::TensorBuffer*> &outputs) {
   std::vector<vart::TensorBuffer*> input_tensor_buffers;
   std::vector<vart::TensorBuffer*> output_tensor_buffers;
-  if(inputs.size()%model_->get_input_tensors().size())
+  const auto &input_io = model_->get_input_io();
+  const auto &output_io = model_->get_output_io();
+  if(inputs.size()%input_io.size())
     throw std::runtime_error("Error: input tensorbuffers error");
-  unsigned ibs = inputs[0]->get_tensor()->get_shape()[0]*batch_size_/model_->get_input_tensors()[0]->get_shape()[0];
-  unsigned obs = outputs[0]->get_tensor()->get_shape()[0]*batch_size_/model_->get_output_tensors()[0]->get_shape()[0];
+  unsigned ibs = inputs[0]->get_tensor()->get_shape()[0]*batch_size_/input_io[0].tensor->get_shape()[0];
+  unsigned obs = outputs[0]->get_tensor()->get_shape()[0]*batch_size_/output_io[0].tensor->get_shape()[0];
 
   unsigned inputBs;
-  if ((inputs.size()/model_->get_input_tensors().size())>1)
-    inputBs = inputs.size()/model_->get_input_tensors().size();
+  if ((inputs.size()/input_io.size())>1)
+    inputBs = inputs.size()/input_io.size();
   else
     inputBs = ibs;
   if ((ibs < obs) || (inputBs > BATCHSIZE) )
@@ -282,25 +307,36 @@ void DpuV3meController::run(const std::vector<vart::TensorBuffer*> &inputs,
     input_tensor_buffers = inputs;
     output_tensor_buffers = outputs;
   }
-  Engine& engine = Engine::get_instance();
-  const unsigned worker_id = engine.get_my_worker_id();
+  const unsigned worker_id = engine_.get_my_worker_id();
   if (worker_id >= contexts_.size())
     throw std::runtime_error("Error: worker_id too large; update controller code");
-  auto &context = *(contexts_[worker_id]);
+  auto &context = contexts_[worker_id];
   auto xcl_handle = context.get_dev_handle();
   //auto xcl_handle_tmp = handle_->get_context().get_dev_handle();
   auto bo_handle = context.get_bo_handle();
   auto bo_addr = context.get_bo_addr();
 
-  vector<std::tuple<int, int,uint64_t>> xdpu_total_dpureg_map2;
+  std::shared_ptr<const DpuAddrTable> io_addrs;
 
   //std::vector<uint64_t> in_addrs(batch_size_);
   //std::vector<uint64_t> out_addrs(batch_size_);
   if (create_tb_outside && tensorbuffer_phy) {
-    xdpu_total_dpureg_map2 = get_dpu_reg_outside(create_tb_batch, output_tensor_buffers, input_tensor_buffers);
+    io_addrs = get_dpu_reg_outside(create_tb_batch, output_tensor_buffers, input_tensor_buffers);
   } else {
-    xdpu_total_dpureg_map2 = get_dpu_reg_inside(create_tb_batch,  output_tensor_buffers, input_tensor_buffers);
+    io_addrs = get_dpu_reg_inside(create_tb_batch,  output_tensor_buffers, input_tensor_buffers);
   }
+  const DpuAddrTable &xdpu_total_dpureg_map2 = *io_addrs;
+  DpuRunSample sample;
+  sample.batch = inputBs;
+  sample.programmed_batch = batch_size_;
+  DpuRunSample *profiled = dpu_profile_ ? &sample : nullptr;
+  auto phase_start = std::chrono::steady_clock::now();
+  auto phase_ns = [&phase_start]() {
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - phase_start).count();
+    phase_start = now;
+    return ns;
+  };
 
   // upload batch of inputs
   //const auto inSize = get_input_tensors()[0]->get_element_num();
@@ -314,11 +350,10 @@ void DpuV3meController::run(const std::vector<vart::TensorBuffer*> &inputs,
      //const auto mode = std::ios_base::out | std::ios_base::binary | std::ios_base::trunc;
      //  auto input_file = "./input"+ to_string(i)+".bin";
      //  std::ofstream(input_file, mode).write((char*)inputs[i]->data().first,inSize);
-      for (unsigned j=0; j < model_->get_input_offset().size(); j++) {
+      for (unsigned j=0; j < input_io.size(); j++) {
         uint8_t* dataPtr;
-        auto tensor = get_input_tensors()[j];
-        const auto inSize =tensor->get_element_num()/batch_size_;
-        auto reg_id = tensor->get_attr<int32_t>("reg_id"); 
+        const auto &io = input_io[j];
+        const auto inSize = io.size;
         if (create_tb_batch) {
           auto idx = input_tensor_buffers[j]->get_tensor()->get_shape();
           auto dims = vector<int>(idx.size(),0);
@@ -326,12 +361,12 @@ void DpuV3meController::run(const std::vector<vart::TensorBuffer*> &inputs,
           dataPtr = ((uint8_t*)input_tensor_buffers[j]->data(dims).first)+inSize*i;
         }
         else {
-          auto idx = input_tensor_buffers[i*model_->get_input_offset().size()+j]->get_tensor()->get_shape();
+          auto idx = input_tensor_buffers[i*input_io.size()+j]->get_tensor()->get_shape();
           auto dims = vector<int>(idx.size(),0);
-          dataPtr =(uint8_t*)input_tensor_buffers[i*model_->get_input_offset().size()+j]->data(dims).first;
+          dataPtr =(uint8_t*)input_tensor_buffers[i*input_io.size()+j]->data(dims).first;
         }
         if (xclUnmgdPwrite(xcl_handle, 0, (void *)dataPtr, inSize,
-          get_addr(reg_id, i, xdpu_total_dpureg_map2)  + model_->get_input_offset()[j]))
+          xdpu_total_dpureg_map2.get(io.reg_id, i)  + io.offset))
           throw std::runtime_error("Error: upload failed");
       }
 
@@ -339,8 +374,9 @@ void DpuV3meController::run(const std::vector<vart::TensorBuffer*> &inputs,
   }
 
   __TOC__(INPUT_H2D)
+  if (profiled && !tensorbuffer_phy)
+    sample.h2d_ns = phase_ns();
   int p;
-  int exec_buf_result;
   auto ecmd = reinterpret_cast<ert_start_kernel_cmd*>(bo_addr);
   ecmd->cu_mask = handle_->get_device_info().cu_mask;
   ecmd->extra_cu_masks = 0;
@@ -350,13 +386,17 @@ void DpuV3meController::run(const std::vector<vart::TensorBuffer*> &inputs,
   ecmd->type = ERT_CTRL;
 
   auto core_idx = handle_->get_device_info().cu_index;
-auto trigger_dpu_func = [&](){
+  // debug mode points it at each layer's code in turn
+  auto program = get_program();
+auto trigger_dpu_once = [&]() -> bool {
   __TIC__(DPU_TRIGGER)
 
   //auto t1 = std::chrono::high_resolution_clock::now();
 
   std::vector<std::pair<int, int> > regVals;
-  if (0 == program_once_complete) {
+  // code and params are only written here, so a switch redoes all of it
+  auto lease = cu_sched_->acquire(preload_state_);
+  if (lease.needs_preload() || 0 == program_once_complete) {
 
     // in debug mode, need to run preload instruction layer by layer
     if(!debug_mode_){
@@ -369,18 +409,13 @@ auto trigger_dpu_func = [&](){
     regVals.push_back( { 0x18 / 4, 0x0 });
     regVals.push_back( { XDPU_CONTROL_HP / 4, 0x2020 });
 
-    if (preload_code_addr_){
+    if (program.preload_code_addr){
       // do preload
-      regVals.push_back( { XDPU_CONTROL_INSTR_L / 4, preload_code_addr_ & 0xFFFFFFFF });
-      regVals.push_back( { XDPU_CONTROL_INSTR_H / 4, (preload_code_addr_ >> 32) & 0xFFFFFFFF });
+      regVals.push_back( { XDPU_CONTROL_INSTR_L / 4, program.preload_code_addr & 0xFFFFFFFF });
+      regVals.push_back( { XDPU_CONTROL_INSTR_H / 4, (program.preload_code_addr >> 32) & 0xFFFFFFFF });
 //      regVals.push_back( { XDPU_CONTROL_ADDR_0_L / 4, reg0_addr_ & 0xFFFFFFFF });
 //      regVals.push_back( { XDPU_CONTROL_ADDR_0_H / 4, (reg0_addr_ >> 32) & 0xFFFFFFFF });
-      auto iter = xdpu_total_dpureg_map.begin();
-      while(iter !=xdpu_total_dpureg_map.end()) {
-        regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*iter->first) / 4, iter->second & 0xFFFFFFFF });
-        regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*iter->first) / 4, (iter->second >> 32) & 0xFFFFFFFF });
-        iter++;
-      }
+      regVals.insert(regVals.end(), program.param_reg_vals.begin(), program.param_reg_vals.end());
 
       p = 6;
       for (unsigned i=0; i < regVals.size(); i++) {
@@ -390,65 +425,26 @@ auto trigger_dpu_func = [&](){
       ecmd->count = 1 + p;
 
       //vitis::ai::trace::add_trace("dpu-controller", vitis::ai::trace::func_start, core_idx);
-      // exec kernel
-      exec_buf_result = xclExecBuf(xcl_handle, bo_handle);
-      if (exec_buf_result)
-        throw std::runtime_error("Error: xclExecBuf failed");
-
-      // wait for kernel
-      for (int wait_count=0; wait_count < 15 && xclExecWait(xcl_handle, 1000) == 0
-              && ecmd->state != ERT_CMD_STATE_COMPLETED; wait_count++);
-      //vitis::ai::trace::add_trace("dpu-controller", vitis::ai::trace::func_start, core_idx);
-
-      if (ecmd->state != ERT_CMD_STATE_COMPLETED) {
+      // exec kernel and wait
+      if (!exec_and_wait(ecmd, xcl_handle, bo_handle)) {
         _show_regs(xcl_handle, handle_->get_device_info().cu_base_addr);
-        std::cout << "Error: CU timeout when do preload " << std::endl;
-        throw std::runtime_error("Error: CU timeout when do preload "
-          + std::to_string(handle_->get_device_info().cu_index));
+        LOG(WARNING) << "Error: CU timeout when do preload " << core_idx;
+        return false;
       }
+      lease.preloaded();
       regVals.clear();
     }
 
     //configure real code and parameter
-    regVals.push_back( { XDPU_CONTROL_INSTR_L / 4, code_addr_ & 0xFFFFFFFF });
-    regVals.push_back( { XDPU_CONTROL_INSTR_H / 4, (code_addr_ >> 32) & 0xFFFFFFFF });
-    auto iter = xdpu_total_dpureg_map.begin();
-    while(iter !=xdpu_total_dpureg_map.end()) {
-      regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*iter->first) / 4, iter->second & 0xFFFFFFFF });
-      regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*iter->first) / 4, (iter->second >> 32) & 0xFFFFFFFF });
-      LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-          << "parameter: "  //
-          << iter->second      //
-          ;
-      iter++;
-    }
+    regVals.push_back( { XDPU_CONTROL_INSTR_L / 4, program.code_addr & 0xFFFFFFFF });
+    regVals.push_back( { XDPU_CONTROL_INSTR_H / 4, (program.code_addr >> 32) & 0xFFFFFFFF });
+    regVals.insert(regVals.end(), program.param_reg_vals.begin(), program.param_reg_vals.end());
 
 //    regVals.push_back( { XDPU_CONTROL_ADDR_0_L / 4, reg0_addr_ & 0xFFFFFFFF });
 //    regVals.push_back( { XDPU_CONTROL_ADDR_0_H / 4, (reg0_addr_ >> 32) & 0xFFFFFFFF });
   }
-   auto iter3 = workspace_addr.begin();
-    while(iter3 != workspace_addr.end() ) {
-      for (int bz=0;bz<batch_size_;bz++) {
-        regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*iter3->first + bz*0x100) / 4, (iter3->second)[bz] & 0xFFFFFFFF });
-        regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*iter3->first + bz*0x100) / 4, (iter3->second[bz] >> 32) & 0xFFFFFFFF });
-        LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-          << "io: "  //
-          << iter3->second[bz]      //
-          ;
-      }
-      iter3++;
-    }
-
-    for (auto iter2 : xdpu_total_dpureg_map2) {
-      regVals.push_back(  { (XDPU_CONTROL_ADDR_0_L + 8*std::get<0>(iter2) + std::get<1>(iter2)*0x100) / 4, std::get<2>(iter2) & 0xFFFFFFFF });
-      regVals.push_back(  { (XDPU_CONTROL_ADDR_0_H + 8*std::get<0>(iter2) + std::get<1>(iter2)*0x100) / 4, (std::get<2>(iter2) >> 32) & 0xFFFFFFFF });
-   LOG_IF(INFO, ENV_PARAM(DEBUG_DPU_CONTROLLER))
-          << "io: "  //
-          << std::get<0>(iter2)
-          << std::hex << " "
-          << std::get<2>(iter2)      //
-          ;
-    }
+    regVals.insert(regVals.end(), program.workspace_reg_vals.begin(), program.workspace_reg_vals.end());
+    append_io_reg_vals(regVals, xdpu_total_dpureg_map2);
 
   p = 6;
   for (unsigned i=0; i < regVals.size(); i++)
@@ -464,13 +460,7 @@ auto trigger_dpu_func = [&](){
 #ifndef _WIN32
   vitis::ai::trace::add_trace("dpu-controller", vitis::ai::trace::func_start, core_idx);
 #endif
-  exec_buf_result = xclExecBuf(xcl_handle, bo_handle);
-  if (exec_buf_result)
-    throw std::runtime_error("Error: xclExecBuf failed");
-
-  // wait for kernel
-  for (int wait_count=0; wait_count < 15 && xclExecWait(xcl_handle, 1000) == 0
-            && ecmd->state != ERT_CMD_STATE_COMPLETED; wait_count++);
+  const bool completed = exec_and_wait(ecmd, xcl_handle, bo_handle);
 #ifndef _WIN32
   vitis::ai::trace::add_trace("dpu-controller", vitis::ai::trace::func_end, core_idx);
 #endif
@@ -481,12 +471,15 @@ auto trigger_dpu_func = [&](){
     std::cout << "xclExecBuf: us " << fp_us.count() << std::endl;
   }
 
-  if (ecmd->state != ERT_CMD_STATE_COMPLETED)
+  if (!completed)
   {
     _show_regs(xcl_handle, handle_->get_device_info().cu_base_addr);
-    std::cout << "Error: CU timeout " << std::endl;
-    throw std::runtime_error("Error: CU timeout " + std::to_string(handle_->get_device_info().cu_index));
+    LOG(WARNING) << "Error: CU timeout " << core_idx;
+    return false;
   }
+  lease.preloaded();
+  if (profiled)
+    profiled->add_counters(xcl_handle, handle_->get_device_info().cu_base_addr);
   if(ENV_PARAM(DPU_IP_COUNTER)){
     _show_regs(xcl_handle, handle_->get_device_info().cu_base_addr);
   }
@@ -496,11 +489,19 @@ auto trigger_dpu_func = [&](){
   //auto t2 = std::chrono::high_resolution_clock::now();
   //std::chrono::duration<double, std::micro> fp_us = t2 - t1;
   //std::cout << "dpu trigger: us " << fp_us.count() << std::endl;
-
+  return true;
+};
+// a hung CU is reset and the job retried once
+auto trigger_dpu_func = [&]() {
+  if (profiled)
+    phase_ns();
+  retry_on_hang(ecmd, xcl_handle, bo_handle, trigger_dpu_once);
+  if (profiled)
+    sample.exec_ns += phase_ns();
 };
 
  auto t1 = std::chrono::high_resolution_clock::now();
-  auto dbg_layers = model_->get_dbg_layers();
+  const auto &dbg_layers = model_->get_dbg_layers();
   // program DPU request
   if(!debug_mode_) { //=== run release instructions
     if(dump_mode_ ) { // dump input
@@ -511,7 +512,7 @@ auto trigger_dpu_func = [&](){
         auto reg_id = std::get<3>(out);
         auto data = std::make_unique<char[]>(size);
         for (int i=0; i < batch_size_; i++) {
-          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, get_addr(reg_id, i, xdpu_total_dpureg_map2) + offset))
+          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, xdpu_total_dpureg_map2.get(reg_id, i) + offset))
             throw std::runtime_error("Error: dump failed!");
           std::stringstream ss;
           ss << dump_folder_ << "/E" << i << "/" << std::get<2>(out);
@@ -522,7 +523,7 @@ auto trigger_dpu_func = [&](){
         tensor_idx++;
       }
     }
-    auto info = model_->get_subgraph_info();
+    const auto &info = model_->get_subgraph_info();
 #ifndef _WIN32
     vitis::ai::trace::add_trace("dpu-runner", info.name, batch_size_, info.workload, info.depth);
 #endif
@@ -536,7 +537,7 @@ auto trigger_dpu_func = [&](){
         auto reg_id = std::get<3>(out);
         auto data = std::make_unique<char[]>(size);
         for (int i=0; i < batch_size_; i++) {
-          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, get_addr(reg_id, i, xdpu_total_dpureg_map2) + offset))
+          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, xdpu_total_dpureg_map2.get(reg_id, i) + offset))
             throw std::runtime_error("Error: dump failed!");
           std::stringstream ss;
           ss << dump_folder_ << "/E" << i << "/" << std::get<2>(out);
@@ -557,7 +558,7 @@ auto trigger_dpu_func = [&](){
         auto reg_id = std::get<3>(input);
         auto data = std::make_unique<char[]>(size);
         for (int i=0; i < batch_size_; i++) {
-          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, get_addr(reg_id, i, xdpu_total_dpureg_map2) + offset))
+          if (xclUnmgdPread(xcl_handle, 0, data.get(), size, xdpu_total_dpureg_map2.get(reg_id, i) + offset))
             throw std::runtime_error("Error: dump failed!");
           std::stringstream ss;
           ss << dump_folder_ << "/E" << i << "/" << std::get<2>(input); 
@@ -574,11 +575,11 @@ auto trigger_dpu_func = [&](){
       auto code_info = layer_debug_mode.find(layer.name);
       if (code_info != layer_debug_mode.end()) {
         if((code_info->second).second>0) {
-         code_addr_ = (code_info->second).first;
+         program.code_addr = (code_info->second).first;
          auto code_info_pre = layer_debug_mode_preload.find(layer.name);
          if (code_info_pre != layer_debug_mode_preload.end()) {
            if((code_info_pre->second).second>0) {
-             preload_code_addr_ = (code_info_pre->second).first;
+             program.preload_code_addr = (code_info_pre->second).first;
            }
          }
       //if(std::get<1>(layer.code_addr) > 0) {
@@ -599,13 +600,13 @@ auto trigger_dpu_func = [&](){
           auto reg_id = std::get<3>(out);
           auto data = std::make_unique<char[]>(size);
           //for (unsigned i=0; i < io_bufs.size(); i++) {
-          for (auto it :  xdpu_total_dpureg_map2 ) {
-            auto regid = std::get<0>(it);
+          for (auto &it :  xdpu_total_dpureg_map2.entries() ) {
+            auto regid = it.reg_id;
             if (regid == reg_id) {
-              if (xclUnmgdPread(xcl_handle, 0, data.get(), size, std::get<2>(it) + offset))
+              if (xclUnmgdPread(xcl_handle, 0, data.get(), size, it.addr + offset))
                 throw std::runtime_error("Error: dump failed!");
               std::stringstream ss;
-              ss << dump_folder_ << "/E" << std::get<1>(it) << "/" << std::get<2>(out);
+              ss << dump_folder_ << "/E" << it.idx << "/" << std::get<2>(out);
               std::ofstream ofs(ss.str(), std::ofstream::binary);
               ofs.write(data.get(), size);
               ofs.close();
@@ -619,16 +620,17 @@ auto trigger_dpu_func = [&](){
   }
 
 
+  if (profiled)
+    phase_ns();
  __TIC__(OUTPUT_D2H)
   if((!tensorbuffer_phy)&& (!ENV_PARAM(DPU_HW_POST))) for (unsigned i=0; i < inputBs; i++)
   {
     // instead of downloading all {output, input, intermediate},
     // just download output region
     // io_bufs[i]->download();
-      for (unsigned j=0; j< model_->get_output_offset().size(); j++) {
-        auto tensor = get_output_tensors()[j];
-        int32_t reg_id = tensor->get_attr<int32_t>("reg_id");
-        const auto outSize = tensor->get_element_num();
+      for (unsigned j=0; j< output_io.size(); j++) {
+        const auto &io = output_io[j];
+        const auto outSize = io.tensor->get_element_num();
         uint8_t* dataPtr;
         if (create_tb_batch) {
           auto idx = output_tensor_buffers[j]->get_tensor()->get_shape();
@@ -637,20 +639,25 @@ auto trigger_dpu_func = [&](){
           dataPtr = ((uint8_t *)output_tensor_buffers[j]->data(dims).first)+outSize*i;
         }
         else {
-          auto idx = output_tensor_buffers[i*model_->get_output_offset().size()+j]->get_tensor()->get_shape();
+          auto idx = output_tensor_buffers[i*output_io.size()+j]->get_tensor()->get_shape();
           auto dims = vector<int>(idx.size(),0);
-          dataPtr = (uint8_t *)output_tensor_buffers[i*model_->get_output_offset().size()+j]->data(dims).first;
+          dataPtr = (uint8_t *)output_tensor_buffers[i*output_io.size()+j]->data(dims).first;
         }
         //__TIC_PROFILING__(OUTPUT)
         if (xclUnmgdPread(xcl_handle, 0, (void*)dataPtr,
           outSize,
-           get_addr(reg_id, i, xdpu_total_dpureg_map2)  + model_->get_output_offset()[j]))
+           xdpu_total_dpureg_map2.get(io.reg_id, i)  + io.offset))
           throw std::runtime_error("Error: download failed");
         //__TOC_PROFILING__(OUTPUT)
       }
 
   }
   __TOC__(OUTPUT_D2H)
+  if (profiled) {
+    if (!tensorbuffer_phy && !ENV_PARAM(DPU_HW_POST))
+      sample.d2h_ns = phase_ns();
+    dpu_profile_->record(sample);
+  }
   if((!tensorbuffer_phy) &&create_tb_outside) {
     tensorbuffer_trans(input_tensor_buffers, output_tensor_buffers,inputs,outputs, false,buf_id);
   }
@@ -24,12 +24,24 @@ class DpuV3meController
   virtual void run(
     const std::vector<vart::TensorBuffer*> &inputs, 
     const std::vector<vart::TensorBuffer*> &outputs) override;
+  // io is resolved per run, a binding only records the buffers
+  virtual std::shared_ptr<const DpuIoBinding> bind(
+    const std::vector<vart::TensorBuffer*> &inputs,
+    const std::vector<vart::TensorBuffer*> &outputs) override {
+    return DpuController::bind(inputs, outputs);
+  }
+  virtual void run_bound(const DpuIoBinding &binding) override {
+    DpuController::run_bound(binding);
+  }
   virtual std::vector<unsigned> get_hbmw() override;
   virtual std::vector<unsigned> get_hbmc() override;
   virtual std::vector<unsigned> get_hbmio() override;
+  virtual std::vector<unsigned> get_hbmws() override;
   //virtual std::vector<vart::TensorBuffer*> get_outputs(int batchsz=-1) override; 
  private:
   std::tuple<uint64_t,int32_t,std::string> alloc_and_fill_device_memory(xclDeviceHandle handle, std::vector<char> code);
   int dpu_hbm_start;
   std::vector<unsigned> hbm;
+  HbmPlan plan_;
+  bool use_plan_ = false;
 };
@@ -53,9 +53,11 @@ Ipuv1CnnController::Ipuv1CnnController(const xir::Subgraph *subgraph)
   : XclDpuController<IpuDeviceHandle, IpuDeviceBuffer, IpuDeviceBuffer>(subgraph),
     inTensors_(initTensorVec(subgraph->get_input_tensors())),
     outTensors_(initTensorVec(subgraph->get_output_tensors())),
-    engine_(Engine::get_instance()),
+    workerInit_(engine_.get_num_workers()),
+    runners_(engine_.get_num_workers()),
     inputBuffers_(engine_.get_num_workers()),
-    outputBuffers_(engine_.get_num_workers())
+    outputBuffers_(engine_.get_num_workers()),
+    intermediateBuffers_(engine_.get_num_workers())
     {
 
   // Do our own resource allocation
@@ -175,30 +177,29 @@ Ipuv1CnnController::Ipuv1CnnController(const xir::Subgraph *subgraph)
     LOG(INFO) << "Intermediate Buffer Requested size is 0. Using 1MB instead.";
     interSize_ = 1024*1024;
   }
+}
 
-  // For each worker
-  for (unsigned i=0; i < engine_.get_num_workers(); i++) {
+void Ipuv1CnnController::initWorker(const unsigned int wIdx) {
 
-    // Create a runner
-    runners_.emplace_back(kernel_);
+  // Create a runner
+  runners_[wIdx] = xrt::run(kernel_);
 
-    // Create input buffers
-    for (auto& inTensor : inTensors_)
-      inputBuffers_[i].emplace_back(
-        device_, inTensor->get_data_size(), XRT_BO_FLAGS_HOST_ONLY, kernel_.group_id(1)
-      );
+  // Create input buffers
+  for (auto& inTensor : inTensors_)
+    inputBuffers_[wIdx].emplace_back(
+      device_, inTensor->get_data_size(), XRT_BO_FLAGS_HOST_ONLY, kernel_.group_id(1)
+    );
 
-    // Create output buffers
-    for (auto& outTensor : outTensors_)
-      outputBuffers_[i].emplace_back(
-        device_, outTensor->get_data_size(), XRT_BO_FLAGS_HOST_ONLY, kernel_.group_id(3)
-      );
-    
-    // Create intermediate buffers
-    intermediateBuffers_.emplace_back(
-      device_, interSize_, XRT_BO_FLAGS_HOST_ONLY, kernel_.group_id(4)
+  // Create output buffers
+  for (auto& outTensor : outTensors_)
+    outputBuffers_[wIdx].emplace_back(
+      device_, outTensor->get_data_size(), XRT_BO_FLAGS_HOST_ONLY, kernel_.group_id(3)
     );
-  }
+  
+  // Create intermediate buffers
+  intermediateBuffers_[wIdx] = xrt::bo(
+    device_, interSize_, XRT_BO_FLAGS_HOST_ONLY, kernel_.group_id(4)
+  );
 }
 
 void Ipuv1CnnController::copyInputs(const unsigned int wIdx, const std::vector<vart::TensorBuffer*> &inputs) {
@@ -277,10 +278,15 @@ void Ipuv1CnnController::copyOutputs(const unsigned int wIdx, const std::vector<
   }
 }
 
+void Ipuv1CnnController::init_worker(unsigned worker_id) {
+  std::call_once(workerInit_[worker_id], [this, worker_id] { initWorker(worker_id); });
+}
+
 void Ipuv1CnnController::run(const std::vector<vart::TensorBuffer*> &inputs,
                              const std::vector<vart::TensorBuffer*> &outputs) {
 
   const auto wIdx = engine_.get_my_worker_id();
+  init_worker(wIdx);
 
   // Copy inputs to Device
   copyInputs(wIdx, inputs);
@@ -310,7 +316,6 @@ std::vector<float> Ipuv1CnnController::get_input_scale() {return inputScales_;}
 std::vector<float> Ipuv1CnnController::get_output_scale() {return outputScales_;}
 
 Ipuv1CnnController::Ipuv1CnnController(std::string meta)
-  : XclDpuController<IpuDeviceHandle, IpuDeviceBuffer, IpuDeviceBuffer>(meta),
-      engine_(Engine::get_instance()) {
+  : XclDpuController<IpuDeviceHandle, IpuDeviceBuffer, IpuDeviceBuffer>(meta) {
   throw std::runtime_error("Error: Meta json file flow not supported by this DPU.");
 }
@@ -19,6 +19,7 @@
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <xir/graph/subgraph.hpp> // xir::Subgraph
 #include "dpu_controller.hpp" // XclDpuController
 #include "engine.hpp" // Engine
@@ -64,6 +65,16 @@ public:
    * The thread will process the inputs provided, and return the results to the outputs buffer.
    */
   virtual void run(const std::vector<vart::TensorBuffer*> &inputs, const std::vector<vart::TensorBuffer*> &outputs) override;
+
+  /**
+   * init_worker() - Create the kernel runner and device buffers of one worker
+   *
+   * @param worker_id
+   *  Engine worker id; must be called from that worker's thread
+   *
+   * run() does this lazily on a worker's first inference.
+   */
+  virtual void init_worker(unsigned worker_id) override;
   
   /**
    * get_input_tensors() - Retrieve metadata regarding model inputs. i.e. shapes.
@@ -129,9 +140,6 @@ protected:
   std::vector<std::vector<std::int32_t>> paddedInputShape_, paddedOutputShape_; // N, H, W, C
   std::vector<std::int32_t> origInputSize_, origOutputSize_;
 
-  // Reference to the engine
-  Engine& engine_;
-
   // All workers will share
   xrt::device device_;
   xrt::kernel kernel_;
@@ -139,7 +147,9 @@ protected:
   xrt::bo parameters_;
   xrt::bo instructions_;
 
-  // Create per worker thread resources
+  // Per worker thread resources, created on the worker's first run
+  void initWorker(const unsigned int wIdx);
+  std::vector<std::once_flag> workerInit_;
   std::vector<xrt::run> runners_; 
   std::vector<std::vector<xrt::bo>> inputBuffers_;
   std::vector<std::vector<xrt::bo>> outputBuffers_;
@@ -0,0 +1,88 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Wall time spent in each runner construction phase
+ * (acquire, model, upload, workspace, buffers), in first-seen order.
+ * Not thread safe; each controller fills its own from one thread.
+ */
+class StartupProfile {
+ public:
+  // adds the wall time of its lifetime to one phase
+  class Scope {
+   public:
+    Scope(StartupProfile &profile, std::string name)
+      : profile_(profile), name_(std::move(name)),
+        start_(std::chrono::steady_clock::now()) {}
+    ~Scope() {
+      profile_.add(name_, std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_).count());
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+   private:
+    StartupProfile &profile_;
+    std::string name_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  void add(const std::string &name, double ms) {
+    for (auto &p : phases_)
+      if (p.first == name) {
+        p.second += ms;
+        return;
+      }
+    phases_.emplace_back(name, ms);
+  }
+
+  void merge(const StartupProfile &other) {
+    for (auto &p : other.phases_)
+      add(p.first, p.second);
+  }
+
+  double get(const std::string &name) const {
+    for (auto &p : phases_)
+      if (p.first == name)
+        return p.second;
+    return 0;
+  }
+
+  double total_ms() const {
+    double total = 0;
+    for (auto &p : phases_)
+      total += p.second;
+    return total;
+  }
+
+  const std::vector<std::pair<std::string, double>> &phases() const { return phases_; }
+
+  std::string to_string() const {
+    std::ostringstream os;
+    for (auto &p : phases_)
+      os << p.first << " " << p.second << " ms, ";
+    os << "total " << total_ms() << " ms";
+    return os.str();
+  }
+
+ private:
+  std::vector<std::pair<std::string, double>> phases_;
+};
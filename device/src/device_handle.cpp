@@ -12,8 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <climits>
+#include <thread>
 #include <fstream>
 #include <memory>
 #include <iostream>
@@ -34,6 +37,9 @@ static std::atomic<unsigned> naive_resource_mgr_cu_idx_(0);
 
 DeviceResource::DeviceResource(std::string kernelName, std::string xclbin, xir::Attrs* attrs) {
   // fallback unmanaged/caveman resource manager
+  // cuIdxMap and the burn-once logic below are not safe to run concurrently
+  static std::mutex acquire_mtx;
+  std::lock_guard<std::mutex> lock(acquire_mtx);
   auto num_devices = xclProbe();
   if (num_devices == 0)
     throw std::runtime_error("Error: no devices available");
@@ -84,6 +90,12 @@ DeviceResource::DeviceResource(std::string kernelName, std::string xclbin, xir::
     if (cuIdx > (binstream.get_num_of_cu()-1)) cuIdx = rand()%binstream.get_num_of_cu(); 
     #ifndef _WIN32
     cuIdx_xrt = xclIPName2Index(handle, binstream.get_cu(cuIdx).c_str());
+    // route around CUs that hung and have not recovered
+    for (size_t n=1; n < binstream.get_num_of_cu()
+      && !CuHealth::get_instance().is_healthy(deviceIdx, cuIdx_xrt); n++) {
+      cuIdx = (cuIdx + 1) % binstream.get_num_of_cu();
+      cuIdx_xrt = xclIPName2Index(handle, binstream.get_cu(cuIdx).c_str());
+    }
     #else
     cuIdx_xrt = 0; // API is not supported on windows
     #endif 
@@ -127,6 +139,7 @@ static const std::string find_kernel_name(std::string name) {
 }
 
 std::string KernelNameManager::getRealKernelName(std::string xclbinPath, std::string kernelName) {
+  std::lock_guard<std::mutex> lock(mtx_);
   xir::XrtBinStream binstream(xclbinPath);
   auto cu_num = binstream.get_num_of_cu();
   std::string realKernelName; 
@@ -154,6 +167,11 @@ std::string KernelNameManager::getRealKernelName(std::string xclbinPath, std::st
 
 DeviceHandle::DeviceHandle(std::string kernelName, std::string xclbin, xir::Attrs* attrs, ResourceType type) {
 
+  if (std::getenv("RTE_FAKE_DEVICE") || type == ResourceType::FAKE) {
+    resource_.reset(new FakeResource(kernelName, xclbin, attrs));
+    return;
+  }
+
   if (std::getenv("RTE_ACQUIRE_DEVICE_UNMANAGED") || type == ResourceType::DEVICE) {
     resource_.reset(new DeviceResource(kernelName, xclbin, attrs));
     return;
@@ -212,6 +230,120 @@ XrtContext::~XrtContext() {
   xclClose(dev_handle_);
 }
 
+XrtWorkerContexts::XrtWorkerContexts(XrtDeviceHandle &handle, unsigned num_workers)
+  : handle_(handle), contexts_(num_workers), init_flags_(num_workers) {
+}
+
+XrtContext &XrtWorkerContexts::operator[](unsigned worker_id) {
+  if (worker_id >= contexts_.size())
+    throw std::runtime_error("Error: worker_id too large; update controller code");
+  std::call_once(init_flags_[worker_id], [this, worker_id] {
+    contexts_[worker_id].reset(new XrtContext(handle_));
+  });
+  return *contexts_[worker_id];
+}
+
+XrtContext &XrtWorkerContexts::reset(unsigned worker_id) {
+  // make sure the first use has happened so call_once cannot run again later
+  (*this)[worker_id];
+  contexts_[worker_id].reset();
+  contexts_[worker_id].reset(new XrtContext(handle_));
+  return *contexts_[worker_id];
+}
+
+/*
+ * CU health
+ */
+void CuHealth::report_hang(size_t device_index, size_t cu_index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto &cu = cus_[{device_index, cu_index}];
+  if (cu.healthy)
+    num_unhealthy_++;
+  cu.healthy = false;
+  cu.stats.hangs++;
+}
+
+void CuHealth::report_recovery(size_t device_index, size_t cu_index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto &cu = cus_[{device_index, cu_index}];
+  if (!cu.healthy)
+    num_unhealthy_--;
+  cu.healthy = true;
+  cu.stats.recoveries++;
+}
+
+void CuHealth::report_failure(size_t device_index, size_t cu_index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  cus_[{device_index, cu_index}].stats.failures++;
+}
+
+bool CuHealth::is_healthy(size_t device_index, size_t cu_index) const {
+  if (num_unhealthy_.load(std::memory_order_relaxed) == 0)
+    return true;
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = cus_.find({device_index, cu_index});
+  return it == cus_.end() || it->second.healthy;
+}
+
+CuHealth::Stats CuHealth::get_stats(size_t device_index, size_t cu_index) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = cus_.find({device_index, cu_index});
+  return it == cus_.end() ? Stats() : it->second.stats;
+}
+
+CuHealth::Stats CuHealth::get_stats() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  Stats total;
+  for (auto &cu : cus_) {
+    total.hangs += cu.second.stats.hangs;
+    total.recoveries += cu.second.stats.recoveries;
+    total.failures += cu.second.stats.failures;
+  }
+  return total;
+}
+
+/*
+ * Fake device resource
+ */
+static std::atomic<unsigned> fake_resource_cu_idx_(0);
+
+FakeResource::FakeResource(std::string kernelName, std::string xclbin, xir::Attrs* attrs) {
+  const char* value = std::getenv("RTE_FAKE_DEVICE");
+  const unsigned num_cus = std::max(1, value ? atoi(value) : 1);
+  value = std::getenv("RTE_FAKE_ACQUIRE_MS");
+  if (value)
+    std::this_thread::sleep_for(std::chrono::milliseconds(atoi(value)));
+
+  size_t deviceIdx = 0;
+  if (attrs && attrs->has_attr("__device_id__"))
+    deviceIdx = attrs->get_attr<size_t>("__device_id__");
+  size_t cuIdx = fake_resource_cu_idx_.fetch_add(1) % num_cus;
+  for (unsigned n=1; n < num_cus && !CuHealth::get_instance().is_healthy(deviceIdx, cuIdx); n++)
+    cuIdx = (cuIdx + 1) % num_cus;
+  if (attrs && attrs->has_attr("__device_core_id__"))
+    cuIdx = attrs->get_attr<size_t>("__device_core_id__");
+  if (cuIdx >= num_cus)
+    throw std::runtime_error("Error: no CUs available");
+
+  uuid_.fill(0);
+  info_.reset(new DeviceInfo{
+      /* cu_base_addr */  0x10000 * cuIdx,
+      /* ddr_bank */      0,
+      /* device_index */  deviceIdx,
+      /* cu_index */      cuIdx,
+      /* cu_mask */       (1u << cuIdx),
+      /* xclbin_path */   xclbin,
+      /* full_name */     kernelName + ":" + std::to_string(deviceIdx) + ":" + std::to_string(cuIdx),
+      /* device_handle */ nullptr,
+      /* uuid */          get_uuid(),
+      /* fingerprint */   0,
+  });
+  LOG_IF(INFO, ENV_PARAM(DEBUG_DEVICE_HANDLE))
+    << "Fake device acquired : " << info_->full_name;
+}
+
+FakeResource::~FakeResource() = default;
+
 /*
  * IPU device handle
  */
@@ -18,11 +18,13 @@
  * Reference: vart/xrt-device-handle/src/xrt_device_handle_butler.hpp
  */
 #include <array>
+#include <atomic>
 #include <map>
 #include <unordered_map>
 #include <mutex>
 #include <memory>
 #include <string>
+#include <vector>
 #include <xrt.h>
 #include "xir/attrs/attrs.hpp"
 
@@ -46,7 +48,7 @@ struct DeviceInfo {
 
 // Define resource Types
 // Each type of resource will be acquired in a different way
-enum class ResourceType {DEVICE, XRM, IPU};
+enum class ResourceType {DEVICE, XRM, IPU, FAKE};
 
 /*
  * DeviceResource acquires/releases resource & populates DeviceInfo
@@ -71,6 +73,17 @@ public:
   IpuResource(std::string kernelName, std::string xclbin, xir::Attrs* attrs);
   ~IpuResource();
 };
+/*
+ * Hardware-free stand-in: hands out CUs round-robin without touching XRT and
+ * sleeps RTE_FAKE_ACQUIRE_MS to model xclbin load / XRM latency.
+ * Selected with ResourceType::FAKE or RTE_FAKE_DEVICE=<num cus>.
+ */
+class FakeResource : public DeviceResource {
+public:
+  FakeResource(std::string kernelName, std::string xclbin, xir::Attrs* attrs);
+  ~FakeResource();
+};
+
 /* 
  * DeviceHandle holds a DeviceResource
  * Derived classes add convenience functions for XRT API layer
@@ -122,12 +135,61 @@ class XrtContext {
   void *bo_addr_;
 };
 
+class XrtWorkerContexts {
+ // one XrtContext per engine worker id, opened on the worker's first use
+ public:
+  XrtWorkerContexts(XrtDeviceHandle &handle, unsigned num_workers);
+  XrtContext &operator[](unsigned worker_id);
+  // close and reopen a worker's context, dropping commands still queued on it
+  XrtContext &reset(unsigned worker_id);
+  size_t size() const { return contexts_.size(); }
+
+ private:
+  XrtDeviceHandle &handle_;
+  std::vector<std::unique_ptr<XrtContext>> contexts_;
+  std::vector<std::once_flag> init_flags_;
+};
+
 class IpuDeviceHandle : public DeviceHandle {
 public:
   IpuDeviceHandle(std::string kernelName, std::string xclbin, xir::Attrs* attrs);
   virtual ~IpuDeviceHandle();
 };
 
+/*
+ * Process-wide CU health. Controllers report command timeouts and recoveries;
+ * acquisition skips unhealthy CUs while a healthy one is left. A CU stays
+ * unhealthy, even after a failed retry, until a command completes on it.
+ */
+class CuHealth {
+  public:
+    struct Stats {
+      uint64_t hangs = 0;       // command timeouts
+      uint64_t recoveries = 0;  // commands that completed on an unhealthy CU
+      uint64_t failures = 0;    // retries that timed out again
+    };
+    static CuHealth &get_instance() {
+      static CuHealth instance;
+      return instance;
+    }
+    void report_hang(size_t device_index, size_t cu_index);
+    void report_recovery(size_t device_index, size_t cu_index);
+    void report_failure(size_t device_index, size_t cu_index);
+    bool is_healthy(size_t device_index, size_t cu_index) const;
+    Stats get_stats(size_t device_index, size_t cu_index) const;
+    Stats get_stats() const; // summed over all CUs
+  private:
+    CuHealth() {};
+    struct Cu {
+      bool healthy = true;
+      Stats stats;
+    };
+    mutable std::mutex mtx_;
+    std::map<std::pair<size_t, size_t>, Cu> cus_;
+    // lets is_healthy() skip the lock on every run while all CUs are fine
+    std::atomic<size_t> num_unhealthy_{0};
+};
+
 class KernelNameManager {
   public:
     ~KernelNameManager() { }
@@ -139,5 +201,6 @@ class KernelNameManager {
   private:
     KernelNameManager() {};
     std::unordered_map<std::string, unsigned > xclbin2usedCuIdx;
+    std::mutex mtx_; // runners may be created concurrently
 };
 
@@ -50,6 +50,11 @@ int XrmResource::alloc_with_deviceId(std::string kernelName, char* xclbinPath, x
 }
 
 int XrmResource::alloc_from_attrs(std::string kernelName, char* xclbinPath, xir::Attrs* attrs) {
+  // The probe loop below holds on to CUs it does not want until it finds the
+  // requested core. Two runners probing at once can each hold the other's
+  // core and both give up, so probing is serialized within the process.
+  static std::mutex probe_mtx;
+  std::lock_guard<std::mutex> lock(probe_mtx);
   int err=-1;
   bool cu_correct=false;
   std::vector<std::unique_ptr<xrmCuResource>> cu_rsrc;
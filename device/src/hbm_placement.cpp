@@ -0,0 +1,191 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include "hbm_placement.hpp"
+#include "xrt_bin_stream.hpp"
+
+/*
+ * Topology
+ */
+
+HbmTopology HbmTopology::from_xclbin(const xir::XrtBinStream &binstream) {
+  HbmTopology topology;
+  auto mem = binstream.get_mem_topology();
+  for (int i = 0; i < mem->m_count; ++i) {
+    const auto &m = mem->m_mem_data[i];
+    const std::string tag((const char*)m.m_tag, strnlen((const char*)m.m_tag, sizeof(m.m_tag)));
+    const bool memType = m.m_type == MEM_HBM || m.m_type == MEM_DDR4
+      || m.m_type == MEM_DDR3 || m.m_type == MEM_DRAM;
+    topology.banks.push_back({ unsigned(i), tag,
+      m.m_used && memType && tag.compare(0, 5, "PLRAM") != 0 });
+  }
+
+  topology.cu_banks.resize(binstream.get_num_of_cu());
+  auto conn = binstream.get_connectivity();
+  if (conn == nullptr)
+    return topology;
+  for (size_t cu = 0; cu < topology.cu_banks.size(); cu++) {
+    std::set<unsigned> banks;
+    const int ipIdx = binstream.get_cu_ip_index(cu);
+    for (int i = 0; i < conn->m_count; ++i) {
+      const auto &c = conn->m_connection[i];
+      if (c.m_ip_layout_index == ipIdx && c.mem_data_index >= 0
+        && c.mem_data_index < mem->m_count)
+        banks.insert(c.mem_data_index);
+    }
+    topology.cu_banks[cu].assign(banks.begin(), banks.end());
+  }
+  return topology;
+}
+
+/*
+ * Plan
+ */
+
+std::vector<unsigned> HbmPlan::ordered(const std::vector<unsigned> &primary, size_t count) const {
+  std::vector<unsigned> banks;
+  for (size_t i = 0; i < std::max(count, primary.size()); i++)
+    banks.push_back(primary[i % primary.size()]);
+  for (auto b : fallback)
+    if (std::find(primary.begin(), primary.end(), b) == primary.end())
+      banks.push_back(b);
+  return banks;
+}
+
+namespace {
+  void writeBanks(std::ostringstream &os, const char *name, const std::vector<unsigned> &banks) {
+    os << " " << name << "=[";
+    for (size_t i = 0; i < banks.size(); i++)
+      os << (i ? "," : "") << banks[i];
+    os << "]";
+  }
+}
+
+std::string HbmPlan::to_string() const {
+  std::ostringstream os;
+  os << "hbm plan cu " << cu_index << (shared ? " (shared banks)" : "") << ":";
+  writeBanks(os, "code", code);
+  writeBanks(os, "weights", weights);
+  writeBanks(os, "io", io);
+  writeBanks(os, "workspace", workspace);
+  writeBanks(os, "fallback", fallback);
+  return os.str();
+}
+
+HbmPlan plan_hbm_banks(const HbmTopology &topology, unsigned cu_index,
+  unsigned num_weight_banks) {
+  const unsigned numCus = std::max<size_t>(1, topology.cu_banks.size());
+  if (cu_index >= numCus)
+    throw std::runtime_error("Error: no CU " + std::to_string(cu_index) + " in xclbin");
+
+  std::vector<unsigned> usable;
+  for (const auto &b : topology.banks)
+    if (b.usable)
+      usable.push_back(b.index);
+  if (usable.empty())
+    throw std::runtime_error("Error: xclbin has no usable memory banks");
+  auto isUsable = [&usable](unsigned b) {
+    return std::find(usable.begin(), usable.end(), b) != usable.end();
+  };
+
+  // banks wired to this cu, or an even share when connectivity is unknown
+  std::vector<unsigned> mine;
+  if (cu_index < topology.cu_banks.size())
+    for (auto b : topology.cu_banks[cu_index])
+      if (isUsable(b))
+        mine.push_back(b);
+  if (mine.empty())
+  {
+    const size_t begin = cu_index * usable.size() / numCus;
+    const size_t end = (cu_index + 1) * usable.size() / numCus;
+    for (size_t i = begin; i < end; i++)
+      mine.push_back(usable[i]);
+    if (mine.empty())
+      mine.push_back(usable[cu_index % usable.size()]);
+  }
+
+  // don't share a pseudo-channel with another cu unless there is no choice
+  std::vector<unsigned> priv;
+  for (auto b : mine)
+  {
+    bool other = false;
+    for (unsigned cu = 0; cu < topology.cu_banks.size(); cu++)
+      if (cu != cu_index && std::count(topology.cu_banks[cu].begin(), topology.cu_banks[cu].end(), b))
+        other = true;
+    if (!other)
+      priv.push_back(b);
+  }
+
+  HbmPlan plan;
+  plan.cu_index = cu_index;
+  if (priv.empty())
+  {
+    // every bank is wired to other cus too: take every k-th of them, k being
+    // the number of cus wired to any, so their plans stay apart if they can
+    std::vector<unsigned> sharers;
+    for (unsigned cu = 0; cu < topology.cu_banks.size(); cu++)
+      for (auto b : mine)
+        if (std::count(topology.cu_banks[cu].begin(), topology.cu_banks[cu].end(), b))
+        {
+          sharers.push_back(cu);
+          break;
+        }
+    size_t rank = std::find(sharers.begin(), sharers.end(), cu_index) - sharers.begin();
+    if (rank == sharers.size())
+      sharers.push_back(cu_index);
+    for (size_t i = rank; i < mine.size(); i += sharers.size())
+      priv.push_back(mine[i]);
+    if (priv.empty())
+      priv.push_back(mine[rank % mine.size()]);
+    plan.shared = true;
+  }
+
+  // code is small, weights get one bank per segment if possible,
+  // I/O takes the rest since it moves the most data per request
+  const size_t n = priv.size();
+  const size_t nw = std::max(1u, num_weight_banks);
+  if (n >= nw + 2) {
+    plan.code = { priv[0] };
+    plan.weights.assign(priv.begin() + 1, priv.begin() + 1 + nw);
+    plan.io.assign(priv.begin() + 1 + nw, priv.end());
+  } else if (n >= 3) {
+    plan.code = { priv[0] };
+    plan.weights.assign(priv.begin() + 1, priv.end() - 1);
+    plan.io = { priv[n-1] };
+  } else if (n == 2) {
+    plan.code = { priv[0] };
+    plan.weights = { priv[0] };
+    plan.io = { priv[1] };
+  } else {
+    plan.code = plan.weights = plan.io = { priv[0] };
+  }
+  // a batch engine's workspace sits next to, not on, its own I/O bank
+  plan.workspace = plan.io;
+  std::rotate(plan.workspace.begin(), plan.workspace.begin() + 1, plan.workspace.end());
+
+  // this cu's private banks first, then its shared ones, then everything else
+  plan.fallback = priv;
+  for (auto b : mine)
+    if (std::find(priv.begin(), priv.end(), b) == priv.end())
+      plan.fallback.push_back(b);
+  for (auto b : usable)
+    if (std::find(mine.begin(), mine.end(), b) == mine.end())
+      plan.fallback.push_back(b);
+  return plan;
+}
@@ -0,0 +1,63 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xir {
+class XrtBinStream;
+}
+
+/*
+ * Memory banks and CU connectivity of an xclbin, reduced to what bank
+ * placement needs. Built from MEM_TOPOLOGY/CONNECTIVITY or by hand in tests.
+ */
+struct HbmTopology {
+  struct Bank {
+    unsigned index;   // MEM_TOPOLOGY index, what xclAllocUserPtrBO takes
+    std::string tag;  // e.g. "HBM[3]"
+    bool usable;      // used, and DDR/HBM rather than PLRAM or streaming
+  };
+  std::vector<Bank> banks;
+  std::vector<std::vector<unsigned>> cu_banks; // per cu (sorted by base address), banks it connects to
+
+  static HbmTopology from_xclbin(const xir::XrtBinStream &binstream);
+};
+
+/*
+ * Banks one CU should use for each kind of buffer. Each role lists its
+ * primary banks; fallback is tried in order when those are full.
+ */
+struct HbmPlan {
+  unsigned cu_index = 0;
+  std::vector<unsigned> weights;
+  std::vector<unsigned> code;
+  std::vector<unsigned> io;
+  std::vector<unsigned> workspace;
+  std::vector<unsigned> fallback;
+  bool shared = false; // no bank private to this cu, placement shares with other cus
+
+  // primary banks repeated to fill count slots (one per weight segment or
+  // batch engine), followed by the fallback banks
+  std::vector<unsigned> ordered(const std::vector<unsigned> &primary, size_t count=0) const;
+  std::string to_string() const;
+};
+
+// Spread code, weights, I/O and workspace of cu_index over the banks only it
+// connects to. Without connectivity info usable banks are split evenly
+// between cus.
+HbmPlan plan_hbm_banks(const HbmTopology &topology, unsigned cu_index,
+  unsigned num_weight_banks=2);
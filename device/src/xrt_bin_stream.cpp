@@ -12,71 +12,184 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+
 #include "xrt_bin_stream.hpp"
+#include "vitis/ai/env_config.hpp"
+
+DEF_ENV_PARAM(DEBUG_XRT_BIN_STREAM, "0")
 
 namespace xir {
 
-XrtBinStream::XrtBinStream(const std::string filename) {
-  init_fd(filename);
-  init_top();
-  init_uuid();
-  init_ip_layout();
-  init_mem_topology();
-  init_cu_names();
-  init_cu_indices();
+/*
+ * Parsed xclbin, immutable once published to the cache
+ */
+
+struct XrtBinStream::Image {
+  ~Image() {
+    if (data)
+      munmap(const_cast<char*>(data), size);
+  }
+
+  const char* data = nullptr; // whole file, PROT_READ
+  size_t size = 0;
+  struct timespec mtime;
+  const axlf* top = nullptr;
+  std::array<unsigned char, sizeof(xuid_t)> uuid;
+  std::string dsa;
+  const ip_layout* ip_layout_ = nullptr;
+  const mem_topology* topology = nullptr;
+  const connectivity* connectivity_ = nullptr;
+  std::vector<std::string> cu_names;     // sorted by cu base address
+  std::vector<uint64_t> cu_base_addrs;   // same order as cu_names
+  std::vector<int> cu_ip_indices;        // same order as cu_names
+  unsigned data_clock_mhz = 0;
+};
+
+namespace {
+  std::mutex cacheMtx;
+  XrtBinStream::CacheStats cacheStats = {0, 0};
+
+  const axlf_section_header* findSection(const axlf* top, axlf_section_kind kind,
+    size_t fileSize, const std::string &fnm, bool required=true) {
+    auto section = xclbin::get_axlf_section(top, kind);
+    if (section == nullptr && !required)
+      return nullptr;
+    if (section == nullptr)
+      throw std::runtime_error("Error: xclbin '" + fnm + "' has no section " + std::to_string(kind));
+    if (section->m_sectionOffset + section->m_sectionSize > fileSize)
+      throw std::runtime_error("Error: xclbin '" + fnm + "' is truncated");
+    return section;
+  }
+}
+
+XrtBinStream::XrtBinStream(const std::string filename) : image_(load(filename)) {
 }
 
 XrtBinStream::~XrtBinStream() {
-  delete[] data_;
 }
 
-void XrtBinStream::init_fd(const std::string fnm) {
-  std::ifstream stream(fnm);
-  if (!stream)
+std::shared_ptr<const XrtBinStream::Image> XrtBinStream::load(const std::string &fnm) {
+  int fd = open(fnm.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
     throw std::runtime_error("Failed to open xclbin file '" + fnm + "' for reading");
 
-  stream.seekg(0, stream.end);
-  size_t size = stream.tellg();
-  stream.seekg(0, stream.beg);
+  // only the header is read to validate a cached image
+  struct stat st;
+  axlf header;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header)
+    || pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)))
+  {
+    close(fd);
+    throw std::runtime_error("Error: xclbin '" + fnm + "' is truncated");
+  }
 
-  data_ = new char[size];
+  // path -> latest image of that path
+  static std::unordered_map<std::string, std::shared_ptr<const Image>> cache;
 
-  stream.read(data_, size);
+  std::unique_lock<std::mutex> lock(cacheMtx);
+  auto it = cache.find(fnm);
+  if (it != cache.end())
+  {
+    const auto &image = it->second;
+    if (image->size == size_t(st.st_size)
+      && image->mtime.tv_sec == st.st_mtim.tv_sec
+      && image->mtime.tv_nsec == st.st_mtim.tv_nsec
+      && memcmp(image->uuid.data(), header.m_header.uuid, sizeof(xuid_t)) == 0)
+    {
+      cacheStats.hits++;
+      close(fd);
+      return image;
+    }
+  }
 
-}
-void XrtBinStream::init_top() { top_ = (const axlf*)data_; }
-void XrtBinStream::init_uuid() {  //
-  memcpy(&uuid_, top_->m_header.uuid, sizeof(xuid_t));
-  dsa_ = (const char*)top_->m_header.m_platformVBNV;
+  // parse under the lock so concurrent runners don't map the same file twice
+  std::shared_ptr<Image> image;
+  try {
+    image = parse(fnm, fd, st.st_size);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd); // the mapping stays valid
+  image->mtime = st.st_mtim;
+  cache[fnm] = image;
+  cacheStats.misses++;
+  return image;
 }
 
-void XrtBinStream::init_ip_layout() {
-  auto ip = xclbin::get_axlf_section(top_, IP_LAYOUT);
-  ip_layout_ = (ip_layout*)(data_ + ip->m_sectionOffset);
-}
+std::shared_ptr<XrtBinStream::Image> XrtBinStream::parse(
+  const std::string &fnm, int fd, size_t size) {
+  const auto t0 = std::chrono::steady_clock::now();
+  auto image = std::make_shared<Image>();
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Error: cannot mmap xclbin '" + fnm + "'");
+  image->data = static_cast<const char*>(data);
+  image->size = size;
 
-void XrtBinStream::init_mem_topology() {
-  auto topo = xclbin::get_axlf_section(top_, MEM_TOPOLOGY);
-  topology_ = (mem_topology*)(data_+ topo->m_sectionOffset);
-}
-void XrtBinStream::init_cu_names() {
-  for (auto i = 0; i < ip_layout_->m_count; ++i) {
-    if (ip_layout_->m_ip_data[i].m_type != IP_KERNEL) continue;
-    cu_names_.push_back(std::string((char*)ip_layout_->m_ip_data[i].m_name));
+  image->top = reinterpret_cast<const axlf*>(image->data);
+  if (strncmp(image->top->m_magic, "xclbin2", 7) != 0)
+    throw std::runtime_error("Error: '" + fnm + "' is not an xclbin");
+  memcpy(image->uuid.data(), image->top->m_header.uuid, sizeof(xuid_t));
+  image->dsa = (const char*)image->top->m_header.m_platformVBNV;
+
+  auto ip = findSection(image->top, IP_LAYOUT, size, fnm);
+  image->ip_layout_ = reinterpret_cast<const ip_layout*>(image->data + ip->m_sectionOffset);
+  auto topo = findSection(image->top, MEM_TOPOLOGY, size, fnm);
+  image->topology = reinterpret_cast<const mem_topology*>(image->data + topo->m_sectionOffset);
+  auto conn = findSection(image->top, CONNECTIVITY, size, fnm, /*required*/false);
+  if (conn)
+    image->connectivity_ = reinterpret_cast<const connectivity*>(image->data + conn->m_sectionOffset);
+  auto clocks = findSection(image->top, CLOCK_FREQ_TOPOLOGY, size, fnm, /*required*/false);
+  if (clocks)
+  {
+    auto freqs = reinterpret_cast<const clock_freq_topology*>(image->data + clocks->m_sectionOffset);
+    for (auto i = 0; i < freqs->m_count; ++i)
+      if (freqs->m_clock_freq[i].m_type == CT_DATA)
+        image->data_clock_mhz = freqs->m_clock_freq[i].m_freq_Mhz;
   }
-}
 
-void XrtBinStream::init_cu_indices() {
-  indices_ = std::vector<size_t>(get_num_of_cu());
-  std::iota(indices_.begin(), indices_.end(), 0u);
-  std::sort(indices_.begin(), indices_.end(), [this](size_t a, size_t b) {
-    return ip_layout_->m_ip_data[a].m_base_address <
-           ip_layout_->m_ip_data[b].m_base_address;
+  // kernel cus ordered by base address
+  const auto ipData = image->ip_layout_->m_ip_data;
+  std::vector<int> indices;
+  for (auto i = 0; i < image->ip_layout_->m_count; ++i) {
+    if (ipData[i].m_type != IP_KERNEL) continue;
+    indices.push_back(i);
+  }
+  std::sort(indices.begin(), indices.end(), [ipData](int a, int b) {
+    return ipData[a].m_base_address < ipData[b].m_base_address;
   });
+  for (auto idx : indices) {
+    image->cu_names.push_back(std::string((const char*)ipData[idx].m_name));
+    image->cu_base_addrs.push_back(ipData[idx].m_base_address);
+    image->cu_ip_indices.push_back(idx);
+  }
+
+  LOG_IF(INFO, ENV_PARAM(DEBUG_XRT_BIN_STREAM))
+    << "parsed xclbin " << fnm << " (" << size << " bytes, "
+    << image->cu_names.size() << " cus) in "
+    << std::chrono::duration_cast<std::chrono::microseconds>(
+         std::chrono::steady_clock::now() - t0).count() << "us";
+  return image;
+}
+
+XrtBinStream::CacheStats XrtBinStream::get_cache_stats() {
+  std::unique_lock<std::mutex> lock(cacheMtx);
+  return cacheStats;
 }
 
 void XrtBinStream::dump_layout() const {
   //LOG(INFO) << "uuid: " << to_string(uuid_) << "\nDSA: " << dsa_;
+  auto ip_layout_ = image_->ip_layout_;
   for (auto i = 0; i < ip_layout_->m_count; ++i) {
     if (ip_layout_->m_ip_data[i].m_type != IP_KERNEL) continue;
     ///LOG(INFO) << "TYPE: " << ip_layout_->m_ip_data[i].m_type << "\n"
@@ -100,6 +213,7 @@ void XrtBinStream::dump_layout() const {
 }
 
 void XrtBinStream::dump_mem_topology() const {
+  auto topology_ = image_->topology;
   std::ostringstream str;
   for (int i = 0; i < topology_->m_count; ++i) {
     if (topology_->m_mem_data[i].m_used) {
@@ -115,21 +229,26 @@ void XrtBinStream::burn(int device_id) {
   xclClose(handle);
 }
 void XrtBinStream::burn(xclDeviceHandle handle) {
-  const xclBin* blob = (const xclBin*)data_;
+  const xclBin* blob = (const xclBin*)image_->data;
   if (xclLoadXclBin(handle, blob)) throw std::runtime_error("Bitstream download failed !");
 }
 std::array<unsigned char, sizeof(xuid_t)> XrtBinStream::get_uuid() const {
-  auto ret = std::array<unsigned char, sizeof(xuid_t)>();
-  memcpy(&ret[0], &uuid_[0], sizeof(uuid_));
-  return ret;
+  return image_->uuid;
 }
-size_t XrtBinStream::get_num_of_cu() const { return cu_names_.size(); }
+size_t XrtBinStream::get_num_of_cu() const { return image_->cu_names.size(); }
 std::string XrtBinStream::get_cu(size_t idx) const {
-  if (idx >= indices_.size()) throw std::runtime_error("invalid cu idx");
-  return cu_names_[indices_[idx]];
+  if (idx >= image_->cu_names.size()) throw std::runtime_error("invalid cu idx");
+  return image_->cu_names[idx];
 }
 uint64_t XrtBinStream::get_cu_base_addr(size_t idx) const {
-  return ip_layout_->m_ip_data[indices_[idx]].m_base_address;
+  return image_->cu_base_addrs[idx];
+}
+std::string XrtBinStream::get_dsa() const { return image_->dsa; }
+const mem_topology* XrtBinStream::get_mem_topology() const { return image_->topology; }
+const connectivity* XrtBinStream::get_connectivity() const { return image_->connectivity_; }
+int XrtBinStream::get_cu_ip_index(size_t idx) const {
+  if (idx >= image_->cu_ip_indices.size()) throw std::runtime_error("invalid cu idx");
+  return image_->cu_ip_indices[idx];
 }
-std::string XrtBinStream::get_dsa() const { return dsa_; }
+unsigned XrtBinStream::get_data_clock_mhz() const { return image_->data_clock_mhz; }
 }  // namespace xir
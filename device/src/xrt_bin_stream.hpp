@@ -17,6 +17,7 @@
 #include <xrt.h>
 
 #include <array>
+#include <memory>
 #include <string>
 #include <vector>
 #include <cstring>
@@ -25,6 +26,12 @@
 #include <fstream>
 
 namespace xir {
+/*
+ * Read-only view of an xclbin. The file is mmap'ed and only the header,
+ * IP_LAYOUT, MEM_TOPOLOGY, CONNECTIVITY and CLOCK_FREQ_TOPOLOGY are parsed; bitstream pages are touched by
+ * burn() alone. Parsed images are shared process-wide, keyed by
+ * path + mtime + uuid, so constructing one per runner is cheap.
+ */
 class XrtBinStream {
  public:
   explicit XrtBinStream(const std::string filename);
@@ -40,24 +47,22 @@ class XrtBinStream {
   std::string get_dsa() const;
   uint64_t get_cu_base_addr(size_t cu_idx) const;
   std::array<unsigned char, sizeof(xuid_t)> get_uuid() const;
+  const mem_topology* get_mem_topology() const;
+  const connectivity* get_connectivity() const; // nullptr if absent
+  int get_cu_ip_index(size_t cu_idx) const;     // index into IP_LAYOUT
+  unsigned get_data_clock_mhz() const;          // CUs' ap_clk, 0 if absent
 
- private:
-  void init_fd(const std::string filename);
-  void init_top();
-  void init_uuid();
-  void init_ip_layout();
-  void init_mem_topology();
-  void init_cu_names();
-  void init_cu_indices();
+  struct CacheStats {
+    uint64_t hits;
+    uint64_t misses; // includes reparses after the file changed
+  };
+  static CacheStats get_cache_stats();
 
  private:
-  char* data_;
-  const axlf* top_;
-  xuid_t uuid_;
-  ip_layout* ip_layout_;
-  mem_topology* topology_;
-  std::vector<std::string> cu_names_;
-  std::vector<size_t> indices_;
-  std::string dsa_;
+  struct Image;
+  static std::shared_ptr<const Image> load(const std::string &filename);
+  static std::shared_ptr<Image> parse(const std::string &filename, int fd, size_t size);
+
+  std::shared_ptr<const Image> image_;
 };
 }  // namespace xir
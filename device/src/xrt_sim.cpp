@@ -0,0 +1,478 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <glog/logging.h>
+#include <xrt.h>
+
+#include "ert.h"
+#include "xrt_sim.hpp"
+#include "vitis/ai/env_config.hpp"
+
+DEF_ENV_PARAM(DEBUG_XRT_SIM, "0")
+
+/*
+ * The xcl* functions below replace libxrt_core's when this library is
+ * preloaded. Only the calls rt-engine makes are modeled.
+ */
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  // bank n occupies [BASE_ADDR + n*bank_bytes, +bank_bytes); nonzero so a
+  // valid address is never 0 and the high register half gets exercised
+  const uint64_t BASE_ADDR = 1ull << 32;
+  const uint64_t ALIGN = 4096;
+
+  std::mutex configMtx;
+  xrt_sim::SimConfig config = xrt_sim::SimConfig::from_env();
+
+  std::atomic<uint64_t> numCommands(0);
+  std::atomic<uint64_t> bytesToDevice(0);
+  std::atomic<uint64_t> bytesFromDevice(0);
+  std::atomic<uint64_t> numBos(0);
+  std::atomic<uint64_t> deviceBytes(0);
+
+  // CU control registers read back by xclRead, by (device, offset)
+  std::mutex registersMtx;
+  std::map<std::pair<unsigned, uint64_t>, uint32_t> registers;
+
+  xrt_sim::SimConfig currentConfig() {
+    std::lock_guard<std::mutex> lock(configMtx);
+    return config;
+  }
+
+  unsigned envUnsigned(const char *name, unsigned dflt) {
+    const char *value = std::getenv(name);
+    return value ? unsigned(std::strtoul(value, nullptr, 10)) : dflt;
+  }
+
+  /*
+   * A resource that serves one request at a time (a CU, one DMA direction).
+   * reserve() queues behind earlier requests and returns when this one is done.
+   */
+  class Timeline {
+    public:
+      Clock::time_point reserve(Clock::duration busy) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        busyUntil_ = std::max(Clock::now(), busyUntil_) + busy;
+        return busyUntil_;
+      }
+    private:
+      std::mutex mtx_;
+      Clock::time_point busyUntil_;
+  };
+
+  struct Handle;
+
+  struct Bo {
+    Handle *owner;
+    size_t size;
+    unsigned bank;
+    uint64_t paddr;                  // 0 for command BOs
+    char *host;                      // user pointer, or shadow below
+    std::unique_ptr<char[]> shadow;  // host side of xclAllocBO buffers
+    std::unique_ptr<char[]> mem;     // device side
+  };
+
+  struct Device {
+    Device(uint64_t bank_bytes) : bankBytes(bank_bytes) {}
+    const uint64_t bankBytes;
+    unsigned numHandles = 0;
+
+    std::mutex mtx;
+    xclBufferHandle nextBo = 1;
+    std::unordered_map<xclBufferHandle, std::unique_ptr<Bo>> bos;
+    std::map<uint64_t, Bo*> byAddr;  // paddr -> device BOs
+
+    Timeline toDevice;
+    Timeline fromDevice;
+    std::map<unsigned, std::unique_ptr<Timeline>> cus;
+  };
+
+  struct Command {
+    ert_start_kernel_cmd *ecmd;
+    Clock::time_point done;
+  };
+
+  struct Handle {
+    unsigned index;
+    std::shared_ptr<Device> device;
+    std::mutex mtx;
+    std::deque<Command> pending;  // submitted, not yet reported by xclExecWait
+  };
+
+  std::mutex devicesMtx;
+  std::map<unsigned, std::shared_ptr<Device>> devices;
+
+  Handle *toHandle(xclDeviceHandle handle) {
+    return static_cast<Handle*>(handle);
+  }
+
+  Bo *findBo(Device &dev, xclBufferHandle bo) {
+    std::lock_guard<std::mutex> lock(dev.mtx);
+    auto it = dev.bos.find(bo);
+    return it == dev.bos.end() ? nullptr : it->second.get();
+  }
+
+  // address space taken by a BO, at least one page so addresses stay unique
+  uint64_t footprint(size_t size) {
+    return (std::max(size, size_t(1)) + ALIGN - 1) / ALIGN * ALIGN;
+  }
+
+  // first fit inside the bank, dev.mtx held
+  uint64_t allocAddr(Device &dev, unsigned bank, size_t size) {
+    const uint64_t bankStart = BASE_ADDR + bank * dev.bankBytes;
+    const uint64_t bankEnd = bankStart + dev.bankBytes;
+    const uint64_t alignedSize = footprint(size);
+    uint64_t addr = bankStart;
+    for (auto it = dev.byAddr.lower_bound(bankStart);
+      it != dev.byAddr.end() && it->first < bankEnd; ++it)
+    {
+      if (it->first - addr >= alignedSize)
+        break;
+      addr = it->first + footprint(it->second->size);
+    }
+    if (addr + alignedSize > bankEnd)
+      return 0;
+    return addr;
+  }
+
+  xclBufferHandle allocBo(Handle *h, void *userptr, size_t size, unsigned flags) {
+    Device &dev = *h->device;
+    std::unique_ptr<Bo> bo(new Bo{h, size, flags & 0xffff, 0, nullptr, nullptr, nullptr});
+    if (userptr)
+      bo->host = static_cast<char*>(userptr);
+    else {
+      bo->shadow.reset(new char[size]());
+      bo->host = bo->shadow.get();
+    }
+    std::lock_guard<std::mutex> lock(dev.mtx);
+    if (!(flags & XCL_BO_FLAGS_EXECBUF))
+    {
+      bo->paddr = allocAddr(dev, bo->bank, size);
+      if (!bo->paddr)
+      {
+        LOG_IF(INFO, ENV_PARAM(DEBUG_XRT_SIM))
+          << "bank " << bo->bank << " full, cannot allocate " << size << " bytes";
+        return NULLBO;
+      }
+      bo->mem.reset(new char[size]);
+      dev.byAddr.emplace(bo->paddr, bo.get());
+      deviceBytes += size;
+    }
+    const auto handle = dev.nextBo++;
+    LOG_IF(INFO, ENV_PARAM(DEBUG_XRT_SIM))
+      << "bo " << handle << " size " << size << " bank " << bo->bank
+      << " paddr " << std::hex << bo->paddr;
+    dev.bos.emplace(handle, std::move(bo));
+    numBos++;
+    return handle;
+  }
+
+  // dev.mtx held
+  void freeBo(Device &dev, std::unordered_map<xclBufferHandle, std::unique_ptr<Bo>>::iterator it) {
+    if (it->second->paddr)
+    {
+      dev.byAddr.erase(it->second->paddr);
+      deviceBytes -= it->second->size;
+    }
+    dev.bos.erase(it);
+    numBos--;
+  }
+
+  // copy, then hold the caller until the transfer would have finished
+  void dma(Timeline &direction, void *dst, const void *src, size_t size) {
+    std::memcpy(dst, src, size);
+    const double mbps = currentConfig().dma_mbps;
+    if (mbps <= 0 || size == 0)
+      return;
+    const auto busy = std::chrono::duration<double, std::micro>(size / mbps);
+    std::this_thread::sleep_until(direction.reserve(
+      std::chrono::duration_cast<Clock::duration>(busy)));
+  }
+
+  // device memory backing [paddr, paddr+size), nullptr if no single BO covers it
+  char *deviceMemory(Device &dev, uint64_t paddr, size_t size) {
+    std::lock_guard<std::mutex> lock(dev.mtx);
+    auto it = dev.byAddr.upper_bound(paddr);
+    if (it == dev.byAddr.begin())
+      return nullptr;
+    --it;
+    const auto offset = paddr - it->first;
+    if (offset > it->second->size || size > it->second->size - offset)
+      return nullptr;
+    return it->second->mem.get() + offset;
+  }
+
+  // preloading is the switch: use the fake device layer as well
+  __attribute__((constructor)) void selectFakeDevice() {
+    setenv("RTE_FAKE_DEVICE", "1", 0);
+  }
+}
+
+namespace xrt_sim {
+
+SimConfig SimConfig::from_env() {
+  SimConfig c;
+  c.num_devices = envUnsigned("RTE_SIM_NUM_DEVICES", c.num_devices);
+  c.exec_us = envUnsigned("RTE_SIM_EXEC_US", c.exec_us);
+  c.dma_mbps = envUnsigned("RTE_SIM_DMA_MBPS", unsigned(c.dma_mbps));
+  c.bank_bytes = uint64_t(envUnsigned("RTE_SIM_BANK_MB", unsigned(c.bank_bytes >> 20))) << 20;
+  c.hang_every = envUnsigned("RTE_SIM_HANG_EVERY", c.hang_every);
+  return c;
+}
+
+void set_config(const SimConfig &c) {
+  std::lock_guard<std::mutex> lock(configMtx);
+  config = c;
+}
+
+SimConfig get_config() {
+  return currentConfig();
+}
+
+SimStats get_stats() {
+  return {numCommands.load(), bytesToDevice.load(), bytesFromDevice.load(),
+    numBos.load(), deviceBytes.load()};
+}
+
+void set_register(unsigned device, uint64_t offset, uint32_t value) {
+  std::lock_guard<std::mutex> lock(registersMtx);
+  registers[{device, offset}] = value;
+}
+
+}
+
+/*
+ * Devices and contexts
+ */
+
+unsigned int xclProbe() {
+  return currentConfig().num_devices;
+}
+
+xclDeviceHandle xclOpen(unsigned int deviceIndex, const char *, enum xclVerbosityLevel) {
+  const auto c = currentConfig();
+  if (deviceIndex >= c.num_devices)
+    return nullptr;
+  std::unique_ptr<Handle> h(new Handle);
+  h->index = deviceIndex;
+  std::lock_guard<std::mutex> lock(devicesMtx);
+  auto &dev = devices[deviceIndex];
+  if (!dev)
+    dev = std::make_shared<Device>(c.bank_bytes);
+  dev->numHandles++;
+  h->device = dev;
+  return h.release();
+}
+
+void xclClose(xclDeviceHandle handle) {
+  std::unique_ptr<Handle> h(toHandle(handle));
+  if (!h)
+    return;
+  {
+    // like XRT, closing a handle frees the BOs allocated through it
+    Device &dev = *h->device;
+    std::lock_guard<std::mutex> lock(dev.mtx);
+    for (auto it = dev.bos.begin(); it != dev.bos.end(); )
+      if (it->second->owner == h.get())
+        freeBo(dev, it++);
+      else
+        ++it;
+  }
+  std::lock_guard<std::mutex> lock(devicesMtx);
+  if (--h->device->numHandles == 0)
+    devices.erase(h->index);
+}
+
+int xclLoadXclBin(xclDeviceHandle, const xclBin *) {
+  return 0;
+}
+
+int xclIPName2Index(xclDeviceHandle, const char *) {
+  return 0;
+}
+
+int xclOpenContext(xclDeviceHandle, const xuid_t, unsigned int, bool) {
+  return 0;
+}
+
+int xclCloseContext(xclDeviceHandle, const xuid_t, unsigned int) {
+  return 0;
+}
+
+/*
+ * Buffer objects
+ */
+
+xclBufferHandle xclAllocBO(xclDeviceHandle handle, size_t size, int, unsigned int flags) {
+  return allocBo(toHandle(handle), nullptr, size, flags);
+}
+
+xclBufferHandle xclAllocUserPtrBO(xclDeviceHandle handle, void *userptr, size_t size, unsigned int flags) {
+  return allocBo(toHandle(handle), userptr, size, flags);
+}
+
+void xclFreeBO(xclDeviceHandle handle, xclBufferHandle boHandle) {
+  Device &dev = *toHandle(handle)->device;
+  std::lock_guard<std::mutex> lock(dev.mtx);
+  auto it = dev.bos.find(boHandle);
+  if (it != dev.bos.end())
+    freeBo(dev, it);
+}
+
+void *xclMapBO(xclDeviceHandle handle, xclBufferHandle boHandle, bool) {
+  auto bo = findBo(*toHandle(handle)->device, boHandle);
+  return bo ? bo->host : nullptr;
+}
+
+int xclSyncBO(xclDeviceHandle handle, xclBufferHandle boHandle, enum xclBOSyncDirection dir,
+  size_t size, size_t offset) {
+  Device &dev = *toHandle(handle)->device;
+  auto bo = findBo(dev, boHandle);
+  if (!bo || !bo->mem || offset > bo->size || size > bo->size - offset)
+    return -EINVAL;
+  if (dir == XCL_BO_SYNC_BO_TO_DEVICE)
+  {
+    dma(dev.toDevice, bo->mem.get() + offset, bo->host + offset, size);
+    bytesToDevice += size;
+  }
+  else
+  {
+    dma(dev.fromDevice, bo->host + offset, bo->mem.get() + offset, size);
+    bytesFromDevice += size;
+  }
+  return 0;
+}
+
+int xclGetBOProperties(xclDeviceHandle handle, xclBufferHandle boHandle, struct xclBOProperties *properties) {
+  auto bo = findBo(*toHandle(handle)->device, boHandle);
+  if (!bo)
+    return -EINVAL;
+  properties->handle = boHandle;
+  properties->flags = bo->bank;
+  properties->size = bo->size;
+  properties->paddr = bo->paddr;
+  return 0;
+}
+
+uint64_t xclGetDeviceAddr(xclDeviceHandle handle, xclBufferHandle boHandle) {
+  auto bo = findBo(*toHandle(handle)->device, boHandle);
+  return bo ? bo->paddr : uint64_t(-1);
+}
+
+ssize_t xclUnmgdPread(xclDeviceHandle handle, unsigned int, void *buf, size_t size, uint64_t offset) {
+  Device &dev = *toHandle(handle)->device;
+  auto mem = deviceMemory(dev, offset, size);
+  if (!mem)
+    return -EFAULT;
+  dma(dev.fromDevice, buf, mem, size);
+  bytesFromDevice += size;
+  return 0;
+}
+
+ssize_t xclUnmgdPwrite(xclDeviceHandle handle, unsigned int, const void *buf, size_t size, uint64_t offset) {
+  Device &dev = *toHandle(handle)->device;
+  auto mem = deviceMemory(dev, offset, size);
+  if (!mem)
+    return -EFAULT;
+  dma(dev.toDevice, mem, buf, size);
+  bytesToDevice += size;
+  return 0;
+}
+
+/*
+ * ERT command processing. A command occupies its CU for exec_us, queued
+ * behind commands other handles sent to the same CU. It completes when its
+ * handle waits past that point.
+ */
+
+int xclExecBuf(xclDeviceHandle handle, xclBufferHandle cmdBO) {
+  Handle *h = toHandle(handle);
+  Device &dev = *h->device;
+  auto bo = findBo(dev, cmdBO);
+  if (!bo)
+    return -EINVAL;
+  auto ecmd = reinterpret_cast<ert_start_kernel_cmd*>(bo->host);
+  const unsigned cu = ecmd->cu_mask ? __builtin_ctz(ecmd->cu_mask) : 0;
+  Timeline *timeline;
+  {
+    std::lock_guard<std::mutex> lock(dev.mtx);
+    auto &t = dev.cus[cu];
+    if (!t)
+      t.reset(new Timeline);
+    timeline = t.get();
+  }
+  const auto c = currentConfig();
+  ecmd->state = ERT_CMD_STATE_QUEUED;
+  std::lock_guard<std::mutex> lock(h->mtx);
+  const auto n = ++numCommands;
+  if (c.hang_every && n % c.hang_every == 0)
+  {
+    // never completes and does not hold up the cu for others
+    LOG_IF(INFO, ENV_PARAM(DEBUG_XRT_SIM)) << "cu " << cu << " hangs";
+    h->pending.push_back({ecmd, Clock::time_point::max()});
+    return 0;
+  }
+  h->pending.push_back({ecmd, timeline->reserve(std::chrono::microseconds(c.exec_us))});
+  return 0;
+}
+
+int xclExecWait(xclDeviceHandle handle, int timeoutMilliSec) {
+  Handle *h = toHandle(handle);
+  std::lock_guard<std::mutex> lock(h->mtx);
+  const auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMilliSec);
+  auto wake = deadline;
+  for (auto &c : h->pending)
+    wake = std::min(wake, c.done);
+  std::this_thread::sleep_until(wake);
+
+  const auto now = Clock::now();
+  int completed = 0;
+  for (auto it = h->pending.begin(); it != h->pending.end(); )
+    if (it->done <= now)
+    {
+      it->ecmd->state = ERT_CMD_STATE_COMPLETED;
+      it = h->pending.erase(it);
+      completed++;
+    }
+    else
+      ++it;
+  return completed;
+}
+
+size_t xclRead(xclDeviceHandle handle, enum xclAddressSpace, uint64_t offset, void *hostbuf, size_t size) {
+  // registers the test set with set_register(), 0 elsewhere
+  std::memset(hostbuf, 0, size);
+  std::lock_guard<std::mutex> lock(registersMtx);
+  for (size_t i=0; i + 4 <= size; i += 4) {
+    auto reg = registers.find({toHandle(handle)->index, offset + i});
+    if (reg != registers.end())
+      std::memcpy(static_cast<char*>(hostbuf) + i, &reg->second, 4);
+  }
+  return size;
+}
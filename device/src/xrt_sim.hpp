@@ -0,0 +1,66 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Host-memory model of the XRT calls rt-engine makes (xclOpen, BOs, unmanaged
+ * DMA, ERT exec). Built as lib<project>-xrt-sim.so; preload it to run without
+ * a card:
+ *
+ *   LD_PRELOAD=librt-engine-xrt-sim.so XLNX_VART_FIRMWARE=<xclbin> app.exe ...
+ *
+ * Preloading also selects the fake device layer (RTE_FAKE_DEVICE) unless it
+ * is already set. The xclbin is only read for its metadata.
+ *
+ * Every BO gets a device-side copy at a physical address inside its bank, so
+ * syncs and unmanaged reads/writes move real bytes. As with XRT, BOs belong
+ * to the handle that allocated them and are freed when it is closed.
+ * Commands complete RTE_SIM_EXEC_US after the CU they target becomes free;
+ * the DPU itself does not compute anything, and CU registers only hold what
+ * set_register() put there. A hung command stays queued until
+ * its handle is closed.
+ */
+namespace xrt_sim {
+
+struct SimConfig {
+  unsigned num_devices = 1;            // RTE_SIM_NUM_DEVICES
+  unsigned exec_us = 1000;             // RTE_SIM_EXEC_US, per command per CU
+  double dma_mbps = 12000;             // RTE_SIM_DMA_MBPS, per direction, 0 = unlimited
+  uint64_t bank_bytes = 256ull << 20;  // RTE_SIM_BANK_MB
+  unsigned hang_every = 0;             // RTE_SIM_HANG_EVERY, every nth command never completes
+
+  static SimConfig from_env();
+};
+
+struct SimStats {
+  uint64_t commands;
+  uint64_t bytes_to_device;
+  uint64_t bytes_from_device;
+  uint64_t num_bos;       // currently allocated
+  uint64_t device_bytes;  // currently allocated
+};
+
+// latency and bandwidth apply to commands/transfers issued afterwards, the
+// bank size once no handle of a device is open
+void set_config(const SimConfig &config);
+SimConfig get_config();
+SimStats get_stats();
+// value xclRead returns for a 32-bit register (absolute CU control offset);
+// the model itself never updates registers
+void set_register(unsigned device, uint64_t offset, uint32_t value);
+
+}
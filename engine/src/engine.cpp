@@ -12,6 +12,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "engine.hpp"
 
 namespace {
@@ -19,6 +29,84 @@ namespace {
     const char* value = getenv("RTENGINE_NUM_WORKERS");
     return value ? std::stoi(value) : 64;
   }
+
+  unsigned getMinWorkers() {
+    const char* value = getenv("RTENGINE_MIN_WORKERS");
+    return value ? std::stoi(value) : 1;
+  }
+
+  unsigned getWorkerIdleMs() {
+    const char* value = getenv("RTENGINE_WORKER_IDLE_MS");
+    return value ? std::stoi(value) : 10000;
+  }
+
+  // lets a worker look up its own id without touching the shared map
+  struct WorkerIdentity {
+    const void* pool = nullptr;
+    unsigned id = 0;
+  };
+  thread_local WorkerIdentity tlsWorker;
+
+  // task status word: generation in the upper bits, TaskState in the low byte
+  inline uint64_t makeStatus(uint64_t gen, int state) { return (gen << 8) | state; }
+  inline uint64_t getGeneration(uint64_t status) { return status >> 8; }
+  inline int getState(uint64_t status) { return status & 0xff; }
+
+  // task queue key: generation in the upper 32 bits, task id in the lower
+  inline uint64_t makeKey(uint64_t gen, uint32_t id) { return (gen << 32) | id; }
+
+  inline uint64_t elapsedNs(std::chrono::steady_clock::time_point from,
+    std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+  }
+
+  std::string getStatsFile(const std::string &engineName) {
+    const char* value = getenv("RTENGINE_STATS_FILE");
+    if (!value)
+      return "";
+    // named engines write next to the default engine's file
+    return engineName.empty() ? value : std::string(value) + "." + engineName;
+  }
+
+  // pin/prioritize the calling worker thread, best effort
+  void applyThreadConfig(const EngineConfig &config) {
+#ifdef __linux__
+    if (!config.cpu_affinity.empty())
+    {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      for (int cpu : config.cpu_affinity)
+        CPU_SET(cpu, &cpus);
+      if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+        std::cerr << "Warning: failed to set engine worker cpu affinity" << std::endl;
+    }
+    if (config.sched_policy != EngineConfig::DEFAULT)
+    {
+      sched_param param;
+      param.sched_priority = config.sched_priority;
+      const int policy = (config.sched_policy == EngineConfig::FIFO) ? SCHED_FIFO : SCHED_RR;
+      if (pthread_setschedparam(pthread_self(), policy, &param))
+        std::cerr << "Warning: failed to set engine worker scheduling policy" << std::endl;
+    }
+#endif
+  }
+
+  unsigned getStatsIntervalMs() {
+    const char* value = getenv("RTENGINE_STATS_INTERVAL_MS");
+    return value ? std::stoi(value) : 10000;
+  }
+}
+
+/*
+ * Engine Config
+ */
+
+EngineConfig EngineConfig::from_env() {
+  EngineConfig config;
+  config.num_workers = getNumWorkers();
+  config.min_workers = getMinWorkers();
+  config.worker_idle_ms = getWorkerIdleMs();
+  return config;
 }
 
 /*
@@ -26,39 +114,137 @@ namespace {
  * General purpose pool that can execute any std::function
  */
 
-EngineThreadPool::EngineThreadPool() : terminate_(false) {
+EngineThreadPool::EngineThreadPool(const EngineConfig &config) 
+  : terminate_(false),
+    config_(config),
+    max_workers_(std::max(1u, config.num_workers)),
+    min_workers_(std::min(config.min_workers, max_workers_)),
+    idle_timeout_(config.worker_idle_ms),
+    live_workers_(0), idle_workers_(0), pending_tasks_(0),
+    start_time_(std::chrono::steady_clock::now()),
+    num_submitted_(0), num_cancelled_(0), num_detached_(0) {
   const unsigned maxConcurrentTasks = 10000;
-  const unsigned numWorkerThreads = getNumWorkers();
 
   // init task ids and task status
-  task_status_.resize(maxConcurrentTasks, EngineThreadPool::DONE);
+  task_status_ = std::vector<std::atomic<uint64_t> >(maxConcurrentTasks);
   for (uint32_t i=0; i < maxConcurrentTasks; i++)
-    task_ids_.enqueue(i);
-  
-  // spawn threads
-  for (unsigned i=0; i < numWorkerThreads; i++)
   {
-    threads_.emplace_back(std::thread([this]{run();}));
-    thread_worker_ids_[threads_.back().get_id()] = i;
+    task_status_[i] = makeStatus(0, EngineThreadPool::DONE);
+    task_ids_.enqueue(i);
   }
+  
+  // worker ids are handed out lowest first
+  threads_.resize(max_workers_);
+  worker_telemetry_ = std::vector<WorkerTelemetry>(max_workers_);
+  for (unsigned i=max_workers_; i > 0; i--)
+    free_worker_ids_.push_back(i-1);
+
+  // only the minimum set of threads is spawned upfront, the rest on demand
+  for (unsigned i=0; i < min_workers_; i++)
+    spawn_worker();
 }
 
 EngineThreadPool::~EngineThreadPool() {
-  // collect threads
+  // collect threads; don't hold the lock while joining, retiring
+  // workers need it to unregister themselves
   terminate_ = true;
-  for (unsigned i=0; i < threads_.size(); i++)
-    threads_[i].join();
+  std::vector<std::thread> threads;
+  {
+    std::unique_lock<std::mutex> lock(workers_mtx_);
+    threads.swap(threads_);
+  }
+  for (auto &thread : threads)
+    if (thread.joinable())
+      thread.join();
+}
+
+bool EngineThreadPool::spawn_worker() {
+  std::unique_lock<std::mutex> lock(workers_mtx_);
+  if (free_worker_ids_.empty() || terminate_)
+    return false;
+
+  const unsigned workerId = free_worker_ids_.back();
+  free_worker_ids_.pop_back();
+
+  // reap the retired thread that last held this id, it has already unregistered
+  if (threads_[workerId].joinable())
+  {
+    thread_worker_ids_.erase(threads_[workerId].get_id());
+    threads_[workerId].join();
+  }
+
+  live_workers_++;
+  idle_workers_++;
+  threads_[workerId] = std::thread([this, workerId]{run(workerId);});
+  thread_worker_ids_[threads_[workerId].get_id()] = workerId;
+  return true;
+}
+
+bool EngineThreadPool::retire_worker(unsigned workerId) {
+  std::unique_lock<std::mutex> lock(workers_mtx_);
+  if (terminate_ || live_workers_ <= min_workers_)
+    return false;
+
+  // enqueue() bumps pending_tasks_ before it looks at idle_workers_ and
+  // live_workers_, and we drop both before looking at pending_tasks_, so a
+  // task can't be stranded: either we see it and stay, or enqueue sees us
+  // gone and spawns (waiting on the lock until our id is free again)
+  idle_workers_--;
+  live_workers_--;
+  if (pending_tasks_ > idle_workers_)
+  {
+    idle_workers_++;
+    live_workers_++;
+    return false;
+  }
+  free_worker_ids_.push_back(workerId);
+  return true;
 }
 
 uint32_t EngineThreadPool::enqueue(std::function<void()> task) {
   uint32_t id;
   task_ids_.wait_dequeue(id); // block until we get a free ID from the pool
-  task_status_[id] = EngineThreadPool::NEW; // mark task "new"
-  taskq_.enqueue(std::make_pair(id, task)); // send task for thread to execute
+  // mark task "new" under a fresh generation
+  const uint64_t gen = (getGeneration(task_status_[id]) + 1) & 0xffffffff;
+  task_status_[id] = makeStatus(gen, EngineThreadPool::NEW);
+  num_submitted_.fetch_add(1, std::memory_order_relaxed);
+  // send task for thread to execute
+#ifndef RTENGINE_NO_TELEMETRY
+  taskq_.enqueue(Task{makeKey(gen, id), std::chrono::steady_clock::now(), std::move(task)});
+#else
+  taskq_.enqueue(Task{makeKey(gen, id), {}, std::move(task)});
+#endif
+
+  // grow the pool if every live worker already has something to do
+  if (++pending_tasks_ > idle_workers_ && live_workers_ < max_workers_)
+    spawn_worker();
   return id;
 }
 
+bool EngineThreadPool::transition(uint32_t id, TaskState from, TaskState to) {
+  uint64_t status = task_status_[id];
+  if (getState(status) != from)
+    return false;
+  return task_status_[id].compare_exchange_strong(
+    status, makeStatus(getGeneration(status), to));
+}
+
+bool EngineThreadPool::cancel(uint32_t id) {
+  if (id >= task_status_.size())
+    throw std::runtime_error("Error: invalid task id: " + std::to_string(id));
+
+  // the stale queue entry is skipped by the worker, so the id can be reused now
+  if (!transition(id, EngineThreadPool::NEW, EngineThreadPool::CANCELLED))
+    return false;
+  num_cancelled_.fetch_add(1, std::memory_order_relaxed);
+  task_ids_.enqueue(id);
+  return true;
+}
+
 void EngineThreadPool::wait(uint32_t id, int timeoutMs) {
+  if (id >= task_status_.size())
+    throw std::runtime_error("Error: invalid task id: " + std::to_string(id));
+
   // wait for task to be done
   const auto waitInterval = (timeoutMs > 0) ? 
     std::chrono::milliseconds(timeoutMs) : std::chrono::seconds(5);
@@ -66,8 +252,11 @@ void EngineThreadPool::wait(uint32_t id, int timeoutMs) {
 
   {
     std::unique_lock<std::mutex> lock(status_mtx_);
-    while (task_status_[id] != EngineThreadPool::DONE)
+    while (getState(task_status_[id]) != EngineThreadPool::DONE)
     {
+      if (getState(task_status_[id]) == EngineThreadPool::CANCELLED)
+        throw std::runtime_error("Error: task cancelled: " + std::to_string(id));
+
       (void)status_cvar_.wait_for(lock, waitInterval);
 
       if (timeoutMs <= 0)
@@ -79,7 +268,19 @@ void EngineThreadPool::wait(uint32_t id, int timeoutMs) {
             currTime - startTime);
 
       if (elapsedTime.count()*1000 > timeoutMs)
-        throw std::runtime_error("Error: task timeout: " + std::to_string(id));
+      {
+        // give up on the task without leaking its id:
+        // - not started: cancel it, the id goes back to the pool right away
+        // - running: detach it, the worker returns the id when the task ends
+        // - just finished: fall through and reclaim the id as usual
+        if (cancel(id))
+          throw std::runtime_error("Error: task timeout: " + std::to_string(id));
+        if (transition(id, EngineThreadPool::RUNNING, EngineThreadPool::DETACHED))
+        {
+          num_detached_.fetch_add(1, std::memory_order_relaxed);
+          throw std::runtime_error("Error: task timeout: " + std::to_string(id));
+        }
+      }
     }
   }
 
@@ -87,48 +288,174 @@ void EngineThreadPool::wait(uint32_t id, int timeoutMs) {
   task_ids_.enqueue(id); 
 }
 
-void EngineThreadPool::run() {
+void EngineThreadPool::run(unsigned workerId) {
+  tlsWorker.pool = this;
+  tlsWorker.id = workerId;
+  applyThreadConfig(config_);
+  auto lastActive = std::chrono::steady_clock::now();
+
   while (1) {
     // get new task from queue
-    std::pair<int, std::function<void()> > task;
+    Task task;
     bool found = taskq_.wait_dequeue_timed(task, std::chrono::milliseconds(5));
     if (!found)
     {
       // queue was empty
       if (terminate_)
         break;
-      else
-        continue;
+      if (std::chrono::steady_clock::now() - lastActive > idle_timeout_
+        && retire_worker(workerId))
+        break;
+      continue;
+    }
+    idle_workers_--;
+    pending_tasks_--;
+
+    // claim task, skip it if it was cancelled while queued
+    const uint32_t id = task.key & 0xffffffff;
+    const uint64_t gen = task.key >> 32;
+    uint64_t status = makeStatus(gen, EngineThreadPool::NEW);
+    if (!task_status_[id].compare_exchange_strong(
+          status, makeStatus(gen, EngineThreadPool::RUNNING)))
+    {
+      idle_workers_++;
+      continue;
     }
 
-    // run task
-    task_status_[task.first] = EngineThreadPool::RUNNING;
-    task.second();
+    // run task; a reused worker id's shard is ours, its last worker was joined
+#ifndef RTENGINE_NO_TELEMETRY
+    auto &telemetry = worker_telemetry_[workerId];
+    const auto startTime = std::chrono::steady_clock::now();
+    telemetry.queue_wait.record_owned(elapsedNs(task.enqueue_time, startTime));
+    task.func();
+    const uint64_t runNs = elapsedNs(startTime, std::chrono::steady_clock::now());
+    telemetry.run.record_owned(runNs);
+    telemetry.busy_ns.store(telemetry.busy_ns.load(std::memory_order_relaxed) + runNs,
+      std::memory_order_relaxed);
+#else
+    task.func();
+#endif
 
     // report task done
+    lastActive = std::chrono::steady_clock::now();
+    idle_workers_++;
     {
-      task_status_[task.first] = EngineThreadPool::DONE;
       std::unique_lock<std::mutex> lock(status_mtx_);
+      if (!transition(id, EngineThreadPool::RUNNING, EngineThreadPool::DONE))
+      {
+        // waiter timed out and detached, nobody will reclaim the id but us
+        task_status_[id] = makeStatus(gen, EngineThreadPool::DONE);
+        task_ids_.enqueue(id);
+        continue;
+      }
       status_cvar_.notify_all();
     }
   }
 }
 
 unsigned EngineThreadPool::get_worker_id(std::thread::id id) {
+  if (id == std::this_thread::get_id() && tlsWorker.pool == this)
+    return tlsWorker.id;
+
+  std::unique_lock<std::mutex> lock(workers_mtx_);
   auto it = thread_worker_ids_.find(id);
   if (it == thread_worker_ids_.end())
     throw std::runtime_error("Error: unknown worker thread id");
   return it->second;
 }
 
+EngineStats EngineThreadPool::get_stats() const {
+  // counters are derived from the workers' histograms to keep the worker
+  // path lean; they are read without a common lock, so the depth is approximate
+  EngineStats stats;
+  stats.cancelled = num_cancelled_;
+  for (auto &worker : worker_telemetry_)
+  {
+    stats.queue_wait.add(worker.queue_wait.snapshot()); // one sample per started task
+    stats.run.add(worker.run.snapshot());
+    stats.worker_busy_ns.push_back(worker.busy_ns.load(std::memory_order_relaxed));
+  }
+  stats.submitted = num_submitted_;
+  stats.completed = stats.run.count;
+  stats.detached = num_detached_;
+  stats.live_workers = live_workers_;
+#ifndef RTENGINE_NO_TELEMETRY
+  const uint64_t resolved = stats.queue_wait.count + stats.cancelled;
+  stats.queue_depth = stats.submitted > resolved ? stats.submitted - resolved : 0;
+#else
+  // no per-task samples: tasks the workers have not picked up yet
+  stats.queue_depth = std::max<int64_t>(pending_tasks_, 0);
+#endif
+  stats.uptime_s = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start_time_).count();
+  return stats;
+}
+
 /*
  * Engine
  */
 
-Engine::Engine() {
+Engine::Engine(const std::string &name, const EngineConfig &config)
+  : name_(name), tpool_(config), stats_stop_(false) {
+  if (!getStatsFile(name_).empty())
+    stats_thread_ = std::thread([this]{dump_stats();});
+}
+
+struct EngineRegistry {
+  struct Deleter {
+    void operator()(Engine *engine) const { delete engine; }
+  };
+  std::mutex mtx;
+  std::map<std::string, std::unique_ptr<Engine, Deleter> > engines;
+
+  static EngineRegistry &get() {
+    static EngineRegistry registry;
+    return registry;
+  }
+};
+
+Engine &Engine::get_instance(const std::string &name, const EngineConfig &config) {
+  if (name.empty())
+    return get_instance();
+
+  auto &registry = EngineRegistry::get();
+  std::unique_lock<std::mutex> lock(registry.mtx);
+  auto &engine = registry.engines[name];
+  if (!engine)
+    engine.reset(new Engine(name, config));
+  return *engine;
 }
 
 Engine::~Engine() {
+  if (stats_thread_.joinable())
+  {
+    {
+      std::unique_lock<std::mutex> lock(stats_mtx_);
+      stats_stop_ = true;
+    }
+    stats_cvar_.notify_all();
+    stats_thread_.join();
+  }
+}
+
+void Engine::dump_stats() {
+  // write to a temp file and rename so scrapers never see a partial file
+  const std::string path = getStatsFile(name_);
+  const std::string tmpPath = path + ".tmp";
+  const auto interval = std::chrono::milliseconds(getStatsIntervalMs());
+
+  std::unique_lock<std::mutex> lock(stats_mtx_);
+  while (true)
+  {
+    const bool stop = stats_cvar_.wait_for(lock, interval, [this]{ return stats_stop_; });
+    {
+      std::ofstream ofs(tmpPath, std::ios::trunc);
+      ofs << tpool_.get_stats().to_prometheus();
+    }
+    std::rename(tmpPath.c_str(), path.c_str());
+    if (stop)
+      break;
+  }
 }
 
 uint32_t Engine::submit(std::function<void()> task) {
@@ -139,6 +466,10 @@ void Engine::wait(uint32_t id, int timeout_ms) {
   tpool_.wait(id, timeout_ms);
 }
 
+bool Engine::cancel(uint32_t id) {
+  return tpool_.cancel(id);
+}
+
 unsigned Engine::get_my_worker_id() {
   return tpool_.get_worker_id(std::this_thread::get_id());
 }
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <unordered_map>
@@ -23,50 +24,128 @@
 #include <string>
 #include <chrono>
 #include "blockingconcurrentqueue.hpp"
+#include "engine_stats.hpp"
+
+struct EngineConfig {
+  enum SchedPolicy { DEFAULT, FIFO, RR }; // OS scheduling policy of workers
+
+  unsigned num_workers;            // max workers, RTENGINE_NUM_WORKERS
+  unsigned min_workers;            // always alive, RTENGINE_MIN_WORKERS
+  unsigned worker_idle_ms;         // retire after idle, RTENGINE_WORKER_IDLE_MS
+  std::vector<int> cpu_affinity;   // CPUs workers may run on, empty for any
+  SchedPolicy sched_policy = DEFAULT;
+  int sched_priority = 0;          // for FIFO/RR
+
+  static EngineConfig from_env();
+};
 
 class EngineThreadPool {
   public: 
-    enum TaskState { NEW, RUNNING, DONE };
+    enum TaskState { NEW, RUNNING, DONE, CANCELLED, DETACHED };
 
-    EngineThreadPool();
+    EngineThreadPool(const EngineConfig &config = EngineConfig::from_env());
     ~EngineThreadPool();
 
     uint32_t enqueue(std::function<void()> task);
+    // On timeout, a task that has not started is cancelled and a running
+    // task is detached; either way its id is returned to the pool.
     void wait(uint32_t id, int timeout_ms=-1);
-    unsigned get_num_workers() const { return threads_.size(); }
+    // Drop a task that has not started yet. Returns false if it is already
+    // running or done. A cancelled id is released and must not be waited on.
+    bool cancel(uint32_t id);
+    // workers are spawned on demand and retired when idle; worker ids are
+    // always in [0, get_num_workers()) and are reused by later workers
+    unsigned get_num_workers() const { return max_workers_; }
+    unsigned get_num_live_workers() const { return live_workers_; }
     unsigned get_worker_id(std::thread::id); // get a thread's 0-indexed worker id
+    EngineStats get_stats() const;
 
   private:
-    void run();
+    struct Task {
+      uint64_t key; // generation << 32 | id
+      std::chrono::steady_clock::time_point enqueue_time;
+      std::function<void()> func;
+    };
+    // one worker's telemetry: only that worker records into it (with plain
+    // loads and stores), get_stats() merges them; aligned so workers never
+    // write to the same cache line
+    struct alignas(64) WorkerTelemetry {
+      LatencyHistogram queue_wait;
+      LatencyHistogram run;
+      std::atomic<uint64_t> busy_ns{0};
+    };
+
+    void run(unsigned worker_id);
+    bool spawn_worker(); // false if all worker ids are taken
+    bool retire_worker(unsigned worker_id); // false if the worker must stay
+    bool transition(uint32_t id, TaskState from, TaskState to);
     std::mutex status_mtx_;
     std::condition_variable status_cvar_;
-    moodycamel::BlockingConcurrentQueue<std::pair<int, std::function<void()> > > taskq_;
+    moodycamel::BlockingConcurrentQueue<Task> taskq_;
     moodycamel::BlockingConcurrentQueue<uint32_t> task_ids_;
-    std::vector<int> task_status_; // ID -> status
+    // ID -> (generation << 8 | status). The generation is bumped on every
+    // enqueue so stale queue entries of cancelled tasks are never run.
+    std::vector<std::atomic<uint64_t> > task_status_;
     std::atomic<bool> terminate_;
-    std::vector<std::thread> threads_;
+
+    // elastic workers
+    const EngineConfig config_;
+    const unsigned max_workers_;
+    const unsigned min_workers_;
+    const std::chrono::milliseconds idle_timeout_;
+    std::atomic<unsigned> live_workers_;
+    std::atomic<int64_t> idle_workers_;   // workers waiting for a task
+    std::atomic<int64_t> pending_tasks_;  // tasks not yet picked up by a worker
+    std::mutex workers_mtx_;
+    std::vector<std::thread> threads_;    // indexed by worker id
+    std::vector<unsigned> free_worker_ids_;
     std::unordered_map<std::thread::id, unsigned> thread_worker_ids_;
+
+    // telemetry; the per-task part is left out with -DRTENGINE_NO_TELEMETRY
+    // (cmake -DENGINE_TELEMETRY=OFF)
+    const std::chrono::steady_clock::time_point start_time_;
+    std::atomic<uint64_t> num_submitted_;
+    std::atomic<uint64_t> num_cancelled_;
+    std::atomic<uint64_t> num_detached_;
+    std::vector<WorkerTelemetry> worker_telemetry_; // indexed by worker id
 };
 
 class Engine {
   public:
+    // process-wide default engine, configured from the environment
     static Engine &get_instance() {
       static Engine instance; // magic static is thread-safe in C++11
       return instance;
     }
+    // named engines have their own queue and workers; an empty name is the
+    // default engine. The config only applies when the engine is created by
+    // this call, an existing engine is returned as is.
+    static Engine &get_instance(const std::string &name,
+      const EngineConfig &config = EngineConfig::from_env());
     
+    const std::string &get_name() const { return name_; }
     uint32_t submit(std::function<void()> task);
     void wait(uint32_t id, int timeout_ms=-1);
+    bool cancel(uint32_t id);
     unsigned get_num_workers() const { return tpool_.get_num_workers(); }
     unsigned get_my_worker_id(); // for task to get its 0-indexed worker id
+    EngineStats get_stats() const { return tpool_.get_stats(); }
 
   private:
-    Engine();
+    friend struct EngineRegistry;
+    void dump_stats(); // periodic Prometheus dump, see RTENGINE_STATS_FILE
+
+    Engine(const std::string &name="", const EngineConfig &config=EngineConfig::from_env());
     ~Engine();
     Engine(const Engine&) = delete;
     Engine& operator=(const Engine&) = delete;
     Engine(Engine&&) = delete;
     Engine& operator=(Engine&&) = delete;
 
+    const std::string name_;
     EngineThreadPool tpool_;
+    std::mutex stats_mtx_;
+    std::condition_variable stats_cvar_;
+    bool stats_stop_;
+    std::thread stats_thread_;
 };
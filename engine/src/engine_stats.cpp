@@ -0,0 +1,165 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <sstream>
+#include "engine_stats.hpp"
+
+/*
+ * Latency Histogram
+ */
+
+LatencyHistogram::LatencyHistogram() : sum_(0), max_(0) {
+  for (auto &c : counts_)
+    c = 0;
+}
+
+unsigned LatencyHistogram::bucket_index(uint64_t ns) {
+  if (ns < SUB_BUCKETS)
+    return ns;
+  const unsigned msb = 63 - __builtin_clzll(ns);
+  const unsigned shift = msb - SUB_BUCKET_BITS;
+  const unsigned sub = (ns >> shift) - SUB_BUCKETS;
+  return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(unsigned idx) {
+  if (idx < SUB_BUCKETS)
+    return idx;
+  const unsigned shift = idx / SUB_BUCKETS - 1;
+  const uint64_t sub = idx % SUB_BUCKETS;
+  const uint64_t lower = (SUB_BUCKETS + sub) << shift;
+  return lower + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+  counts_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(ns, std::memory_order_relaxed);
+  uint64_t prev = max_.load(std::memory_order_relaxed);
+  while (ns > prev && !max_.compare_exchange_weak(prev, ns, std::memory_order_relaxed))
+    ;
+}
+
+void LatencyHistogram::record_owned(uint64_t ns) {
+  auto &count = counts_[bucket_index(ns)];
+  count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  sum_.store(sum_.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+  if (ns > max_.load(std::memory_order_relaxed))
+    max_.store(ns, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+  Snapshot s;
+  s.counts.resize(NUM_BUCKETS);
+  for (unsigned i=0; i < NUM_BUCKETS; i++)
+  {
+    s.counts[i] = counts_[i].load(std::memory_order_relaxed);
+    s.count += s.counts[i];
+  }
+  s.sum_ns = sum_.load(std::memory_order_relaxed);
+  s.max_ns = max_.load(std::memory_order_relaxed);
+  return s;
+}
+
+void LatencyHistogram::Snapshot::add(const Snapshot &other) {
+  if (counts.size() < other.counts.size())
+    counts.resize(other.counts.size());
+  for (unsigned i=0; i < other.counts.size(); i++)
+    counts[i] += other.counts[i];
+  count += other.count;
+  sum_ns += other.sum_ns;
+  max_ns = std::max(max_ns, other.max_ns);
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile_ns(double p) const {
+  if (count == 0)
+    return 0;
+  const uint64_t rank = std::max<uint64_t>(1, uint64_t(p / 100.0 * count + 0.5));
+  uint64_t seen = 0;
+  for (unsigned i=0; i < counts.size(); i++)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::min(bucket_upper_bound(i), max_ns);
+  }
+  return max_ns;
+}
+
+/*
+ * Engine Stats
+ */
+
+double EngineStats::worker_utilization(unsigned worker_id) const {
+  if (worker_id >= worker_busy_ns.size() || uptime_s <= 0)
+    return 0.0;
+  return worker_busy_ns[worker_id] / (uptime_s * 1e9);
+}
+
+namespace {
+  void writeHistogram(std::ostringstream &os, const std::string &name,
+    const std::string &help, const LatencyHistogram::Snapshot &h) {
+    os << "# HELP " << name << " " << help << "\n";
+    os << "# TYPE " << name << " histogram\n";
+    // only emit populated buckets, le boundaries may be sparse
+    uint64_t cumulative = 0;
+    for (unsigned i=0; i < h.counts.size(); i++)
+    {
+      if (h.counts[i] == 0)
+        continue;
+      cumulative += h.counts[i];
+      os << name << "_bucket{le=\""
+         << (LatencyHistogram::bucket_upper_bound(i) + 1) * 1e-9 << "\"} "
+         << cumulative << "\n";
+    }
+    os << name << "_bucket{le=\"+Inf\"} " << h.count << "\n";
+    os << name << "_sum " << h.sum_ns * 1e-9 << "\n";
+    os << name << "_count " << h.count << "\n";
+  }
+
+  void writeCounter(std::ostringstream &os, const std::string &name,
+    const std::string &type, const std::string &help, double value) {
+    os << "# HELP " << name << " " << help << "\n";
+    os << "# TYPE " << name << " " << type << "\n";
+    os << name << " " << value << "\n";
+  }
+}
+
+std::string EngineStats::to_prometheus() const {
+  std::ostringstream os;
+  writeHistogram(os, "rtengine_queue_wait_seconds",
+    "Time from submit to a worker picking up the task.", queue_wait);
+  writeHistogram(os, "rtengine_run_seconds",
+    "Time a worker spends executing the task.", run);
+  writeCounter(os, "rtengine_queue_depth", "gauge",
+    "Tasks submitted but not yet started.", queue_depth);
+  writeCounter(os, "rtengine_tasks_submitted_total", "counter",
+    "Tasks submitted.", submitted);
+  writeCounter(os, "rtengine_tasks_completed_total", "counter",
+    "Tasks run to completion.", completed);
+  writeCounter(os, "rtengine_tasks_cancelled_total", "counter",
+    "Tasks cancelled before they started.", cancelled);
+  writeCounter(os, "rtengine_tasks_detached_total", "counter",
+    "Tasks whose waiter timed out while they were running.", detached);
+  writeCounter(os, "rtengine_live_workers", "gauge",
+    "Worker threads currently alive.", live_workers);
+  writeCounter(os, "rtengine_uptime_seconds", "gauge",
+    "Time since the engine started.", uptime_s);
+
+  os << "# HELP rtengine_worker_busy_seconds_total Time each worker spent running tasks.\n";
+  os << "# TYPE rtengine_worker_busy_seconds_total counter\n";
+  for (unsigned i=0; i < worker_busy_ns.size(); i++)
+    os << "rtengine_worker_busy_seconds_total{worker=\"" << i << "\"} "
+       << worker_busy_ns[i] * 1e-9 << "\n";
+  return os.str();
+}
@@ -0,0 +1,79 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Log-linear latency histogram in the spirit of HdrHistogram.
+ * Each power-of-two range of nanoseconds is split into 16 linear sub-buckets
+ * (~6% relative error). record() is a few relaxed atomic ops, so any number
+ * of threads can share one histogram without locking; a histogram only one
+ * thread records into can use record_owned(), which skips the atomic
+ * read-modify-writes. snapshot() may run concurrently with either.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr unsigned NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    struct Snapshot {
+      std::vector<uint64_t> counts; // per bucket, not cumulative
+      uint64_t count = 0;
+      uint64_t sum_ns = 0;
+      uint64_t max_ns = 0;
+
+      double mean_ns() const { return count ? double(sum_ns)/count : 0.0; }
+      uint64_t percentile_ns(double p) const; // p in [0, 100]
+      void add(const Snapshot &other);        // merge another histogram's samples
+    };
+
+    LatencyHistogram();
+    void record(uint64_t ns);
+    void record_owned(uint64_t ns); // single writer only
+    Snapshot snapshot() const;
+
+    static unsigned bucket_index(uint64_t ns);
+    static uint64_t bucket_upper_bound(unsigned idx); // largest ns value in bucket
+
+  private:
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> counts_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+/*
+ * Point-in-time view of the engine thread pool
+ */
+struct EngineStats {
+  LatencyHistogram::Snapshot queue_wait; // enqueue -> start
+  LatencyHistogram::Snapshot run;        // start -> end
+  uint64_t queue_depth = 0;              // submitted but not started
+  uint64_t submitted = 0;
+  uint64_t completed = 0;
+  uint64_t cancelled = 0;
+  uint64_t detached = 0;                 // timed out while running
+  double uptime_s = 0;
+  unsigned live_workers = 0;
+  std::vector<uint64_t> worker_busy_ns;  // indexed by worker id
+
+  double worker_utilization(unsigned worker_id) const;
+  std::string to_prometheus() const;     // Prometheus text exposition format
+};
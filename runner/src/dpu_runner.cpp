@@ -15,10 +15,16 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include "dpu_runner.hpp"
 #include "engine.hpp"
 #include "json-c/json.h"
 #include "dpu_controller_factory.hpp"
+#include "parallel_init.hpp"
+#include "common/image_quantize.hpp"
 #include "vitis/ai/target_factory.hpp"
 
 namespace vart{
@@ -38,6 +44,7 @@ DpuRunner::DpuRunner(const xir::Subgraph* subgraph) {
 
   dpu_controller_ = DpuControllerFactory::get_instance().get(kernel, subgraph);
   
+  StartupProfile::Scope buffers(startup_, "buffers");
   in_bufs = dpu_controller_->get_inputs();
   out_bufs = dpu_controller_->get_outputs();
 }
@@ -57,6 +64,7 @@ DpuRunner::DpuRunner(const xir::Subgraph* subgraph, xir::Attrs* attrs) {
 
   dpu_controller_ = DpuControllerFactory::get_instance().get(kernel, subgraph, attrs);
   
+  StartupProfile::Scope buffers(startup_, "buffers");
   in_bufs = dpu_controller_->get_inputs();
   out_bufs = dpu_controller_->get_outputs();
 }
@@ -85,6 +93,22 @@ DpuRunner::DpuRunner(std::string meta) {
 DpuRunner::~DpuRunner() {
 }
 
+std::vector<std::unique_ptr<DpuRunner>> DpuRunner::create_runners(const std::vector<Spec> &specs) {
+  return construct_all<DpuRunner>(specs.size(), [&specs](size_t i) {
+    return std::make_unique<DpuRunner>(specs[i].subgraph, specs[i].attrs);
+  });
+}
+
+StartupProfile DpuRunner::get_startup_profile() const {
+  StartupProfile profile = dpu_controller_->get_startup_profile();
+  profile.merge(startup_);
+  return profile;
+}
+
+bool DpuRunner::is_healthy() const {
+  return dpu_controller_->is_healthy();
+}
+
 std::vector<const xir::Tensor*> DpuRunner::get_input_tensors() {
   return dpu_controller_->get_input_tensors();
 }
@@ -109,18 +133,145 @@ std::vector<vart::TensorBuffer*> DpuRunner::make_outputs(int batchsz) {
 
 
 
+void DpuRunner::warmup(unsigned num_runs) {
+  Engine& engine = dpu_controller_->get_engine();
+
+  // runners built from meta.json do not allocate their buffers up front
+  if (in_bufs.empty())
+    in_bufs = dpu_controller_->get_inputs();
+  if (out_bufs.empty())
+    out_bufs = dpu_controller_->get_outputs();
+  const bool can_run = !in_bufs.empty() && !out_bufs.empty();
+
+  dpu_controller_->fault_in_buffers();
+
+  // the first inference executes the preload; keep it on its own
+  if (can_run)
+    wait(execute_async(in_bufs, out_bufs).first, -1);
+
+  // One job per worker to prime. Jobs rendezvous before doing any work so the
+  // pool has to hand each of them to a different worker; the deadline keeps a
+  // busy pool from stalling warmup.
+  const unsigned num_jobs =
+    std::max(1u, std::min(num_runs, engine.get_num_workers()));
+  std::atomic<unsigned> arrived(0);
+  std::atomic<unsigned> extra_runs(num_jobs);
+  std::mutex run_mtx; // dummy runs share one buffer set
+  std::vector<uint32_t> job_ids;
+  for (unsigned j=0; j < num_jobs; j++)
+    job_ids.push_back(engine.submit([&] {
+      arrived++;
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+      while (arrived < num_jobs && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+
+      dpu_controller_->init_worker(engine.get_my_worker_id());
+      if (!can_run || num_runs == 0)
+        return;
+
+      // one run per worker, the rest go to whichever worker asks first
+      do {
+        std::unique_lock<std::mutex> lock(run_mtx);
+        dpu_controller_->run(in_bufs, out_bufs);
+      } while (extra_runs++ < num_runs);
+    }));
+
+  for (auto id : job_ids)
+    engine.wait(id);
+}
+
 std::pair<uint32_t, int> DpuRunner::execute_async(
   const std::vector<vart::TensorBuffer*>& inputs,
   const std::vector<vart::TensorBuffer*>& outputs) {
-  Engine& engine = Engine::get_instance();
+  Engine& engine = dpu_controller_->get_engine();
   auto job_id = engine.submit([this, inputs, outputs] {
     dpu_controller_->run(inputs, outputs);
   });
   return std::pair<uint32_t, int>(job_id, 0);
 }
 
+std::shared_ptr<const DpuIoBinding> DpuRunner::bind(
+  const std::vector<vart::TensorBuffer*>& inputs,
+  const std::vector<vart::TensorBuffer*>& outputs) {
+  return dpu_controller_->bind(inputs, outputs);
+}
+
+std::pair<uint32_t, int> DpuRunner::execute_async(
+  const std::shared_ptr<const DpuIoBinding>& binding) {
+  if (!binding || binding->owner != dpu_controller_.get())
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  Engine& engine = dpu_controller_->get_engine();
+  auto job_id = engine.submit([this, binding] {
+    dpu_controller_->run_bound(*binding);
+  });
+  return std::pair<uint32_t, int>(job_id, 0);
+}
+
+std::shared_ptr<const DpuIoBinding> DpuRunner::with_topk(
+  const std::shared_ptr<const DpuIoBinding>& binding, const DpuTopK& topk) {
+  if (!binding || binding->owner != dpu_controller_.get())
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  return dpu_controller_->with_topk(*binding, topk);
+}
+
+std::shared_ptr<const DpuIoBinding> DpuRunner::with_lazy_outputs(
+  const std::shared_ptr<const DpuIoBinding>& binding) {
+  if (!binding || binding->owner != dpu_controller_.get())
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  return dpu_controller_->with_lazy_outputs(*binding);
+}
+
+std::shared_ptr<const DpuIoBinding> DpuRunner::with_batch(
+  const std::shared_ptr<const DpuIoBinding>& binding, unsigned batch) {
+  if (!binding || binding->owner != dpu_controller_.get())
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  return dpu_controller_->with_batch(*binding, batch);
+}
+
+std::pair<std::shared_ptr<const DpuIoBinding>, std::shared_ptr<const DpuIoBinding>>
+DpuRunner::chain(const std::shared_ptr<const DpuIoBinding>& up,
+  const std::shared_ptr<const DpuIoBinding>& down, bool download_chained) {
+  if (!down || down->owner != dpu_controller_.get())
+    throw std::runtime_error("Error: io binding belongs to another runner");
+  if (!up || up->owner == down->owner)
+    throw std::runtime_error("Error: upstream binding must come from another runner");
+  return dpu_controller_->chain(*up, *down, download_chained);
+}
+
+void DpuRunner::set_image_input(vart::TensorBuffer* input, const uint8_t* images, unsigned num_images,
+  const std::vector<float>& mean, const std::vector<float>& scale) {
+  const auto tensors = dpu_controller_->get_input_tensors();
+  const auto &name = input->get_tensor()->get_name();
+  unsigned idx = 0;
+  while (idx < tensors.size() && name.find(tensors[idx]->get_name()) == std::string::npos)
+    idx++;
+  if (idx == tensors.size())
+    throw std::runtime_error("Error: no input tensor matches " + name);
+
+  const auto dims = input->get_tensor()->get_shape();
+  if (dims.size() != 4 || input->get_tensor()->get_data_type().bit_width != 8)
+    throw std::runtime_error("Error: image input " + name + " is not int8 NHWC");
+  if (unsigned(dims[3]) != mean.size())
+    throw std::runtime_error("Error: image input " + name + " has "
+      + std::to_string(dims[3]) + " channels, got " + std::to_string(mean.size()));
+  if (num_images > unsigned(dims[0]))
+    throw std::runtime_error("Error: image input " + name + " holds "
+      + std::to_string(dims[0]) + " images, got " + std::to_string(num_images));
+
+  ImageQuantizer(mean, scale, dpu_controller_->get_input_scale()[idx])
+    .write(input, images, num_images);
+}
+
+bool DpuRunner::register_memory(void* ptr, size_t size) {
+  return dpu_controller_->register_memory(ptr, size);
+}
+
+void DpuRunner::unregister_memory(void* ptr) {
+  dpu_controller_->unregister_memory(ptr);
+}
+
 int DpuRunner::wait(int jobid, int timeout) {
-  Engine& engine = Engine::get_instance();
+  Engine& engine = dpu_controller_->get_engine();
   engine.wait(jobid, timeout);
 
   return 0;
@@ -58,8 +58,77 @@ public:
   execute_async(const std::vector<vart::TensorBuffer*>& inputs,
                 const std::vector<vart::TensorBuffer*>& outputs) override;
 
+  // Resolve inputs/outputs once (batch layout, tensor name matching,
+  // scales, device addresses) for buffers that are run repeatedly. The
+  // binding stays valid as long as its buffers do.
+  std::shared_ptr<const DpuIoBinding>
+  bind(const std::vector<vart::TensorBuffer*>& inputs,
+       const std::vector<vart::TensorBuffer*>& outputs);
+
+  // execute_async() for a binding from this runner's bind()
+  std::pair<uint32_t, int>
+  execute_async(const std::shared_ptr<const DpuIoBinding>& binding);
+
+  // Copy of binding that, in the engine worker right after each download,
+  // turns output topk.output into softmax probabilities of its topk.k best
+  // classes per batch element, written to topk.results ([batch][k]). User
+  // host buffers bound to that output are then no longer written.
+  std::shared_ptr<const DpuIoBinding>
+  with_topk(const std::shared_ptr<const DpuIoBinding>& binding, const DpuTopK& topk);
+
+  // Copy of binding whose outputs are not downloaded after each run: the
+  // runner-allocated host output buffers pull from the device only what
+  // data() (the rest of the addressed batch element) or sync_for_read()
+  // (that byte range) touches, until the next run of the binding. For
+  // models with outputs read only conditionally; XLNX_DPU_PROFILE counts
+  // the bytes avoided. Runner phy buffers already work this way.
+  std::shared_ptr<const DpuIoBinding>
+  with_lazy_outputs(const std::shared_ptr<const DpuIoBinding>& binding);
+
+  // Copy of binding that only uploads, downloads and post-processes its
+  // first batch elements, for requests that do not fill the xclbin's
+  // batch. The other engines still run on their (stale) inputs, so the
+  // DPU time is that of a full batch; XLNX_DPU_PROFILE reports the fill.
+  std::shared_ptr<const DpuIoBinding>
+  with_batch(const std::shared_ptr<const DpuIoBinding>& binding, unsigned batch);
+
+  // Chain down, one of this runner's bindings, after up, a binding of
+  // another runner on the same device (consecutive DPU subgraphs). Inputs
+  // of down whose tensor is one of up's outputs (same name) are read where
+  // up's DPU wrote them instead of being uploaded, and up no longer
+  // downloads them unless download_chained; the buffers down was bound with
+  // for them are left alone. Both must be bound to runner-allocated, phy or
+  // registered buffers. Returns {up, down} re-bound: run down's job after
+  // up's has completed, and one request per pair at a time.
+  std::pair<std::shared_ptr<const DpuIoBinding>, std::shared_ptr<const DpuIoBinding>>
+  chain(const std::shared_ptr<const DpuIoBinding>& up,
+        const std::shared_ptr<const DpuIoBinding>& down,
+        bool download_chained = false);
+
+  // Input stage for uint8 HWC images: writes num_images images (each H*W*C
+  // bytes of the input tensor's NHWC shape) as (pixel - mean[c]) * scale[c]
+  // quantized with the tensor's fix_point, in one pass straight into batch
+  // elements 0..num_images of input, one of the runner's input buffers
+  // (matched by tensor name). No float copy of the images is made; written
+  // elements of HOST_PHY buffers are synced to the device.
+  void set_image_input(vart::TensorBuffer* input, const uint8_t* images, unsigned num_images,
+                       const std::vector<float>& mean, const std::vector<float>& scale);
+
+  // Pin a long-lived, page-aligned host region once. HOST_VIRT buffers
+  // lying inside it whose type and size match the model's io tensors are
+  // then DMA'd directly instead of being copied through staging buffers;
+  // others still take the copy path. Returns false if the region could not
+  // be pinned. Unregister (or destroy the runner) before freeing the memory;
+  // bindings over it must not run after unregister_memory().
+  bool register_memory(void* ptr, size_t size);
+  void unregister_memory(void* ptr);
+
   virtual int wait(int jobid, int timeout) override;
 
+  // layout of the model tensors and of runner-allocated buffers. Host
+  // buffers of the user's own whose shape is the NCHW form of a tensor
+  // (int8 or float) are transposed while being copied to and from the
+  // device; see layout_transpose.hpp.
   virtual TensorFormat get_tensor_format() override
   {
     return Runner::TensorFormat::NHWC;
@@ -77,8 +146,32 @@ public:
 
   virtual std::vector<vart::TensorBuffer*> make_outputs(int batchsz = -1);
 
+  // Bring the runner to steady state before the first real request:
+  // fault in all pooled/runner-owned host buffers, run one inference that
+  // executes the preload, then spread num_runs dummy inferences over up to
+  // num_runs engine workers, each creating its per-worker resources first.
+  // Inputs are zero-filled; output contents are undefined afterwards.
+  virtual void warmup(unsigned num_runs = 4);
+
+  // Construct one runner per spec, all concurrently. Device acquisition is
+  // serialized by the resource manager; model parsing and weight uploads
+  // overlap. The first error is rethrown after every construction finishes.
+  struct Spec {
+    const xir::Subgraph* subgraph;
+    xir::Attrs* attrs;
+  };
+  static std::vector<std::unique_ptr<DpuRunner>> create_runners(const std::vector<Spec> &specs);
+
+  // controller construction phases plus this runner's "buffers"
+  StartupProfile get_startup_profile() const;
+
+  // false while this runner's CU is marked hung (see CuHealth); callers
+  // choosing between runners should prefer healthy ones
+  bool is_healthy() const;
+
 protected:
   std::shared_ptr<DpuController> dpu_controller_;
+  StartupProfile startup_;
   std::vector<vart::TensorBuffer*> in_bufs;
   std::vector<vart::TensorBuffer*> out_bufs;
 };
@@ -0,0 +1,53 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace vart {
+
+/*
+ * Build count objects with make(i), one thread each, and return them in
+ * index order. Every construction runs to completion before the first
+ * exception (lowest index) is rethrown, so nothing is left half-built.
+ */
+template <typename T>
+std::vector<std::unique_ptr<T>> construct_all(size_t count,
+  const std::function<std::unique_ptr<T>(size_t)> &make) {
+  std::vector<std::unique_ptr<T>> objs(count);
+  std::vector<std::exception_ptr> errors(count);
+  std::vector<std::thread> threads;
+  threads.reserve(count);
+  for (size_t i=0; i < count; i++)
+    threads.emplace_back([&, i] {
+      try {
+        objs[i] = make(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  for (auto &t : threads)
+    t.join();
+  for (auto &e : errors)
+    if (e)
+      std::rethrow_exception(e);
+  return objs;
+}
+
+}
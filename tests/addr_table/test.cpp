@@ -0,0 +1,96 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include "dpu_addr_table.hpp"
+
+/*
+ * Flat [reg_id][batch] io address table.
+ * No device needed.
+ */
+
+TEST(DpuAddrTableTest, resolves_bound_slots) {
+  DpuAddrTable table(4, 2);
+  table.set(3, 1, 0x1000);
+  table.set(1, 0, 0); // bank 0 starts at address 0
+  table.set(1, 1, 0x2000);
+  EXPECT_EQ(table.get(3, 1), 0x1000u);
+  EXPECT_EQ(table.get(1, 0), 0u);
+  EXPECT_THROW(table.get(3, 0), std::runtime_error);
+  EXPECT_THROW(table.get(4, 0), std::runtime_error);
+  EXPECT_THROW(table.get(-1, 0), std::runtime_error);
+  EXPECT_THROW(table.set(0, 2, 0), std::runtime_error);
+
+  // programming order is the binding order, rebinding keeps the slot's place
+  table.set(3, 1, 0x3000);
+  ASSERT_EQ(table.entries().size(), 3u);
+  EXPECT_EQ(table.entries()[0].reg_id, 3);
+  EXPECT_EQ(table.entries()[0].addr, 0x3000u);
+  EXPECT_EQ(table.entries()[2].idx, 1);
+}
+
+/*
+ * Address resolution benchmark: one run's upload and download lookups,
+ * table vs the per-run tuple vector searched linearly it replaces.
+ */
+TEST(DpuAddrTableTest, resolution_benchmark) {
+  const int numRegs = 4;     // input, output and two more io regs
+  const int numTensors = 4;  // lookups per batch element and direction
+  const unsigned runs = 20000;
+
+  for (int batch : {1, 2, 4, 8, 16})
+  {
+    DpuAddrTable table(numRegs, batch);
+    std::vector<std::tuple<int, int, uint64_t>> tuples;
+    for (int r=0; r < numRegs; r++)
+      for (int i=0; i < batch; i++)
+      {
+        const uint64_t addr = (uint64_t(r) << 32) | (i << 20);
+        table.set(r, i, addr);
+        tuples.emplace_back(r, i, addr);
+      }
+    auto linear = [&tuples](int regid, int idx) {
+      for (auto &t : tuples)
+        if (std::get<0>(t) == regid && std::get<1>(t) == idx)
+          return std::get<2>(t);
+      throw std::runtime_error("not bound");
+    };
+
+    uint64_t sum = 0;
+    auto t1 = std::chrono::steady_clock::now();
+    for (unsigned n=0; n < runs; n++)
+      for (int i=0; i < batch; i++)
+        for (int t=0; t < numTensors; t++)
+          sum += linear(t % numRegs, i) + linear((t + 1) % numRegs, i);
+    auto t2 = std::chrono::steady_clock::now();
+    for (unsigned n=0; n < runs; n++)
+      for (int i=0; i < batch; i++)
+        for (int t=0; t < numTensors; t++)
+          sum -= table.get(t % numRegs, i) + table.get((t + 1) % numRegs, i);
+    auto t3 = std::chrono::steady_clock::now();
+    EXPECT_EQ(sum, 0u);
+
+    const double linearNs = std::chrono::duration<double, std::nano>(t2-t1).count() / runs;
+    const double tableNs = std::chrono::duration<double, std::nano>(t3-t2).count() / runs;
+    std::cout << "batch " << batch << ": linear " << linearNs << " ns/run, table "
+      << tableNs << " ns/run" << std::endl;
+  }
+}
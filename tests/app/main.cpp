@@ -74,6 +74,14 @@ int main(int argc, char** argv) {
     std::cout << "QPS: " << numQueries/elapsed.count() << std::endl;
   }
 
+  if (std::find(tests.begin(), tests.end(), "wu") != tests.end())
+  {
+    const unsigned numWarmupRuns = 8;
+    std::cout << std::endl << "Testing warmup..." << std::endl;
+    WarmupTest warmupTest(runnerMeta, numWarmupRuns);
+    warmupTest.run();
+  }
+
   if (std::find(tests.begin(), tests.end(), "tc") != tests.end())
   {
     const unsigned numQueries = 4;
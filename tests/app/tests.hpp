@@ -49,6 +49,16 @@ class MultiThreadTest : public Test {
     std::vector<std::unique_ptr<vart::DpuRunner>> runners_;
 };
 
+class WarmupTest : public Test {
+  public:
+    WarmupTest(std::string runner_dir, unsigned num_warmup_runs);
+    virtual void run();
+
+  private:
+    unsigned num_warmup_runs_;
+    std::string runner_dir_;
+};
+
 class TestClassify : public Test {
   public:
     TestClassify(std::string runner_dir, unsigned num_queries);
@@ -0,0 +1,58 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <iostream>
+#include "tests.hpp"
+
+namespace {
+  std::unique_ptr<vart::DpuRunner> makeRunner(std::string runner_dir) {
+    if(runner_dir.find(".json") != std::string::npos)
+      return std::unique_ptr<vart::DpuRunner>(new vart::DpuRunner(runner_dir));
+
+    std::unique_ptr<xir::Graph> graph = xir::Graph::deserialize(runner_dir);
+    std::vector<xir::Subgraph *> subgraphs = graph->get_root_subgraph()->children_topological_sort();
+    auto subgraph = subgraphs[1];//TO_DO - replace 1 with automated value
+    return std::unique_ptr<vart::DpuRunner>(new vart::DpuRunner(subgraph));
+  }
+
+  // latency of the first request a client would send
+  double firstRequestMs(vart::DpuRunner &runner) {
+    auto inputs = runner.get_inputs();
+    auto outputs = runner.get_outputs();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto ret = runner.execute_async(inputs, outputs);
+    runner.wait(uint32_t(ret.first), -1);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(t2-t1).count();
+  }
+}
+
+WarmupTest::WarmupTest(std::string runner_dir, unsigned num_warmup_runs)
+ : num_warmup_runs_(num_warmup_runs), runner_dir_(runner_dir)
+{
+}
+
+void WarmupTest::run() {
+  auto cold = makeRunner(runner_dir_);
+  std::cout << "First request, cold runner (ms): " << firstRequestMs(*cold) << std::endl;
+
+  auto warm = makeRunner(runner_dir_);
+  auto t1 = std::chrono::high_resolution_clock::now();
+  warm->warmup(num_warmup_runs_);
+  auto t2 = std::chrono::high_resolution_clock::now();
+  std::cout << "Warmup (ms): "
+    << std::chrono::duration<double, std::milli>(t2-t1).count() << std::endl;
+  std::cout << "First request, warm runner (ms): " << firstRequestMs(*warm) << std::endl;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <xrt.h>
+#include "dpucloud_controller.hpp"
+#include "xrt_sim.hpp"
+
+/*
+ * DpuCloudController::run_bank_uploads() with weight-style uploads (a BO in
+ * the bank, filled and synced) against the simulated XRT backend: banks
+ * upload at the same time, each bank's jobs in order. No device needed.
+ */
+
+namespace {
+  const size_t BLOB = 64 << 10;
+
+  struct Uploads {
+    Uploads() { handle = xclOpen(0, nullptr, XCL_INFO); }
+    ~Uploads() { xclClose(handle); }
+    // job uploads a blob of seed to bank, after first() if given
+    void add(unsigned bank, int seed, std::function<void()> first = nullptr) {
+      jobs[bank].emplace_back([this, bank, seed, first] {
+        if (first)
+          first();
+        auto bo = xclAllocBO(handle, BLOB, 0, bank);
+        auto *host = static_cast<char*>(xclMapBO(handle, bo, true));
+        memset(host, seed, BLOB);
+        ASSERT_EQ(xclSyncBO(handle, bo, XCL_BO_SYNC_BO_TO_DEVICE, BLOB, 0), 0);
+        std::lock_guard<std::mutex> lock(mtx);
+        order[bank].push_back(seed);
+        bos[seed] = bo;
+      });
+    }
+    // what the device holds for seed's blob, and its bank
+    std::pair<std::vector<char>, unsigned> uploaded(int seed) {
+      std::vector<char> bytes(BLOB);
+      xclBOProperties prop;
+      xclGetBOProperties(handle, bos[seed], &prop);
+      EXPECT_EQ(xclUnmgdPread(handle, 0, bytes.data(), BLOB, prop.paddr), 0);
+      return {bytes, prop.flags};
+    }
+    xclDeviceHandle handle;
+    std::map<unsigned, std::vector<std::function<void()>>> jobs;
+    std::mutex mtx;
+    std::map<unsigned, std::vector<int>> order;
+    std::map<int, xclBufferHandle> bos;
+  };
+}
+
+TEST(BankUploadsTest, banks_upload_concurrently) {
+  const unsigned BANKS = 4, PER_BANK = 3;
+  Uploads u;
+  // every bank's first job waits for the others' to start: only uploads
+  // that overlap all get through (the timeout only guards against a hang)
+  std::mutex mtx;
+  std::condition_variable cv;
+  unsigned started = 0, together = 0;
+  std::set<std::thread::id> threads;
+  auto meet = [&] {
+    std::unique_lock<std::mutex> lock(mtx);
+    threads.insert(std::this_thread::get_id());
+    started++;
+    cv.notify_all();
+    if (cv.wait_for(lock, std::chrono::seconds(10), [&] { return started == BANKS; }))
+      together++;
+  };
+  for (unsigned b=0; b < BANKS; b++)
+    for (unsigned j=0; j < PER_BANK; j++)
+      u.add(b, int(b * PER_BANK + j), j == 0 ? std::function<void()>(meet) : nullptr);
+
+  const auto before = xrt_sim::get_stats();
+  DpuCloudController::run_bank_uploads(u.jobs);
+  EXPECT_EQ(together, BANKS);
+  EXPECT_EQ(threads.size(), size_t(BANKS));
+  EXPECT_EQ(xrt_sim::get_stats().bytes_to_device - before.bytes_to_device, uint64_t(BANKS * PER_BANK * BLOB));
+  for (unsigned b=0; b < BANKS; b++) {
+    EXPECT_EQ(u.order[b], std::vector<int>({int(b * PER_BANK), int(b * PER_BANK + 1), int(b * PER_BANK + 2)}));
+    for (unsigned j=0; j < PER_BANK; j++) {
+      const int seed = int(b * PER_BANK + j);
+      auto got = u.uploaded(seed);
+      EXPECT_EQ(got.first, std::vector<char>(BLOB, char(seed)));
+      EXPECT_EQ(got.second, b);
+    }
+  }
+}
+
+TEST(BankUploadsTest, one_bank_uploads_inline) {
+  Uploads u;
+  std::thread::id ran;
+  u.add(2, 1, [&] { ran = std::this_thread::get_id(); });
+  u.add(2, 2);
+  DpuCloudController::run_bank_uploads(u.jobs);
+  EXPECT_EQ(ran, std::this_thread::get_id());
+  EXPECT_EQ(u.order[2], std::vector<int>({1, 2}));
+  EXPECT_EQ(u.uploaded(2).first, std::vector<char>(BLOB, char(2)));
+}
+
+TEST(BankUploadsTest, error_waits_for_every_bank) {
+  Uploads u;
+  u.add(0, 1);
+  u.jobs[0].emplace_back([] { throw std::runtime_error("Error: upload failed"); });
+  u.add(0, 2);
+  for (unsigned b=1; b < 4; b++)
+    for (int j=0; j < 3; j++)
+      u.add(b, int(10 * b + j));
+  EXPECT_THROW(DpuCloudController::run_bank_uploads(u.jobs), std::runtime_error);
+  // the failing bank stops, the others finish before the error is seen
+  EXPECT_EQ(u.order[0], std::vector<int>({1}));
+  for (unsigned b=1; b < 4; b++)
+    EXPECT_EQ(u.order[b].size(), 3u);
+}
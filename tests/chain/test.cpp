@@ -0,0 +1,215 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "dpucloud_controller.hpp"
+#include "xrt_sim.hpp"
+#include "SimIo.hpp"
+
+/*
+ * DpuCloudController::chain_of() on two subgraphs' bindings against the
+ * simulated XRT backend: which inputs are read where the upstream DPU wrote
+ * them, what the transfers of the re-bound bindings skip, and every layout
+ * chain() refuses. No device needed.
+ */
+
+namespace {
+  // img -> [up] -> mid, side, score; mid, aux -> [down] -> res
+  struct Subgraphs {
+    Subgraphs() {
+      up.add(true, "img", 48, 1, 0);
+      up.add(false, "mid", 64, 2, 0);
+      up.add(false, "side", 8, 2, 128);
+      up.add(false, "score", 10, 3, 0);
+    }
+    SimModel up;
+  };
+
+  struct Bound {
+    Bound(SimModel &model) : table(model.alloc()), in(model.input_io), out(model.output_io) {
+      binding.inputBs = BATCH;
+      binding.io_addrs = table;
+      binding.in_ptrs = in.ptrs(model.input_io);
+      binding.out_ptrs = out.ptrs(model.output_io);
+      binding.io_banks = {0};
+    }
+    std::shared_ptr<DpuAddrTable> table;
+    UserIo in, out;
+    DpuCloudController::IoBinding binding;
+  };
+
+  const std::vector<unsigned> BANKS = {0, 1};
+
+  std::pair<std::shared_ptr<DpuCloudController::IoBinding>, std::shared_ptr<DpuCloudController::IoBinding>>
+  chain(const SimModel &up, const DpuCloudController::IoBinding &up_binding,
+      const SimModel &down, const DpuCloudController::IoBinding &down_binding, bool download_chained = false,
+      bool up_split_io = true, bool down_split_io = true) {
+    return DpuCloudController::chain_of(up_binding, up.output_io, up_split_io,
+      down_binding, down.input_io, down.output_io, down_split_io, BANKS, download_chained);
+  }
+}
+
+TEST(ChainTest, reads_matching_outputs_in_place) {
+  Subgraphs g;
+  SimModel down;
+  down.add(true, "mid", 64, 1, 0);
+  down.add(true, "aux", 16, 4, 0);
+  down.add(false, "res", 12, 2, 0);
+  Bound up(g.up), dn(down);
+
+  auto chained = chain(g.up, up.binding, down, dn.binding);
+  auto &cup = *chained.first;
+  auto &cdown = *chained.second;
+  ASSERT_EQ(cdown.in_on_device.size(), 2u * BATCH);
+  ASSERT_EQ(cup.out_on_device.size(), 3u * BATCH);
+  for (int i=0; i < BATCH; i++) {
+    // by name: mid only
+    EXPECT_TRUE(cdown.in_on_device[i*2]);
+    EXPECT_FALSE(cdown.in_on_device[i*2+1]);
+    EXPECT_TRUE(cup.out_on_device[i*3]);
+    EXPECT_FALSE(cup.out_on_device[i*3+1]);
+    EXPECT_FALSE(cup.out_on_device[i*3+2]);
+    EXPECT_EQ(cdown.io_addrs->get(1, i), up.table->get(2, i));
+    EXPECT_EQ(cdown.io_addrs->get(4, i), dn.table->get(4, i));
+    EXPECT_EQ(cdown.io_addrs->get(2, i), dn.table->get(2, i));
+  }
+  // the bindings given are left alone
+  EXPECT_TRUE(dn.binding.in_on_device.empty());
+  EXPECT_EQ(dn.binding.io_addrs->get(1, 0), dn.table->get(1, 0));
+
+  // what upstream's DPU wrote is what downstream's reads
+  for (int i=0; i < BATCH; i++)
+    g.up.write(*up.table, g.up.output_io[0], i, pattern(64, i));
+  auto before = xrt_sim::get_stats();
+  DpuCloudController::upload_inputs(cdown, down.input_io, *cdown.io_addrs, cdown.in_ptrs, down.handle, nullptr);
+  EXPECT_EQ(xrt_sim::get_stats().bytes_to_device - before.bytes_to_device, 16u * BATCH);
+  for (int i=0; i < BATCH; i++)
+    EXPECT_EQ(down.read(*cdown.io_addrs, down.input_io[0], i), pattern(64, i));
+  DpuRunSample sample;
+  before = xrt_sim::get_stats();
+  DpuCloudController::download_outputs(cup, g.up.output_io, *cup.io_addrs, cup.out_ptrs, g.up.handle, nullptr,
+    nullptr, nullptr, sample);
+  EXPECT_EQ(xrt_sim::get_stats().bytes_from_device - before.bytes_from_device, (8u + 10u) * BATCH);
+  EXPECT_EQ(up.out.element(0, 1, 64), std::vector<char>(64, 0));
+
+  // download_chained: upstream still downloads it
+  auto both = chain(g.up, up.binding, down, dn.binding, true);
+  for (int i=0; i < BATCH; i++) {
+    EXPECT_FALSE(both.first->out_on_device[i*3]);
+    EXPECT_TRUE(both.second->in_on_device[i*2]);
+  }
+}
+
+TEST(ChainTest, keeps_reg_layout) {
+  Subgraphs g;
+  Bound up(g.up);
+  // mid and side share reg_id 2 upstream, 128 bytes apart
+  SimModel same;
+  same.add(true, "mid", 64, 1, 0);
+  same.add(true, "side", 8, 1, 128);
+  same.add(false, "res", 12, 2, 0);
+  Bound sameBound(same);
+  auto chained = chain(g.up, up.binding, same, sameBound.binding);
+  for (int i=0; i < BATCH; i++) {
+    EXPECT_EQ(chained.second->io_addrs->get(1, i), up.table->get(2, i));
+    EXPECT_TRUE(chained.second->in_on_device[i*2+1]);
+  }
+
+  SimModel shifted;
+  shifted.add(true, "mid", 64, 1, 0);
+  shifted.add(true, "side", 8, 1, 64);
+  shifted.add(false, "res", 12, 2, 0);
+  Bound shiftedBound(shifted);
+  EXPECT_THROW(chain(g.up, up.binding, shifted, shiftedBound.binding), std::runtime_error);
+
+  // one reg_id, one base: mid can't be read in place while aux is uploaded
+  SimModel mixed;
+  mixed.add(true, "mid", 64, 1, 0);
+  mixed.add(true, "aux", 16, 1, 64);
+  mixed.add(false, "res", 12, 2, 0);
+  Bound mixedBound(mixed);
+  EXPECT_THROW(chain(g.up, up.binding, mixed, mixedBound.binding), std::runtime_error);
+
+  // downstream would write res over upstream's mid
+  SimModel shared;
+  shared.add(true, "mid", 64, 1, 0);
+  shared.add(false, "res", 12, 1, 256);
+  Bound sharedBound(shared);
+  EXPECT_THROW(chain(g.up, up.binding, shared, sharedBound.binding), std::runtime_error);
+}
+
+TEST(ChainTest, refusals) {
+  Subgraphs g;
+  SimModel down;
+  down.add(true, "mid", 64, 1, 0);
+  down.add(true, "aux", 16, 4, 0);
+  down.add(false, "res", 12, 2, 0);
+  Bound up(g.up), dn(down);
+  ASSERT_NO_THROW(chain(g.up, up.binding, down, dn.binding));
+
+  // split io on both sides
+  EXPECT_THROW(chain(g.up, up.binding, down, dn.binding, false, false, true), std::runtime_error);
+  EXPECT_THROW(chain(g.up, up.binding, down, dn.binding, false, true, false), std::runtime_error);
+  // staged bindings
+  auto staged = dn.binding;
+  staged.io_addrs = nullptr;
+  EXPECT_THROW(chain(g.up, up.binding, down, staged), std::runtime_error);
+  EXPECT_THROW(chain(g.up, staged, down, dn.binding), std::runtime_error);
+  // batch
+  auto smaller = dn.binding;
+  smaller.inputBs = BATCH - 1;
+  EXPECT_THROW(chain(g.up, up.binding, down, smaller), std::runtime_error);
+  // upstream's io in a bank downstream's CU does not reach
+  auto far = up.binding;
+  far.io_banks = {0, 7};
+  EXPECT_THROW(chain(g.up, far, down, dn.binding), std::runtime_error);
+  // same name, other size
+  SimModel resized;
+  resized.add(true, "mid", 60, 1, 0);
+  resized.add(false, "res", 12, 2, 0);
+  Bound resizedBound(resized);
+  EXPECT_THROW(chain(g.up, up.binding, resized, resizedBound.binding), std::runtime_error);
+  // nothing to chain
+  SimModel unrelated;
+  unrelated.add(true, "aux", 16, 1, 0);
+  unrelated.add(false, "res", 12, 2, 0);
+  Bound unrelatedBound(unrelated);
+  EXPECT_THROW(chain(g.up, up.binding, unrelated, unrelatedBound.binding), std::runtime_error);
+}
+
+TEST(ChainTest, topk_output_is_downloaded) {
+  Subgraphs g;
+  SimModel down;
+  down.add(true, "mid", 64, 1, 0);
+  down.add(false, "res", 12, 2, 0);
+  Bound up(g.up), dn(down);
+  std::vector<TopKEntry> results(BATCH);
+  // post-processing the chained output needs it on the host
+  auto topk = up.binding;
+  topk.topk = std::make_shared<const DpuTopK>(DpuTopK{0, 1, results.data()});
+  EXPECT_THROW(chain(g.up, topk, down, dn.binding), std::runtime_error);
+  auto chained = chain(g.up, topk, down, dn.binding, true);
+  for (int i=0; i < BATCH; i++) {
+    EXPECT_FALSE(chained.first->out_on_device[i*3]);
+    EXPECT_TRUE(chained.second->in_on_device[i]);
+  }
+  // on another output it does not matter
+  topk.topk = std::make_shared<const DpuTopK>(DpuTopK{2, 1, results.data()});
+  EXPECT_TRUE(chain(g.up, topk, down, dn.binding).first->out_on_device[0]);
+}
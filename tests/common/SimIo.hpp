@@ -0,0 +1,153 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <xrt.h>
+#include <xir/tensor/tensor.hpp>
+#include "dpucloud_controller.hpp"
+#include "tensor_buffer_imp_host.hpp"
+#include "user_mem_registry.hpp"
+
+// models, host buffers and registered memory for controller tests that
+// build IoBindings against the simulated XRT backend
+
+const int BATCH = 4;
+const uint64_t ENGINE_STRIDE = 4096;  // between engines in a reg_id's BO
+
+// a model's io as DpuXmodel describes it ("sub/<name>_fix", one batch
+// element per engine), with device memory per reg_id in the simulator
+struct SimModel {
+  SimModel() { handle = xclOpen(0, nullptr, XCL_INFO); }
+  ~SimModel() { xclClose(handle); }
+  void add(bool input, const std::string &name, size_t size, int32_t reg_id, int32_t offset) {
+    tensors.push_back(xir::Tensor::create("sub/" + name + "_fix", {BATCH, int32_t(size)}, xir::DataType{xir::DataType::XINT, 8}));
+    (input ? input_io : output_io).push_back({tensors.back().get(), reg_id, offset, size});
+  }
+  // one BO per reg_id, each engine's io ENGINE_STRIDE apart
+  std::shared_ptr<DpuAddrTable> alloc() {
+    std::set<int32_t> regs;
+    for (auto *ios : {&input_io, &output_io})
+      for (auto &io : *ios)
+        regs.insert(io.reg_id);
+    auto table = std::make_shared<DpuAddrTable>(*regs.rbegin() + 1, BATCH);
+    for (auto reg : regs) {
+      auto bo = xclAllocBO(handle, BATCH * ENGINE_STRIDE, 0, 0);
+      const auto base = xclGetDeviceAddr(handle, bo);
+      for (int i=0; i < BATCH; i++)
+        table->set(reg, i, base + i * ENGINE_STRIDE);
+    }
+    return table;
+  }
+  std::vector<char> read(const DpuAddrTable &t, const DpuXmodel::io_tensor &io, int i) const {
+    std::vector<char> bytes(io.size);
+    EXPECT_EQ(xclUnmgdPread(handle, 0, bytes.data(), bytes.size(), t.get(io.reg_id, i) + io.offset), 0);
+    return bytes;
+  }
+  void write(const DpuAddrTable &t, const DpuXmodel::io_tensor &io, int i, const std::vector<char> &bytes) const {
+    EXPECT_EQ(xclUnmgdPwrite(handle, 0, bytes.data(), bytes.size(), t.get(io.reg_id, i) + io.offset), 0);
+  }
+  xclDeviceHandle handle;
+  std::vector<std::unique_ptr<xir::Tensor>> tensors;
+  std::vector<DpuXmodel::io_tensor> input_io;
+  std::vector<DpuXmodel::io_tensor> output_io;
+};
+
+// the app's host buffers, one per tensor holding the batch
+struct UserIo {
+  UserIo(const std::vector<DpuXmodel::io_tensor> &ios, xir::DataType type = xir::DataType{xir::DataType::XINT, 8}) {
+    for (auto &io : ios) {
+      const auto &name = io.tensor->get_name();
+      tensors.push_back(xir::Tensor::create(name.substr(4, name.size() - 8), {BATCH, int32_t(io.size)}, type));
+      data.emplace_back(BATCH * io.size * type.bit_width / 8);
+      bufs.emplace_back(new vart::TensorBufferExtImpHost(data.back().data(), tensors.back().get()));
+    }
+  }
+  std::vector<vart::TensorBuffer*> buffers() const {
+    std::vector<vart::TensorBuffer*> ret;
+    for (auto &b : bufs)
+      ret.push_back(b.get());
+    return ret;
+  }
+  // host address per (batch element, tensor)
+  std::vector<uint64_t> ptrs(const std::vector<DpuXmodel::io_tensor> &ios) {
+    std::vector<uint64_t> ret;
+    for (int i=0; i < BATCH; i++)
+      for (unsigned j=0; j < ios.size(); j++)
+        ret.push_back(uint64_t(data[j].data() + i * ios[j].size));
+    return ret;
+  }
+  std::vector<char> element(unsigned j, int i, size_t size) const {
+    return std::vector<char>(data[j].begin() + i * size, data[j].begin() + (i + 1) * size);
+  }
+  std::vector<std::unique_ptr<xir::Tensor>> tensors;
+  std::vector<std::vector<char>> data;
+  std::vector<std::unique_ptr<vart::TensorBuffer>> bufs;
+};
+
+// the app's host buffers at given addresses, one per (batch element,
+// tensor) in that order
+struct PlacedIo {
+  PlacedIo(const std::vector<DpuXmodel::io_tensor> &ios, const std::vector<char*> &at,
+      xir::DataType type = xir::DataType{xir::DataType::XINT, 8}, int size_delta = 0) {
+    for (unsigned k=0; k < at.size(); k++) {
+      const auto &name = ios[k % ios.size()].tensor->get_name();
+      tensors.push_back(xir::Tensor::create(name.substr(4, name.size() - 8),
+        {1, int32_t(ios[k % ios.size()].size) + size_delta}, type));
+      bufs.emplace_back(new vart::TensorBufferExtImpHost(at[k], tensors.back().get()));
+    }
+  }
+  std::vector<vart::TensorBuffer*> buffers() const {
+    std::vector<vart::TensorBuffer*> ret;
+    for (auto &b : bufs)
+      ret.push_back(b.get());
+    return ret;
+  }
+  std::vector<std::unique_ptr<xir::Tensor>> tensors;
+  std::vector<std::unique_ptr<vart::TensorBuffer>> bufs;
+};
+
+// page aligned host memory registered the way register_memory() does it
+struct Registered {
+  Registered(xclDeviceHandle handle, size_t pages) : handle(handle) {
+    mem = static_cast<char*>(aligned_alloc(PAGE, pages * PAGE));
+    memset(mem, 0, pages * PAGE);
+  }
+  ~Registered() { free(mem); }
+  void add(size_t first_page, size_t pages) {
+    auto bo = xclAllocUserPtrBO(handle, mem + first_page * PAGE, pages * PAGE, 0);
+    registry.add({uintptr_t(mem + first_page * PAGE), pages * PAGE, bo, xclGetDeviceAddr(handle, bo)});
+  }
+  uint64_t paddr(const char *p) const {
+    return registry.find(p, 1)->paddr + (uintptr_t(p) - registry.find(p, 1)->start);
+  }
+  static const size_t PAGE = 4096;
+  xclDeviceHandle handle;
+  char *mem;
+  UserMemRegistry registry;
+};
+
+inline std::vector<char> pattern(size_t size, int seed) {
+  std::vector<char> bytes(size);
+  for (size_t k=0; k < size; k++)
+    bytes[k] = char(seed * 31 + k);
+  return bytes;
+}
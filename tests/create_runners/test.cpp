@@ -19,9 +19,12 @@
 #include <vector>
 #include <map>
 #include <thread>
+#include <chrono>
 #include <vart/runner.hpp>
 #include <xir/graph/graph.hpp>
 #include <cstdlib>
+#include "xrt_bin_stream.hpp"
+#include "model_cache.hpp"
 
 /*
  * This Testcase will verify that a number of runners can be created in parallel
@@ -89,3 +92,76 @@ TEST_F(CreateRunnerTest, create_four_runners) {
 TEST_F(CreateRunnerTest, create_five_runners) {
   EXPECT_TRUE( create_runners(env_["XLNX_XMODEL"], 5) == EXIT_SUCCESS );
 }
+
+/*
+ * Startup benchmark: 16 runners from one xclbin, created back to back.
+ * Every runner after the first should reuse the cached xclbin image.
+ */
+TEST_F(CreateRunnerTest, create_sixteen_runners_startup) {
+  const unsigned numRunners = 16;
+  std::unique_ptr<xir::Graph> graph = xir::Graph::deserialize(env_["XLNX_XMODEL"]);
+  std::vector<xir::Subgraph *> subgraphs = graph->get_root_subgraph()->children_topological_sort();
+  auto subgraph = *std::find_if(subgraphs.begin(), subgraphs.end(), [](xir::Subgraph *sg) {
+    return sg->get_attr<std::string>("device") == "DPU";
+  });
+
+  const auto before = xir::XrtBinStream::get_cache_stats();
+  std::vector<std::unique_ptr<vart::Runner>> runners;
+  std::vector<double> elapsedMs;
+  for (unsigned i=0; i < numRunners; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    runners.push_back(vart::Runner::create_runner(subgraph, "run"));
+    auto t2 = std::chrono::high_resolution_clock::now();
+    elapsedMs.push_back(std::chrono::duration<double, std::milli>(t2-t1).count());
+  }
+  const auto after = xir::XrtBinStream::get_cache_stats();
+
+  double total = 0;
+  for (auto ms : elapsedMs)
+    total += ms;
+  std::cout << "Created " << numRunners << " runners in " << total << " ms"
+    << " (first " << elapsedMs.front() << " ms, rest avg "
+    << (total - elapsedMs.front()) / (numRunners - 1) << " ms)" << std::endl;
+  std::cout << "xclbin cache: " << after.hits - before.hits << " hits, "
+    << after.misses - before.misses << " misses" << std::endl;
+
+  EXPECT_LE(after.misses - before.misses, 1u) << "xclbin parsed more than once";
+}
+
+/*
+ * Startup benchmark: runner construction time without the model cache,
+ * with a cold cache (parse + store) and with a warm cache (mmap).
+ */
+TEST_F(CreateRunnerTest, create_runner_model_cache) {
+  std::unique_ptr<xir::Graph> graph = xir::Graph::deserialize(env_["XLNX_XMODEL"]);
+  std::vector<xir::Subgraph *> subgraphs = graph->get_root_subgraph()->children_topological_sort();
+  auto subgraph = *std::find_if(subgraphs.begin(), subgraphs.end(), [](xir::Subgraph *sg) {
+    return sg->get_attr<std::string>("device") == "DPU";
+  });
+  auto timeCreate = [subgraph]() {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto runner = vart::Runner::create_runner(subgraph, "run");
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(t2-t1).count();
+  };
+
+  char tmpl[] = "/tmp/rtm_runner_XXXXXX";
+  ASSERT_NE(mkdtemp(tmpl), nullptr);
+  const std::string dir = tmpl;
+
+  unsetenv("XLNX_MODEL_CACHE_DIR");
+  const double uncached = timeCreate();
+  setenv("XLNX_MODEL_CACHE_DIR", dir.c_str(), 1);
+  const auto before = ModelImage::get_cache_stats();
+  const double cold = timeCreate();
+  const double warm = timeCreate();
+  const auto after = ModelImage::get_cache_stats();
+  unsetenv("XLNX_MODEL_CACHE_DIR");
+  std::string cmd = "rm -rf " + dir;
+  EXPECT_EQ(system(cmd.c_str()), 0);
+
+  std::cout << "create_runner: no cache " << uncached << " ms, cold cache " << cold
+    << " ms, warm cache " << warm << " ms" << std::endl;
+  EXPECT_EQ(after.stores - before.stores, 1u);
+  EXPECT_EQ(after.hits - before.hits, 1u);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <memory>
+#include "device_handle.hpp"
+#include "xir/attrs/attrs.hpp"
+
+/*
+ * CU hang bookkeeping and acquisition around unhealthy CUs, on the fake
+ * device layer. No device needed.
+ */
+
+TEST(CuHealthTest, counts_hangs_and_recoveries) {
+  auto &health = CuHealth::get_instance();
+  const auto before = health.get_stats();
+  EXPECT_TRUE(health.is_healthy(5, 1));
+
+  health.report_hang(5, 1);
+  EXPECT_FALSE(health.is_healthy(5, 1));
+  EXPECT_TRUE(health.is_healthy(5, 0));
+  health.report_recovery(5, 1);
+  EXPECT_TRUE(health.is_healthy(5, 1));
+  health.report_hang(5, 1);
+  health.report_failure(5, 1);
+  EXPECT_FALSE(health.is_healthy(5, 1));
+
+  const auto cu = health.get_stats(5, 1);
+  EXPECT_EQ(cu.hangs, 2u);
+  EXPECT_EQ(cu.recoveries, 1u);
+  EXPECT_EQ(cu.failures, 1u);
+  const auto after = health.get_stats();
+  EXPECT_EQ(after.hangs - before.hangs, 2u);
+  EXPECT_EQ(after.recoveries - before.recoveries, 1u);
+}
+
+TEST(CuHealthTest, acquisition_skips_unhealthy_cu) {
+  setenv("RTE_FAKE_DEVICE", "2", 1);
+  const size_t device = 6;
+  auto attrs = xir::Attrs::create();
+  attrs->set_attr<size_t>("__device_id__", device);
+
+  auto &health = CuHealth::get_instance();
+  health.report_hang(device, 0);
+  for (int i = 0; i < 3; i++) {
+    DeviceHandle handle("DPUCAHX8H", "fake.xclbin", attrs.get());
+    EXPECT_EQ(handle.get_device_info().cu_index, 1u);
+  }
+
+  health.report_recovery(device, 0);
+  DeviceHandle a("DPUCAHX8H", "fake.xclbin", attrs.get());
+  DeviceHandle b("DPUCAHX8H", "fake.xclbin", attrs.get());
+  EXPECT_NE(a.get_device_info().cu_index, b.get_device_info().cu_index);
+  unsetenv("RTE_FAKE_DEVICE");
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "cu_scheduler.hpp"
+
+/*
+ * Several models' commands on one CU: same-model commands overlap, a switch
+ * drains the CU and re-runs the preload once. No device needed.
+ */
+
+TEST(CuSchedulerTest, preloads_only_on_switch) {
+  CuScheduler sched(16);
+  {
+    auto a = sched.acquire(1);
+    EXPECT_TRUE(a.needs_preload());
+    a.preloaded();
+    // the resident model runs alongside itself
+    auto b = sched.acquire(1);
+    EXPECT_FALSE(b.needs_preload());
+  }
+  EXPECT_FALSE(sched.acquire(1).needs_preload());
+  EXPECT_TRUE(sched.acquire(2).needs_preload());
+  {
+    // a preload that never completed leaves nothing resident
+    auto a = sched.acquire(1);
+    EXPECT_TRUE(a.needs_preload());
+  }
+  auto a = sched.acquire(1);
+  EXPECT_TRUE(a.needs_preload());
+  a.preloaded();
+  auto s = sched.get_stats();
+  EXPECT_EQ(s.commands, 6u);
+  EXPECT_EQ(s.switches, 4u);
+}
+
+TEST(CuSchedulerTest, other_model_waits_for_drain) {
+  CuScheduler sched(16);
+  auto a = std::unique_ptr<CuScheduler::Lease>(new CuScheduler::Lease(sched.acquire(1)));
+  a->preloaded();
+
+  std::atomic<bool> granted(false);
+  std::thread other([&] {
+    auto b = sched.acquire(2);
+    EXPECT_TRUE(b.needs_preload());
+    granted = true;
+    b.preloaded();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  a.reset();
+  other.join();
+  EXPECT_TRUE(granted);
+  EXPECT_FALSE(sched.acquire(2).needs_preload());
+}
+
+TEST(CuSchedulerTest, invalidate_forces_exclusive_preload) {
+  CuScheduler sched(16);
+  auto a = std::unique_ptr<CuScheduler::Lease>(new CuScheduler::Lease(sched.acquire(1)));
+  a->preloaded();
+  // the CU was reset under a running command of the resident model
+  sched.invalidate();
+
+  std::atomic<bool> granted(false);
+  std::thread same([&] {
+    auto b = sched.acquire(1);
+    EXPECT_TRUE(b.needs_preload());
+    granted = true;
+    b.preloaded();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  a.reset();
+  same.join();
+  EXPECT_TRUE(granted);
+  EXPECT_FALSE(sched.acquire(1).needs_preload());
+  EXPECT_EQ(sched.get_stats().switches, 2u);
+}
+
+/*
+ * Bursty traffic of two models on one CU: per command 200 us, 1 ms per
+ * preload. Commands admitted in arrival order (one at a time, preload
+ * whenever the model changes) vs through the scheduler.
+ */
+TEST(CuSchedulerTest, switch_batching_benchmark) {
+  const unsigned threads = 8;
+  const unsigned perThread = 40;
+  const auto execTime = std::chrono::microseconds(200);
+  const auto preloadTime = std::chrono::milliseconds(1);
+
+  auto runAll = [&](const std::function<void(uint64_t)> &command) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t=0; t < threads; t++)
+      workers.emplace_back([&, t] {
+        for (unsigned n=0; n < perThread; n++)
+          command(1 + (t + n) % 2);
+      });
+    for (auto &w : workers)
+      w.join();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  std::mutex fifo;
+  uint64_t resident = 0;
+  unsigned fifoSwitches = 0;
+  auto fifoMs = runAll([&](uint64_t model) {
+    std::lock_guard<std::mutex> lock(fifo);
+    if (model != resident) {
+      std::this_thread::sleep_for(preloadTime);
+      resident = model;
+      fifoSwitches++;
+    }
+    std::this_thread::sleep_for(execTime);
+  });
+
+  CuScheduler sched(16);
+  std::mutex mtx, cu;
+  unsigned running[3] = {0, 0, 0};
+  bool overlap = false;
+  auto schedMs = runAll([&](uint64_t model) {
+    auto lease = sched.acquire(model);
+    if (lease.needs_preload()) {
+      std::this_thread::sleep_for(preloadTime);
+      lease.preloaded();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      running[model]++;
+      overlap |= running[1] && running[2];
+    }
+    {
+      // the CU still runs one command at a time
+      std::lock_guard<std::mutex> lock(cu);
+      std::this_thread::sleep_for(execTime);
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    running[model]--;
+  });
+
+  const auto s = sched.get_stats();
+  std::cout << threads * perThread << " commands of 2 models: in order " << fifoMs << " ms, "
+    << fifoSwitches << " preloads; scheduled " << schedMs << " ms, " << s.switches
+    << " preloads" << std::endl;
+  EXPECT_FALSE(overlap);
+  EXPECT_EQ(s.commands, threads * perThread);
+  EXPECT_LT(s.switches * 3, fifoSwitches);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include "dpu_profile.hpp"
+
+/*
+ * Aggregation and report of XLNX_DPU_PROFILE samples.
+ * No device needed.
+ */
+
+TEST(DpuProfileTest, aggregates_samples) {
+  DpuModelProfile profile(300);
+  DpuRunSample sample;
+  sample.h2d_ns = 100000;
+  sample.exec_ns = 1000000;
+  sample.d2h_ns = 100000;
+  sample.cycles = 240000; // 800 us at 300 MHz
+  sample.load = 30;
+  sample.save = 10;
+  sample.conv = 50;
+  sample.misc = 10;
+  for (int i=0; i < 4; i++)
+    profile.record(sample);
+  // inputs already on the device
+  sample.h2d_ns = 0;
+  profile.record(sample);
+
+  auto s = profile.snapshot();
+  EXPECT_EQ(s.exec.count, 5u);
+  EXPECT_EQ(s.h2d.count, 4u);
+  EXPECT_EQ(s.d2h.count, 5u);
+  EXPECT_EQ(s.load, 150u);
+  EXPECT_NEAR(s.dpu_mean_us(), 800, 1);
+  EXPECT_NEAR(s.dpu_busy_fraction(), 0.8, 0.01);
+  EXPECT_NEAR(s.transfer_fraction(), 0.9 / 5.9, 0.01);
+  EXPECT_DOUBLE_EQ(s.memory_instr_fraction(), 0.4);
+}
+
+TEST(DpuProfileTest, counts_avoided_lazy_downloads) {
+  DpuModelProfile profile(300);
+  DpuRunSample sample;
+  sample.exec_ns = 1000;
+  sample.d2h_deferred_bytes = 4096;
+  profile.record(sample);
+  profile.record(sample);
+  profile.record_fetched(1024);
+
+  auto s = profile.snapshot();
+  EXPECT_EQ(s.d2h.count, 0u);
+  EXPECT_EQ(s.d2h_deferred_bytes, 8192u);
+  EXPECT_EQ(s.d2h_fetched_bytes, 1024u);
+  EXPECT_EQ(s.d2h_avoided_bytes(), 7168u);
+}
+
+TEST(DpuProfileTest, reports_effective_batch) {
+  DpuModelProfile profile(300);
+  DpuRunSample sample;
+  sample.exec_ns = 1000;
+  sample.programmed_batch = 4;
+  sample.batch = 1;
+  for (int i=0; i < 3; i++)
+    profile.record(sample);
+  sample.batch = 4;
+  profile.record(sample);
+
+  auto s = profile.snapshot();
+  EXPECT_DOUBLE_EQ(s.effective_batch(), 7.0 / 4);
+  EXPECT_DOUBLE_EQ(s.batch_fill(), 7.0 / 16);
+}
+
+TEST(DpuProfileTest, unknown_clock) {
+  DpuModelProfile profile(0);
+  DpuRunSample sample;
+  sample.exec_ns = 1000;
+  sample.cycles = 500;
+  profile.record(sample);
+  auto s = profile.snapshot();
+  EXPECT_EQ(s.dpu_mean_us(), 0);
+  EXPECT_EQ(s.dpu_busy_fraction(), 0);
+  EXPECT_EQ(s.memory_instr_fraction(), 0);
+}
+
+TEST(DpuProfileTest, reports_json_per_model) {
+  auto &profile = DpuProfile::get_instance();
+  auto *a = profile.get_model("subgraph_\"a\"", 300);
+  EXPECT_EQ(profile.get_model("subgraph_\"a\"", 250), a);
+  DpuRunSample sample;
+  sample.exec_ns = 2000;
+  sample.cycles = 300;
+  a->record(sample);
+
+  auto stats = profile.get_stats();
+  ASSERT_EQ(stats.count("subgraph_\"a\""), 1u);
+  EXPECT_EQ(stats["subgraph_\"a\""].clock_mhz, 300);
+
+  const auto json = profile.to_json();
+  EXPECT_NE(json.find("\"name\": \"subgraph_\\\"a\\\"\""), std::string::npos) << json;
+  EXPECT_NE(json.find("\"dpu\": {\"count\": 1, \"mean_us\": 1,"), std::string::npos) << json;
+  EXPECT_NE(json.find("\"memory_instr_fraction\""), std::string::npos) << json;
+  EXPECT_NE(json.find("\"batch\": {\"effective\": 0, \"programmed\": 0, \"fill\": 0}"), std::string::npos) << json;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <xrt.h>
+#include "ert.h"
+#include "dpucloud_controller.hpp"
+#include "device_handle.hpp"
+#include "xrt_sim.hpp"
+
+/*
+ * DpuCloudController::trigger_once() against the simulated XRT backend: the
+ * commands two models' runners submit to one CU through its scheduler, what
+ * they program, and retry_on_hang() around hung commands. No device needed.
+ */
+
+namespace {
+  // hung commands time out quickly; read on first use
+  [[maybe_unused]] const int shortTimeout = setenv("XLNX_DPU_TIMEOUT_MS", "200", 0);
+
+  const uint32_t INSTR_L = 0x140;
+  const uint32_t ADDR_0_L = 0x100;
+
+  // one worker's context: a handle and its command BO
+  struct Context {
+    Context() {
+      handle = xclOpen(0, nullptr, XCL_INFO);
+      bo = xclAllocBO(handle, 4096, 0, XCL_BO_FLAGS_EXECBUF);
+      ecmd = reinterpret_cast<ert_start_kernel_cmd*>(xclMapBO(handle, bo, true));
+      ecmd->cu_mask = 1;
+      ecmd->opcode = ERT_EXEC_WRITE;
+      ecmd->type = ERT_CTRL;
+    }
+    ~Context() { xclClose(handle); }
+    bool trigger(CuScheduler &sched, uint64_t state, std::atomic<int> &once,
+        const DpuCloudController::DpuProgram &program, const DpuAddrTable &io) {
+      ecmd->state = ERT_CMD_STATE_NEW;
+      return DpuCloudController::trigger_once(sched, state, once, false, cu, ecmd, handle, bo, program, io, nullptr);
+    }
+    // value the last command wrote to a CU register, 0 if none
+    uint32_t written(uint32_t offset) const {
+      for (unsigned p=6; p + 1 < ecmd->count; p += 2)
+        if (ecmd->data[p] == offset)
+          return ecmd->data[p+1];
+      return 0;
+    }
+    xclDeviceHandle handle;
+    xclBufferHandle bo;
+    ert_start_kernel_cmd *ecmd;
+    DeviceInfo cu{};
+  };
+
+  uint64_t commands() { return xrt_sim::get_stats().commands; }
+}
+
+TEST(DpuTriggerTest, preload_follows_the_lease) {
+  auto saved = xrt_sim::get_config();
+  auto config = saved;
+  config.exec_us = 100;
+  xrt_sim::set_config(config);
+  Context ctx;
+  CuScheduler sched(16);
+  const std::vector<std::pair<int, int>> paramsA = {{ADDR_0_L/4, 0x10000}}, paramsB = {{ADDR_0_L/4, 0x20000}};
+  const std::vector<std::pair<int, int>> workspace;
+  const DpuCloudController::DpuProgram a{0x1000, 0x1800, paramsA, workspace};
+  const DpuCloudController::DpuProgram b{0x3000, 0x3800, paramsB, workspace};
+  std::atomic<int> onceA(0), onceB(0);
+  DpuAddrTable io(4, 1);
+  io.set(2, 0, 0x40000);
+
+  auto n = commands();
+  ASSERT_TRUE(ctx.trigger(sched, 1, onceA, a, io));
+  EXPECT_EQ(commands() - n, 2u);  // preload, then the job
+  EXPECT_EQ(ctx.written(INSTR_L), 0x1000u);
+  EXPECT_EQ(ctx.written(ADDR_0_L), 0x10000u);
+  EXPECT_EQ(ctx.written(ADDR_0_L + 8*2), 0x40000u);
+
+  n = commands();
+  ASSERT_TRUE(ctx.trigger(sched, 1, onceA, a, io));
+  EXPECT_EQ(commands() - n, 1u);
+
+  // the other model's preload replaces ours, even though A ran it once
+  n = commands();
+  ASSERT_TRUE(ctx.trigger(sched, 2, onceB, b, io));
+  ASSERT_TRUE(ctx.trigger(sched, 1, onceA, a, io));
+  EXPECT_EQ(commands() - n, 4u);
+  EXPECT_EQ(ctx.written(INSTR_L), 0x1000u);
+
+  // a CU reset loses it too
+  sched.invalidate();
+  n = commands();
+  ASSERT_TRUE(ctx.trigger(sched, 1, onceA, a, io));
+  EXPECT_EQ(commands() - n, 2u);
+  EXPECT_EQ(sched.get_stats().switches, 4u);
+  xrt_sim::set_config(saved);
+}
+
+TEST(DpuTriggerTest, hung_preload_leaves_nothing_resident) {
+  auto saved = xrt_sim::get_config();
+  auto config = saved;
+  config.exec_us = 100;
+  CuScheduler sched(16);
+  const std::vector<std::pair<int, int>> params = {{ADDR_0_L/4, 0x10000}};
+  const std::vector<std::pair<int, int>> workspace;
+  const DpuCloudController::DpuProgram a{0x1000, 0x1800, params, workspace};
+  std::atomic<int> once(0);
+  DpuAddrTable io(4, 1);
+  io.set(2, 0, 0x40000);
+  {
+    Context ctx;
+    // the next command, the preload, never completes
+    config.hang_every = unsigned(commands() + 1);
+    xrt_sim::set_config(config);
+    EXPECT_FALSE(ctx.trigger(sched, 1, once, a, io));
+  }
+  config.hang_every = 0;
+  xrt_sim::set_config(config);
+  // as after reset_cu(): a new context, and the preload runs again
+  Context ctx;
+  auto n = commands();
+  ASSERT_TRUE(ctx.trigger(sched, 1, once, a, io));
+  EXPECT_EQ(commands() - n, 2u);
+  n = commands();
+  ASSERT_TRUE(ctx.trigger(sched, 1, once, a, io));
+  EXPECT_EQ(commands() - n, 1u);
+  xrt_sim::set_config(saved);
+}
+
+TEST(DpuTriggerTest, hung_run_is_retried_after_reset) {
+  auto saved = xrt_sim::get_config();
+  auto config = saved;
+  config.exec_us = 100;
+  xrt_sim::set_config(config);
+  const size_t DEVICE = 7, CU = 0;
+  auto &health = CuHealth::get_instance();
+  CuScheduler sched(16);
+  const std::vector<std::pair<int, int>> params = {{ADDR_0_L/4, 0x10000}};
+  const std::vector<std::pair<int, int>> workspace;
+  const DpuCloudController::DpuProgram a{0x1000, 0x1800, params, workspace};
+  std::atomic<int> once(0);
+  // the job's io in its own BO, which a reset must leave alone
+  auto mem = xclOpen(0, nullptr, XCL_INFO);
+  auto io_bo = xclAllocBO(mem, 4096, 0, 0);
+  DpuAddrTable io(4, 1);
+  io.set(2, 0, xclGetDeviceAddr(mem, io_bo));
+  std::unique_ptr<Context> ctx(new Context);
+  // as reset_cu(): a new context for this worker, preloads redone
+  auto reset = [&] {
+    ctx.reset(new Context);
+    once = 0;
+    sched.invalidate();
+  };
+  auto trigger = [&] { return ctx->trigger(sched, 1, once, a, io); };
+  ASSERT_NO_THROW(DpuCloudController::retry_on_hang(DEVICE, CU, true, reset, trigger));
+
+  // the next command, the job, never completes
+  const auto before = xrt_sim::get_stats();
+  const auto stats = health.get_stats(DEVICE, CU);
+  config.hang_every = unsigned(before.commands + 1);
+  xrt_sim::set_config(config);
+  ASSERT_NO_THROW(DpuCloudController::retry_on_hang(DEVICE, CU, true, reset, trigger));
+  auto after = xrt_sim::get_stats();
+  // hung job, then preload and job again on the new context
+  EXPECT_EQ(after.commands - before.commands, 3u);
+  EXPECT_EQ(ctx->written(ADDR_0_L + 8*2), uint32_t(xclGetDeviceAddr(mem, io_bo)));
+  EXPECT_EQ(sched.get_stats().switches, 2u);
+  // the old context's command BO went with it; nothing else was freed
+  EXPECT_EQ(after.num_bos, before.num_bos);
+  EXPECT_EQ(after.device_bytes, before.device_bytes);
+  EXPECT_EQ(health.get_stats(DEVICE, CU).hangs - stats.hangs, 1u);
+  EXPECT_EQ(health.get_stats(DEVICE, CU).recoveries - stats.recoveries, 1u);
+  EXPECT_TRUE(health.is_healthy(DEVICE, CU));
+
+  // every command hangs: the retry fails and the CU is left unhealthy
+  config.hang_every = 1;
+  xrt_sim::set_config(config);
+  EXPECT_THROW(DpuCloudController::retry_on_hang(DEVICE, CU, true, reset, trigger), std::runtime_error);
+  EXPECT_EQ(health.get_stats(DEVICE, CU).failures - stats.failures, 1u);
+  EXPECT_FALSE(health.is_healthy(DEVICE, CU));
+  // until a command completes on it again
+  config.hang_every = 0;
+  xrt_sim::set_config(config);
+  reset();
+  ASSERT_NO_THROW(DpuCloudController::retry_on_hang(DEVICE, CU, false, reset, trigger));
+  EXPECT_TRUE(health.is_healthy(DEVICE, CU));
+  EXPECT_EQ(health.get_stats(DEVICE, CU).recoveries - stats.recoveries, 2u);
+  EXPECT_EQ(xrt_sim::get_stats().num_bos, before.num_bos);
+
+  ctx.reset();
+  xclClose(mem);
+  xrt_sim::set_config(saved);
+}
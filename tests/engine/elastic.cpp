@@ -0,0 +1,91 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.hpp"
+#include "tests.hpp"
+
+ElasticTest::ElasticTest(unsigned idle_timeout_ms) : idle_timeout_ms_(idle_timeout_ms) {
+}
+
+void ElasticTest::run() {
+  Engine& engine = Engine::get_instance();
+  const unsigned numWorkers = engine.get_num_workers();
+
+  // one blocking task per worker id forces the pool to its max size
+  std::atomic<bool> release(false);
+  std::atomic<unsigned> numStarted(0);
+  std::mutex idsMtx;
+  std::set<unsigned> workerIds;
+  std::vector<uint32_t> ids;
+  for (unsigned i=0; i < numWorkers; i++)
+    ids.push_back(engine.submit([&]{
+      const unsigned workerId = engine.get_my_worker_id();
+      {
+        std::unique_lock<std::mutex> lock(idsMtx);
+        workerIds.insert(workerId);
+      }
+      numStarted++;
+      while (!release)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }));
+  while (numStarted != numWorkers)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  const unsigned peakWorkers = engine.get_stats().live_workers;
+  release = true;
+  for (auto id : ids)
+    engine.wait(id);
+
+  if (peakWorkers != numWorkers)
+    throw std::runtime_error("Error: expected " + std::to_string(numWorkers)
+      + " live workers under load, got " + std::to_string(peakWorkers));
+  if (workerIds.size() != numWorkers || *workerIds.rbegin() >= numWorkers)
+    throw std::runtime_error("Error: concurrent tasks did not get distinct worker ids");
+
+  // idle workers retire, the pool shrinks back
+  std::this_thread::sleep_for(std::chrono::milliseconds(idle_timeout_ms_ * 2 + 100));
+  const unsigned idleWorkers = engine.get_stats().live_workers;
+  std::cout << "live workers: " << peakWorkers << " under load, "
+            << idleWorkers << " after idle" << std::endl;
+  if (idleWorkers >= peakWorkers && numWorkers > 1)
+    throw std::runtime_error("Error: idle workers were not retired");
+
+  // and grows again on demand, reusing worker ids
+  bool ran = false;
+  unsigned workerId = numWorkers;
+  engine.wait(engine.submit([&]{ ran = true; workerId = engine.get_my_worker_id(); }));
+  if (!ran || workerId >= numWorkers)
+    throw std::runtime_error("Error: engine did not run task after shrinking");
+
+  // a single worker that may retire: submits racing its retirement must
+  // still be served (wait() times out on a stranded task)
+  EngineConfig config = EngineConfig::from_env();
+  config.num_workers = 1;
+  config.min_workers = 0;
+  config.worker_idle_ms = 0;
+  Engine& lone = Engine::get_instance("test_retire", config);
+  for (unsigned i=0; i < 200; i++) {
+    std::this_thread::sleep_for(std::chrono::microseconds(4000 + 50 * (i % 40)));
+    lone.wait(lone.submit([]{}), 1000);
+  }
+}
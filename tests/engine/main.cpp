@@ -14,10 +14,16 @@
 
 // Engine performance test
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <string>
 #include "tests.hpp"
 
 int main() {
+  // retire idle workers quickly so the elastic test doesn't sit around
+  const unsigned idleTimeoutMs = 1000;
+  setenv("RTENGINE_WORKER_IDLE_MS", std::to_string(idleTimeoutMs).c_str(), 0);
+
   const unsigned numQueries = 500000;
   const unsigned numThreads = 100;
 
@@ -29,7 +35,11 @@ int main() {
   std::cout << "Elapsed: " << elapsed.count() << std::endl;
   std::cout << "QPS: " << numQueries/elapsed.count() << std::endl;
 
+#ifdef RTENGINE_NO_TELEMETRY
+  std::cout << std::endl << "Testing multi thread (telemetry compiled out)..." << std::endl;
+#else
   std::cout << std::endl << "Testing multi thread..." << std::endl;
+#endif
   t1 = std::chrono::high_resolution_clock::now();
   MultiThreadTest(numQueries, numThreads).run();
   t2 = std::chrono::high_resolution_clock::now();
@@ -49,5 +59,42 @@ int main() {
   elapsed = t2-t1;
   std::cout << "Elapsed: " << elapsed.count() << std::endl;
 
+  const unsigned numTimeoutJobs = 100000;
+  std::cout << std::endl << "Testing task id reclaim after " << numTimeoutJobs << " timeouts..." << std::endl;
+  t1 = std::chrono::high_resolution_clock::now();
+  try {
+    TimeoutReclaimTest(numTimeoutJobs, numThreads).run();
+  } catch(std::runtime_error& e) {
+    std::cout << "Exception caught: '" << e.what() << "'" << std::endl;
+    return 1;
+  }
+  t2 = std::chrono::high_resolution_clock::now();
+  elapsed = t2-t1;
+  std::cout << "Elapsed: " << elapsed.count() << std::endl;
+
+  std::cout << std::endl << "Testing elastic worker pool..." << std::endl;
+  try {
+    ElasticTest(std::stoi(getenv("RTENGINE_WORKER_IDLE_MS"))).run();
+  } catch(std::runtime_error& e) {
+    std::cout << "Exception caught: '" << e.what() << "'" << std::endl;
+    return 1;
+  }
+
+  std::cout << std::endl << "Testing named engines..." << std::endl;
+  try {
+    NamedEngineTest().run();
+  } catch(std::runtime_error& e) {
+    std::cout << "Exception caught: '" << e.what() << "'" << std::endl;
+    return 1;
+  }
+
+  std::cout << std::endl << "Testing engine stats..." << std::endl;
+  try {
+    StatsTest(10000).run();
+  } catch(std::runtime_error& e) {
+    std::cout << "Exception caught: '" << e.what() << "'" << std::endl;
+    return 1;
+  }
+
   return 0;
 }
@@ -0,0 +1,74 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.hpp"
+#include "tests.hpp"
+
+NamedEngineTest::NamedEngineTest() {
+}
+
+void NamedEngineTest::run() {
+  EngineConfig slowConfig = EngineConfig::from_env();
+  slowConfig.num_workers = 2;
+  slowConfig.cpu_affinity = {0};
+  EngineConfig fastConfig = EngineConfig::from_env();
+  fastConfig.num_workers = 4;
+
+  Engine& slow = Engine::get_instance("test_slow", slowConfig);
+  Engine& fast = Engine::get_instance("test_fast", fastConfig);
+  if (&slow != &Engine::get_instance("test_slow") || &slow == &fast
+    || &slow == &Engine::get_instance() || &Engine::get_instance("") != &Engine::get_instance())
+    throw std::runtime_error("Error: engine registry returned the wrong instance");
+  if (slow.get_num_workers() != 2 || fast.get_num_workers() != 4)
+    throw std::runtime_error("Error: named engine ignored its config");
+
+  // saturate the slow engine
+  std::atomic<bool> release(false);
+  std::vector<uint32_t> slowIds;
+  for (unsigned i=0; i < slow.get_num_workers(); i++)
+    slowIds.push_back(slow.submit([&release]{
+      while (!release)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }));
+
+  // the fast engine is unaffected, and its tasks resolve their own worker ids
+  std::atomic<unsigned> badIds(0);
+  std::atomic<unsigned> leaked(0);
+  std::vector<uint32_t> fastIds;
+  for (unsigned i=0; i < 100; i++)
+    fastIds.push_back(fast.submit([&]{
+      if (fast.get_my_worker_id() >= fast.get_num_workers())
+        badIds++;
+      try {
+        slow.get_my_worker_id(); // not one of slow's workers
+        leaked++;
+      } catch (std::runtime_error&) {
+      }
+    }));
+  for (auto id : fastIds)
+    fast.wait(id, 5000);
+
+  release = true;
+  for (auto id : slowIds)
+    slow.wait(id);
+
+  if (badIds || leaked)
+    throw std::runtime_error("Error: worker ids leaked across engines");
+}
@@ -0,0 +1,114 @@
+// Copyright 2021 Xilinx Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.hpp"
+#include "tests.hpp"
+
+StatsTest::StatsTest(unsigned num_queries) : num_queries_(num_queries) {
+}
+
+void StatsTest::run() {
+  // bucket boundaries must round-trip
+  for (uint64_t ns : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, ~0ull})
+  {
+    const unsigned idx = LatencyHistogram::bucket_index(ns);
+    if (ns > LatencyHistogram::bucket_upper_bound(idx)
+      || (idx > 0 && ns <= LatencyHistogram::bucket_upper_bound(idx-1)))
+      throw std::runtime_error("Error: bad histogram bucket for " + std::to_string(ns));
+  }
+
+  // per-worker histograms merge into one
+  LatencyHistogram a, b;
+  for (uint64_t ns=1; ns <= 1000; ns++)
+    (ns % 2 ? a : b).record_owned(ns * 1000);
+  b.record(5000000);
+  LatencyHistogram::Snapshot merged;
+  merged.add(a.snapshot());
+  merged.add(b.snapshot());
+  if (merged.count != 1001 || merged.max_ns != 5000000
+    || merged.sum_ns != 500500000 + 5000000
+    || LatencyHistogram::bucket_index(merged.percentile_ns(50)) != LatencyHistogram::bucket_index(500000))
+    throw std::runtime_error("Error: merged histogram lost samples");
+
+#ifdef RTENGINE_NO_TELEMETRY
+  std::cout << "per-task telemetry compiled out (ENGINE_TELEMETRY=OFF)" << std::endl;
+  return;
+#endif
+  Engine& engine = Engine::get_instance();
+  const EngineStats before = engine.get_stats();
+
+  std::vector<uint32_t> ids;
+  for (unsigned i=0; i < num_queries_; i++)
+    ids.push_back(engine.submit([]{
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }));
+  for (auto id : ids)
+    engine.wait(id);
+
+  const EngineStats after = engine.get_stats();
+  if (after.completed - before.completed != num_queries_
+    || after.run.count - before.run.count != num_queries_
+    || after.queue_wait.count - before.queue_wait.count != num_queries_)
+    throw std::runtime_error("Error: engine stats missed tasks");
+  if ((after.run.sum_ns - before.run.sum_ns) / num_queries_ < 100000)
+    throw std::runtime_error("Error: mean run time below task duration");
+
+  uint64_t busyNs = 0;
+  for (auto ns : after.worker_busy_ns)
+    busyNs += ns;
+  std::cout << "queue wait p50/p99 (us): "
+            << after.queue_wait.percentile_ns(50)/1000.0 << "/"
+            << after.queue_wait.percentile_ns(99)/1000.0 << std::endl;
+  std::cout << "run p50/p99 (us): "
+            << after.run.percentile_ns(50)/1000.0 << "/"
+            << after.run.percentile_ns(99)/1000.0 << std::endl;
+  std::cout << "worker busy (s): " << busyNs*1e-9
+            << " over " << after.uptime_s << "s uptime" << std::endl;
+
+  if (after.to_prometheus().find("rtengine_run_seconds_count") == std::string::npos)
+    throw std::runtime_error("Error: prometheus output missing run histogram");
+
+  // concurrent submitters: every task counted once across the workers' shards
+  const unsigned numThreads = 8;
+  const unsigned perThread = num_queries_ / numThreads;
+  std::vector<std::thread> submitters;
+  for (unsigned t=0; t < numThreads; t++)
+    submitters.emplace_back([&engine, perThread]{
+      std::vector<uint32_t> ids;
+      for (unsigned i=0; i < perThread; i++)
+        ids.push_back(engine.submit([]{
+          std::this_thread::sleep_for(std::chrono::microseconds(10));
+        }));
+      for (auto id : ids)
+        engine.wait(id);
+    });
+  for (auto &t : submitters)
+    t.join();
+  const EngineStats concurrent = engine.get_stats();
+  const uint64_t tasks = numThreads * perThread;
+  if (concurrent.completed - after.completed != tasks
+    || concurrent.queue_wait.count - after.queue_wait.count != tasks)
+    throw std::runtime_error("Error: engine stats missed concurrent tasks");
+  uint64_t concurrentBusyNs = 0;
+  for (auto ns : concurrent.worker_busy_ns)
+    concurrentBusyNs += ns;
+  if (concurrentBusyNs - busyNs < tasks * 10000)
+    throw std::runtime_error("Error: worker busy time below task durations");
+}
@@ -45,3 +45,37 @@ class TimeoutTest : public Test {
   private:
     unsigned timeout_ms_;
 };
+
+class TimeoutReclaimTest : public Test {
+  public:
+    TimeoutReclaimTest(unsigned num_jobs, unsigned num_threads);
+    virtual void run();
+
+  private:
+    unsigned num_jobs_;
+    unsigned num_threads_;
+};
+
+class StatsTest : public Test {
+  public:
+    StatsTest(unsigned num_queries);
+    virtual void run();
+
+  private:
+    unsigned num_queries_;
+};
+
+class ElasticTest : public Test {
+  public:
+    ElasticTest(unsigned idle_timeout_ms);
+    virtual void run();
+
+  private:
+    unsigned idle_timeout_ms_;
+};
+
+class NamedEngineTest : public Test {
+  public:
+    NamedEngineTest();
+    virtual void run();
+};
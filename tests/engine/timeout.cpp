@@ -12,8 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
 #include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
 #include "engine.hpp"
 #include "tests.hpp"
 
@@ -28,3 +33,74 @@ void TimeoutTest::run() {
   });
   engine.wait(id, timeout_ms_);
 }
+
+TimeoutReclaimTest::TimeoutReclaimTest(unsigned num_jobs, unsigned num_threads)
+  : num_jobs_(num_jobs), num_threads_(num_threads) {
+}
+
+void TimeoutReclaimTest::run() {
+  Engine& engine = Engine::get_instance();
+
+  // park every worker so the jobs below stay queued until they time out
+  std::atomic<bool> release(false);
+  std::atomic<unsigned> numParked(0);
+  std::vector<uint32_t> blockers;
+  for (unsigned i=0; i < engine.get_num_workers(); i++)
+    blockers.push_back(engine.submit([&release, &numParked]{
+      numParked++;
+      while (!release)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }));
+  while (numParked != engine.get_num_workers())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  // time out num_jobs_ jobs, far more than the pool has task ids;
+  // a leaked id per timeout would leave submit() blocked forever
+  std::atomic<unsigned> numRan(0);
+  std::atomic<unsigned> numTimeouts(0);
+  std::promise<void> done;
+  auto doneFuture = done.get_future();
+  std::thread driver([&]{
+    std::vector<std::thread> threads(num_threads_);
+    for (unsigned ti=0; ti < threads.size(); ti++)
+      threads[ti] = std::thread([&]{
+        for (unsigned i=0; i < num_jobs_/num_threads_; i++)
+        {
+          auto id = engine.submit([&numRan]{ numRan++; });
+          try {
+            engine.wait(id, 1);
+          } catch (std::runtime_error&) {
+            numTimeouts++;
+          }
+        }
+      });
+    for (unsigned ti=0; ti < threads.size(); ti++)
+      threads[ti].join();
+    done.set_value();
+  });
+
+  if (doneFuture.wait_for(std::chrono::seconds(60)) != std::future_status::ready)
+  {
+    driver.detach();
+    throw std::runtime_error("Error: task ids exhausted after "
+      + std::to_string(numTimeouts) + " timeouts");
+  }
+  driver.join();
+
+  release = true;
+  for (auto id : blockers)
+    engine.wait(id);
+
+  // queued jobs were cancelled on timeout and must never run
+  const unsigned expected = (num_jobs_/num_threads_) * num_threads_;
+  if (numTimeouts != expected || numRan != 0)
+    throw std::runtime_error("Error: expected " + std::to_string(expected)
+      + " cancelled jobs, got " + std::to_string(numTimeouts)
+      + " timeouts and " + std::to_string(numRan) + " runs");
+
+  // pool is still usable
+  bool ran = false;
+  engine.wait(engine.submit([&ran]{ ran = true; }));
+  if (!ran)
+    throw std::runtime_error("Error: engine did not run task after timeouts");
+}
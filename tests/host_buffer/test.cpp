@@ -0,0 +1,196 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <xir/tensor/tensor.hpp>
+#include "tensor_buffer_imp_host.hpp"
+#include "tensor_buffer_imp_host_phy.hpp"
+#include "tensor_buffer_imp_view.hpp"
+
+/*
+ * Host tensor buffers with strides cached at construction.
+ * No device needed.
+ */
+
+namespace {
+  const std::vector<int32_t> shape = {8, 14, 14, 64};
+
+  std::unique_ptr<xir::Tensor> makeTensor(const std::string &name, std::vector<int32_t> dims) {
+    return xir::Tensor::create(name, dims, xir::DataType{xir::DataType::XINT, 8});
+  }
+
+  // data(idx) as it was: strides rebuilt with get_shape() on every call
+  uint64_t legacyData(const xir::Tensor *tensor, uint64_t base, const std::vector<int32_t> idx) {
+    uint32_t size = tensor->get_data_type().bit_width / 8;
+    auto dims = tensor->get_shape();
+    auto offset = 0;
+    for (std::size_t k = 0; k < tensor->get_shape().size(); k++) {
+      auto stride = 1;
+      for (std::size_t m = k + 1; m < tensor->get_shape().size(); m++)
+        stride *= dims[m];
+      offset += idx[k] * stride;
+    }
+    return base + offset * size;
+  }
+}
+
+TEST(HostBufferTest, cached_strides_match_index_math) {
+  auto tensor = makeTensor("in", shape);
+  std::vector<char> data(tensor->get_data_size());
+  const uint64_t base = reinterpret_cast<uint64_t>(data.data());
+  vart::TensorBufferExtImpHost host(data.data(), tensor.get());
+  vart::TensorBuffer &tb = host;
+
+  for (std::vector<int32_t> idx : {std::vector<int32_t>{0, 0, 0, 0}, {3, 0, 0, 0}, {7, 13, 2, 63}})
+  {
+    EXPECT_EQ(tb.data(idx).first, legacyData(tensor.get(), base, idx));
+    EXPECT_EQ(host.data(idx.data(), idx.size()).first, tb.data(idx).first);
+  }
+  EXPECT_EQ(tb.data().second, size_t(tensor->get_data_size()));
+  EXPECT_EQ(tb.data({7, 13, 13, 63}).second, 1u);
+  for (int32_t b=0; b < shape[0]; b++)
+    EXPECT_EQ(host.batch_ptr(b), tb.data({b, 0, 0, 0}).first);
+
+  // one backstore buffer per batch element, viewed at an offset
+  auto single = makeTensor("io", {1, 4096});
+  std::vector<std::vector<char>> backData(2, std::vector<char>(4096));
+  std::vector<std::unique_ptr<vart::TensorBuffer>> backs;
+  std::vector<vart::TensorBuffer*> backPtrs;
+  for (auto &d : backData) {
+    backs.emplace_back(new vart::rt_engine::TensorBufferExtImpHostPhy(d.data(), single.get()));
+    backPtrs.push_back(backs.back().get());
+  }
+  auto viewed = makeTensor("view", {2, 4, 4, 16});
+  vart::TensorBufferExtImpView view(viewed.get(), 128, backPtrs);
+  vart::TensorBuffer &vtb = view;
+  for (int32_t b=0; b < 2; b++) {
+    EXPECT_EQ(view.batch_ptr(b), reinterpret_cast<uint64_t>(backData[b].data()) + 128);
+    EXPECT_EQ(vtb.data({b, 0, 0, 0}).first, view.batch_ptr(b));
+    EXPECT_EQ(vtb.data({b, 1, 0, 0}).first, view.batch_ptr(b) + 64);
+  }
+}
+
+/*
+ * Outputs left on the device by with_lazy_outputs(): only what data() and
+ * sync_for_read() touch is fetched, once.
+ */
+TEST(HostBufferTest, lazy_fetch_only_touched_ranges) {
+  auto tensor = makeTensor("out", {2, 4, 4, 16});
+  const size_t batchBytes = 4 * 4 * 16;
+  std::vector<char> device(2 * batchBytes);
+  for (size_t i=0; i < device.size(); i++)
+    device[i] = char(i * 7);
+  std::vector<char> data(device.size(), 0);
+  vart::TensorBufferExtImpHost host(data.data(), tensor.get());
+  vart::TensorBuffer &tb = host;
+
+  size_t fetched = 0;
+  auto arm = [&](int32_t b) {
+    host.set_pending(b, [&, b](void *dst, size_t offset, size_t size) {
+      memcpy(dst, &device[b * batchBytes + offset], size);
+      fetched += size;
+    });
+  };
+  arm(0);
+  arm(1);
+  EXPECT_EQ(fetched, 0u);
+
+  // a byte range of batch element 1
+  tb.sync_for_read(batchBytes + 100, 20);
+  EXPECT_EQ(fetched, 20u);
+  EXPECT_EQ(memcmp(&data[batchBytes + 100], &device[batchBytes + 100], 20), 0);
+  EXPECT_EQ(data[batchBytes + 99], 0);
+
+  // the rest of batch element 0 from row 2, then all of it: no byte twice
+  tb.data({0, 2, 0, 0});
+  EXPECT_EQ(fetched, 20u + batchBytes / 2);
+  tb.data({0, 0, 0, 0});
+  EXPECT_EQ(fetched, 20u + batchBytes);
+  EXPECT_EQ(memcmp(data.data(), device.data(), batchBytes), 0);
+  tb.data({0, 1, 0, 0});
+  tb.sync_for_read(0, batchBytes);
+  EXPECT_EQ(fetched, 20u + batchBytes);
+
+  // batch_ptr() is ours and never fetches; the whole tensor does
+  host.batch_ptr(1);
+  EXPECT_EQ(fetched, 20u + batchBytes);
+  tb.data();
+  EXPECT_EQ(memcmp(data.data(), device.data(), device.size()), 0);
+  EXPECT_EQ(fetched, 20u + 2 * batchBytes);
+
+  // the next run re-arms
+  device[5] = 42;
+  arm(0);
+  tb.sync_for_read(0, 8);
+  EXPECT_EQ(data[5], 42);
+}
+
+/*
+ * Host pointer lookups of DpuCloudController::run's upload and download
+ * loops (one per batch element and tensor): as they were, through the
+ * cached strides, and through batch_ptr().
+ */
+TEST(HostBufferTest, batch_lookup_benchmark) {
+  const unsigned numTensors = 4;
+  const unsigned runs = 20000;
+
+  std::vector<std::unique_ptr<xir::Tensor>> tensors;
+  std::vector<std::vector<char>> data;
+  std::vector<std::unique_ptr<vart::TensorBufferExtImpHost>> bufs;
+  for (unsigned t=0; t < numTensors; t++) {
+    tensors.push_back(makeTensor("t" + std::to_string(t), shape));
+    data.emplace_back(tensors.back()->get_data_size());
+    bufs.emplace_back(new vart::TensorBufferExtImpHost(data.back().data(), tensors.back().get()));
+  }
+
+  uint64_t legacySum = 0, cachedSum = 0, batchSum = 0;
+  auto t1 = std::chrono::steady_clock::now();
+  for (unsigned n=0; n < runs; n++)
+    for (int32_t i=0; i < shape[0]; i++)
+      for (unsigned j=0; j < numTensors; j++) {
+        auto dims = std::vector<int32_t>(tensors[j]->get_shape().size(), 0);
+        dims[0] = i;
+        legacySum += legacyData(tensors[j].get(), reinterpret_cast<uint64_t>(data[j].data()), dims);
+      }
+  auto t2 = std::chrono::steady_clock::now();
+  for (unsigned n=0; n < runs; n++)
+    for (int32_t i=0; i < shape[0]; i++)
+      for (unsigned j=0; j < numTensors; j++) {
+        auto dims = std::vector<int32_t>(tensors[j]->get_shape().size(), 0);
+        dims[0] = i;
+        cachedSum += static_cast<vart::TensorBuffer*>(bufs[j].get())->data(dims).first;
+      }
+  auto t3 = std::chrono::steady_clock::now();
+  for (unsigned n=0; n < runs; n++)
+    for (int32_t i=0; i < shape[0]; i++)
+      for (unsigned j=0; j < numTensors; j++)
+        batchSum += bufs[j]->batch_ptr(i);
+  auto t4 = std::chrono::steady_clock::now();
+  EXPECT_EQ(legacySum, cachedSum);
+  EXPECT_EQ(legacySum, batchSum);
+
+  auto perRun = [runs](std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count() / runs;
+  };
+  std::cout << "batch " << shape[0] << " x " << numTensors << " tensors: legacy "
+    << perRun(t2-t1) << " ns/run, cached strides " << perRun(t3-t2)
+    << " ns/run, batch_ptr " << perRun(t4-t3) << " ns/run" << std::endl;
+}
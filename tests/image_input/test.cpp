@@ -0,0 +1,174 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <vart/tensor_buffer.hpp>
+#include <xir/tensor/tensor.hpp>
+#include "image_quantize.hpp"
+#include "tensor_buffer_imp_view.hpp"
+
+/*
+ * Fused normalize + quantize of uint8 HWC images into an int8 input.
+ * No device needed.
+ */
+
+namespace {
+  std::vector<uint8_t> randomImages(size_t n, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> data(n);
+    for (auto &d : data)
+      d = uint8_t(dist(gen));
+    return data;
+  }
+
+  const std::vector<float> mean = {104.f, 107.f, 123.f};
+  const std::vector<float> scale = {0.5f, 0.5f, 0.5f};
+
+  std::unique_ptr<xir::Tensor> makeTensor(const std::string &name, std::vector<int32_t> dims) {
+    return xir::Tensor::create(name, dims, xir::DataType{xir::DataType::XINT, 8});
+  }
+
+  // a device-backed {batch, bytes} buffer: host copy plus the flushed ranges
+  class PhyBuffer : public vart::TensorBuffer {
+    public:
+      explicit PhyBuffer(const xir::Tensor *tensor)
+        : vart::TensorBuffer(tensor), bytes(tensor->get_data_size()) {}
+      location_t get_location() const override { return location_t::HOST_PHY; }
+      std::pair<uint64_t, size_t> data(const std::vector<int32_t> idx = {}) override {
+        const size_t offset = idx.empty() ? 0 : idx[0] * get_tensor()->get_shape()[1] + idx[1];
+        return {reinterpret_cast<uint64_t>(&bytes[offset]), bytes.size() - offset};
+      }
+      std::pair<uint64_t, size_t> data_phy(const std::vector<int32_t> idx) override { return {0, 0}; }
+      void sync_for_read(uint64_t offset, size_t size) override {}
+      void sync_for_write(uint64_t offset, size_t size) override { synced.emplace_back(offset, size); }
+
+      std::vector<int8_t> bytes;
+      std::vector<std::pair<uint64_t, size_t>> synced;
+  };
+}
+
+TEST(ImageQuantizeTest, matches_reference) {
+  const size_t pixels = 4096;
+  for (float inputScale : {1.f, 2.f, 64.f}) {
+    for (unsigned channels : {1u, 3u, 4u}) {
+      std::vector<float> m(mean.begin(), mean.begin() + std::min(channels, 3u));
+      std::vector<float> s(scale.begin(), scale.begin() + std::min(channels, 3u));
+      m.resize(channels, 128.f);
+      s.resize(channels, 0.25f);
+      auto images = randomImages(pixels * channels, channels);
+
+      std::vector<int8_t> out(images.size());
+      ImageQuantizer(m, s, inputScale)(images.data(), pixels, out.data());
+      for (size_t i=0; i < images.size(); i++) {
+        const unsigned c = i % channels;
+        const float ref = std::round((images[i] - m[c]) * s[c] * inputScale);
+        ASSERT_EQ(out[i], int8_t(std::min(127.f, std::max(-128.f, ref))));
+      }
+    }
+  }
+  EXPECT_THROW(ImageQuantizer(mean, {0.5f}, 1.f), std::runtime_error);
+}
+
+/*
+ * A runner's split-io input: a view at an offset into HOST_PHY buffers.
+ * Each written batch element has to be flushed, run() does not upload it.
+ */
+TEST(ImageQuantizeTest, writes_and_syncs_phy_input) {
+  const size_t offset = 256;
+  const size_t pixels = 8 * 8;
+  const size_t bytes = pixels * 3;
+  auto in = makeTensor("in", {4, 8, 8, 3});
+  auto images = randomImages(3 * bytes, 11);
+  ImageQuantizer quantize(mean, scale, 2.f);
+  std::vector<int8_t> ref(bytes);
+
+  // one buffer per batch element
+  auto single = makeTensor("io", {1, 4096});
+  std::vector<std::unique_ptr<PhyBuffer>> backs;
+  std::vector<vart::TensorBuffer*> backPtrs;
+  for (unsigned b=0; b < 4; b++) {
+    backs.emplace_back(new PhyBuffer(single.get()));
+    backPtrs.push_back(backs.back().get());
+  }
+  vart::TensorBufferExtImpView view(in.get(), offset, backPtrs);
+  quantize.write(&view, images.data(), 3);
+  for (unsigned b=0; b < 3; b++) {
+    quantize(&images[b * bytes], pixels, ref.data());
+    EXPECT_EQ(memcmp(&backs[b]->bytes[offset], ref.data(), bytes), 0);
+    ASSERT_EQ(backs[b]->synced.size(), 1u);
+    EXPECT_EQ(backs[b]->synced[0], std::make_pair(uint64_t(offset), bytes));
+  }
+  EXPECT_TRUE(backs[3]->synced.empty());
+
+  // a batch-1 input on a single buffer
+  auto one = makeTensor("in", {1, 8, 8, 3});
+  PhyBuffer back(single.get());
+  vart::TensorBufferExtImpView oneView(one.get(), offset, {&back});
+  quantize.write(&oneView, images.data(), 1);
+  quantize(images.data(), pixels, ref.data());
+  EXPECT_EQ(memcmp(&back.bytes[offset], ref.data(), bytes), 0);
+  ASSERT_EQ(back.synced.size(), 1u);
+  EXPECT_EQ(back.synced[0], std::make_pair(uint64_t(offset), bytes));
+}
+
+/*
+ * One 224x224x3 batch of 4 as classification clients prepare it today
+ * (cpuUtil-style normalize to a float image, then data_float2fix into the
+ * input buffer) vs the fused pass.
+ */
+TEST(ImageQuantizeTest, float_path_benchmark) {
+  const size_t pixels = 224 * 224;
+  const unsigned batch = 4;
+  const unsigned runs = 50;
+  const float inputScale = 1.f;
+  auto images = randomImages(pixels * 3 * batch, 7);
+  std::vector<int8_t> floatOut(images.size()), fusedOut(images.size());
+
+  auto t1 = std::chrono::steady_clock::now();
+  for (unsigned n=0; n < runs; n++) {
+    std::vector<float> normalized(images.size());
+    for (size_t i=0; i < images.size(); i++)
+      normalized[i] = (images[i] - mean[i % 3]) * scale[i % 3];
+    for (size_t i=0; i < normalized.size(); i++)
+      floatOut[i] = (int8_t)(normalized[i] * inputScale);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (unsigned n=0; n < runs; n++) {
+    ImageQuantizer quantize(mean, scale, inputScale);
+    for (unsigned b=0; b < batch; b++)
+      quantize(&images[b * pixels * 3], pixels, &fusedOut[b * pixels * 3]);
+  }
+  auto t3 = std::chrono::steady_clock::now();
+
+  // data_float2fix truncates; the fused stage rounds
+  for (size_t i=0; i < images.size(); i++)
+    ASSERT_LE(std::abs(fusedOut[i] - floatOut[i]), 1);
+
+  const double floatUs = std::chrono::duration<double, std::micro>(t2-t1).count() / runs;
+  const double fusedUs = std::chrono::duration<double, std::micro>(t3-t2).count() / runs;
+  std::cout << "batch " << batch << " x 224x224x3: float path " << floatUs
+    << " us/run (+" << images.size() * sizeof(float) / 1024 << " KB intermediate), fused "
+    << fusedUs << " us/run" << std::endl;
+}
@@ -0,0 +1,553 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <xrt.h>
+#include <xir/tensor/tensor.hpp>
+#include "dpucloud_controller.hpp"
+#include "tensor_buffer_imp_host.hpp"
+#include "xrt_sim.hpp"
+#include "SimIo.hpp"
+
+/*
+ * What bind() resolves once instead of on every run (name matching, staged
+ * copy plans) and the derived bindings' transfers, on IoBindings built here
+ * against the simulated XRT backend.
+ * No device needed.
+ */
+
+namespace {
+  // model tensors carry the subgraph's suffix, user tensors the plain name
+  struct HostIo {
+    std::vector<std::unique_ptr<xir::Tensor>> model;
+    std::vector<std::unique_ptr<xir::Tensor>> user;
+    std::vector<std::vector<char>> data;
+    std::vector<std::unique_ptr<vart::TensorBuffer>> bufs;
+
+    HostIo(unsigned num, int size, bool reversed) {
+      for (unsigned i=0; i < num; i++) {
+        const std::string name = "detect/head_" + std::to_string(i) + "/conv2d/fix";
+        model.push_back(xir::Tensor::create(name + "_downloaded", {1, size}, xir::DataType{xir::DataType::XINT, 8}));
+      }
+      for (unsigned n=0; n < num; n++) {
+        const unsigned i = reversed ? num-1-n : n;
+        const std::string name = "detect/head_" + std::to_string(i) + "/conv2d/fix";
+        user.push_back(xir::Tensor::create(name, {1, size}, xir::DataType{xir::DataType::XINT, 8}));
+        data.emplace_back(size, char(i));
+        bufs.emplace_back(new vart::TensorBufferExtImpHost(data.back().data(), user.back().get()));
+      }
+    }
+    std::vector<const xir::Tensor*> tensors() const {
+      std::vector<const xir::Tensor*> ret;
+      for (auto &t : model)
+        ret.push_back(t.get());
+      return ret;
+    }
+    std::vector<vart::TensorBuffer*> buffers() const {
+      std::vector<vart::TensorBuffer*> ret;
+      for (auto &b : bufs)
+        ret.push_back(b.get());
+      return ret;
+    }
+  };
+}
+
+TEST(IoBindingTest, matches_tensor_names) {
+  HostIo io(3, 16, true);
+  auto matches = DpuCloudController::match_tensor_names(io.tensors(), io.buffers());
+  ASSERT_EQ(matches.size(), 3u);
+  // tensor order, whatever order the user passed the buffers in
+  for (unsigned i=0; i < 3; i++) {
+    EXPECT_EQ(matches[i].first, i);
+    EXPECT_EQ(matches[i].second, 2-i);
+  }
+
+  HostIo other(2, 16, false);
+  EXPECT_TRUE(DpuCloudController::match_tensor_names(io.tensors(), {}).empty());
+  EXPECT_EQ(DpuCloudController::match_tensor_names(other.tensors(), io.buffers()).size(), 2u);
+}
+
+/*
+ * Output download of a 10-output model: matching names on every run, as
+ * run() did, vs copying through the pairs resolved once at bind().
+ */
+TEST(IoBindingTest, bound_download_benchmark) {
+  const unsigned numOutputs = 10;
+  const unsigned runs = 20000;
+
+  for (int size : {64, 1024, 16384})
+  {
+    HostIo io(numOutputs, size, true);
+    const auto tensors = io.tensors();
+    const auto buffers = io.buffers();
+    std::vector<std::vector<char>> staging(numOutputs, std::vector<char>(size, 1));
+
+    auto t1 = std::chrono::steady_clock::now();
+    for (unsigned n=0; n < runs; n++)
+      for (auto &m : DpuCloudController::match_tensor_names(tensors, buffers))
+        memcpy((char*)buffers[m.second]->data().first, staging[m.first].data(), size);
+    auto t2 = std::chrono::steady_clock::now();
+    std::vector<std::pair<char*, const char*>> bound;
+    for (auto &m : DpuCloudController::match_tensor_names(tensors, buffers))
+      bound.emplace_back((char*)buffers[m.second]->data().first, staging[m.first].data());
+    for (unsigned n=0; n < runs; n++)
+      for (auto &b : bound)
+        memcpy(b.first, b.second, size);
+    auto t3 = std::chrono::steady_clock::now();
+    ASSERT_EQ(bound.size(), numOutputs);
+    EXPECT_EQ(io.data[0][0], 1);
+
+    const double perRunNs = std::chrono::duration<double, std::nano>(t2-t1).count() / runs;
+    const double boundNs = std::chrono::duration<double, std::nano>(t3-t2).count() / runs;
+    std::cout << numOutputs << " outputs x " << size << " B: per-run matching "
+      << perRunNs << " ns/run, bound " << boundNs << " ns/run" << std::endl;
+  }
+}
+
+TEST(IoBindingTest, with_batch_drops_idle_staged_copies) {
+  SimModel model;
+  model.add(true, "in_a", 32, 1, 0);
+  model.add(true, "in_b", 16, 1, 64);
+  model.add(false, "out", 10, 2, 0);
+  UserIo in(model.input_io), out(model.output_io);
+  DpuCloudController::IoBinding binding;
+  binding.inputBs = BATCH;
+  binding.in_copies = DpuCloudController::plan_tensorbuffer_trans(in.buffers(), out.buffers(), true,
+    model.input_io, model.output_io, {1.f, 1.f}, BATCH);
+  binding.out_copies = DpuCloudController::plan_tensorbuffer_trans(in.buffers(), out.buffers(), false,
+    model.input_io, model.output_io, {1.f}, BATCH);
+  ASSERT_EQ(binding.in_copies.size(), 2u * BATCH);
+  ASSERT_EQ(binding.out_copies.size(), 1u * BATCH);
+  // staging buffers are numbered [batch element][tensor]
+  for (auto &c : binding.in_copies) {
+    const unsigned i = c.staging / 2, j = c.staging % 2;
+    EXPECT_EQ(c.user, in.data[j].data() + i * model.input_io[j].size);
+    EXPECT_EQ(c.size, model.input_io[j].size);
+  }
+  for (auto &c : binding.out_copies)
+    EXPECT_EQ(c.user, out.data[0].data() + c.staging * 10);
+
+  auto live = DpuCloudController::with_batch_of(binding, 2, 2, 1);
+  EXPECT_EQ(live->live_batch(), 2);
+  EXPECT_EQ(binding.live_batch(), BATCH);
+  ASSERT_EQ(live->in_copies.size(), 4u);
+  for (auto &c : live->in_copies)
+    EXPECT_LT(c.staging / 2, 2u);
+  ASSERT_EQ(live->out_copies.size(), 2u);
+  for (auto &c : live->out_copies)
+    EXPECT_LT(c.staging, 2u);
+
+  EXPECT_THROW(DpuCloudController::with_batch_of(binding, 0, 2, 1), std::runtime_error);
+  EXPECT_THROW(DpuCloudController::with_batch_of(binding, BATCH + 1, 2, 1), std::runtime_error);
+}
+
+TEST(IoBindingTest, with_batch_moves_only_live_elements) {
+  SimModel model;
+  model.add(true, "in_a", 32, 1, 0);
+  model.add(true, "in_b", 16, 1, 64);
+  model.add(false, "out", 10, 2, 0);
+  auto table = model.alloc();
+  UserIo in(model.input_io), out(model.output_io);
+  for (unsigned j=0; j < in.data.size(); j++)
+    in.data[j] = pattern(in.data[j].size(), j + 1);
+  // logits on the device peak at class i+1 for engine i; stale input bytes
+  for (int i=0; i < BATCH; i++) {
+    std::vector<char> logits(10, 0);
+    logits[i+1] = 100;
+    model.write(*table, model.output_io[0], i, logits);
+    for (auto &io : model.input_io)
+      model.write(*table, io, i, std::vector<char>(io.size, 0x55));
+  }
+  const unsigned k = 3;
+  std::vector<TopKEntry> results(BATCH * k, TopKEntry{-7, 0.f});
+
+  DpuCloudController::IoBinding binding;
+  binding.inputBs = BATCH;
+  binding.io_addrs = table;
+  binding.in_ptrs = in.ptrs(model.input_io);
+  binding.out_ptrs = out.ptrs(model.output_io);
+  binding.topk = std::make_shared<const DpuTopK>(DpuTopK{0, k, results.data()});
+  auto live = DpuCloudController::with_batch_of(binding, 2, 2, 1);
+
+  auto before = xrt_sim::get_stats();
+  DpuCloudController::upload_inputs(*live, model.input_io, *table, live->in_ptrs, model.handle, nullptr);
+  auto uploaded = xrt_sim::get_stats();
+  EXPECT_EQ(uploaded.bytes_to_device - before.bytes_to_device, 2u * (32 + 16));
+  for (int i=0; i < BATCH; i++)
+    for (unsigned j=0; j < model.input_io.size(); j++) {
+      const auto &io = model.input_io[j];
+      EXPECT_EQ(model.read(*table, io, i), i < 2 ? in.element(j, i, io.size) : std::vector<char>(io.size, 0x55));
+    }
+
+  DpuRunSample sample;
+  before = xrt_sim::get_stats();
+  DpuCloudController::download_outputs(*live, model.output_io, *table, live->out_ptrs, model.handle, nullptr,
+    nullptr, nullptr, sample);
+  EXPECT_EQ(xrt_sim::get_stats().bytes_from_device - before.bytes_from_device, 2u * 10);
+  for (int i=0; i < BATCH; i++)
+    EXPECT_EQ(out.element(0, i, 10), i < 2 ? model.read(*table, model.output_io[0], i) : std::vector<char>(10, 0));
+
+  DpuCloudController::run_topk(*live, model.output_io, {1.f}, live->out_ptrs);
+  for (int i=0; i < BATCH; i++)
+    EXPECT_EQ(results[i*k].index, i < 2 ? i + 1 : -7);
+}
+
+TEST(IoBindingTest, lazy_outputs_fetch_what_is_read) {
+  SimModel model;
+  model.add(true, "in", 16, 1, 0);
+  model.add(false, "feat", 64, 2, 0);
+  model.add(false, "prob", 10, 2, 256);
+  auto table = model.alloc();
+  UserIo in(model.input_io), out(model.output_io);
+  auto device = [&](int seed) {
+    for (int i=0; i < BATCH; i++)
+      for (unsigned j=0; j < model.output_io.size(); j++)
+        model.write(*table, model.output_io[j], i, pattern(model.output_io[j].size, seed + i*2 + j));
+  };
+  auto fetched = [](const DpuModelProfile &p) { return p.snapshot().d2h_fetched_bytes; };
+  // runner-allocated outputs: one host buffer per tensor holding the batch
+  DpuCloudController::IoBinding binding;
+  binding.tensorbuffer_phy = false;
+  binding.create_tb_batch = true;
+  binding.inputBs = BATCH;
+  binding.io_addrs = table;
+  binding.outputs = out.buffers();
+  binding.out_ptrs = out.ptrs(model.output_io);
+  std::vector<TopKEntry> results(BATCH);
+  binding.topk = std::make_shared<const DpuTopK>(DpuTopK{1, 1, results.data()});
+
+  auto lazy = DpuCloudController::with_lazy_outputs_of(binding, model.output_io);
+  ASSERT_EQ(lazy->lazy_outs.size(), 2u * BATCH);
+  for (int i=0; i < BATCH; i++) {
+    EXPECT_EQ(lazy->lazy_outs[i*2].first, out.bufs[0].get());
+    EXPECT_EQ(lazy->lazy_outs[i*2].second, i);
+    // post-processed right after the run
+    EXPECT_EQ(lazy->lazy_outs[i*2+1].first, nullptr);
+  }
+  // what run_bound() keeps the fetches' handle open with
+  std::shared_ptr<void> mem(xclOpen(0, nullptr, XCL_INFO), [](void *h) { xclClose(h); });
+  DpuModelProfile profile(0);
+  auto *feat = out.bufs[0].get();
+
+  device(1);
+  DpuRunSample sample;
+  auto before = xrt_sim::get_stats();
+  DpuCloudController::download_outputs(*lazy, model.output_io, *table, lazy->out_ptrs, model.handle, nullptr,
+    mem, &profile, sample);
+  EXPECT_EQ(xrt_sim::get_stats().bytes_from_device - before.bytes_from_device, 10u * BATCH);
+  EXPECT_EQ(sample.d2h_deferred_bytes, 64u * BATCH);
+  EXPECT_EQ(out.element(1, 3, 10), model.read(*table, model.output_io[1], 3));
+  EXPECT_EQ(out.element(0, 2, 64), std::vector<char>(64, 0));
+
+  // part of one element
+  before = xrt_sim::get_stats();
+  feat->sync_for_read(2*64 + 8, 16);
+  EXPECT_EQ(xrt_sim::get_stats().bytes_from_device - before.bytes_from_device, 16u);
+  EXPECT_EQ(fetched(profile), 16u);
+  const auto dev2 = model.read(*table, model.output_io[0], 2);
+  EXPECT_TRUE(std::equal(dev2.begin() + 8, dev2.begin() + 24, out.data[0].begin() + 2*64 + 8));
+  // everything, once
+  feat->data();
+  feat->data();
+  EXPECT_EQ(fetched(profile), 16u + 64u * BATCH);
+  for (int i=0; i < BATCH; i++)
+    EXPECT_EQ(out.element(0, i, 64), model.read(*table, model.output_io[0], i));
+
+  // the next run arms it again, and concurrent readers fetch each element once
+  device(11);
+  DpuCloudController::download_outputs(*lazy, model.output_io, *table, lazy->out_ptrs, model.handle, nullptr,
+    mem, &profile, sample);
+  const auto armed = fetched(profile);
+  std::vector<std::thread> readers;
+  for (int t=0; t < 4; t++)
+    readers.emplace_back([feat, t]() {
+      for (int n=0; n < 100; n++) {
+        const int32_t idx[] = {(t + n) % BATCH, 0};
+        static_cast<vart::TensorBufferExtImpHost*>(feat)->data(idx, 2);
+      }
+    });
+  for (auto &r : readers)
+    r.join();
+  EXPECT_EQ(fetched(profile) - armed, 64u * BATCH);
+  for (int i=0; i < BATCH; i++)
+    EXPECT_EQ(out.element(0, i, 64), model.read(*table, model.output_io[0], i));
+
+  // staged or registered bindings have no buffers of ours to arm
+  DpuCloudController::IoBinding staged = binding;
+  staged.io_addrs = nullptr;
+  EXPECT_THROW(DpuCloudController::with_lazy_outputs_of(staged, model.output_io), std::runtime_error);
+}
+
+TEST(IoBindingTest, orders_buffers_by_tensor) {
+  SimModel model;
+  model.add(true, "in_a", 32, 1, 0);
+  model.add(true, "in_b", 16, 1, 64);
+  std::vector<char> mem(1024);
+  // per element buffers, given b before a: the k-th match is element k
+  PlacedIo placed(model.input_io, {&mem[0], &mem[100], &mem[200], &mem[300]});
+  auto bufs = placed.buffers();
+  std::swap(bufs[0], bufs[1]);
+  auto ordered = DpuCloudController::order_by_tensor(bufs, model.input_io, false, 2);
+  ASSERT_EQ(ordered.size(), 4u);
+  EXPECT_EQ(ordered[0], placed.bufs[0].get());
+  EXPECT_EQ(ordered[1], placed.bufs[1].get());
+  EXPECT_EQ(ordered[2], placed.bufs[2].get());
+  EXPECT_EQ(ordered[3], placed.bufs[3].get());
+  // one buffer per tensor holding the batch
+  UserIo batched(model.input_io);
+  auto one = batched.buffers();
+  std::swap(one[0], one[1]);
+  EXPECT_EQ(DpuCloudController::order_by_tensor(one, model.input_io, true, BATCH),
+    (std::vector<vart::TensorBuffer*>{batched.bufs[0].get(), batched.bufs[1].get()}));
+  // a tensor with too few or too many buffers
+  EXPECT_TRUE(DpuCloudController::order_by_tensor({bufs[0], bufs[1], bufs[2]}, model.input_io, false, 2).empty());
+  EXPECT_TRUE(DpuCloudController::order_by_tensor(bufs, model.input_io, true, 2).empty());
+}
+
+TEST(IoBindingTest, binds_registered_memory) {
+  SimModel model;
+  model.add(true, "in_a", 32, 1, 0);
+  model.add(true, "in_b", 16, 1, 64);
+  model.add(false, "out", 10, 2, 0);
+  Registered user(model.handle, 4);
+  user.add(0, 2);
+  user.add(2, 2);
+  // element i's inputs 256 bytes apart, b at the model's offset from a
+  std::vector<char*> in_at, out_at;
+  for (int i=0; i < BATCH; i++) {
+    in_at.push_back(user.mem + i*256);
+    in_at.push_back(user.mem + i*256 + 64);
+    out_at.push_back(user.mem + 2048 + i*16);
+  }
+  auto bind = [&](const PlacedIo &in, const PlacedIo &out, const UserMemRegistry &registry) {
+    DpuCloudController::IoBinding binding;
+    binding.inputs = in.buffers();
+    binding.outputs = out.buffers();
+    binding.inputBs = BATCH;
+    const bool ok = DpuCloudController::bind_registered(binding, registry, model.input_io, model.output_io, 3, false, BATCH);
+    // a refused binding is left as it was
+    EXPECT_EQ(binding.registered, ok);
+    EXPECT_EQ(bool(binding.io_addrs), ok);
+    return binding;
+  };
+
+  PlacedIo in(model.input_io, in_at), out(model.output_io, out_at);
+  auto binding = bind(in, out, user.registry);
+  ASSERT_TRUE(binding.registered);
+  for (int i=0; i < BATCH; i++) {
+    EXPECT_EQ(binding.io_addrs->get(1, i), user.paddr(in_at[i*2]));
+    EXPECT_EQ(binding.io_addrs->get(2, i), user.paddr(out_at[i]));
+    EXPECT_EQ(binding.in_bos[i*2+1].second, size_t(i*256 + 64));
+  }
+  // runs sync the user pages through their BO to where the DPU reads them
+  for (int i=0; i < BATCH; i++)
+    for (unsigned j=0; j < 2; j++) {
+      const auto bytes = pattern(model.input_io[j].size, i*2 + j);
+      memcpy(in_at[i*2+j], bytes.data(), bytes.size());
+    }
+  DpuCloudController::upload_inputs(binding, model.input_io, *binding.io_addrs, binding.in_ptrs, nullptr, model.handle);
+  for (int i=0; i < BATCH; i++)
+    for (unsigned j=0; j < 2; j++)
+      EXPECT_EQ(model.read(*binding.io_addrs, model.input_io[j], i), pattern(model.input_io[j].size, i*2 + j));
+
+  // tensors sharing reg_id 1 must keep the model's offset between them
+  auto moved = in_at;
+  moved[5] += 32;
+  bind(PlacedIo(model.input_io, moved), out, user.registry);
+  // type and size must match the model tensor's
+  bind(PlacedIo(model.input_io, in_at, xir::DataType{xir::DataType::FLOAT, 32}), out, user.registry);
+  bind(in, PlacedIo(model.output_io, out_at, xir::DataType{xir::DataType::XINT, 8}, -1), user.registry);
+  // a buffer across the two regions
+  auto spanning = out_at;
+  spanning[3] = user.mem + 2*Registered::PAGE - 4;
+  bind(in, PlacedIo(model.output_io, spanning), user.registry);
+  // a buffer outside registered memory, or nothing registered
+  std::vector<char> other(16);
+  spanning[3] = other.data();
+  bind(in, PlacedIo(model.output_io, spanning), user.registry);
+  bind(in, out, UserMemRegistry());
+}
+
+TEST(IoBindingTest, runs_bound_staging_until_a_buffer_is_freed) {
+  SimModel model;
+  model.add(true, "img", 32, 1, 0);
+  model.add(false, "res", 32, 2, 0);
+  const xir::DataType FLOAT{xir::DataType::FLOAT, 32};
+  UserIo in(model.input_io, FLOAT), out(model.output_io, FLOAT);
+  // the runner's staging buffers, one per batch element; two sets of outputs
+  std::vector<char> stageIn(BATCH * 32), stageOut(BATCH * 32), stageOther(BATCH * 32);
+  auto at = [](std::vector<char> &stage) {
+    std::vector<char*> ret;
+    for (int i=0; i < BATCH; i++)
+      ret.push_back(stage.data() + i * 32);
+    return ret;
+  };
+  PlacedIo stagedIn(model.input_io, at(stageIn)), stagedOut(model.output_io, at(stageOut)),
+    stagedOther(model.output_io, at(stageOther));
+  auto key = [](const PlacedIo &outs, const PlacedIo &ins) {
+    DpuAddrCache::Key key{false, {}};
+    for (auto *io : {&outs, &ins})
+      for (auto &b : io->bufs)
+        key.second.push_back(b.get());
+    return key;
+  };
+
+  // bind: plans (x2 in, x0.5 out) and the address table, resolved once
+  DpuCloudController::IoBinding binding;
+  binding.tensorbuffer_phy = false;
+  binding.create_tb_batch = false;
+  binding.inputBs = BATCH;
+  binding.in_copies = DpuCloudController::plan_tensorbuffer_trans(in.buffers(), out.buffers(), true,
+    model.input_io, model.output_io, {2.0f}, BATCH);
+  binding.out_copies = DpuCloudController::plan_tensorbuffer_trans(in.buffers(), out.buffers(), false,
+    model.input_io, model.output_io, {0.5f}, BATCH);
+  ASSERT_EQ(binding.in_copies.size(), size_t(BATCH));
+  ASSERT_EQ(binding.out_copies.size(), size_t(BATCH));
+  for (int i=0; i < BATCH; i++) {
+    EXPECT_EQ(binding.in_copies[i].staging, unsigned(i));
+    EXPECT_EQ(binding.in_copies[i].user, in.data[0].data() + i * 32 * sizeof(float));
+    EXPECT_TRUE(binding.in_copies[i].is_float);
+    EXPECT_EQ(binding.in_copies[i].channels, 0u);
+    EXPECT_EQ(binding.out_copies[i].user, out.data[0].data() + i * 32 * sizeof(float));
+    EXPECT_EQ(binding.out_copies[i].scale, 0.5f);
+  }
+  binding.in_ptrs = DpuCloudController::host_batch_ptrs(stagedIn.buffers(), false, BATCH, model.input_io);
+  binding.out_ptrs = DpuCloudController::host_batch_ptrs(stagedOut.buffers(), false, BATCH, model.output_io);
+  DpuAddrCache cache;
+  ASSERT_EQ(cache.find(key(stagedOut, stagedIn)), nullptr);
+  cache.insert(key(stagedOut, stagedIn), model.alloc());
+  cache.insert(key(stagedOther, stagedIn), model.alloc());
+  const auto table = cache.find(key(stagedOut, stagedIn));
+  ASSERT_NE(table, nullptr);
+
+  // the run_bound() phases, twice on the one binding
+  auto run = [&](int seed) {
+    auto *user = reinterpret_cast<float*>(in.data[0].data());
+    for (int k=0; k < BATCH * 32; k++)
+      user[k] = float((seed + k) % 50 - 25);
+    auto io = cache.find(key(stagedOut, stagedIn));
+    EXPECT_EQ(io, table);
+    DpuCloudController::apply_tensorbuffer_trans(binding.in_copies, stagedIn.buffers(), true);
+    DpuCloudController::upload_inputs(binding, model.input_io, *io, binding.in_ptrs, model.handle, nullptr);
+    // the DPU: res = img
+    for (int i=0; i < BATCH; i++)
+      model.write(*io, model.output_io[0], i, model.read(*io, model.input_io[0], i));
+    DpuRunSample sample;
+    DpuCloudController::download_outputs(binding, model.output_io, *io, binding.out_ptrs, model.handle, nullptr,
+      nullptr, nullptr, sample);
+    DpuCloudController::apply_tensorbuffer_trans(binding.out_copies, stagedOut.buffers(), false);
+    for (int i=0; i < BATCH; i++)
+      EXPECT_EQ(stageIn[i * 32 + 1], char(2 * ((seed + i * 32 + 1) % 50 - 25)));
+    EXPECT_EQ(out.data[0], in.data[0]);
+  };
+  run(0);
+  run(7);
+
+  // freeing one staged output drops its tables only
+  cache.evict(stagedOut.bufs[1].get());
+  EXPECT_EQ(cache.find(key(stagedOut, stagedIn)), nullptr);
+  EXPECT_NE(cache.find(key(stagedOther, stagedIn)), nullptr);
+  EXPECT_EQ(cache.size(), 1u);
+  cache.evict(stagedIn.bufs[0].get());
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(IoBindingTest, nchw_only_where_the_shape_says_so) {
+  auto is_nchw = [](std::vector<int32_t> user, std::vector<int32_t> model) {
+    auto u = xir::Tensor::create("u", user, xir::DataType{xir::DataType::FLOAT, 32});
+    auto m = xir::Tensor::create("m", model, xir::DataType{xir::DataType::XINT, 8});
+    return DpuCloudController::is_nchw_of(u.get(), m.get());
+  };
+  EXPECT_TRUE(is_nchw({1, 4, 2, 3}, {1, 2, 3, 4}));
+  EXPECT_TRUE(is_nchw({4, 4, 2, 3}, {1, 2, 3, 4}));  // batch aside
+  EXPECT_FALSE(is_nchw({1, 2, 3, 4}, {1, 2, 3, 4}));
+  // H == C: NHWC and NCHW differ, each is recognized
+  EXPECT_FALSE(is_nchw({1, 4, 3, 4}, {1, 4, 3, 4}));
+  EXPECT_TRUE(is_nchw({1, 4, 4, 3}, {1, 4, 3, 4}));
+  // reads the same both ways: NHWC
+  EXPECT_FALSE(is_nchw({1, 4, 4, 4}, {1, 4, 4, 4}));
+  EXPECT_FALSE(is_nchw({1, 5, 5, 5}, {1, 5, 5, 5}));
+  // neither form
+  EXPECT_FALSE(is_nchw({1, 3, 2, 4}, {1, 2, 3, 4}));
+  EXPECT_FALSE(is_nchw({1, 24}, {1, 24}));
+  EXPECT_FALSE(is_nchw({1, 4, 6}, {1, 2, 3, 4}));
+}
+
+TEST(IoBindingTest, stages_nchw_buffers_as_nhwc) {
+  const int H = 2, W = 3, C = 4, HW = H * W, SIZE = HW * C;
+  std::vector<std::unique_ptr<xir::Tensor>> model;
+  model.push_back(xir::Tensor::create("sub/img_fix", {BATCH, H, W, C}, xir::DataType{xir::DataType::XINT, 8}));
+  model.push_back(xir::Tensor::create("sub/res_fix", {BATCH, H, W, C}, xir::DataType{xir::DataType::XINT, 8}));
+  const std::vector<DpuXmodel::io_tensor> input_io = {{model[0].get(), 1, 0, size_t(SIZE)}};
+  const std::vector<DpuXmodel::io_tensor> output_io = {{model[1].get(), 2, 0, size_t(SIZE)}};
+  std::vector<char> stageIn(BATCH * SIZE), stageOut(BATCH * SIZE);
+  std::vector<char*> atIn, atOut;
+  for (int i=0; i < BATCH; i++) {
+    atIn.push_back(stageIn.data() + i * SIZE);
+    atOut.push_back(stageOut.data() + i * SIZE);
+  }
+  PlacedIo stagedIn(input_io, atIn), stagedOut(output_io, atOut);
+
+  for (auto type : {xir::DataType{xir::DataType::FLOAT, 32}, xir::DataType{xir::DataType::XINT, 8}}) {
+    const bool is_float = type.type == xir::DataType::FLOAT;
+    const size_t elem = type.bit_width / 8;
+    auto inT = xir::Tensor::create("img", {BATCH, C, H, W}, type);
+    auto outT = xir::Tensor::create("res", {BATCH, C, H, W}, type);
+    std::vector<char> inData(BATCH * SIZE * elem), outData(BATCH * SIZE * elem);
+    vart::TensorBufferExtImpHost in(inData.data(), inT.get()), out(outData.data(), outT.get());
+    // user value of (element, c, h*W+w)
+    auto value = [](int i, int c, int p) { return (i * 37 + c * 11 + p * 3) % 60 - 30; };
+    for (int i=0; i < BATCH; i++)
+      for (int c=0; c < C; c++)
+        for (int p=0; p < HW; p++) {
+          const size_t k = (size_t(i) * SIZE + c * HW + p);
+          if (is_float)
+            reinterpret_cast<float*>(inData.data())[k] = float(value(i, c, p));
+          else
+            inData[k] = char(value(i, c, p));
+        }
+
+    const std::vector<vart::TensorBuffer*> ins = {&in}, outs = {&out};
+    auto inCopies = DpuCloudController::plan_tensorbuffer_trans(ins, outs, true, input_io, output_io, {2.0f}, BATCH);
+    auto outCopies = DpuCloudController::plan_tensorbuffer_trans(ins, outs, false, input_io, output_io, {0.5f}, BATCH);
+    ASSERT_EQ(inCopies.size(), size_t(BATCH));
+    for (auto &copy : inCopies) {
+      EXPECT_EQ(copy.channels, unsigned(C));
+      EXPECT_EQ(copy.size, size_t(SIZE));
+      EXPECT_EQ(copy.is_float, is_float);
+    }
+    DpuCloudController::apply_tensorbuffer_trans(inCopies, stagedIn.buffers(), true);
+    // NHWC in the staging buffers, floats quantized
+    for (int i=0; i < BATCH; i++)
+      for (int c=0; c < C; c++)
+        for (int p=0; p < HW; p++)
+          EXPECT_EQ(stageIn[i * SIZE + p * C + c], char(value(i, c, p) * (is_float ? 2 : 1)))
+            << "element " << i << " c " << c << " hw " << p;
+
+    // the DPU: res = img; back to NCHW, dequantized
+    stageOut = stageIn;
+    DpuCloudController::apply_tensorbuffer_trans(outCopies, stagedOut.buffers(), false);
+    EXPECT_EQ(outData, inData);
+  }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "layout_transpose.hpp"
+
+/*
+ * NCHW user buffers transposed while (de)quantizing into NHWC staging.
+ * No device needed.
+ */
+
+namespace {
+  struct Shape { size_t h, w, c; };
+
+  std::vector<float> randomFloats(size_t n, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    std::vector<float> data(n);
+    for (auto &d : data)
+      d = dist(gen);
+    return data;
+  }
+
+  // the two steps NCHW clients take today: transpose on their side, then
+  // the controller's data_float2fix into staging
+  void separateNchwToNhwc(const float *src, const Shape &s, float scale, std::vector<float> &tmp, int8_t *dst) {
+    for (size_t c=0; c < s.c; c++)
+      for (size_t p=0; p < s.h * s.w; p++)
+        tmp[p*s.c + c] = src[c*s.h*s.w + p];
+    for (size_t i=0; i < tmp.size(); i++)
+      dst[i] = (int8_t)(tmp[i]*scale);
+  }
+}
+
+TEST(LayoutTransposeTest, matches_reference) {
+  for (Shape s : {Shape{5, 7, 3}, Shape{33, 31, 65}, Shape{1, 1, 1000}}) {
+    const size_t hw = s.h * s.w, n = hw * s.c;
+    auto nchw = randomFloats(n, unsigned(n));
+    std::vector<float> tmp(n);
+    std::vector<int8_t> ref(n), fused(n);
+    separateNchwToNhwc(nchw.data(), s, 64.f, tmp, ref.data());
+    layout::nchw_to_nhwc(nchw.data(), s.c, hw, 64.f, fused.data());
+    EXPECT_EQ(fused, ref);
+
+    // and back: int8 round trip, float dequantized per element
+    std::vector<int8_t> back(n);
+    layout::nhwc_to_nchw(fused.data(), s.c, hw, back.data());
+    std::vector<int8_t> again(n);
+    layout::nchw_to_nhwc(back.data(), s.c, hw, again.data());
+    EXPECT_EQ(again, fused);
+    std::vector<float> deq(n);
+    layout::nhwc_to_nchw(fused.data(), s.c, hw, 0.5f, deq.data());
+    for (size_t c=0; c < s.c; c++)
+      for (size_t p=0; p < hw; p++)
+        ASSERT_EQ(deq[c*hw + p], fused[p*s.c + c] * 0.5f);
+  }
+}
+
+/*
+ * NCHW float input of common CNN shapes into NHWC int8 staging: separate
+ * transpose + data_float2fix vs the fused, tiled pass.
+ */
+TEST(LayoutTransposeTest, separate_transpose_benchmark) {
+  const unsigned runs = 50;
+  for (Shape s : {Shape{224, 224, 3}, Shape{56, 56, 64}, Shape{28, 28, 256}, Shape{7, 7, 2048}}) {
+    const size_t hw = s.h * s.w, n = hw * s.c;
+    auto nchw = randomFloats(n, 1);
+    std::vector<float> tmp(n);
+    std::vector<int8_t> ref(n), fused(n);
+    separateNchwToNhwc(nchw.data(), s, 64.f, tmp, ref.data());
+    layout::nchw_to_nhwc(nchw.data(), s.c, hw, 64.f, fused.data());
+
+    auto t1 = std::chrono::steady_clock::now();
+    for (unsigned r=0; r < runs; r++)
+      separateNchwToNhwc(nchw.data(), s, 64.f, tmp, ref.data());
+    auto t2 = std::chrono::steady_clock::now();
+    for (unsigned r=0; r < runs; r++)
+      layout::nchw_to_nhwc(nchw.data(), s.c, hw, 64.f, fused.data());
+    auto t3 = std::chrono::steady_clock::now();
+    EXPECT_EQ(fused, ref);
+
+    const double separateUs = std::chrono::duration<double, std::micro>(t2-t1).count() / runs;
+    const double fusedUs = std::chrono::duration<double, std::micro>(t3-t2).count() / runs;
+    std::cout << s.h << "x" << s.w << "x" << s.c << ": separate " << separateUs
+      << " us, fused " << fusedUs << " us" << std::endl;
+  }
+}
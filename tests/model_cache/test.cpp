@@ -0,0 +1,190 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "model_cache.hpp"
+
+/*
+ * On-disk model cache images. No device needed.
+ */
+
+class ModelCacheTest : public testing::Test {
+protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/rtm_cache_XXXXXX";
+    ASSERT_NE(mkdtemp(tmpl), nullptr);
+    dir_ = tmpl;
+    for (int i = 0; i < 5000; i++)
+      weights_.push_back(char(i * 7));
+    code_.assign({ 1, 2, 3, 4, 5 });
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    EXPECT_EQ(system(cmd.c_str()), 0);
+  }
+
+  std::string path(uint64_t key) {
+    std::ostringstream os;
+    os << dir_ << "/" << std::hex << key << ".rtm";
+    return os.str();
+  }
+
+  void fill(ModelImage &image, uint64_t key) {
+    image.key = key;
+    image.split_io = 1;
+    image.md5value = { "aaaa", "bbbb" };
+    image.params.push_back({ 0, int32_t(weights_.size()), "aaaa", weights_.data() });
+    image.params.push_back({ 3, 0, "", code_.data() });
+    image.code.push_back({ 0, int32_t(code_.size()), "cccc", code_.data() });
+    image.total_reg_map = { { 1, 100 }, { 2, 200 } };
+    image.workspace_reg_map = { { 2, 200 } };
+    image.regid_to_hw_segment = { { 0, "W0" } };
+  }
+
+  std::string dir_;
+  std::vector<char> weights_;
+  std::vector<char> code_;
+};
+
+TEST_F(ModelCacheTest, round_trip) {
+  const uint64_t key = 0x1234abcd;
+  ModelImage image;
+  fill(image, key);
+  image.store(dir_);
+
+  auto loaded = ModelImage::load(dir_, key);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(loaded->split_io, 1);
+  EXPECT_EQ(loaded->md5value, image.md5value);
+  ASSERT_EQ(loaded->params.size(), 2u);
+  EXPECT_EQ(loaded->params[0].id, 0);
+  EXPECT_EQ(loaded->params[0].md5, "aaaa");
+  ASSERT_EQ(loaded->params[0].size, int32_t(weights_.size()));
+  EXPECT_EQ(std::string(loaded->params[0].data, weights_.size()),
+    std::string(weights_.data(), weights_.size()));
+  EXPECT_EQ(loaded->params[1].size, 0);
+  ASSERT_EQ(loaded->code.size(), 1u);
+  EXPECT_EQ(std::string(loaded->code[0].data, code_.size()),
+    std::string(code_.data(), code_.size()));
+  EXPECT_EQ(loaded->total_reg_map, image.total_reg_map);
+  EXPECT_EQ(loaded->workspace_reg_map, image.workspace_reg_map);
+  EXPECT_EQ(loaded->regid_to_hw_segment, image.regid_to_hw_segment);
+
+  // blobs must be usable as user-ptr BOs
+  const auto page = uintptr_t(sysconf(_SC_PAGESIZE));
+  EXPECT_EQ(uintptr_t(loaded->params[0].data) % page, 0u);
+  EXPECT_EQ(uintptr_t(loaded->code[0].data) % page, 0u);
+}
+
+TEST_F(ModelCacheTest, miss_on_other_key) {
+  const auto before = ModelImage::get_cache_stats();
+  ModelImage image;
+  fill(image, 1);
+  image.store(dir_);
+  EXPECT_EQ(ModelImage::load(dir_, 2), nullptr);
+  EXPECT_NE(ModelImage::load(dir_, 1), nullptr);
+  const auto after = ModelImage::get_cache_stats();
+  EXPECT_EQ(after.misses - before.misses, 1u);
+  EXPECT_EQ(after.hits - before.hits, 1u);
+  EXPECT_EQ(after.stores - before.stores, 1u);
+}
+
+TEST_F(ModelCacheTest, rejects_truncated_file) {
+  const uint64_t key = 7;
+  ModelImage image;
+  fill(image, key);
+  image.store(dir_);
+  ASSERT_EQ(truncate(path(key).c_str(), 64), 0);
+  EXPECT_EQ(ModelImage::load(dir_, key), nullptr);
+}
+
+TEST_F(ModelCacheTest, rejects_key_mismatch) {
+  ModelImage image;
+  fill(image, 5);
+  image.store(dir_);
+  // a file renamed to another key must not be trusted
+  ASSERT_EQ(rename(path(5).c_str(), path(6).c_str()), 0);
+  EXPECT_EQ(ModelImage::load(dir_, 6), nullptr);
+}
+
+TEST_F(ModelCacheTest, rejects_corrupt_payload_and_rebuilds) {
+  const uint64_t key = 9;
+  ModelImage image;
+  fill(image, key);
+  image.store(dir_);
+  // flip one weight byte: the header and the sizes still look fine
+  {
+    std::fstream f(path(key), std::ios::in | std::ios::out | std::ios::binary);
+    ASSERT_TRUE(f.good());
+    const auto page = sysconf(_SC_PAGESIZE);
+    f.seekg(page + 100);
+    char c;
+    f.read(&c, 1);
+    f.seekp(page + 100);
+    c = char(c ^ 0x5a);
+    f.write(&c, 1);
+  }
+  const auto before = ModelImage::get_cache_stats();
+  EXPECT_EQ(ModelImage::load(dir_, key), nullptr);
+  EXPECT_EQ(ModelImage::get_cache_stats().misses - before.misses, 1u);
+
+  // the rebuilt image replaces the bad file
+  image.store(dir_);
+  auto loaded = ModelImage::load(dir_, key);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(std::string(loaded->params[0].data, weights_.size()),
+    std::string(weights_.data(), weights_.size()));
+}
+
+TEST_F(ModelCacheTest, rejects_corrupt_meta) {
+  const uint64_t key = 10;
+  ModelImage image;
+  fill(image, key);
+  image.store(dir_);
+  std::string bytes;
+  {
+    std::ifstream in(path(key), std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  // an md5 string in the meta section
+  const auto pos = bytes.find("bbbb");
+  ASSERT_NE(pos, std::string::npos);
+  bytes[pos] = 'c';
+  {
+    std::ofstream out(path(key), std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+  }
+  EXPECT_EQ(ModelImage::load(dir_, key), nullptr);
+}
+
+TEST(ModelCacheHashTest, hash_is_content_sensitive) {
+  std::string a(1000, 'x'), b = a;
+  b[999] = 'y';
+  EXPECT_EQ(ModelImage::hash(a.data(), a.size(), 1), ModelImage::hash(a.data(), a.size(), 1));
+  EXPECT_NE(ModelImage::hash(a.data(), a.size(), 1), ModelImage::hash(b.data(), b.size(), 1));
+  EXPECT_NE(ModelImage::hash(a.data(), a.size(), 1), ModelImage::hash(a.data(), a.size(), 2));
+  EXPECT_NE(ModelImage::hash(a.data(), 999, 1), ModelImage::hash(a.data(), 1000, 1));
+}
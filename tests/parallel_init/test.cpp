@@ -0,0 +1,138 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "device_handle.hpp"
+#include "parallel_init.hpp"
+#include "startup_profile.hpp"
+
+/*
+ * Concurrent construction against the fake device layer (RTE_FAKE_DEVICE),
+ * which injects RTE_FAKE_ACQUIRE_MS of latency per acquisition.
+ * No device needed.
+ */
+
+namespace {
+  // uploads in flight, and the most seen at once
+  std::atomic<unsigned> uploading(0);
+  std::atomic<unsigned> peakUploading(0);
+}
+
+class ParallelInitTest : public testing::Test {
+protected:
+  void SetUp() override {
+    setenv("RTE_FAKE_DEVICE", std::to_string(numCus_).c_str(), 1);
+    setenv("RTE_FAKE_ACQUIRE_MS", std::to_string(acquireMs_).c_str(), 1);
+  }
+
+  void TearDown() override {
+    unsetenv("RTE_FAKE_DEVICE");
+    unsetenv("RTE_FAKE_ACQUIRE_MS");
+  }
+
+  // device handle plus the time its construction took, like a controller
+  struct FakeController {
+    std::unique_ptr<DeviceHandle> handle;
+    StartupProfile startup;
+  };
+
+  static std::unique_ptr<FakeController> makeController(size_t) {
+    auto c = std::make_unique<FakeController>();
+    {
+      StartupProfile::Scope acquire(c->startup, "acquire");
+      c->handle.reset(new DeviceHandle("DPUCAHX8H", "fake.xclbin", nullptr));
+    }
+    {
+      // stands in for a weight upload
+      StartupProfile::Scope upload(c->startup, "upload");
+      const unsigned now = ++uploading;
+      unsigned peak = peakUploading;
+      while (now > peak && !peakUploading.compare_exchange_weak(peak, now))
+        ;
+      std::this_thread::sleep_for(std::chrono::milliseconds(acquireMs_));
+      uploading--;
+    }
+    return c;
+  }
+
+  static constexpr unsigned numCus_ = 4;
+  static constexpr unsigned acquireMs_ = 100;
+};
+
+TEST_F(ParallelInitTest, constructs_concurrently) {
+  peakUploading = 0;
+  auto t1 = std::chrono::steady_clock::now();
+  auto controllers = vart::construct_all<FakeController>(numCus_, makeController);
+  auto t2 = std::chrono::steady_clock::now();
+  const double wallMs = std::chrono::duration<double, std::milli>(t2-t1).count();
+
+  ASSERT_EQ(controllers.size(), numCus_);
+  StartupProfile total;
+  std::set<size_t> cus;
+  for (auto &c : controllers) {
+    ASSERT_NE(c, nullptr);
+    cus.insert(c->handle->get_device_info().cu_index);
+    total.merge(c->startup);
+  }
+  std::cout << "wall " << wallMs << " ms (serial " << numCus_ * 2 * acquireMs_
+    << " ms), summed phases: " << total.to_string() << std::endl;
+
+  EXPECT_EQ(cus.size(), size_t(numCus_)) << "each controller should get its own cu";
+  EXPECT_GE(total.get("acquire"), numCus_ * acquireMs_ * 0.9);
+  EXPECT_GE(total.get("upload"), numCus_ * acquireMs_ * 0.9);
+  // serial construction would never have two uploads in flight
+  EXPECT_EQ(peakUploading, numCus_);
+}
+
+TEST_F(ParallelInitTest, rethrows_after_all_finish) {
+  std::atomic<unsigned> finished(0);
+  auto make = [&finished](size_t i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(i == 0 ? 0 : 50));
+    finished++;
+    if (i == 0)
+      throw std::runtime_error("Error: first");
+    return std::make_unique<int>(int(i));
+  };
+  EXPECT_THROW(vart::construct_all<int>(4, make), std::runtime_error);
+  EXPECT_EQ(finished.load(), 4u);
+}
+
+TEST(StartupProfileTest, accumulates_in_first_seen_order) {
+  StartupProfile a, b;
+  a.add("acquire", 10);
+  a.add("model", 5);
+  a.add("acquire", 2);
+  b.add("upload", 7);
+  b.add("model", 1);
+  a.merge(b);
+  ASSERT_EQ(a.phases().size(), 3u);
+  EXPECT_EQ(a.phases()[0].first, "acquire");
+  EXPECT_EQ(a.phases()[2].first, "upload");
+  EXPECT_DOUBLE_EQ(a.get("acquire"), 12);
+  EXPECT_DOUBLE_EQ(a.get("model"), 6);
+  EXPECT_DOUBLE_EQ(a.get("missing"), 0);
+  EXPECT_DOUBLE_EQ(a.total_ms(), 25);
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "hbm_placement.hpp"
+#include "xrt_bin_stream.hpp"
+
+/*
+ * HBM placement from synthetic MEM_TOPOLOGY / CONNECTIVITY tables.
+ * No device needed.
+ */
+
+namespace {
+  HbmTopology makeTopology(unsigned numBanks, std::vector<std::vector<unsigned>> cuBanks) {
+    HbmTopology t;
+    for (unsigned i = 0; i < numBanks; i++)
+      t.banks.push_back({ i, "HBM[" + std::to_string(i) + "]", true });
+    t.cu_banks = cuBanks;
+    return t;
+  }
+
+  std::set<unsigned> primaries(const HbmPlan &p) {
+    std::set<unsigned> s;
+    for (auto v : { &p.code, &p.weights, &p.io, &p.workspace })
+      s.insert(v->begin(), v->end());
+    return s;
+  }
+
+  bool contains(const std::vector<unsigned> &v, unsigned b) {
+    return std::find(v.begin(), v.end(), b) != v.end();
+  }
+}
+
+TEST(HbmPlacementTest, cus_do_not_share_primary_banks) {
+  std::vector<unsigned> cu0, cu1;
+  for (unsigned b = 0; b < 8; b++) cu0.push_back(b);
+  for (unsigned b = 8; b < 16; b++) cu1.push_back(b);
+  cu0.push_back(16); // pseudo-channel wired to both cus
+  cu1.push_back(16);
+  auto t = makeTopology(32, { cu0, cu1 });
+
+  auto p0 = plan_hbm_banks(t, 0);
+  auto p1 = plan_hbm_banks(t, 1);
+  EXPECT_FALSE(p0.shared);
+  EXPECT_FALSE(p1.shared);
+  EXPECT_EQ(p0.weights.size(), 2u);
+  EXPECT_EQ(p0.code.size(), 1u);
+  EXPECT_EQ(p0.io.size(), 5u);
+
+  auto s0 = primaries(p0);
+  auto s1 = primaries(p1);
+  for (auto b : s0) {
+    EXPECT_TRUE(contains(cu0, b));
+    EXPECT_EQ(s1.count(b), 0u) << "bank " << b << " used by both cus";
+  }
+  EXPECT_EQ(s0.count(16), 0u);
+  EXPECT_EQ(s1.count(16), 0u);
+
+  // roles within a cu don't overlap when there are enough banks
+  for (auto b : p0.weights) {
+    EXPECT_FALSE(contains(p0.code, b));
+    EXPECT_FALSE(contains(p0.io, b));
+  }
+}
+
+TEST(HbmPlacementTest, workspace_is_offset_from_io) {
+  auto t = makeTopology(8, { { 0, 1, 2, 3, 4, 5 } });
+  auto p = plan_hbm_banks(t, 0);
+  ASSERT_EQ(p.io.size(), 3u);
+  ASSERT_EQ(p.workspace.size(), 3u);
+  for (size_t i = 0; i < p.io.size(); i++)
+    EXPECT_NE(p.io[i], p.workspace[i]);
+}
+
+TEST(HbmPlacementTest, few_banks_share_roles) {
+  auto t1 = makeTopology(4, { { 2 } });
+  auto p1 = plan_hbm_banks(t1, 0);
+  EXPECT_EQ(p1.code, std::vector<unsigned>{ 2 });
+  EXPECT_EQ(p1.weights, std::vector<unsigned>{ 2 });
+  EXPECT_EQ(p1.io, std::vector<unsigned>{ 2 });
+
+  auto t2 = makeTopology(4, { { 1, 3 } });
+  auto p2 = plan_hbm_banks(t2, 0);
+  EXPECT_EQ(p2.io, std::vector<unsigned>{ 3 });
+  EXPECT_EQ(p2.code, std::vector<unsigned>{ 1 });
+
+  auto t3 = makeTopology(4, { { 0, 1, 2 } });
+  auto p3 = plan_hbm_banks(t3, 0);
+  EXPECT_EQ(p3.weights, std::vector<unsigned>{ 1 });
+  EXPECT_EQ(p3.io, std::vector<unsigned>{ 2 });
+}
+
+TEST(HbmPlacementTest, fully_shared_banks_are_flagged) {
+  auto t = makeTopology(4, { { 0, 1 }, { 0, 1 } });
+  auto p = plan_hbm_banks(t, 1);
+  EXPECT_TRUE(p.shared);
+  EXPECT_FALSE(primaries(p).empty());
+}
+
+TEST(HbmPlacementTest, fully_shared_banks_are_split) {
+  std::vector<unsigned> all;
+  for (unsigned b = 0; b < 8; b++) all.push_back(b);
+  auto t = makeTopology(8, { all, all });
+  auto p0 = plan_hbm_banks(t, 0);
+  auto p1 = plan_hbm_banks(t, 1);
+  EXPECT_TRUE(p0.shared);
+  EXPECT_TRUE(p1.shared);
+  auto s0 = primaries(p0);
+  auto s1 = primaries(p1);
+  EXPECT_EQ(s0.size(), 4u);
+  for (auto b : s1)
+    EXPECT_EQ(s0.count(b), 0u) << "bank " << b << " used by both cus";
+  // the other cu's share is still there to fall back to
+  for (auto b : s1)
+    EXPECT_TRUE(contains(p0.fallback, b));
+
+  // fewer banks than cus: each gets one, round robin
+  auto small = makeTopology(2, { { 0, 1 }, { 0, 1 }, { 0, 1 } });
+  EXPECT_EQ(primaries(plan_hbm_banks(small, 0)), std::set<unsigned>{ 0 });
+  EXPECT_EQ(primaries(plan_hbm_banks(small, 1)), std::set<unsigned>{ 1 });
+  EXPECT_EQ(primaries(plan_hbm_banks(small, 2)), std::set<unsigned>{ 0 });
+}
+
+TEST(HbmPlacementTest, no_connectivity_splits_banks_evenly) {
+  auto t = makeTopology(32, { {}, {}, {} });
+  std::set<unsigned> seen;
+  for (unsigned cu = 0; cu < 3; cu++) {
+    auto p = plan_hbm_banks(t, cu);
+    auto s = primaries(p);
+    EXPECT_FALSE(s.empty());
+    for (auto b : s)
+      EXPECT_TRUE(seen.insert(b).second) << "bank " << b << " given to two cus";
+  }
+
+  // more cus than banks still get a bank each
+  auto small = makeTopology(2, { {}, {}, {}, {} });
+  for (unsigned cu = 0; cu < 4; cu++)
+    EXPECT_FALSE(primaries(plan_hbm_banks(small, cu)).empty());
+}
+
+TEST(HbmPlacementTest, unusable_banks_are_skipped) {
+  auto t = makeTopology(6, { { 0, 1, 2, 3, 4, 5 } });
+  t.banks[0].usable = false; // e.g. PLRAM or unused
+  t.banks[3].usable = false;
+  auto p = plan_hbm_banks(t, 0);
+  for (auto b : primaries(p))
+    EXPECT_TRUE(b != 0 && b != 3);
+  EXPECT_FALSE(contains(p.fallback, 0));
+  EXPECT_FALSE(contains(p.fallback, 3));
+
+  for (auto &b : t.banks)
+    b.usable = false;
+  EXPECT_THROW(plan_hbm_banks(t, 0), std::runtime_error);
+}
+
+TEST(HbmPlacementTest, ordered_fills_slots_then_falls_back) {
+  auto t = makeTopology(16, { { 0, 1, 2, 3, 4, 5 }, { 6, 7 } });
+  auto p = plan_hbm_banks(t, 0);
+  const size_t batch = 8;
+  auto io = p.ordered(p.io, batch);
+  ASSERT_GT(io.size(), batch);
+  for (size_t i = 0; i < batch; i++)
+    EXPECT_EQ(io[i], p.io[i % p.io.size()]);
+  // fallback: no repeats, other cus' banks last
+  std::set<unsigned> rest(io.begin() + batch, io.end());
+  EXPECT_EQ(rest.size(), io.size() - batch);
+  EXPECT_TRUE(contains(io, 7));
+  EXPECT_EQ(io.back(), 15u);
+
+  EXPECT_THROW(plan_hbm_banks(t, 2), std::runtime_error);
+}
+
+TEST(HbmPlacementTest, topology_from_xclbin) {
+  // header + IP_LAYOUT (2 dpu cus, listed out of address order, plus a
+  // non-kernel ip) + MEM_TOPOLOGY (4 HBM, 1 unused, 1 PLRAM) + CONNECTIVITY
+  const size_t hdrSize = sizeof(axlf) + 2 * sizeof(axlf_section_header);
+  const size_t ipSize = sizeof(ip_layout) + 2 * sizeof(ip_data);
+  const size_t memSize = sizeof(mem_topology) + 5 * sizeof(mem_data);
+  const size_t connSize = sizeof(connectivity) + 4 * sizeof(connection);
+  std::vector<char> buf(hdrSize + ipSize + memSize + connSize, 0);
+
+  auto top = reinterpret_cast<axlf*>(buf.data());
+  memcpy(top->m_magic, "xclbin2", 8);
+  top->m_header.m_numSections = 3;
+  const axlf_section_kind kinds[] = { IP_LAYOUT, MEM_TOPOLOGY, CONNECTIVITY };
+  const size_t sizes[] = { ipSize, memSize, connSize };
+  size_t offset = hdrSize;
+  for (int i = 0; i < 3; i++) {
+    top->m_sections[i].m_sectionKind = kinds[i];
+    top->m_sections[i].m_sectionOffset = offset;
+    top->m_sections[i].m_sectionSize = sizes[i];
+    offset += sizes[i];
+  }
+
+  auto ip = reinterpret_cast<ip_layout*>(buf.data() + hdrSize);
+  ip->m_count = 3;
+  ip->m_ip_data[0].m_type = IP_MEM_DDR4;
+  ip->m_ip_data[1].m_type = IP_KERNEL;
+  ip->m_ip_data[1].m_base_address = 0x2000;
+  strcpy((char*)ip->m_ip_data[1].m_name, "DPUCAHX8H:DPUCAHX8H_1");
+  ip->m_ip_data[2].m_type = IP_KERNEL;
+  ip->m_ip_data[2].m_base_address = 0x1000;
+  strcpy((char*)ip->m_ip_data[2].m_name, "DPUCAHX8H:DPUCAHX8H_0");
+
+  auto mem = reinterpret_cast<mem_topology*>(buf.data() + hdrSize + ipSize);
+  mem->m_count = 6;
+  for (int i = 0; i < 6; i++) {
+    mem->m_mem_data[i].m_type = MEM_HBM;
+    mem->m_mem_data[i].m_used = (i != 2);
+    snprintf((char*)mem->m_mem_data[i].m_tag, 16, "HBM[%d]", i);
+  }
+  mem->m_mem_data[5].m_type = MEM_DRAM;
+  strcpy((char*)mem->m_mem_data[5].m_tag, "PLRAM[0]");
+
+  auto conn = reinterpret_cast<connectivity*>(buf.data() + hdrSize + ipSize + memSize);
+  conn->m_count = 5;
+  const int wiring[][2] = { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 1, 3 }, { 1, 4 } }; // ip, bank
+  for (int i = 0; i < 5; i++) {
+    conn->m_connection[i].arg_index = i;
+    conn->m_connection[i].m_ip_layout_index = wiring[i][0];
+    conn->m_connection[i].mem_data_index = wiring[i][1];
+  }
+
+  char path[] = "/tmp/hbm_placement_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, buf.data(), buf.size()), ssize_t(buf.size()));
+  close(fd);
+
+  xir::XrtBinStream binstream(path);
+  auto t = HbmTopology::from_xclbin(binstream);
+  unlink(path);
+
+  ASSERT_EQ(t.banks.size(), 6u);
+  EXPECT_FALSE(t.banks[2].usable); // unused
+  EXPECT_FALSE(t.banks[5].usable); // PLRAM
+  EXPECT_EQ(t.banks[4].tag, "HBM[4]");
+  ASSERT_EQ(t.cu_banks.size(), 2u);
+  // cu 0 is the lower base address, ip index 2
+  EXPECT_EQ(t.cu_banks[0], (std::vector<unsigned>{ 0, 1, 2 }));
+  EXPECT_EQ(t.cu_banks[1], (std::vector<unsigned>{ 3, 4 }));
+
+  auto p0 = plan_hbm_banks(t, 0);
+  for (auto b : primaries(p0))
+    EXPECT_TRUE(b == 0 || b == 1);
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+#include "softmax_topk.hpp"
+
+/*
+ * Fused dequantize + softmax + top-k of int8 classifier outputs.
+ * No device needed.
+ */
+
+namespace {
+  std::vector<int8_t> randomOutput(size_t n, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dist(-128, 127);
+    std::vector<int8_t> data(n);
+    for (auto &d : data)
+      d = int8_t(dist(gen));
+    return data;
+  }
+
+  // what classification users run today: data_fix2float, then
+  // cpuUtil::computeSoftmax and cpuUtil::sortArr
+  std::vector<std::pair<float, int>> cpuUtilTop5(const std::vector<int8_t> &data, float scale) {
+    std::vector<float> deq(data.size());
+    for (size_t i = 0; i < data.size(); i++)
+      deq[i] = (float)(data[i]*scale);
+    float m = deq[0];
+    for (size_t i = 1; i < deq.size(); i++)
+      if (deq[i] > m)
+        m = deq[i];
+    float sum = 0;
+    for (size_t i = 0; i < deq.size(); i++)
+      sum += std::exp(deq[i] - m);
+    std::vector<float> softmax(deq.size());
+    for (size_t i = 0; i < deq.size(); i++)
+      softmax[i] = std::exp(deq[i] - m - log(sum));
+    std::vector<std::pair<float, float>> vp;
+    for (size_t i = 0; i < softmax.size(); ++i)
+      vp.push_back(std::make_pair(softmax[i], i));
+    std::sort(vp.begin(), vp.end());
+    std::vector<std::pair<float, int>> p;
+    for (uint32_t i = vp.size() - 1; i > vp.size() - 6; i--)
+      p.push_back(std::make_pair(vp[i].first, int(vp[i].second)));
+    return p;
+  }
+}
+
+TEST(SoftmaxTopKTest, matches_reference) {
+  const float scale = 0.125f;
+  for (size_t n : {size_t(10), size_t(1000), size_t(1001)}) {
+    auto data = randomOutput(n, unsigned(n));
+    std::vector<std::pair<double, int>> ref;
+    double sum = 0;
+    for (auto d : data)
+      sum += std::exp(double(d) * scale);
+    for (size_t i=0; i < n; i++)
+      ref.emplace_back(std::exp(double(data[i]) * scale) / sum, int(i));
+    std::stable_sort(ref.begin(), ref.end(),
+      [](const std::pair<double, int> &a, const std::pair<double, int> &b) { return a.first > b.first; });
+
+    TopKEntry top[7];
+    softmax_topk(data.data(), n, scale, 7, top);
+    for (unsigned c=0; c < 7; c++) {
+      EXPECT_EQ(top[c].index, ref[c].second);
+      EXPECT_NEAR(top[c].prob, ref[c].first, 1e-6);
+    }
+  }
+
+  // ties go to the lower class, short outputs are padded
+  std::vector<int8_t> ties = {3, 9, 9, 1, 9};
+  TopKEntry top[7];
+  softmax_topk(ties.data(), ties.size(), 1.f, 7, top);
+  EXPECT_EQ(top[0].index, 1);
+  EXPECT_EQ(top[1].index, 2);
+  EXPECT_EQ(top[2].index, 4);
+  EXPECT_EQ(top[3].index, 0);
+  EXPECT_EQ(top[4].index, 3);
+  EXPECT_EQ(top[5].index, -1);
+  EXPECT_FLOAT_EQ(top[0].prob, top[2].prob);
+}
+
+/*
+ * Top-5 of a 1000-class output per batch element: the cpuUtil path vs the
+ * fused stage.
+ */
+TEST(SoftmaxTopKTest, cpuutil_benchmark) {
+  const size_t classes = 1000;
+  const unsigned batch = 4;
+  const unsigned runs = 2000;
+  const float scale = 0.25f;
+  std::vector<std::vector<int8_t>> outputs;
+  for (unsigned b=0; b < batch; b++)
+    outputs.push_back(randomOutput(classes, 100 + b));
+
+  float check = 0;
+  auto t1 = std::chrono::steady_clock::now();
+  for (unsigned n=0; n < runs; n++)
+    for (auto &out : outputs)
+      check += cpuUtilTop5(out, scale)[0].first;
+  auto t2 = std::chrono::steady_clock::now();
+  std::vector<TopKEntry> results(batch * 5);
+  for (unsigned n=0; n < runs; n++)
+    for (unsigned b=0; b < batch; b++)
+      softmax_topk(outputs[b].data(), classes, scale, 5, &results[b * 5]);
+  auto t3 = std::chrono::steady_clock::now();
+
+  for (unsigned b=0; b < batch; b++) {
+    auto ref = cpuUtilTop5(outputs[b], scale);
+    for (unsigned c=0; c < 5; c++) {
+      EXPECT_NEAR(results[b * 5 + c].prob, ref[c].first, 1e-5);
+      // cpuUtil breaks ties towards the higher class, compare the values
+      EXPECT_EQ(outputs[b][results[b * 5 + c].index], outputs[b][ref[c].second]);
+    }
+  }
+  EXPECT_GT(check, 0);
+
+  const double cpuUtilUs = std::chrono::duration<double, std::micro>(t2-t1).count() / runs;
+  const double fusedUs = std::chrono::duration<double, std::micro>(t3-t2).count() / runs;
+  std::cout << "batch " << batch << " x " << classes << " classes, top-5: cpuUtil "
+    << cpuUtilUs << " us/run, fused " << fusedUs << " us/run" << std::endl;
+}
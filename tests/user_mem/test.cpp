@@ -0,0 +1,111 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+#include <xrt.h>
+#include "user_mem_registry.hpp"
+#include "xrt_sim.hpp"
+
+/*
+ * Registered user memory, against the simulated XRT backend.
+ * No device needed.
+ */
+
+TEST(UserMemTest, finds_whole_buffers_only) {
+  UserMemRegistry registry;
+  registry.add({0x10000, 0x4000, 1, 0x800000});
+  registry.add({0x20000, 0x1000, 2, 0x900000});
+  EXPECT_THROW(registry.add({0x13000, 0x2000, 3, 0}), std::runtime_error);
+  EXPECT_THROW(registry.add({0xf000, 0x1001, 3, 0}), std::runtime_error);
+  EXPECT_THROW(registry.add({0x30000, 0, 3, 0}), std::runtime_error);
+  registry.add({0x14000, 0x1000, 3, 0xa00000}); // adjacent is fine
+
+  auto *region = registry.find(reinterpret_cast<void*>(0x12000), 0x2000);
+  ASSERT_NE(region, nullptr);
+  EXPECT_EQ(region->bo, 1u);
+  EXPECT_EQ(registry.find(reinterpret_cast<void*>(0x13000), 0x2000), nullptr); // spans two
+  EXPECT_EQ(registry.find(reinterpret_cast<void*>(0x8000), 0x10), nullptr);
+  EXPECT_EQ(registry.find(reinterpret_cast<void*>(0x20800), 0x10)->bo, 2u);
+
+  UserMemRegistry::Region removed;
+  EXPECT_FALSE(registry.remove(reinterpret_cast<void*>(0x20800), removed));
+  EXPECT_TRUE(registry.remove(reinterpret_cast<void*>(0x20000), removed));
+  EXPECT_EQ(removed.paddr, 0x900000u);
+  EXPECT_EQ(registry.find(reinterpret_cast<void*>(0x20800), 0x10), nullptr);
+}
+
+/*
+ * One run's io traffic for a HOST_VIRT buffer: copied through a staging
+ * buffer with unmanaged DMA, as before, vs synced straight from the
+ * registered user pages.
+ */
+TEST(UserMemTest, registered_dma_benchmark) {
+  auto saved = xrt_sim::get_config();
+  auto config = saved;
+  config.dma_mbps = 0;
+  xrt_sim::set_config(config);
+  auto handle = xclOpen(0, nullptr, XCL_INFO);
+  ASSERT_NE(handle, nullptr);
+  const unsigned runs = 200;
+
+  for (size_t size : {size_t(64) << 10, size_t(1) << 20})
+  {
+    void *user = nullptr;
+    void *staging = nullptr;
+    ASSERT_EQ(posix_memalign(&user, getpagesize(), size), 0);
+    ASSERT_EQ(posix_memalign(&staging, getpagesize(), size), 0);
+    memset(user, 7, size);
+    auto stagingBo = xclAllocUserPtrBO(handle, staging, size, 0);
+    auto userBo = xclAllocUserPtrBO(handle, user, size, 0);
+    ASSERT_NE(stagingBo, NULLBO);
+    ASSERT_NE(userBo, NULLBO);
+    const auto stagingAddr = xclGetDeviceAddr(handle, stagingBo);
+
+    auto t1 = std::chrono::steady_clock::now();
+    for (unsigned n=0; n < runs; n++) {
+      memcpy(staging, user, size);
+      ASSERT_EQ(xclUnmgdPwrite(handle, 0, staging, size, stagingAddr), 0);
+      ASSERT_EQ(xclUnmgdPread(handle, 0, staging, size, stagingAddr), 0);
+      memcpy(user, staging, size);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (unsigned n=0; n < runs; n++) {
+      ASSERT_EQ(xclSyncBO(handle, userBo, XCL_BO_SYNC_BO_TO_DEVICE, size, 0), 0);
+      ASSERT_EQ(xclSyncBO(handle, userBo, XCL_BO_SYNC_BO_FROM_DEVICE, size, 0), 0);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    EXPECT_EQ(static_cast<char*>(user)[size-1], 7);
+
+    const double stagedUs = std::chrono::duration<double, std::micro>(t2-t1).count() / runs;
+    const double registeredUs = std::chrono::duration<double, std::micro>(t3-t2).count() / runs;
+    std::cout << size << " B in+out: staged " << stagedUs << " us/run, registered "
+      << registeredUs << " us/run" << std::endl;
+
+    xclFreeBO(handle, userBo);
+    xclFreeBO(handle, stagingBo);
+    free(user);
+    free(staging);
+  }
+  xclClose(handle);
+  xrt_sim::set_config(saved);
+}
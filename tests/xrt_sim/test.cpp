@@ -0,0 +1,246 @@
+/*
+ * Copyright 2021 Xilinx Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <xrt.h>
+#include "ert.h"
+#include "dpu_profile.hpp"
+#include "xrt_sim.hpp"
+
+/*
+ * The simulated XRT backend, linked directly instead of preloaded.
+ * No device needed.
+ */
+
+class XrtSimTest : public testing::Test {
+protected:
+  void SetUp() override {
+    saved_ = xrt_sim::get_config();
+    auto config = saved_;
+    config.exec_us = execUs_;
+    config.dma_mbps = 0;
+    config.bank_bytes = 16 << 20;
+    xrt_sim::set_config(config);
+    handle_ = xclOpen(0, nullptr, XCL_INFO);
+    ASSERT_NE(handle_, nullptr);
+  }
+
+  void TearDown() override {
+    xclClose(handle_);
+    xrt_sim::set_config(saved_);
+  }
+
+  static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // submit one command to cu on handle, return its packet
+  static ert_start_kernel_cmd *submit(xclDeviceHandle handle, xclBufferHandle bo, unsigned cu) {
+    auto ecmd = reinterpret_cast<ert_start_kernel_cmd*>(xclMapBO(handle, bo, true));
+    ecmd->cu_mask = 1u << cu;
+    ecmd->state = ERT_CMD_STATE_NEW;
+    EXPECT_EQ(xclExecBuf(handle, bo), 0);
+    return ecmd;
+  }
+
+  static void waitDone(xclDeviceHandle handle, ert_start_kernel_cmd *ecmd) {
+    for (int i=0; i < 10 && xclExecWait(handle, 1000) == 0
+      && ecmd->state != ERT_CMD_STATE_COMPLETED; i++);
+    EXPECT_EQ(ecmd->state, ERT_CMD_STATE_COMPLETED);
+  }
+
+  // commands in the order they were seen completed, polling all handles
+  static std::vector<ert_start_kernel_cmd*> completionOrder(
+    const std::vector<std::pair<xclDeviceHandle, ert_start_kernel_cmd*>> &cmds) {
+    std::vector<ert_start_kernel_cmd*> order;
+    for (int i=0; i < 10000 && order.size() < cmds.size(); i++)
+      for (auto &c : cmds) {
+        xclExecWait(c.first, 1);
+        if (c.second->state == ERT_CMD_STATE_COMPLETED
+          && std::find(order.begin(), order.end(), c.second) == order.end())
+          order.push_back(c.second);
+      }
+    return order;
+  }
+
+  static constexpr unsigned execUs_ = 20000;
+  xrt_sim::SimConfig saved_;
+  xclDeviceHandle handle_ = nullptr;
+};
+
+TEST_F(XrtSimTest, allocates_inside_banks) {
+  std::vector<char> a(1 << 20), b(1 << 20), big(17 << 20);
+  auto boA = xclAllocUserPtrBO(handle_, a.data(), a.size(), 0);
+  auto boB = xclAllocUserPtrBO(handle_, b.data(), b.size(), 1);
+  ASSERT_NE(boA, NULLBO);
+  ASSERT_NE(boB, NULLBO);
+  const auto addrA = xclGetDeviceAddr(handle_, boA);
+  const auto addrB = xclGetDeviceAddr(handle_, boB);
+  EXPECT_NE(addrA, 0u);
+  EXPECT_GE(addrB, addrA + (16 << 20));
+  EXPECT_EQ(xclAllocUserPtrBO(handle_, big.data(), big.size(), 0), NULLBO);
+
+  // freed space is reused
+  xclFreeBO(handle_, boA);
+  auto boC = xclAllocUserPtrBO(handle_, a.data(), a.size(), 0);
+  EXPECT_EQ(xclGetDeviceAddr(handle_, boC), addrA);
+}
+
+TEST_F(XrtSimTest, moves_bytes) {
+  std::vector<char> host(8192, 'a'), back(100);
+  auto bo = xclAllocUserPtrBO(handle_, host.data(), host.size(), 2);
+  ASSERT_NE(bo, NULLBO);
+  xclBOProperties p;
+  ASSERT_EQ(xclGetBOProperties(handle_, bo, &p), 0);
+  ASSERT_EQ(p.size, host.size());
+
+  ASSERT_EQ(xclSyncBO(handle_, bo, XCL_BO_SYNC_BO_TO_DEVICE, host.size(), 0), 0);
+  ASSERT_EQ(xclUnmgdPread(handle_, 0, back.data(), back.size(), p.paddr + 4000), 0);
+  EXPECT_EQ(std::string(back.data(), back.size()), std::string(100, 'a'));
+
+  const std::string hello = "hello";
+  ASSERT_EQ(xclUnmgdPwrite(handle_, 0, hello.data(), hello.size(), p.paddr + 10), 0);
+  ASSERT_EQ(xclSyncBO(handle_, bo, XCL_BO_SYNC_BO_FROM_DEVICE, hello.size(), 10), 0);
+  EXPECT_EQ(std::string(host.data() + 10, hello.size()), hello);
+
+  // past the end of the BO
+  EXPECT_NE(xclUnmgdPread(handle_, 0, back.data(), back.size(), p.paddr + 8100), 0);
+}
+
+TEST_F(XrtSimTest, serializes_commands_per_cu) {
+  auto other = xclOpen(0, nullptr, XCL_INFO);
+  auto bo1 = xclAllocBO(handle_, 4096, 0, XCL_BO_FLAGS_EXECBUF);
+  auto bo2 = xclAllocBO(other, 4096, 0, XCL_BO_FLAGS_EXECBUF);
+
+  // same cu from two handles: the second waits for the first
+  auto t = std::chrono::steady_clock::now();
+  auto c1 = submit(handle_, bo1, 0);
+  auto c2 = submit(other, bo2, 0);
+  EXPECT_EQ(c1->state, ERT_CMD_STATE_QUEUED);
+  waitDone(handle_, c1);
+  waitDone(other, c2);
+  EXPECT_GE(msSince(t), 2 * execUs_ / 1000.0 * 0.9);
+
+  // different cus run side by side: a later command on cu 1 finishes
+  // before the one queued behind cu 0's
+  auto bo3 = xclAllocBO(handle_, 4096, 0, XCL_BO_FLAGS_EXECBUF);
+  t = std::chrono::steady_clock::now();
+  c1 = submit(handle_, bo1, 0);
+  c2 = submit(other, bo2, 0);
+  auto c3 = submit(handle_, bo3, 1);
+  auto order = completionOrder({{handle_, c1}, {other, c2}, {handle_, c3}});
+  ASSERT_EQ(order.size(), 3u);
+  EXPECT_EQ(order[2], c2);
+  std::cout << "2 commands on cu 0 + 1 on cu 1: " << msSince(t) << " ms, "
+    << execUs_ / 1000.0 << " ms per command" << std::endl;
+
+  // nothing pending: wait times out
+  EXPECT_EQ(xclExecWait(handle_, 1), 0);
+  xclClose(other);
+}
+
+/*
+ * DPU counters as the profiler reads them after a command: from the CU's
+ * control registers, through to the per-model time and instruction mix.
+ */
+TEST_F(XrtSimTest, profiles_dpu_counters_from_registers) {
+  const uint64_t cuBase = 0x1800000;
+  xrt_sim::set_register(0, cuBase + 0xa8, 3000000);  // cycle counter
+  xrt_sim::set_register(0, cuBase + 0x90, 600);      // load end
+  xrt_sim::set_register(0, cuBase + 0x8c, 200);      // save end
+  xrt_sim::set_register(0, cuBase + 0x88, 1000);     // conv end
+  xrt_sim::set_register(0, cuBase + 0x84, 200);      // misc end
+
+  DpuModelProfile profile(300);
+  for (int i=0; i < 2; i++) {
+    DpuRunSample sample;
+    sample.exec_ns = 20000000;
+    sample.add_counters(handle_, cuBase);
+    EXPECT_EQ(sample.cycles, 3000000u);
+    EXPECT_EQ(sample.conv, 1000u);
+    profile.record(sample);
+  }
+
+  auto s = profile.snapshot();
+  EXPECT_EQ(s.load, 1200u);
+  EXPECT_EQ(s.misc, 400u);
+  // 3M cycles at 300 MHz
+  EXPECT_DOUBLE_EQ(s.dpu_mean_us(), 10000.0);
+  EXPECT_DOUBLE_EQ(s.dpu_busy_fraction(), 0.5);
+  EXPECT_DOUBLE_EQ(s.memory_instr_fraction(), 0.4);
+
+  // another CU's registers are not ours
+  DpuRunSample other;
+  other.add_counters(handle_, cuBase + 0x10000);
+  EXPECT_EQ(other.cycles, 0u);
+}
+
+TEST_F(XrtSimTest, models_dma_bandwidth) {
+  auto config = xrt_sim::get_config();
+  config.dma_mbps = 100;
+  xrt_sim::set_config(config);
+  std::vector<char> host(1 << 20);
+  auto bo = xclAllocUserPtrBO(handle_, host.data(), host.size(), 0);
+  const auto before = xrt_sim::get_stats();
+  const auto t = std::chrono::steady_clock::now();
+  // ~10 ms each, both directions in parallel threads
+  std::thread up([&] { xclSyncBO(handle_, bo, XCL_BO_SYNC_BO_TO_DEVICE, host.size(), 0); });
+  xclUnmgdPread(handle_, 0, host.data(), host.size(), xclGetDeviceAddr(handle_, bo));
+  up.join();
+  const double ms = msSince(t);
+  const auto after = xrt_sim::get_stats();
+  EXPECT_EQ(after.bytes_to_device - before.bytes_to_device, host.size());
+  EXPECT_EQ(after.bytes_from_device - before.bytes_from_device, host.size());
+  EXPECT_GE(ms, 9.0);
+  std::cout << "1 MB each way at 100 MB/s: " << ms << " ms (20 ms if the directions shared)"
+    << std::endl;
+}
+
+TEST_F(XrtSimTest, close_frees_bos) {
+  const auto before = xrt_sim::get_stats();
+  auto other = xclOpen(0, nullptr, XCL_INFO);
+  std::vector<char> host(4096);
+  xclAllocUserPtrBO(other, host.data(), host.size(), 0);
+  xclAllocBO(other, 4096, 0, XCL_BO_FLAGS_EXECBUF);
+  EXPECT_EQ(xrt_sim::get_stats().num_bos, before.num_bos + 2);
+  EXPECT_EQ(xrt_sim::get_stats().device_bytes, before.device_bytes + host.size());
+  xclClose(other);
+  EXPECT_EQ(xrt_sim::get_stats().num_bos, before.num_bos);
+  EXPECT_EQ(xrt_sim::get_stats().device_bytes, before.device_bytes);
+}
+
+TEST_F(XrtSimTest, injects_hangs) {
+  auto config = xrt_sim::get_config();
+  config.hang_every = 1;
+  xrt_sim::set_config(config);
+  auto other = xclOpen(0, nullptr, XCL_INFO);
+  auto bo = xclAllocBO(other, 4096, 0, XCL_BO_FLAGS_EXECBUF);
+  auto ecmd = submit(other, bo, 0);
+  EXPECT_EQ(xclExecWait(other, 50), 0);
+  EXPECT_NE(ecmd->state, ERT_CMD_STATE_COMPLETED);
+  // closing the handle drops the hung command; the cu still serves others
+  xclClose(other);
+  config.hang_every = 0;
+  xrt_sim::set_config(config);
+  auto bo2 = xclAllocBO(handle_, 4096, 0, XCL_BO_FLAGS_EXECBUF);
+  waitDone(handle_, submit(handle_, bo2, 0));
+}